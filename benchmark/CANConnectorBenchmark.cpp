@@ -0,0 +1,602 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      CANConnectorBenchmark.cpp
+ \brief     Throughput and latency benchmark of the CANConnector on a vcan
+            interface. A CAN_RAW socket on the same interface observes the
+            frames the BCM sends and injects the frames the BCM receives.
+            Every result is printed as one JSON object per line. With
+            --simulated the scale benchmark runs on the simulated BCM.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "CANConnector.h"
+#include "SimulatedBcm.h"
+#include <poll.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <future>
+#include <algorithm>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can/raw.h>
+#include <boost/asio/post.hpp>
+#include <boost/asio/use_future.hpp>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+// Default number of frames per benchmark
+#define BENCHMARK_DEFAULT_COUNT 100000
+
+// Default number of frames in flight before the sender waits for the receiver
+#define BENCHMARK_DEFAULT_WINDOW 64
+
+// Number of frames in a batch of the batched send benchmark
+#define BENCHMARK_BATCH_SIZE 32
+
+// CAN IDs of the benchmark frames
+#define BENCHMARK_TX_CAN_ID 0x100
+#define BENCHMARK_RX_CAN_ID 0x200
+
+// Time after which missing frames are counted as lost
+#define BENCHMARK_TIMEOUT std::chrono::seconds(2)
+
+// Default number of CAN IDs, cycle time and time scale of the simulated scale benchmark
+#define BENCHMARK_SIM_DEFAULT_IDS 1000
+#define BENCHMARK_SIM_CYCLE_US 10000
+#define BENCHMARK_SIM_TIME_SCALE 10.0
+
+// Real time the simulated scale benchmark is measured
+#define BENCHMARK_SIM_DURATION std::chrono::seconds(2)
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the send and receive times of the frames of one benchmark run.
+ * The index of a frame is carried in the first 8 data bytes.
+ */
+struct BenchmarkRun{
+    explicit BenchmarkRun(size_t count) : sendTimes(count, 0), receiveTimes(count){}
+
+    std::vector<int64_t> sendTimes;
+    std::vector<std::atomic<int64_t>> receiveTimes;
+    std::atomic<size_t> received{0};
+};
+
+/**
+ * Struct for the result of one benchmark run.
+ */
+struct BenchmarkResult{
+    const char* name;
+    bool isCANFD;
+    size_t count;
+    size_t received;
+    double seconds;
+    int64_t p50;
+    int64_t p99;
+    int64_t p999;
+};
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Returns the monotonic time in nanoseconds.
+ *
+ * @return The current time.
+ */
+static int64_t now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Builds a benchmark frame that carries its index.
+ *
+ * @param canID   - The CAN ID of the frame.
+ * @param index   - The index of the frame in the run.
+ * @param isCANFD - Flag for a CANFD frame.
+ * @return The frame.
+ */
+static struct canfd_frame makeFrame(canid_t canID, uint64_t index, bool isCANFD){
+
+    struct canfd_frame frame = {0};
+    frame.can_id = canID;
+    frame.len    = isCANFD ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+    std::memcpy(frame.data, &index, sizeof(index));
+
+    return frame;
+}
+
+/**
+ * Records the receive time of a benchmark frame. Duplicates are ignored.
+ *
+ * @param run   - The benchmark run.
+ * @param data  - The data of the received frame.
+ */
+static void recordReceive(BenchmarkRun& run, const uint8_t* data){
+
+    uint64_t index = 0;
+    std::memcpy(&index, data, sizeof(index));
+
+    if(index >= run.receiveTimes.size()){
+        return;
+    }
+
+    int64_t expected = 0;
+
+    if(run.receiveTimes[index].compare_exchange_strong(expected, now())){
+        run.received.fetch_add(1);
+    }
+
+}
+
+/**
+ * Opens a CAN_RAW socket with CANFD frames enabled on an interface.
+ *
+ * @param interfaceName - The name of the interface.
+ * @return The socket or -1 on an error.
+ */
+static int openRawSocket(const char* interfaceName){
+
+    int rawSocket = ::socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+    if(rawSocket < 0){
+        std::fprintf(stderr, "Error could not open CAN_RAW socket: %s\n", std::strerror(errno));
+        return -1;
+    }
+
+    int enable = 1;
+    setsockopt(rawSocket, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable));
+
+    int bufferSize = 4 * 1024 * 1024;
+    setsockopt(rawSocket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+    sockaddr_can addr = {0};
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = static_cast<int>(if_nametoindex(interfaceName));
+
+    if(addr.can_ifindex == 0 || ::bind(rawSocket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0){
+        std::fprintf(stderr, "Error could not bind CAN_RAW socket to %s: %s\n", interfaceName, std::strerror(errno));
+        ::close(rawSocket);
+        return -1;
+    }
+
+    return rawSocket;
+}
+
+/**
+ * Discards the frames that are still queued on the CAN_RAW socket from a previous run.
+ *
+ * @param rawSocket - The CAN_RAW socket.
+ */
+static void flushRawSocket(int rawSocket){
+
+    struct canfd_frame frame = {0};
+
+    while(::recv(rawSocket, &frame, sizeof(frame), MSG_DONTWAIT) > 0){
+    }
+
+}
+
+/**
+ * Observes the frames on the interface and records the benchmark frames.
+ *
+ * @param rawSocket - The CAN_RAW socket.
+ * @param canID     - The CAN ID of the benchmark frames.
+ * @param run       - The benchmark run.
+ * @param stop      - Flag to stop the observer.
+ */
+static void observeFrames(int rawSocket, canid_t canID, BenchmarkRun& run, const std::atomic<bool>& stop){
+
+    struct canfd_frame frame = {0};
+    struct pollfd pollDescriptor = {rawSocket, POLLIN, 0};
+
+    while(!stop.load()){
+
+        if(::poll(&pollDescriptor, 1, 10) <= 0){
+            continue;
+        }
+
+        while(::recv(rawSocket, &frame, sizeof(frame), MSG_DONTWAIT) > 0){
+            if(frame.can_id == canID){
+                recordReceive(run, frame.data);
+            }
+        }
+    }
+
+}
+
+/**
+ * Waits until at most window frames are in flight or the timeout expired.
+ *
+ * @param run    - The benchmark run.
+ * @param sent   - The number of sent frames.
+ * @param window - The number of frames that may be in flight.
+ */
+static void waitForWindow(const BenchmarkRun& run, size_t sent, size_t window){
+
+    auto deadline = std::chrono::steady_clock::now() + BENCHMARK_TIMEOUT;
+
+    while(run.received.load() + window < sent && std::chrono::steady_clock::now() < deadline){
+        std::this_thread::yield();
+    }
+
+}
+
+/**
+ * Calculates the throughput and the latency percentiles of a benchmark run.
+ *
+ * @param name    - The name of the benchmark.
+ * @param isCANFD - Flag for CANFD frames.
+ * @param run     - The benchmark run.
+ * @param start   - The start time of the run.
+ * @return The result.
+ */
+static BenchmarkResult evaluate(const char* name, bool isCANFD, const BenchmarkRun& run, int64_t start){
+
+    std::vector<int64_t> latencies;
+    latencies.reserve(run.sendTimes.size());
+
+    int64_t end = start;
+
+    for(size_t index = 0; index < run.sendTimes.size(); index++){
+
+        int64_t receiveTime = run.receiveTimes[index].load();
+
+        if(receiveTime != 0 && run.sendTimes[index] != 0){
+            latencies.push_back(receiveTime - run.sendTimes[index]);
+            end = std::max(end, receiveTime);
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&latencies](double fraction) -> int64_t {
+        if(latencies.empty()){
+            return 0;
+        }
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(fraction * static_cast<double>(latencies.size())))];
+    };
+
+    return {name, isCANFD, run.sendTimes.size(), latencies.size(), static_cast<double>(end - start) / 1e9,
+            percentile(0.50), percentile(0.99), percentile(0.999)};
+}
+
+/**
+ * Prints a result as a single line of JSON.
+ *
+ * @param result - The result.
+ * @param label  - The label of the measured build, e.g. the git revision.
+ */
+static void printResult(const BenchmarkResult& result, const char* label){
+
+    double framesPerSecond = result.seconds > 0 ? static_cast<double>(result.received) / result.seconds : 0;
+
+    std::printf("{\"label\":\"%s\",\"benchmark\":\"%s\",\"frames\":\"%s\",\"count\":%zu,\"received\":%zu,"
+                "\"lost\":%zu,\"seconds\":%.6f,\"frames_per_sec\":%.1f,\"p50_ns\":%lld,\"p99_ns\":%lld,\"p999_ns\":%lld}\n",
+                label, result.name, result.isCANFD ? "CANFD" : "CAN", result.count, result.received,
+                result.count - result.received, result.seconds, framesPerSecond,
+                static_cast<long long>(result.p50), static_cast<long long>(result.p99), static_cast<long long>(result.p999));
+    std::fflush(stdout);
+}
+
+/**
+ * Measures single TX_SEND operations from the call to the frame on the interface.
+ */
+static BenchmarkResult benchmarkTxSend(CANConnector& connector, int rawSocket, size_t count, size_t window, bool isCANFD){
+
+    BenchmarkRun run(count);
+    std::atomic<bool> stop{false};
+    flushRawSocket(rawSocket);
+    std::thread observer(observeFrames, rawSocket, BENCHMARK_TX_CAN_ID, std::ref(run), std::cref(stop));
+
+    int64_t start = now();
+
+    for(size_t index = 0; index < count; index++){
+        waitForWindow(run, index, window);
+        run.sendTimes[index] = now();
+        connector.txSendSingleFrame(makeFrame(BENCHMARK_TX_CAN_ID, index, isCANFD), isCANFD);
+    }
+
+    waitForWindow(run, count, 0);
+    stop.store(true);
+    observer.join();
+
+    return evaluate("txSendSingleFrame", isCANFD, run, start);
+}
+
+/**
+ * Measures batches of TX_SEND operations that are submitted with one sendmmsg call.
+ */
+static BenchmarkResult benchmarkBatchedSend(CANConnector& connector, int rawSocket, size_t count, size_t window, bool isCANFD){
+
+    BenchmarkRun run(count);
+    std::atomic<bool> stop{false};
+    flushRawSocket(rawSocket);
+    std::thread observer(observeFrames, rawSocket, BENCHMARK_TX_CAN_ID, std::ref(run), std::cref(stop));
+
+    // Allocate the batches before the clock starts, the completed batches return into the pool of the connector
+    std::vector<std::unique_ptr<BcmBatch>> batches;
+
+    for(size_t index = 0; index < BCM_BATCH_POOL_SIZE; index++){
+        batches.push_back(connector.acquireBatch());
+    }
+
+    int64_t start = now();
+
+    for(size_t index = 0; index < count;){
+
+        waitForWindow(run, index, std::max<size_t>(window, BENCHMARK_BATCH_SIZE));
+
+        std::unique_ptr<BcmBatch> batch;
+
+        if(!batches.empty()){
+            batch = std::move(batches.back());
+            batches.pop_back();
+        }else{
+            batch = connector.acquireBatch();
+        }
+
+        int64_t sendTime = now();
+
+        for(size_t frame = 0; frame < BENCHMARK_BATCH_SIZE && index < count; frame++, index++){
+            run.sendTimes[index] = sendTime;
+            connector.addTxSend(*batch, makeFrame(BENCHMARK_TX_CAN_ID, index, isCANFD), isCANFD);
+        }
+
+        connector.submitBatch(std::move(batch), {});
+    }
+
+    waitForWindow(run, count, 0);
+    stop.store(true);
+    observer.join();
+
+    return evaluate("batchedTxSend", isCANFD, run, start);
+}
+
+/**
+ * Measures re-arming a cyclic TX_SETUP sequence. STARTTIMER sends the
+ * first frame immediately, so every re-arm puts one new frame on the bus.
+ */
+static BenchmarkResult benchmarkTxSetupSequence(CANConnector& connector, int rawSocket, size_t count, size_t window, bool isCANFD){
+
+    BenchmarkRun run(count);
+    std::atomic<bool> stop{false};
+    flushRawSocket(rawSocket);
+    std::thread observer(observeFrames, rawSocket, BENCHMARK_TX_CAN_ID, std::ref(run), std::cref(stop));
+
+    // Note: The long interval keeps the timer from sending a second frame before the next re-arm
+    struct bcm_timeval ival1 = {1, 0};
+    struct bcm_timeval ival2 = {0, 0};
+
+    int64_t start = now();
+
+    for(size_t index = 0; index < count; index++){
+
+        // Note: Re-arming waits for the previous frame, otherwise the update replaces it
+        waitForWindow(run, index, std::min<size_t>(window, 1));
+
+        struct canfd_frame frame = makeFrame(BENCHMARK_TX_CAN_ID, index, isCANFD);
+        run.sendTimes[index] = now();
+        connector.txSetupSequence(&frame, 1, 1, ival1, ival2, isCANFD);
+    }
+
+    waitForWindow(run, count, 0);
+    connector.txDelete(BENCHMARK_TX_CAN_ID, isCANFD);
+    stop.store(true);
+    observer.join();
+
+    return evaluate("txSetupSequence", isCANFD, run, start);
+}
+
+/**
+ * Waits for the completion of an asynchronous BCM operation.
+ *
+ * @param result      - The future of the operation.
+ * @param description - The description of the operation for the error output.
+ * @return False if the operation failed.
+ */
+static bool waitForJob(std::future<void> result, const char* description){
+
+    try{
+        result.get();
+    }catch(const boost::system::system_error& error){
+        std::fprintf(stderr, "Error %s failed: %s\n", description, error.what());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Measures the round trip from a frame on the interface to the RX_CHANGED handler.
+ */
+static BenchmarkResult benchmarkRxChanged(CANConnector& connector, int rawSocket, size_t count, size_t window, bool isCANFD){
+
+    BenchmarkRun run(count);
+    BenchmarkRun* runPointer = &run;
+
+    connector.subscribe(RxEvent::Changed, BENCHMARK_RX_CAN_ID, [runPointer](const BcmNotification& notification){
+        if(notification.nframes > 0){
+            recordReceive(*runPointer, static_cast<const struct can_frame*>(notification.frames)->data);
+        }
+    });
+
+    // Note: The handler is installed before the RX_SETUP completes, both run in the io context thread
+    if(!waitForJob(isCANFD ? connector.asyncRxSetupCanID<struct canfd_frame>(BENCHMARK_RX_CAN_ID, boost::asio::use_future)
+                           : connector.asyncRxSetupCanID<struct can_frame>(BENCHMARK_RX_CAN_ID, boost::asio::use_future), "RX_SETUP")){
+        connector.unsubscribe(RxEvent::Changed, BENCHMARK_RX_CAN_ID);
+        boost::asio::post(connector.getExecutor(), boost::asio::use_future).get();
+        return evaluate("rxSetupToRxChanged", isCANFD, run, now());
+    }
+
+    int64_t start = now();
+
+    for(size_t index = 0; index < count; index++){
+
+        waitForWindow(run, index, window);
+
+        struct canfd_frame frame = makeFrame(BENCHMARK_RX_CAN_ID, index, isCANFD);
+        size_t frameSize = isCANFD ? sizeof(struct canfd_frame) : sizeof(struct can_frame);
+
+        run.sendTimes[index] = now();
+
+        if(::write(rawSocket, &frame, frameSize) < 0){
+            run.sendTimes[index] = 0;
+        }
+    }
+
+    waitForWindow(run, count, 0);
+
+    waitForJob(isCANFD ? connector.asyncRxDelete<struct canfd_frame>(BENCHMARK_RX_CAN_ID, boost::asio::use_future)
+                       : connector.asyncRxDelete<struct can_frame>(BENCHMARK_RX_CAN_ID, boost::asio::use_future), "RX_DELETE");
+    connector.unsubscribe(RxEvent::Changed, BENCHMARK_RX_CAN_ID);
+
+    // Note: The handler refers to the run, wait until the io context thread removed it
+    boost::asio::post(connector.getExecutor(), boost::asio::use_future).get();
+
+    return evaluate("rxSetupToRxChanged", isCANFD, run, start);
+}
+
+/**
+ * Measures the notification throughput of many cyclic TX jobs that loop back
+ * to RX filters of the same CAN IDs on the simulated BCM.
+ *
+ * @param ids   - The number of CAN IDs.
+ * @param label - The label of the measured build, e.g. the git revision.
+ * @return False if the connector could not be provisioned.
+ */
+static bool benchmarkSimulatedScale(size_t ids, const char* label){
+
+    SimulatedBcmOptions options;
+    options.timeScale = BENCHMARK_SIM_TIME_SCALE;
+
+    auto simulation = std::make_shared<SimulatedBcm>(options);
+    CANConnector connector("sim0", simulation);
+
+    // Note: Extended CAN IDs, so any number of IDs fits
+    canid_t firstCanID = CAN_EFF_FLAG | BENCHMARK_TX_CAN_ID;
+    std::atomic<uint64_t> notifications{0};
+
+    connector.subscribe(RxEvent::Changed, firstCanID, firstCanID + ids - 1, [&notifications](const BcmNotification&){
+        notifications.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    InterfaceConfig config;
+    config.name = "sim0";
+
+    for(size_t index = 0; index < ids; index++){
+
+        canid_t canID = firstCanID + index;
+        config.rxFilters.emplace_back(canID, false, RxOptions());
+
+        TxScheduleConfig schedule;
+        schedule.frame = makeFrame(canID, index, false);
+        schedule.ival2 = {0, BENCHMARK_SIM_CYCLE_US};
+        config.txSchedules.push_back(schedule);
+    }
+
+    std::promise<void> provisioned;
+    std::promise<void>* provisionedPointer = &provisioned;
+
+    connector.provision(config, [provisionedPointer](const ProvisionResult&){
+        provisionedPointer->set_value();
+    });
+
+    if(provisioned.get_future().wait_for(BENCHMARK_TIMEOUT) != std::future_status::ready){
+        return false;
+    }
+
+    uint64_t firstNotifications = notifications.load();
+    auto firstStatistics = simulation->statistics();
+    int64_t firstSimulated = simulation->now().count();
+    int64_t start = now();
+
+    std::this_thread::sleep_for(BENCHMARK_SIM_DURATION);
+
+    uint64_t received = notifications.load() - firstNotifications;
+    auto statistics = simulation->statistics();
+    double seconds = static_cast<double>(now() - start) / 1e9;
+    double simulatedSeconds = static_cast<double>(simulation->now().count() - firstSimulated) / 1e9;
+
+    std::printf("{\"label\":\"%s\",\"benchmark\":\"simulatedScale\",\"ids\":%zu,\"time_scale\":%.1f,\"seconds\":%.6f,"
+                "\"simulated_seconds\":%.6f,\"notifications\":%llu,\"notifications_per_sec\":%.1f,\"frames_sent\":%llu,"
+                "\"notifications_lost\":%llu}\n",
+                label, ids, BENCHMARK_SIM_TIME_SCALE, seconds, simulatedSeconds, static_cast<unsigned long long>(received),
+                static_cast<double>(received) / seconds,
+                static_cast<unsigned long long>(statistics.framesSent - firstStatistics.framesSent),
+                static_cast<unsigned long long>(statistics.notificationsLost - firstStatistics.notificationsLost));
+    std::fflush(stdout);
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+
+    // Arguments: --simulated [ids] [label]
+    if(argc > 1 && std::strcmp(argv[1], "--simulated") == 0){
+
+        size_t ids = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : BENCHMARK_SIM_DEFAULT_IDS;
+        const char* label = argc > 3 ? argv[3] : "current";
+
+        Log::setLevel(LogLevel::Warning);
+
+        return benchmarkSimulatedScale(ids, label) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Arguments: [interface] [count] [window] [label]
+    const char* interfaceName = argc > 1 ? argv[1] : INTERFACE;
+    size_t count  = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : BENCHMARK_DEFAULT_COUNT;
+    size_t window = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : BENCHMARK_DEFAULT_WINDOW;
+    const char* label = argc > 4 ? argv[4] : "current";
+
+    // Keep the log output out of the measurement
+    Log::setLevel(LogLevel::Warning);
+
+    int rawSocket = openRawSocket(interfaceName);
+
+    if(rawSocket < 0){
+        return EXIT_FAILURE;
+    }
+
+    CANConnector connector(interfaceName);
+
+    if(!connector.isConnected()){
+        ::close(rawSocket);
+        return EXIT_FAILURE;
+    }
+
+    for(bool isCANFD : {false, true}){
+        printResult(benchmarkTxSend(connector, rawSocket, count, window, isCANFD), label);
+        printResult(benchmarkBatchedSend(connector, rawSocket, count, window, isCANFD), label);
+        printResult(benchmarkTxSetupSequence(connector, rawSocket, count, window, isCANFD), label);
+        printResult(benchmarkRxChanged(connector, rawSocket, count, window, isCANFD), label);
+    }
+
+    ::close(rawSocket);
+
+    return EXIT_SUCCESS;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,158 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      AsyncCompletion.h
+ \brief     Type-erased completion of an asynchronous operation that was
+            started with a boost::asio completion token. The completion is
+            allocated once with the allocator of the handler and invoked on
+            the executor of the handler.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_ASYNCCOMPLETION_H
+#define CAN_BCM_BOOST_ASIO_ASYNCCOMPLETION_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <boost/asio/post.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/system/error_code.hpp>
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * Completion with the signature void(boost::system::error_code, Values...).
+ * A completion is invoked exactly once and destroys itself afterwards.
+ */
+template<typename... Values>
+class AsyncCompletion{
+
+public:
+    /**
+     * Deleter of an owned completion that was never invoked. The
+     * handler is completed with operation_aborted, so a waiting
+     * coroutine is resumed instead of leaking its frame.
+     */
+    struct Abort{
+        void operator()(AsyncCompletion* completion) const{
+            completion->complete(boost::asio::error::operation_aborted, Values()...);
+        }
+    };
+
+    /**
+     * Posts the handler with the result to the executor of the handler.
+     *
+     * @param errorCode - The result of the operation.
+     * @param values    - The values of the operation.
+     */
+    virtual void complete(const boost::system::error_code& errorCode, Values... values) = 0;
+
+protected:
+    virtual ~AsyncCompletion() = default;
+};
+
+/**
+ * Owned completion. Dropping it without an explicit completion aborts the operation.
+ */
+template<typename... Values>
+using AsyncCompletionPtr = std::unique_ptr<AsyncCompletion<Values...>, typename AsyncCompletion<Values...>::Abort>;
+
+/**
+ * Completion for a handler of a specific type.
+ */
+template<typename Handler, typename Executor, typename... Values>
+class AsyncCompletionImpl final : public AsyncCompletion<Values...>{
+
+public:
+    using Allocator = typename std::allocator_traits<boost::asio::associated_allocator_t<Handler>>::template rebind_alloc<AsyncCompletionImpl>;
+
+    AsyncCompletionImpl(Handler&& handler, const Executor& executor) :
+        handler(std::move(handler)), work(executor){}
+
+    void complete(const boost::system::error_code& errorCode, Values... values) override{
+
+        Allocator allocator(boost::asio::get_associated_allocator(handler));
+
+        // Move everything out so the memory is freed before the handler runs
+        auto function = boost::asio::bind_executor(work.get_executor(), [handler = std::move(handler), errorCode, values...]() mutable{
+            handler(errorCode, std::move(values)...);
+        });
+
+        auto guard = std::move(work);
+
+        std::allocator_traits<Allocator>::destroy(allocator, this);
+        std::allocator_traits<Allocator>::deallocate(allocator, this, 1);
+
+        // Note: The handler is always posted and never runs inside the caller,
+        // e.g. inside the completion of a batch in the io context loop thread.
+        boost::asio::post(std::move(function));
+    }
+
+private:
+    // Data members
+    Handler handler;
+    boost::asio::executor_work_guard<Executor> work;
+};
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Wraps a handler of an initiating function into a completion. The work of
+ * the executor of the handler is tracked until the handler is invoked.
+ *
+ * @param handler  - The handler that async_initiate passed to the initiation.
+ * @param fallback - The executor for handlers without an associated executor.
+ * @return The owned completion.
+ */
+template<typename... Values, typename Handler, typename Fallback>
+AsyncCompletionPtr<Values...> makeAsyncCompletion(Handler&& handler, const Fallback& fallback){
+
+    using DecayedHandler = std::decay_t<Handler>;
+    using Executor       = boost::asio::associated_executor_t<DecayedHandler, Fallback>;
+    using Completion     = AsyncCompletionImpl<DecayedHandler, Executor, Values...>;
+
+    Executor executor = boost::asio::get_associated_executor(handler, fallback);
+    typename Completion::Allocator allocator(boost::asio::get_associated_allocator(handler));
+
+    Completion* completion = std::allocator_traits<typename Completion::Allocator>::allocate(allocator, 1);
+    std::allocator_traits<typename Completion::Allocator>::construct(allocator, completion, std::move(handler), executor);
+
+    return AsyncCompletionPtr<Values...>(completion);
+}
+
+/**
+ * Invokes an owned completion with a result.
+ *
+ * @param completion - The owned completion. Empty afterwards.
+ * @param errorCode  - The result of the operation.
+ * @param values     - The values of the operation.
+ */
+template<typename... Values>
+void completeAsync(AsyncCompletionPtr<Values...>& completion, const boost::system::error_code& errorCode, std::type_identity_t<Values>... values){
+
+    if(completion){
+        completion.release()->complete(errorCode, std::move(values)...);
+    }
+
+}
+
+
+#endif //CAN_BCM_BOOST_ASIO_ASYNCCOMPLETION_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,145 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmBatch.h
+ \brief     A batch of BCM messages that is submitted with a single sendmmsg
+            call on the BCM socket. The batch reports the result of every
+            message and has exactly one completion per batch.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_BCMBATCH_H
+#define CAN_BCM_BOOST_ASIO_BCMBATCH_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "BcmMessagePool.h"
+#include "InplaceFunction.h"
+#include "AsyncCompletion.h"
+
+// System includes
+#include <array>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <boost/system/error_code.hpp>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Defines how many BCM messages can be put in a single batch.
+ * The kernel accepts up to UIO_MAXIOV messages in a single sendmmsg call.
+ */
+#define BCM_BATCH_MAX_MESSAGES 256
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class BcmTransport;
+
+class BcmBatch{
+
+public:
+    // Completion function that is called once after all messages were processed
+    using Handler = InplaceFunction<void(const BcmBatch& batch)>;
+
+    // Completion of a single message that was started with a completion token
+    using Completion = AsyncCompletionPtr<>;
+
+    // Function members
+    BcmBatch();
+    BcmBatch(const BcmBatch&) = delete;
+    BcmBatch& operator=(const BcmBatch&) = delete;
+
+    bool add(BcmMessage msg, Completion completion = Completion());
+    void clear();
+
+    size_t size() const;
+    bool empty() const;
+    bool full() const;
+    size_t failed() const;
+    const bcm_msg_head* head(size_t index) const;
+    const boost::system::error_code& errorCode(size_t index) const;
+    size_t bytes(size_t index) const;
+    int64_t submitted(size_t index) const;
+
+private:
+    friend class CANConnector;
+
+    // Function members
+    void routeRaw();
+    bool sendOn(BcmTransport& transport, int fileDescriptor, int rawDescriptor = -1);
+    bool blockedOnRaw() const;
+    void fail(const boost::system::error_code& errorCode);
+    void skip(const boost::system::error_code& errorCode);
+    void completeMessages();
+
+    // Data members
+    std::array<BcmMessage, BCM_BATCH_MAX_MESSAGES> messages;
+    std::array<struct iovec, BCM_BATCH_MAX_MESSAGES> iovecs{};
+    std::array<struct mmsghdr, BCM_BATCH_MAX_MESSAGES> headers{};
+    std::array<boost::system::error_code, BCM_BATCH_MAX_MESSAGES> errorCodes;
+    std::array<Completion, BCM_BATCH_MAX_MESSAGES> completions;
+    std::array<int64_t, BCM_BATCH_MAX_MESSAGES> submitTimes{};
+    std::array<bool, BCM_BATCH_MAX_MESSAGES> rawRoutes{};
+    size_t count = 0;
+    size_t sent = 0;
+    bool congested = false;     // The last send stopped with ENOBUFS
+    uint32_t retries = 0;       // ENOBUFS retries of the next message
+    Handler handler;
+};
+
+
+/**
+ * Bounded lock-free pool of empty batches. A batch is large, so the threads
+ * that build batches take them from the pool instead of allocating them and
+ * the io context loop thread puts them back after their completion.
+ * Can be used from any thread.
+ */
+class BcmBatchPool{
+
+public:
+    // Function members
+    explicit BcmBatchPool(std::size_t capacity);
+    BcmBatchPool(const BcmBatchPool&) = delete;
+    BcmBatchPool& operator=(const BcmBatchPool&) = delete;
+    ~BcmBatchPool();
+
+    std::unique_ptr<BcmBatch> acquire();
+    void release(std::unique_ptr<BcmBatch> batch);
+    std::size_t capacity() const;
+
+private:
+    // Marker for the end of a list
+    static constexpr std::uint32_t INVALID_INDEX = UINT32_MAX;
+
+    // Function members
+    std::uint32_t pop(std::atomic<std::uint64_t>& head);
+    void push(std::atomic<std::uint64_t>& head, std::uint32_t index);
+
+    // Data members
+    std::size_t slotCount;
+    std::unique_ptr<std::atomic<BcmBatch*>[]> batches;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> next;
+
+    // Tagged heads of the slots with a batch and the empty slots:
+    // upper 32 bits ABA tag, lower 32 bits index
+    std::atomic<std::uint64_t> filledHead{INVALID_INDEX};
+    std::atomic<std::uint64_t> emptyHead{INVALID_INDEX};
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_BCMBATCH_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
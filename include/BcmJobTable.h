@@ -0,0 +1,148 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmJobTable.h
+ \brief     User-space copy of the TX and RX jobs that are installed in the
+            BCM of a connector. The table follows the accepted TX_SETUP,
+            RX_SETUP and delete messages and the TX_STATUS and RX_STATUS
+            replies, so the state of a job is a local lookup.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_BCMJOBTABLE_H
+#define CAN_BCM_BOOST_ASIO_BCMJOBTABLE_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Number of slots of the job table. Must be a power of two. The table does
+ * not grow, so readers never see a reallocation. Jobs of further CAN IDs
+ * are not tracked and counted as dropped.
+ */
+#define BCM_JOB_TABLE_SLOTS 4096
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the state of a TX or RX job of the BCM. The struct is trivial,
+ * because the job table copies it word by word, so value-initialize it with {}.
+ */
+struct BcmJobStatus{
+    canid_t canID;
+    bool isCANFD;
+    bool isTx;
+    bool installed;
+    bool confirmed;                     // The state was read back from the kernel with TX_READ or RX_READ
+    uint32_t flags;                     // The flags of the last setup or status message
+    uint32_t count;                     // Remaining frames with ival1, TX jobs only
+    uint32_t nframes;                   // Frames of a TX job or masks of a RX job
+    struct bcm_timeval ival1;
+    struct bcm_timeval ival2;
+    struct canfd_frame frame;           // The first frame or mask, if any
+    int64_t updated;                    // Steady clock time of the last update in nanoseconds
+
+    /**
+     * Returns the current cycle time of a TX job or the throttle interval of a RX job.
+     *
+     * @return The interval, ival1 while the count is running.
+     */
+    std::chrono::microseconds interval() const{
+        const struct bcm_timeval& ival = (isTx && count > 0) ? ival1 : ival2;
+        return std::chrono::seconds(ival.tv_sec) + std::chrono::microseconds(ival.tv_usec);
+    }
+
+    /**
+     * Checks if a TX job sends its frames cyclic.
+     *
+     * @return True if the job has a running interval.
+     */
+    bool isCyclic() const{
+        return isTx && installed && interval().count() > 0;
+    }
+};
+
+/**
+ * Struct for the result of a reconciliation of the job table with the kernel.
+ */
+struct BcmJobReconcileResult{
+    size_t confirmed = 0;   // Jobs the kernel reported, their state was refreshed
+    size_t missing = 0;     // Jobs the kernel does not know, they were removed from the table
+    size_t failed = 0;      // Queries that failed for another reason
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class BcmJobTable{
+
+public:
+    // Function members
+    BcmJobTable();
+    BcmJobTable(const BcmJobTable&) = delete;
+    BcmJobTable& operator=(const BcmJobTable&) = delete;
+
+    void update(const BcmJobStatus& status);
+    void remove(canid_t canID, bool isCANFD, bool isTx);
+    bool lookup(canid_t canID, bool isCANFD, bool isTx, BcmJobStatus& status) const;
+    void collect(std::vector<BcmJobStatus>& jobs) const;
+    size_t dropped() const;
+
+    static uint64_t keyOf(canid_t canID, bool isCANFD, bool isTx);
+
+private:
+    static_assert(std::is_trivially_copyable_v<BcmJobStatus>, "The job status is copied word by word");
+    static_assert(std::is_trivial_v<BcmJobStatus>, "The job status must not have default member initializers");
+
+    // Number of 64 bit words of a BcmJobStatus
+    static constexpr size_t statusWords = (sizeof(BcmJobStatus) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    /**
+     * Seqlock slot like the slots of the RxShadowCache. The sequence is
+     * odd while the writer changes the slot.
+     */
+    struct alignas(64) Slot{
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<uint64_t> key{0};
+        std::array<std::atomic<uint64_t>, statusWords> words{};
+    };
+
+    // Function members
+    static size_t hashOf(uint64_t key);
+    Slot* findSlot(uint64_t key, bool insert);
+    const Slot* findSlot(uint64_t key) const;
+    static void write(Slot& slot, const BcmJobStatus& status);
+
+    // Data members
+    std::unique_ptr<Slot[]> slots;
+    size_t usedSlots = 0;
+    std::atomic<size_t> droppedJobs{0};
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_BCMJOBTABLE_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
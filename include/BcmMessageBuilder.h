@@ -0,0 +1,280 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmMessageBuilder.h
+ \brief     Builds BCM messages for a frame type that is known at compile
+            time. The flags and sizes of CAN and CANFD messages are constant
+            expressions, so the builder neither branches on the frame type
+            nor widens a can_frame to a canfd_frame.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_BCMMESSAGEBUILDER_H
+#define CAN_BCM_BOOST_ASIO_BCMMESSAGEBUILDER_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "BcmMessagePool.h"
+
+// System includes
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Compile-time properties of the frame types of the BCM.
+ */
+template<typename Frame>
+struct BcmFrameTraits;
+
+template<>
+struct BcmFrameTraits<struct can_frame>{
+    static constexpr bool isCANFD = false;
+    static constexpr uint32_t flags = 0;
+};
+
+template<>
+struct BcmFrameTraits<struct canfd_frame>{
+    static constexpr bool isCANFD = true;
+    static constexpr uint32_t flags = CAN_FD_FRAME;
+};
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Views the CAN part of a canfd_frame as a can_frame without copying.
+ * Both structs share the layout of the CAN ID, the length and the first 8 data bytes.
+ *
+ * @param frame - The CAN frame stored in a canfd_frame.
+ * @return The same frame as can_frame.
+ */
+inline const struct can_frame& asCANFrame(const struct canfd_frame& frame){
+    return *reinterpret_cast<const struct can_frame*>(&frame);
+}
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * Every build function fills a buffer that was acquired with at least
+ * messageSize(nframes) bytes. An empty buffer results in an empty message.
+ */
+template<typename Frame>
+class BcmMessageBuilder{
+
+public:
+    using Traits = BcmFrameTraits<Frame>;
+
+    /**
+     * Calculates the size in bytes of a message with exactly nframes frames.
+     *
+     * @param nframes - The number of frames behind the bcm_msg_head.
+     * @return The size of the message in bytes.
+     */
+    static constexpr size_t messageSize(uint32_t nframes){
+        return sizeof(struct bcm_msg_head) + nframes * sizeof(Frame);
+    }
+
+    /**
+     * Builds a TX_SEND message for a single frame.
+     */
+    static BcmMessage txSend(BcmMessagePool::Buffer msg, const Frame& frame){
+        return single(std::move(msg), TX_SEND, Traits::flags, frame);
+    }
+
+    /**
+     * Builds a TX_SETUP message for a cyclic transmission task of a frame.
+     * Note: By combining the flags SETTIMER and STARTTIMER
+     * the BCM will start sending the messages immediately.
+     */
+    static BcmMessage txSetup(BcmMessagePool::Buffer msg, const Frame& frame, uint32_t count,
+                              struct bcm_timeval ival1, struct bcm_timeval ival2){
+
+        if(!msg){
+            return {};
+        }
+
+        setTimer(msg.head(), count, ival1, ival2);
+        return single(std::move(msg), TX_SETUP, Traits::flags | SETTIMER | STARTTIMER, frame);
+    }
+
+    /**
+     * Builds a TX_SETUP message for a cyclic transmission task of a sequence of frames.
+     * The source frames can be wider than Frame, e.g. canfd_frame for a CAN sequence,
+     * in this case only the CAN part of every frame is copied.
+     */
+    template<typename Source>
+    static BcmMessage txSetupSequence(BcmMessagePool::Buffer msg, const Source frames[], uint32_t nframes, uint32_t count,
+                                      struct bcm_timeval ival1, struct bcm_timeval ival2){
+
+        static_assert(sizeof(Source) >= sizeof(Frame), "The source frames must not be narrower than the built frames");
+
+        if(!msg){
+            return {};
+        }
+
+        bcm_msg_head* head = msg.head();
+        head->opcode  = TX_SETUP;
+        head->flags   = Traits::flags | SETTIMER | STARTTIMER;
+        head->can_id  = frames[0].can_id;
+        head->nframes = nframes;
+        setTimer(head, count, ival1, ival2);
+
+        if constexpr(std::is_same<Source, Frame>::value){
+            std::memcpy(msg.frames<Frame>(), frames, nframes * sizeof(Frame));
+        }else{
+            Frame* target = msg.frames<Frame>();
+
+            for(uint32_t index = 0; index < nframes; index++){
+                std::memcpy(&target[index], &frames[index], sizeof(Frame));
+            }
+        }
+
+        return {std::move(msg), messageSize(nframes)};
+    }
+
+    /**
+     * Builds a TX_SETUP message that updates the data of a cyclic transmission task.
+     */
+    static BcmMessage txSetupUpdate(BcmMessagePool::Buffer msg, const Frame& frame, bool announce){
+        return single(std::move(msg), TX_SETUP, Traits::flags | (announce ? TX_ANNOUNCE : 0), frame);
+    }
+
+    /**
+     * Builds a TX_DELETE message for the given CAN ID.
+     */
+    static BcmMessage txDelete(BcmMessagePool::Buffer msg, canid_t canID){
+        return empty(std::move(msg), TX_DELETE, Traits::flags, canID);
+    }
+
+    /**
+     * Builds a TX_READ message that requests the TX_STATUS of the given CAN ID.
+     */
+    static BcmMessage txRead(BcmMessagePool::Buffer msg, canid_t canID){
+        return empty(std::move(msg), TX_READ, Traits::flags, canID);
+    }
+
+    /**
+     * Builds a RX_SETUP message that filters on the given CAN ID.
+     */
+    static BcmMessage rxSetupCanID(BcmMessagePool::Buffer msg, canid_t canID){
+        return empty(std::move(msg), RX_SETUP, Traits::flags | RX_FILTER_ID, canID);
+    }
+
+    /**
+     * Builds a RX_SETUP message that filters on the CAN ID and the relevant bits of the frame.
+     */
+    static BcmMessage rxSetupMask(BcmMessagePool::Buffer msg, canid_t canID, const Frame& mask){
+
+        BcmMessage result = single(std::move(msg), RX_SETUP, Traits::flags, mask);
+
+        if(result.buffer){
+            result.buffer.head()->can_id = canID;
+        }
+
+        return result;
+    }
+
+    /**
+     * Builds a RX_SETUP message with explicit flags, timers and mask frames. Without
+     * mask frames the message filters on the CAN ID. The source frames can be wider
+     * than Frame, in this case only the CAN part of every mask is copied.
+     */
+    template<typename Source>
+    static BcmMessage rxSetup(BcmMessagePool::Buffer msg, canid_t canID, uint32_t flags, struct bcm_timeval ival1,
+                              struct bcm_timeval ival2, const Source masks[], uint32_t nframes){
+
+        static_assert(sizeof(Source) >= sizeof(Frame), "The source frames must not be narrower than the built frames");
+
+        if(!msg){
+            return {};
+        }
+
+        bcm_msg_head* head = msg.head();
+        head->opcode  = RX_SETUP;
+        head->flags   = Traits::flags | flags | (nframes == 0 ? RX_FILTER_ID : 0);
+        head->can_id  = canID;
+        head->nframes = nframes;
+        setTimer(head, 0, ival1, ival2);
+
+        Frame* target = msg.frames<Frame>();
+
+        for(uint32_t index = 0; index < nframes; index++){
+            std::memcpy(&target[index], &masks[index], sizeof(Frame));
+        }
+
+        return {std::move(msg), messageSize(nframes)};
+    }
+
+    /**
+     * Builds a RX_DELETE message for the given CAN ID.
+     */
+    static BcmMessage rxDelete(BcmMessagePool::Buffer msg, canid_t canID){
+        return empty(std::move(msg), RX_DELETE, Traits::flags, canID);
+    }
+
+    /**
+     * Builds a RX_READ message that requests the RX_STATUS of the given CAN ID.
+     */
+    static BcmMessage rxRead(BcmMessagePool::Buffer msg, canid_t canID){
+        return empty(std::move(msg), RX_READ, Traits::flags, canID);
+    }
+
+private:
+    static void setTimer(bcm_msg_head* head, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2){
+        head->count = count;
+        head->ival1 = ival1;
+        head->ival2 = ival2;
+    }
+
+    static BcmMessage single(BcmMessagePool::Buffer msg, uint32_t opcode, uint32_t flags, const Frame& frame){
+
+        if(!msg){
+            return {};
+        }
+
+        bcm_msg_head* head = msg.head();
+        head->opcode  = opcode;
+        head->flags   = flags;
+        head->can_id  = frame.can_id;
+        head->nframes = 1;
+        msg.frames<Frame>()[0] = frame;
+
+        return {std::move(msg), messageSize(1)};
+    }
+
+    static BcmMessage empty(BcmMessagePool::Buffer msg, uint32_t opcode, uint32_t flags, canid_t canID){
+
+        if(!msg){
+            return {};
+        }
+
+        bcm_msg_head* head = msg.head();
+        head->opcode = opcode;
+        head->flags  = flags;
+        head->can_id = canID;
+
+        return {std::move(msg), messageSize(0)};
+    }
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_BCMMESSAGEBUILDER_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,229 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmMessagePool.h
+ \brief     Fixed-capacity lock-free pool of pre-sized BCM message buffers.
+            Every buffer also carries the memory for the boost::asio send
+            operation, so the steady-state send path does not allocate.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_BCMMESSAGEPOOL_H
+#define CAN_BCM_BOOST_ASIO_BCMMESSAGEPOOL_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+#include <boost/system/error_code.hpp>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Size of the memory that is reserved next to every message buffer for the
+ * boost::asio operation of the send. If an operation does not fit it falls
+ * back to the global operator new.
+ */
+#define BCM_HANDLER_MEMORY_SIZE 256
+
+/**
+ * Alignment of the pool slots. Slots are cache line aligned so that buffers
+ * used by different threads do not share a cache line.
+ */
+#define BCM_POOL_SLOT_ALIGNMENT 64
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class BcmMessagePool{
+
+public:
+    class Buffer;
+    template<typename T> class HandlerAllocator;
+
+    // Function members
+    BcmMessagePool(std::size_t messageSize, std::size_t slotCount);
+    BcmMessagePool(const BcmMessagePool&) = delete;
+    BcmMessagePool& operator=(const BcmMessagePool&) = delete;
+
+    Buffer acquire();
+    std::size_t messageCapacity() const;
+    std::size_t slotCapacity() const;
+
+private:
+    // Cache line sized storage unit of the slots
+    struct alignas(BCM_POOL_SLOT_ALIGNMENT) CacheLine{
+        std::uint8_t bytes[BCM_POOL_SLOT_ALIGNMENT];
+    };
+
+    // Marker for the end of the free list
+    static constexpr std::uint32_t INVALID_INDEX = UINT32_MAX;
+
+    // Function members
+    void release(std::uint32_t index);
+    std::uint8_t* slot(std::uint32_t index) const;
+
+    // Data members
+    std::size_t messageSize;
+    std::size_t handlerOffset;
+    std::size_t slotStride;
+    std::size_t slotCount;
+    std::unique_ptr<CacheLine[]> storage;
+    std::unique_ptr<bool[]> handlerMemoryInUse;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> nextFree;
+
+    // Tagged head of the free list: upper 32 bits ABA tag, lower 32 bits index
+    std::atomic<std::uint64_t> freeListHead;
+};
+
+/**
+ * Move-only handle of a pool slot. The slot goes back to
+ * the pool when the handle is reset or destroyed.
+ */
+class BcmMessagePool::Buffer{
+
+public:
+    // Function members
+    Buffer() = default;
+    Buffer(Buffer&& other) noexcept;
+    Buffer& operator=(Buffer&& other) noexcept;
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+    ~Buffer();
+
+    explicit operator bool() const;
+    void reset();
+
+    void* data() const;
+    std::size_t capacity() const;
+    bcm_msg_head* head() const;
+    HandlerAllocator<void> handlerAllocator() const;
+
+    /**
+     * Returns the frames that are appended to the bcm_msg_head.
+     *
+     * @return Pointer to the first CAN or CANFD frame.
+     */
+    template<typename Frame>
+    Frame* frames() const{
+        return reinterpret_cast<Frame*>(static_cast<std::uint8_t*>(data()) + sizeof(bcm_msg_head));
+    }
+
+private:
+    friend class BcmMessagePool;
+    Buffer(BcmMessagePool* pool, std::uint32_t index);
+
+    // Data members
+    BcmMessagePool* pool = nullptr;
+    std::uint32_t index = INVALID_INDEX;
+};
+
+/**
+ * A BCM message that was built in a pool buffer with its size in bytes.
+ */
+struct BcmMessage{
+    BcmMessagePool::Buffer buffer;
+    size_t size = 0;
+};
+
+/**
+ * Allocator for the boost::asio operation of a send. It hands out the handler
+ * memory of the pool slot once and uses the global operator new otherwise.
+ */
+template<typename T>
+class BcmMessagePool::HandlerAllocator{
+
+public:
+    using value_type = T;
+
+    HandlerAllocator(void* memory, bool* inUse) noexcept : memory(memory), inUse(inUse){}
+
+    template<typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory(other.memory), inUse(other.inUse){}
+
+    T* allocate(std::size_t n){
+
+        // Use the slot memory if it is still free and big enough
+        if(!*inUse && n * sizeof(T) <= BCM_HANDLER_MEMORY_SIZE){
+            *inUse = true;
+            return static_cast<T*>(memory);
+        }
+
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n){
+
+        if(p == memory){
+            *inUse = false;
+        }else{
+            ::operator delete(p);
+        }
+    }
+
+    template<typename U>
+    bool operator==(const HandlerAllocator<U>& other) const noexcept{
+        return memory == other.memory;
+    }
+
+    template<typename U>
+    bool operator!=(const HandlerAllocator<U>& other) const noexcept{
+        return memory != other.memory;
+    }
+
+private:
+    template<typename> friend class HandlerAllocator;
+
+    // Data members
+    void* memory;
+    bool* inUse;
+};
+
+/**
+ * Completion handler for an async send of a pooled BCM message. It keeps the
+ * buffer alive until the handler is invoked, uses the slot memory for the
+ * boost::asio operation and returns the slot to the pool afterwards.
+ */
+template<typename Handler>
+class BcmSendHandler{
+
+public:
+    using allocator_type = BcmMessagePool::HandlerAllocator<void>;
+
+    BcmSendHandler(BcmMessagePool::Buffer buffer, Handler handler) :
+        buffer(std::move(buffer)), handler(std::move(handler)){}
+
+    allocator_type get_allocator() const noexcept{
+        return buffer.handlerAllocator();
+    }
+
+    void operator()(const boost::system::error_code& errorCode, std::size_t size){
+
+        // Call the completion function and give the buffer back to the pool
+        handler(errorCode, size);
+        buffer.reset();
+    }
+
+private:
+    // Data members
+    BcmMessagePool::Buffer buffer;
+    Handler handler;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_BCMMESSAGEPOOL_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
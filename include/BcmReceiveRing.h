@@ -0,0 +1,90 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmReceiveRing.h
+ \brief     Ring of pre-sized receive buffers that drains the BCM socket with
+            a single recvmmsg call. It also counts how many datagrams were
+            drained on each wakeup of the socket.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_BCMRECEIVERING_H
+#define CAN_BCM_BOOST_ASIO_BCMRECEIVERING_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Size in bytes of the control buffer of a receive buffer. Fits the
+ * SCM_TIMESTAMPNS control message of SO_TIMESTAMPNS and a spare one.
+ */
+#define BCM_RX_CONTROL_SIZE (2 * CMSG_SPACE(sizeof(struct timespec)))
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class BcmReceiveRing{
+
+public:
+    /**
+     * Snapshot of the drain counters.
+     */
+    struct Statistics{
+        std::uint64_t wakeups   = 0;
+        std::uint64_t datagrams = 0;
+
+        // drained[n] is the number of wakeups that drained n datagrams.
+        // The last entry counts all wakeups with more datagrams.
+        std::vector<std::uint64_t> drained;
+    };
+
+    // Function members
+    BcmReceiveRing(size_t slotCount, size_t slotSize);
+    BcmReceiveRing(const BcmReceiveRing&) = delete;
+    BcmReceiveRing& operator=(const BcmReceiveRing&) = delete;
+
+    int drain(int fileDescriptor);
+    void recordWakeup(size_t datagrams);
+    Statistics statistics() const;
+
+    size_t size() const;
+    const std::uint8_t* data(size_t index) const;
+    size_t bytes(size_t index) const;
+    std::int64_t timestamp(size_t index) const;
+
+private:
+    // Data members
+    size_t slotCount;
+    size_t slotSize;
+    std::unique_ptr<std::uint8_t[]> storage;
+    std::unique_ptr<std::uint8_t[]> controls;
+    std::unique_ptr<struct iovec[]> iovecs;
+    std::unique_ptr<struct mmsghdr[]> headers;
+
+    // Drain counters, written by the io context thread and read by any thread
+    std::atomic<std::uint64_t> wakeups{0};
+    std::atomic<std::uint64_t> datagrams{0};
+    std::unique_ptr<std::atomic<std::uint64_t>[]> drainedHistogram;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_BCMRECEIVERING_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,77 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmTransport.h
+ \brief     Transport of the BCM messages of a connector. The kernel transport
+            talks to the CAN_BCM socket of an interface, other transports like
+            the simulated BCM provide a socket that speaks the same protocol.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_BCMTRANSPORT_H
+#define CAN_BCM_BOOST_ASIO_BCMTRANSPORT_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// System includes
+#include <string>
+#include <sys/socket.h>
+
+#include <utility>
+#include <boost/asio/generic/datagram_protocol.hpp>
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class BcmTransport{
+
+public:
+    // Function members
+    virtual ~BcmTransport() = default;
+
+    /**
+     * Opens the socket of a connector. The notifications are received on the
+     * socket with recvmmsg, so the socket must deliver one BCM message per datagram.
+     *
+     * @param socket         - The socket that is opened.
+     * @param interfaceName  - The name of the CAN interface.
+     * @param interfaceIndex - The index of the interface, set on success.
+     * @return True if the socket is connected to the interface.
+     */
+    virtual bool open(boost::asio::generic::datagram_protocol::socket& socket, const std::string& interfaceName, int& interfaceIndex) = 0;
+
+    /**
+     * Sends BCM messages like a non blocking sendmmsg call. A rejected message
+     * stops the call, its errno is reported if it is the first message.
+     *
+     * @param fileDescriptor - The native handle of the socket.
+     * @param headers        - The message headers.
+     * @param count          - The number of messages.
+     * @return The number of sent messages or -1 with errno set.
+     */
+    virtual int send(int fileDescriptor, struct mmsghdr* headers, unsigned int count);
+
+    /**
+     * Checks if the one-shot frames may bypass the transport on a CAN_RAW socket.
+     *
+     * @return True if the interface is a real CAN interface.
+     */
+    virtual bool supportsRawFastPath() const;
+};
+
+class KernelBcmTransport : public BcmTransport{
+
+public:
+    // Function members
+    bool open(boost::asio::generic::datagram_protocol::socket& socket, const std::string& interfaceName, int& interfaceIndex) override;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_BCMTRANSPORT_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -15,14 +15,45 @@
  * INCLUDES
  ******************************************************************************/
 // Project includes
+#include "Log.h"
 #include "InterfaceIndexIO.h"
+#include "BcmBatch.h"
+#include "BcmTransport.h"
+#include "BcmMessagePool.h"
+#include "BcmMessageBuilder.h"
+#include "TxJob.h"
+#include "BcmReceiveRing.h"
+#include "RxDispatcher.h"
+#include "RxShadowCache.h"
+#include "BcmJobTable.h"
+#include "RxNotificationStream.h"
+#include "RxBroadcastRing.h"
+#include "IsoTpChannel.h"
+#include "RxFilterSet.h"
+#include "RxOptions.h"
+#include "ConnectorConfig.h"
+#include "CaptureWriter.h"
+#include "ConnectorMetrics.h"
+#include "AsyncCompletion.h"
+#include "MpscQueue.h"
+#include "TxBacklog.h"
 #include "CANConnectorConfig.h"
 
 // System includes
+#include <string>
+#include <vector>
+#include <atomic>
 #include <thread>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <future>
+#include <chrono>
 #include <iostream>
 #include <linux/can.h>
 #include <linux/can/bcm.h>
+// Note: Boost 1.74 uses std::exchange in awaitable.hpp without including <utility>
+#include <utility>
 #include <boost/asio.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/system/error_code.hpp>
@@ -40,42 +71,104 @@
 #define MAXFRAMES 256
 
 
+/**
+ * Size in bytes of the biggest BCM message with a single frame.
+ * Note: The messages are built in raw pool buffers. A struct with a nested
+ * bcm_msg_head is not possible since the bcm_msg_head ends with a flexible
+ * array member. The frames directly follow the bcm_msg_head and only the
+ * used frames are sent, see CANConnector::bcmMessageSize.
+ */
+#define BCM_MSG_SINGLE_FRAME_CANFD_SIZE (sizeof(struct bcm_msg_head) + sizeof(struct canfd_frame))
+
+/**
+ * Size in bytes of the biggest BCM message with MAXFRAMES frames.
+ */
+#define BCM_MSG_MULTIPLE_FRAMES_CANFD_SIZE (sizeof(struct bcm_msg_head) + MAXFRAMES * sizeof(struct canfd_frame))
+
+
 /*******************************************************************************
  * STRUCTS
  ******************************************************************************/
 
 /**
- * Struct for a BCM message with a single CAN frame.
+ * Struct for the occupancy of the transmission path that producers can
+ * read to throttle themselves.
+ */
+struct TxQueueStatus{
+    size_t queued = 0;                          // Commands in the submission queue
+    size_t queueCapacity = TX_QUEUE_SIZE;
+    size_t backlog = 0;                         // Commands that wait while the socket is congested
+    size_t backlogBudget = TX_BACKLOG_BUDGET;
+    bool congested = false;                     // A batch waits for the socket or an ENOBUFS backoff
+};
+
+
+/**
+ * Struct for a TX_READ or RX_READ request that waits for its status reply.
+ * Only accessed in the io context loop thread.
  */
-struct bcmMsgSingleFrameCan{
-    struct bcm_msg_head msg_head;
-    struct can_frame canFrame[1];
+struct JobQuery{
+    uint64_t id = 0;
+    canid_t canID = 0;
+    bool isCANFD = false;
+    bool isTx = false;
+    AsyncCompletionPtr<BcmJobStatus> completion;
 };
 
 /**
- * Struct for a BCM message with a single CANFD frame.
+ * Struct for the state of a reconciliation of the job table that reads
+ * the jobs back from the kernel batch by batch.
+ * Only accessed in the io context loop thread.
  */
-struct bcmMsgSingleFrameCanFD{
-    struct bcm_msg_head msg_head;
-    struct canfd_frame canfdFrame[1];
+struct JobReconcile{
+    std::vector<BcmJobStatus> jobs;
+    size_t submitted = 0;
+    size_t remaining = 0;
+    BcmJobReconcileResult result;
+    AsyncCompletionPtr<BcmJobReconcileResult> completion;
 };
 
 /**
- * Struct for a BCM message with multiple CAN frames.
+ * Struct for the result of a provisioned interface configuration.
  */
-struct bcmMsgMultipleFramesCan{
-    struct bcm_msg_head msg_head;
-    struct can_frame canFrames[MAXFRAMES];
+struct ProvisionResult{
+    size_t txJobs = 0;                          // TX_SETUP messages of the cyclic TX jobs
+    size_t txFailed = 0;                        // TX_SETUP messages that could not be made or sent
+    RxFilterResult rxFilters;
 };
 
 /**
-* Struct for a BCM message with multiple CANFD frames.
-*/
-struct bcmMsgMultipleFramesCanFD{
-    struct bcm_msg_head msg_head;
-    struct canfd_frame canfdFrames[MAXFRAMES];
+ * Handler that is called once after an interface configuration was provisioned.
+ */
+using ProvisionHandler = InplaceFunction<void(const ProvisionResult& result)>;
+
+/**
+ * Struct for the state of a provisioning that waits for its TX_SETUP batches
+ * and its RX filters. A rejected batch completes in the calling thread, so
+ * the counters are atomic.
+ */
+struct ProvisionState{
+    std::atomic<size_t> pending{1};             // The RX filters and the TX_SETUP batches in flight
+    std::atomic<size_t> txFailed{0};
+    size_t txJobs = 0;
+    RxFilterResult rxFilters;
+    ProvisionHandler handler;
 };
 
+/**
+ * Struct for the state of a filter set that is applied in batches.
+ * Only accessed in the io context loop thread.
+ */
+struct RxFilterApply{
+    std::vector<RxFilterChange> changes;
+    std::unordered_map<uint64_t, size_t> changeIndex;
+    RxFilterResult result;
+    size_t pendingBatches = 0;
+    bool submitting = true;
+    RxFilterHandler handler;
+};
+
+
 /*******************************************************************************
  * CLASS DECLARATIONS
  ******************************************************************************/
@@ -85,39 +178,442 @@ class CANConnector{
 public:
     // Functions members
     CANConnector();
+    explicit CANConnector(const std::string& interfaceName, std::shared_ptr<BcmTransport> transport = nullptr);
+    CANConnector(const std::string& interfaceName, boost::shared_ptr<boost::asio::io_context> context,
+                 std::shared_ptr<BcmTransport> transport = nullptr);
+    CANConnector(const CANConnector&) = delete;
+    CANConnector& operator=(const CANConnector&) = delete;
     ~CANConnector();
 
+    const std::string& getInterfaceName() const;
+    bool isConnected() const;
+    bool hasRawFastPath() const;
+    static std::string defaultInterfaceName();
+    boost::asio::io_context::executor_type getExecutor() const;
+
+    void txSendSingleFrame(struct canfd_frame frame, bool isCANFD);
+    void txSendMultipleFrames(struct canfd_frame frames[], int nframes, bool isCANFD);
+    TxJobHandle txSetupSingleFrame(struct canfd_frame frame, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD);
+    void txSetupMultipleFrames(struct canfd_frame frames[], int nframes, uint32_t count[], struct bcm_timeval ival1[], struct bcm_timeval ival2[], bool isCANFD);
+    TxJobHandle txSetupSequence(struct canfd_frame frames[], int nframes, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD);
+    void txSetupUpdateSingleFrame(struct canfd_frame frame, bool isCANFD, bool announce);
+    void txSetupUpdateMultipleFrames(struct canfd_frame frames[], int nframes, bool isCANFD, bool announce);
+    void txDelete(canid_t canID, bool isCANFD);
+
+    bool commitTxJob(TxJob& job, bool announce = false);
+    size_t commitTxJobs(const std::vector<TxJobHandle>& jobs, bool announce = false);
+
+    void rxSetupCanID(canid_t canID, bool isCANFD);
+    void rxSetupMask(canid_t canID, struct canfd_frame mask, bool isCANFD);
+    void rxDelete(canid_t canID, bool isCANFD);
+
+    // Frame type specific operations for can_frame or canfd_frame without runtime checks
+    template<typename Frame> void txSend(const Frame& frame);
+    template<typename Frame> TxJobHandle txSetup(const Frame& frame, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2);
+    template<typename Frame> TxJobHandle txSetupSequence(const Frame frames[], int nframes, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2);
+    template<typename Frame> void txSetupUpdate(const Frame& frame, bool announce);
+    template<typename Frame> void txDelete(canid_t canID);
+    template<typename Frame> void rxSetupCanID(canid_t canID);
+    template<typename Frame> void rxSetupMask(canid_t canID, const Frame& mask);
+    template<typename Frame> void rxDelete(canid_t canID);
+
+    // RX_SETUP with kernel side throttling, timeout monitoring and content filters
+    template<typename Frame> void rxSetup(canid_t canID, const RxOptions& options);
+    template<typename Frame> void rxSetupMask(canid_t canID, const Frame& mask, const RxOptions& options);
+    template<typename Frame> void rxSetupMultiplex(canid_t canID, const Frame masks[], int nmasks, const RxOptions& options);
+
+    bool addTxSend(BcmBatch& batch, struct canfd_frame frame, bool isCANFD);
+    bool addTxSetup(BcmBatch& batch, struct canfd_frame frame, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD);
+    bool addTxSetupSequence(BcmBatch& batch, struct canfd_frame frames[], int nframes, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD);
+    bool addTxSetupUpdate(BcmBatch& batch, struct canfd_frame frame, bool isCANFD, bool announce);
+    bool addTxDelete(BcmBatch& batch, canid_t canID, bool isCANFD);
+    bool addRxSetupCanID(BcmBatch& batch, canid_t canID, bool isCANFD);
+    bool addRxSetupMask(BcmBatch& batch, canid_t canID, struct canfd_frame mask, bool isCANFD);
+    bool addRxDelete(BcmBatch& batch, canid_t canID, bool isCANFD);
+    template<typename Frame> bool addTxSend(BcmBatch& batch, const Frame& frame);
+    template<typename Frame> bool addTxSetupUpdate(BcmBatch& batch, const Frame& frame, bool announce);
+    template<typename Frame> bool addRxSetup(BcmBatch& batch, canid_t canID, const Frame masks[], int nmasks, const RxOptions& options);
+    std::unique_ptr<BcmBatch> acquireBatch();
+    void submitBatch(std::unique_ptr<BcmBatch> batch, BcmBatch::Handler handler);
+
+    void subscribe(RxEvent event, canid_t canID, const RxHandler& handler);
+    void subscribe(RxEvent event, canid_t firstCanID, canid_t lastCanID, const RxHandler& handler);
+    void unsubscribe(RxEvent event, canid_t canID);
+    void unsubscribe(RxEvent event, canid_t firstCanID, canid_t lastCanID);
+
+    void applyRxFilters(std::vector<RxFilter> filters, RxFilterHandler handler = RxFilterHandler());
+    void provision(const InterfaceConfig& config, ProvisionHandler handler = ProvisionHandler());
+
+    RxStreamHandle openRxStream(RxEvent event, canid_t firstCanID, canid_t lastCanID, size_t capacity = RX_STREAM_CAPACITY);
+    void closeRxStream(const RxStreamHandle& stream);
+
+    RxBroadcastReader openRxBroadcast();
+
+    IsoTpChannelHandle openIsoTpChannel(const IsoTpOptions& options);
+    void closeIsoTpChannel(const IsoTpChannelHandle& channel);
+
+    bool startCapture(const std::string& path, bool useMmap = false);
+    CaptureWriter::Statistics stopCapture();
+
+    bool getLatestFrame(canid_t canID, RxShadowSnapshot& snapshot) const;
+    bool getTxJob(canid_t canID, bool isCANFD, BcmJobStatus& status) const;
+    bool getRxJob(canid_t canID, bool isCANFD, BcmJobStatus& status) const;
+    BcmReceiveRing::Statistics getReceiveStatistics() const;
+    ConnectorMetrics::Snapshot getMetrics() const;
+    TxQueueStatus getTxQueueStatus() const;
+    void setTxOverflowPolicy(canid_t canID, bool isCANFD, TxOverflowPolicy policy, size_t limit = TX_BACKLOG_PER_ID);
+
+    static const char* opcodeName(uint32_t opcode);
+
+    // Asynchronous operations with a completion token and the signature void(boost::system::error_code).
+    // The token selects how the result is delivered, e.g. a callback, boost::asio::use_future or
+    // boost::asio::use_awaitable in a coroutine. The error code is the result of the sendmsg call.
+
+    /**
+     * Asynchronous variant of txSend.
+     *
+     * @param frame - The can_frame or canfd_frame that should be send.
+     * @param token - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncTxSend(const Frame& frame, CompletionToken&& token){
+        return asyncSendMessage(BcmMessageBuilder<Frame>::txSend(acquireFrames<Frame>(1), frame), "TX_SEND",
+                                std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Asynchronous variant of txSetup. Use TxJob::create for a handle of the task.
+     *
+     * @param frame - The can_frame or canfd_frame that should be send cyclic.
+     * @param count - Number of times the frame is send with the first interval.
+     * @param ival1 - First interval.
+     * @param ival2 - Second interval.
+     * @param token - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncTxSetup(const Frame& frame, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2, CompletionToken&& token){
+        return asyncSendMessage(BcmMessageBuilder<Frame>::txSetup(acquireFrames<Frame>(1), frame, count, ival1, ival2), "TX_SETUP",
+                                std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Asynchronous variant of txSetupSequence.
+     *
+     * @param frames  - The array of can_frame or canfd_frame that should be send cyclic.
+     * @param nframes - The number of frames that should be send cyclic.
+     * @param count   - Number of times the frame is send with the first interval.
+     * @param ival1   - First interval.
+     * @param ival2   - Second interval.
+     * @param token   - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncTxSetupSequence(const Frame frames[], int nframes, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2,
+                              CompletionToken&& token){
+        return asyncSendMessage(buildSequence<Frame, Frame>(frames, nframes, count, ival1, ival2), "TX_SETUP sequence",
+                                std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Asynchronous variant of txSetupUpdate.
+     *
+     * @param frame    - The can_frame or canfd_frame with the updated data.
+     * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+     * @param token    - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncTxSetupUpdate(const Frame& frame, bool announce, CompletionToken&& token){
+        return asyncSendMessage(BcmMessageBuilder<Frame>::txSetupUpdate(acquireFrames<Frame>(1), frame, announce), "TX_SETUP update",
+                                std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Asynchronous variant of txDelete.
+     *
+     * @param canID - The CAN ID of the task that should be removed.
+     * @param token - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncTxDelete(canid_t canID, CompletionToken&& token){
+        return asyncSendMessage(BcmMessageBuilder<Frame>::txDelete(acquireFrames<Frame>(0), canID), "TX_DELETE",
+                                std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Asynchronous variant of rxSetupCanID.
+     *
+     * @param canID - The CAN ID that should be added to the RX filter.
+     * @param token - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncRxSetupCanID(canid_t canID, CompletionToken&& token){
+        return asyncSendMessage(BcmMessageBuilder<Frame>::rxSetupCanID(acquireFrames<Frame>(0), canID), "RX_SETUP based on a CAN ID",
+                                std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Asynchronous variant of rxSetupMask.
+     *
+     * @param canID - The CAN ID that should be added to the RX filter.
+     * @param mask  - The can_frame or canfd_frame mask for the relevant bits.
+     * @param token - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncRxSetupMask(canid_t canID, const Frame& mask, CompletionToken&& token){
+        return asyncSendMessage(BcmMessageBuilder<Frame>::rxSetupMask(acquireFrames<Frame>(1), canID, mask), "RX_SETUP with mask",
+                                std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Asynchronous variant of rxDelete.
+     *
+     * @param canID - The CAN ID that should be removed from the RX filter.
+     * @param token - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncRxDelete(canid_t canID, CompletionToken&& token){
+        return asyncSendMessage(BcmMessageBuilder<Frame>::rxDelete(acquireFrames<Frame>(0), canID), "RX_DELETE",
+                                std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Asynchronous variant of rxSetup, rxSetupMask and rxSetupMultiplex.
+     *
+     * @param canID   - The CAN ID that should be added to the RX filter.
+     * @param masks   - The can_frame or canfd_frame masks, nullptr to filter on the CAN ID.
+     * @param nmasks  - The number of masks.
+     * @param options - The throttling, timeout and content options.
+     * @param token   - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncRxSetup(canid_t canID, const Frame masks[], int nmasks, const RxOptions& options, CompletionToken&& token){
+        return asyncSendMessage(buildRxSetup<Frame>(canID, masks, nmasks, options), "RX_SETUP with options",
+                                std::forward<CompletionToken>(token));
+    }
+
+    // Queries of the kernel job state. The status replies are correlated with the requests
+    // by their CAN ID and opcode and refresh the job table that getTxJob and getRxJob read.
+
+    /**
+     * Reads the state of a TX job from the kernel with TX_READ. A CAN ID
+     * without a TX job completes with boost::asio::error::not_found.
+     *
+     * @param canID - The CAN ID of the TX job.
+     * @param token - The completion token with the signature void(boost::system::error_code, BcmJobStatus).
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncTxRead(canid_t canID, CompletionToken&& token){
+        return asyncReadJob(TX_READ, canID, BcmFrameTraits<Frame>::isCANFD, std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Reads the state of a RX job from the kernel with RX_READ. A CAN ID
+     * without a RX job completes with boost::asio::error::not_found.
+     *
+     * @param canID - The CAN ID of the RX job.
+     * @param token - The completion token with the signature void(boost::system::error_code, BcmJobStatus).
+     * @return The result of the completion token.
+     */
+    template<typename Frame, typename CompletionToken>
+    auto asyncRxRead(canid_t canID, CompletionToken&& token){
+        return asyncReadJob(RX_READ, canID, BcmFrameTraits<Frame>::isCANFD, std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Reads all jobs of the job table back from the kernel in batches. Jobs
+     * the kernel does not know are removed from the table, e.g. after the
+     * socket was recreated, so the caller can provision them again.
+     *
+     * @param token - The completion token with the signature void(boost::system::error_code, BcmJobReconcileResult).
+     * @return The result of the completion token.
+     */
+    template<typename CompletionToken>
+    auto asyncReconcileJobs(CompletionToken&& token){
+
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, BcmJobReconcileResult)>(
+            [this](auto&& handler){
+
+                auto completion = makeAsyncCompletion<BcmJobReconcileResult>(std::move(handler), ioContext->get_executor());
+
+                // The job table is only iterated in the io context loop thread
+                boost::asio::post(*ioContext, [this, completion = std::move(completion)]() mutable{
+                    startJobReconcile(std::move(completion));
+                });
+
+            }, token);
+    }
+
     // Data members
     void handleSendingData();
 
 private:
     // Function members
+    CANConnector(const std::string& interfaceName, boost::shared_ptr<boost::asio::io_context> context, bool ownsIoContext,
+                 std::shared_ptr<BcmTransport> transport);
     boost::asio::generic::datagram_protocol::socket createBcmSocket();
+    boost::asio::generic::raw_protocol::socket createRawSocket();
 
     void startProcessing();
     void stopProcessing();
+    void detachFromIoContext();
     void ioContextThreadFunction(const boost::shared_ptr<boost::asio::io_context>& context);
 
+    static size_t bcmMessageSize(uint32_t nframes, bool isCANFD);
+    BcmMessagePool::Buffer acquireMessage(size_t msgSize);
+
+    /**
+     * Takes a buffer for a message with exactly nframes frames of the frame type.
+     *
+     * @param nframes - The number of frames behind the bcm_msg_head.
+     * @return The buffer or an empty buffer if the pool is exhausted.
+     */
+    template<typename Frame>
+    BcmMessagePool::Buffer acquireFrames(uint32_t nframes){
+        return acquireMessage(BcmMessageBuilder<Frame>::messageSize(nframes));
+    }
+
+    /**
+     * Starts the asynchronous send of a built message. The completion
+     * is created when the operation is initiated by the token.
+     *
+     * @param msg         - The built BCM message.
+     * @param description - The description of the operation for the log output.
+     * @param token       - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename CompletionToken>
+    auto asyncSendMessage(BcmMessage msg, const char* description, CompletionToken&& token){
+
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+            [this, description](auto&& handler, BcmMessage message){
+                sendMessage(std::move(message), description, makeAsyncCompletion<>(std::move(handler), ioContext->get_executor()));
+            }, token, std::move(msg));
+    }
+
+    /**
+     * Starts a TX_READ or RX_READ request in the io context loop thread.
+     *
+     * @param opcode  - TX_READ or RX_READ.
+     * @param canID   - The CAN ID of the job.
+     * @param isCANFD - Flag for a CANFD job.
+     * @param token   - The completion token.
+     * @return The result of the completion token.
+     */
+    template<typename CompletionToken>
+    auto asyncReadJob(uint32_t opcode, canid_t canID, bool isCANFD, CompletionToken&& token){
+
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, BcmJobStatus)>(
+            [this, opcode, canID, isCANFD](auto&& handler){
+
+                auto completion = makeAsyncCompletion<BcmJobStatus>(std::move(handler), ioContext->get_executor());
+
+                // The pending queries are only accessed in the io context loop thread
+                boost::asio::post(*ioContext, [this, opcode, canID, isCANFD, completion = std::move(completion)]() mutable{
+                    sendMessage(buildJobRead(opcode, canID, isCANFD), opcodeName(opcode),
+                                registerJobQuery(opcode, canID, isCANFD, std::move(completion)));
+                });
+
+            }, token);
+    }
+
+    BcmMessage buildJobRead(uint32_t opcode, canid_t canID, bool isCANFD);
+    BcmBatch::Completion registerJobQuery(uint32_t opcode, canid_t canID, bool isCANFD, AsyncCompletionPtr<BcmJobStatus> completion);
+    void failJobQuery(uint64_t key, uint64_t id, const boost::system::error_code& errorCode);
+    void handleJobStatus(const BcmNotification& notification);
+    void updateJobTable(const BcmBatch& batch);
+    void startJobReconcile(AsyncCompletionPtr<BcmJobReconcileResult> completion);
+    void submitJobReconcileBatch(const std::shared_ptr<JobReconcile>& reconcile);
+    static BcmJobStatus jobStatusOf(const bcm_msg_head* head, bool isTx);
+
     void receiveOnSocket();
-    void handleReceivedData(const bcm_msg_head* head, void* frames, uint32_t nframes, bool isCANFD);
+    bool decodeMessage(const std::uint8_t* data, size_t receivedBytes, BcmNotification& notification);
+    void handleReceivedBatch(const BcmNotification notifications[], size_t nnotifications);
+    void handleReceivedData(const BcmNotification& notification);
+    void updateShadowCache(const BcmNotification& notification);
+    void captureNotification(const BcmNotification& notification);
+    void captureBatch(const BcmBatch& batch);
+    void waitForCaptureFlush();
 
-    void txSendSingleFrame(struct canfd_frame frame, bool isCANFD);
-    void txSendMultipleFrames(struct canfd_frame frames[], int nframes, bool isCANFD);
-    void txSetupSingleFrame(struct canfd_frame frame, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD);
-    void txSetupMultipleFrames(struct canfd_frame frames[], int nframes, uint32_t count[], struct bcm_timeval ival1[], struct bcm_timeval ival2[], bool isCANFD);
-    void txSetupSequence(struct canfd_frame frames[], int nframes, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD);
-    void txSetupUpdateSingleFrame(struct canfd_frame frame, bool isCANFD, bool announce);
-    void txSetupUpdateMultipleFrames(struct canfd_frame frames[], int nframes, bool isCANFD, bool announce);
-    void txDelete(canid_t canID, bool isCANFD);
+    template<typename Frame, typename Source>
+    BcmMessage buildSequence(const Source frames[], int nframes, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2);
+    BcmMessage buildTxSend(const struct canfd_frame& frame, bool isCANFD);
+    BcmMessage buildTxSetup(const struct canfd_frame& frame, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD);
+    BcmMessage buildTxSetupSequence(const struct canfd_frame frames[], int nframes, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD);
+    BcmMessage buildTxSetupUpdate(const struct canfd_frame& frame, bool isCANFD, bool announce);
+    BcmMessage buildTxDelete(canid_t canID, bool isCANFD);
+    BcmMessage buildRxSetupCanID(canid_t canID, bool isCANFD);
+    BcmMessage buildRxSetupMask(canid_t canID, const struct canfd_frame& mask, bool isCANFD);
+    BcmMessage buildRxDelete(canid_t canID, bool isCANFD);
+    BcmMessage buildRxFilter(const RxFilter& filter);
+    template<typename Frame>
+    BcmMessage buildRxSetup(canid_t canID, const Frame masks[], int nmasks, const RxOptions& options);
 
-    void rxSetupCanID(canid_t canID, bool isCANFD);
-    void rxSetupMask(canid_t canID, struct canfd_frame mask, bool isCANFD);
-    void rxDelete(canid_t canID, bool isCANFD);
+    void applyRxFilterChanges(const std::vector<RxFilter>& filters, const RxFilterHandler& handler);
+    void submitRxFilterBatch(const std::shared_ptr<RxFilterApply>& apply, std::unique_ptr<BcmBatch> batch);
+    void completeRxFilterBatch(RxFilterApply& apply, const BcmBatch& batch);
+    static void completeProvision(ProvisionState& state);
+
+    bool sendMessage(BcmMessage msg, const char* description, BcmBatch::Completion completion = BcmBatch::Completion());
+    bool enqueue(TxCommand&& command);
+    void waitForTxQueue();
+    void drainTxQueue();
+    void flushBatch(std::unique_ptr<BcmBatch> batch);
+    void sendBatch(std::unique_ptr<BcmBatch> batch);
+    void waitForSocket(std::unique_ptr<BcmBatch> batch);
+    void completeBatch(std::unique_ptr<BcmBatch> batch);
+    static void logBatchResult(const BcmBatch& batch, const char* description);
 
     // Data members
+    std::string interfaceName;
+    bool connected = false;
+    int interfaceIndex = 0;
+    bool ownsIoContext;
+
+    // Note: The pools must outlive the io context since pending
+    // completion handlers hold buffers of the pools.
+    BcmMessagePool singleFramePool{BCM_MSG_SINGLE_FRAME_CANFD_SIZE, SINGLE_FRAME_POOL_SLOTS};
+    BcmMessagePool multipleFramesPool{BCM_MSG_MULTIPLE_FRAMES_CANFD_SIZE, MULTIPLE_FRAMES_POOL_SLOTS};
+    BcmBatchPool batchPool{BCM_BATCH_POOL_SIZE};
     boost::shared_ptr<boost::asio::io_context> ioContext;
+    std::shared_ptr<BcmTransport> transport;
     boost::asio::generic::datagram_protocol::socket bcmSocket;
-    std::array<std::uint8_t, sizeof(struct bcmMsgMultipleFramesCanFD)> rxBuffer{0};
+
+    // Note: Only used for sending, the receive filters of the socket are disabled
+    boost::asio::generic::raw_protocol::socket rawSocket;
+
+    // Submission queue between the application threads and the io context loop thread
+    MpscQueue<TxCommand, TX_QUEUE_SIZE> txQueue;
+    std::atomic<bool> txQueueWakeupPending{false};
+    boost::asio::posix::stream_descriptor txQueueEvent;
+    std::unique_ptr<BcmBatch> blockedBatch;
+    std::atomic<bool> txCongested{false};
+    boost::asio::steady_timer txBackoffTimer;
+    TxBacklog txBacklog;
+    std::atomic<size_t> txBacklogDepth{0};
+    std::unique_ptr<BcmBatch> pendingBatch;
+    BcmReceiveRing rxRing{RX_RING_SIZE, BCM_MSG_MULTIPLE_FRAMES_CANFD_SIZE};
+    std::array<BcmNotification, RX_RING_SIZE> rxNotifications;
+    RxDispatcher rxDispatcher;
+    RxFilterSet rxFilterSet;
+    std::unique_ptr<CaptureWriter> capture;
+    boost::asio::steady_timer captureTimer;
+    RxShadowCache rxShadowCache;
+    std::once_flag rxBroadcastOnce;
+    std::shared_ptr<RxBroadcastRing> rxBroadcast;
+    std::atomic<RxBroadcastRing*> rxBroadcastRing{nullptr};
+    BcmJobTable jobTable;
+    std::unordered_map<uint64_t, std::deque<JobQuery>> jobQueries;
+    uint64_t nextJobQuery = 0;
+    ConnectorMetrics metrics;
     std::thread ioContextThread;
 };
 
@@ -16,6 +16,49 @@
 // The interface that should be used
 #define INTERFACE "vcan0"
 
+// Environment variable that overrides INTERFACE at runtime
+#define INTERFACE_ENVIRONMENT_VARIABLE "CAN_BCM_INTERFACE"
+
+// The number of io context threads of a CANConnectorManager
+#define IO_CONTEXT_POOL_THREADS 2
+
+// The number of pooled BCM messages with a single frame
+#define SINGLE_FRAME_POOL_SLOTS 1024
+
+// The number of pooled BCM messages with up to MAXFRAMES frames
+#define MULTIPLE_FRAMES_POOL_SLOTS 16
+
+// The number of pooled batches that are reused for the multiple frame operations
+#define BCM_BATCH_POOL_SIZE 8
+
+// The number of commands the submission queue can hold. Must be a power of two.
+#define TX_QUEUE_SIZE 1024
+
+// The number of commands that wait in the backlog while the socket is congested
+#define TX_BACKLOG_BUDGET 512
+
+// The default number of waiting one-shot frames of a CAN ID with the Drop or OverwriteOldest policy
+#define TX_BACKLOG_PER_ID 4
+
+// The first and the longest backoff of a message that was rejected with ENOBUFS
+#define TX_ENOBUFS_BACKOFF_MIN_US 100
+#define TX_ENOBUFS_BACKOFF_MAX_US 10000
+
+// The number of ENOBUFS retries after which a message fails
+#define TX_ENOBUFS_MAX_RETRIES 32
+
+// The number of receive buffers that are drained with a single recvmmsg call
+#define RX_RING_SIZE 16
+
+// The number of notifications a RX stream buffers while no receive is pending
+#define RX_STREAM_CAPACITY 64
+
+// The number of records of the RX broadcast ring, rounded up to a power of two
+#define RX_BROADCAST_CAPACITY 4096
+
+// Send the one-shot TX_SEND frames on a CAN_RAW socket instead of the BCM socket
+#define TX_RAW_FAST_PATH true
+
 
 #endif //CAN_BCM_BOOST_ASIO_CANCONNECTORCONFIG_H
 /*******************************************************************************
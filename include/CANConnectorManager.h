@@ -0,0 +1,68 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      CANConnectorManager.h
+ \brief     The manager opens a CANConnector for each of many CAN interfaces.
+            The connectors are spread over the threads of an IoContextPool.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_CANCONNECTORMANAGER_H
+#define CAN_BCM_BOOST_ASIO_CANCONNECTORMANAGER_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "CANConnector.h"
+#include "IoContextPool.h"
+#include "ConnectorConfig.h"
+
+// System includes
+#include <string>
+#include <vector>
+#include <memory>
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class CANConnectorManager{
+
+public:
+    // Function members
+    explicit CANConnectorManager(size_t threadCount = IO_CONTEXT_POOL_THREADS, std::vector<int> cores = {});
+    CANConnectorManager(const CANConnectorManager&) = delete;
+    CANConnectorManager& operator=(const CANConnectorManager&) = delete;
+    ~CANConnectorManager();
+
+    CANConnector* addInterface(const std::string& interfaceName);
+    CANConnector* addInterface(const std::string& interfaceName, size_t threadIndex);
+    CANConnector* addInterface(const std::string& interfaceName, std::shared_ptr<BcmTransport> transport);
+    CANConnector* addInterface(const std::string& interfaceName, size_t threadIndex, std::shared_ptr<BcmTransport> transport);
+    size_t addInterfaces(const ConnectorConfig& config);
+    CANConnector* getConnector(const std::string& interfaceName) const;
+
+    size_t size() const;
+    size_t threadCount() const;
+
+    std::string getPrometheusMetrics() const;
+
+private:
+    // Function members
+    size_t leastLoadedThread() const;
+
+    // Data members
+    // Note: The io context pool must outlive the connectors
+    IoContextPool ioContextPool;
+    std::vector<size_t> connectorsPerThread;
+    std::vector<std::unique_ptr<CANConnector>> connectors;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_CANCONNECTORMANAGER_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
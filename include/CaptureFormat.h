@@ -0,0 +1,87 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      CaptureFormat.h
+ \brief     Binary capture format of the BCM traffic of a connector. A capture
+            file is a header followed by fixed-size records, so it can be
+            appended to while it is written and mapped while it is replayed.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_CAPTUREFORMAT_H
+#define CAN_BCM_BOOST_ASIO_CAPTUREFORMAT_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <cstdint>
+#include <linux/can.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+// Magic bytes at the start of a capture file
+#define CAPTURE_MAGIC "BCMCAP\0\1"
+
+// Version of the capture format
+#define CAPTURE_VERSION 1
+
+// Info bits of a capture record
+#define CAPTURE_INFO_CANFD 0x01     // The frame is a CANFD frame
+#define CAPTURE_INFO_FRAME 0x02     // The record carries a frame, e.g. not for RX_TIMEOUT
+
+
+/*******************************************************************************
+ * ENUMS
+ ******************************************************************************/
+
+/**
+ * The direction of a captured message.
+ */
+enum class CaptureDirection : std::uint8_t{
+    Rx = 0,     // Notification that was received on the BCM socket
+    Tx = 1      // Message that was sent on the BCM socket
+};
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the header of a capture file.
+ */
+struct CaptureFileHeader{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::int64_t created;       // Creation time in nanoseconds since the epoch
+    std::uint64_t reserved;
+};
+
+/**
+ * Struct for a single frame of a captured BCM message. A message with a
+ * sequence of frames results in one record per frame.
+ */
+struct CaptureRecord{
+    std::int64_t timestamp;     // Receive or send time in nanoseconds since the epoch
+    std::uint32_t opcode;       // Opcode of the bcm_msg_head
+    std::uint32_t flags;        // Flags of the bcm_msg_head
+    canid_t canID;              // CAN ID of the bcm_msg_head
+    CaptureDirection direction;
+    std::uint8_t info;          // CAPTURE_INFO bits
+    std::uint16_t reserved;
+    struct canfd_frame frame;   // The frame, a can_frame uses the first bytes
+};
+
+static_assert(sizeof(CaptureFileHeader) == 32, "The capture file header must have a fixed size");
+static_assert(sizeof(CaptureRecord) == 96, "The capture record must have a fixed size");
+
+
+#endif //CAN_BCM_BOOST_ASIO_CAPTUREFORMAT_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
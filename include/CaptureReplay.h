@@ -0,0 +1,98 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      CaptureReplay.h
+ \brief     Replay of a capture file on a connector. The file is mapped and
+            streamed record by record, so captures larger than the memory can
+            be replayed at the original or at an accelerated speed.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_CAPTUREREPLAY_H
+#define CAN_BCM_BOOST_ASIO_CAPTUREREPLAY_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "CaptureFormat.h"
+
+// System includes
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstddef>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Time in microseconds before the due time of a frame in which the
+ * replay spins instead of sleeping. Trades CPU time for pacing precision.
+ */
+#define CAPTURE_REPLAY_SPIN_US 200
+
+/**
+ * Number of bytes after which the replayed part of the mapping is released.
+ */
+#define CAPTURE_REPLAY_RELEASE_SIZE (64UL * 1024 * 1024)
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the options of a replay.
+ */
+struct CaptureReplayOptions{
+    double speed = 1.0;                             // Speed factor, 0 replays as fast as possible
+    CaptureDirection direction = CaptureDirection::Rx;  // RX_CHANGED or TX_SEND records are replayed
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class CANConnector;
+
+class CaptureReplay{
+
+public:
+    // Function members
+    explicit CaptureReplay(const std::string& path);
+    CaptureReplay(const CaptureReplay&) = delete;
+    CaptureReplay& operator=(const CaptureReplay&) = delete;
+    ~CaptureReplay();
+
+    bool isOpen() const;
+    size_t size() const;
+    const CaptureRecord& record(size_t index) const;
+
+    size_t replay(CANConnector& connector, const CaptureReplayOptions& options = CaptureReplayOptions());
+    void stop();
+
+private:
+    // Function members
+    static bool matches(const CaptureRecord& record, CaptureDirection direction);
+    static void waitUntil(std::chrono::steady_clock::time_point deadline);
+    void release(size_t index);
+
+    // Data members
+    const std::uint8_t* mapping = nullptr;
+    size_t mappingSize = 0;
+    const CaptureRecord* records = nullptr;
+    size_t recordCount = 0;
+    size_t releasedSize = 0;
+    std::atomic<bool> stopRequested{false};
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_CAPTUREREPLAY_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,119 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      CaptureWriter.h
+ \brief     Append-only writer of a capture file. The producer fills one of
+            two record buffers while a background thread writes the other
+            one, either with write or into a memory-mapped file.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_CAPTUREWRITER_H
+#define CAN_BCM_BOOST_ASIO_CAPTUREWRITER_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "CaptureFormat.h"
+
+// System includes
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstddef>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Number of records per buffer. A record is dropped if the
+ * producer fills a buffer before the other one was written.
+ */
+#define CAPTURE_BUFFER_RECORDS 4096
+
+/**
+ * Size in bytes by which a memory-mapped capture file grows.
+ */
+#define CAPTURE_MMAP_CHUNK_SIZE (64UL * 1024 * 1024)
+
+/**
+ * Interval in milliseconds in which the connector hands over
+ * a partially filled buffer, so a quiet bus is written too.
+ */
+#define CAPTURE_FLUSH_INTERVAL_MS 100
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * Note: append and flush must only be called by a single producer thread,
+ * e.g. the io context loop thread of a connector.
+ */
+class CaptureWriter{
+
+public:
+    /**
+     * Struct for the counters of a capture.
+     */
+    struct Statistics{
+        uint64_t written = 0;
+        uint64_t dropped = 0;
+    };
+
+    // Function members
+    CaptureWriter(const std::string& path, bool useMmap);
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+    ~CaptureWriter();
+
+    bool isOpen() const;
+    void append(const CaptureRecord& record);
+    bool handOver();
+    void flush();
+    Statistics statistics() const;
+
+private:
+    // Marker for the writer state
+    static constexpr int NO_BUFFER = -1;
+    static constexpr int STOP = -2;
+
+    // Function members
+    void writerThreadFunction();
+    bool writeRecords(const void* data, size_t size);
+    bool mapChunk();
+    void closeFile();
+
+    // Data members
+    int fileDescriptor = -1;
+    bool useMmap;
+    std::array<std::unique_ptr<CaptureRecord[]>, 2> buffers;
+    std::array<size_t, 2> counts{};
+    int active = 0;
+
+    // Index of the buffer the writer thread owns, NO_BUFFER or STOP
+    std::atomic<int> writing{NO_BUFFER};
+    std::atomic<uint64_t> writtenRecords{0};
+    std::atomic<uint64_t> droppedRecords{0};
+
+    // State of the memory-mapped file, only used by the writer thread
+    std::uint8_t* mapping = nullptr;
+    size_t mappingOffset = 0;
+    size_t mappingUsed = 0;
+    size_t fileSize = 0;
+
+    std::thread writerThread;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_CAPTUREWRITER_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
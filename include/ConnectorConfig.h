@@ -0,0 +1,99 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      ConnectorConfig.h
+ \brief     Runtime configuration of the interfaces with their pre-declared
+            RX filters and cyclic TX jobs. The configuration is loaded once
+            at startup and provisioned with batched submissions.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_CONNECTORCONFIG_H
+#define CAN_BCM_BOOST_ASIO_CONNECTORCONFIG_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "RxFilterSet.h"
+
+// System includes
+#include <chrono>
+#include <string>
+#include <vector>
+#include <istream>
+#include <cstdint>
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for a cyclic TX job of the configuration.
+ */
+struct TxScheduleConfig{
+    struct canfd_frame frame{};
+    bool isCANFD = false;
+    uint32_t count = 0;                     // Number of frames with ival1, zero for ival2 only
+    struct bcm_timeval ival1{};
+    struct bcm_timeval ival2{};             // The cycle time
+};
+
+/**
+ * Struct for the configuration of one interface.
+ */
+struct InterfaceConfig{
+    std::string name;
+    std::vector<RxFilter> rxFilters;
+    std::vector<TxScheduleConfig> txSchedules;
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * Line based configuration file. Empty lines and lines that start with # are
+ * ignored, the rx and tx lines belong to the interface line above them:
+ *
+ *   interface can0
+ *   rx 0x123 timeout=100ms throttle=10ms
+ *   rx 0x124 fd mask=FF00
+ *   tx 0x200 period=10ms data=0102030405060708
+ *   tx 0x18FF0001 fd count=10 ival1=1ms period=100ms data=AABB
+ *
+ * CAN IDs above 0x7FF or with the flag ext are extended CAN IDs. Durations
+ * take the units s, ms and us. The rx flags resume, dlc and noautotimer map
+ * to the RxOptions, every mask adds a content filter.
+ */
+class ConnectorConfig{
+
+public:
+    // Function members
+    bool load(const std::string& path);
+    bool parse(std::istream& input);
+
+    const std::vector<InterfaceConfig>& interfaces() const;
+    const InterfaceConfig* find(const std::string& interfaceName) const;
+
+private:
+    // Function members
+    static bool parseCanID(const std::string& token, canid_t& canID);
+    static bool parseDuration(const std::string& token, std::chrono::microseconds& duration);
+    static bool parseCount(const std::string& token, uint32_t& count);
+    static bool parseHex(const std::string& token, struct canfd_frame& frame, bool isCANFD);
+
+    // Data members
+    std::vector<InterfaceConfig> entries;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_CONNECTORCONFIG_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
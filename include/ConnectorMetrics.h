@@ -0,0 +1,234 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      ConnectorMetrics.h
+ \brief     Per-operation counters and a latency histogram of a CANConnector.
+            Every thread writes relaxed atomics of its own shard, the shards
+            are merged when a snapshot is read.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_CONNECTORMETRICS_H
+#define CAN_BCM_BOOST_ASIO_CONNECTORMETRICS_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "BcmBatch.h"
+
+// System includes
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Number of counter shards. Threads are spread round robin over the shards,
+ * so concurrent writers rarely share a cache line.
+ */
+#define METRICS_SHARDS 8
+
+/**
+ * Number of counted BCM opcodes. The opcodes of the BCM are 1 to 12.
+ */
+#define METRICS_OPCODES 13
+
+/**
+ * Number of counted errno values. Larger values are counted in the last slot.
+ */
+#define METRICS_ERRNO_SLOTS 136
+
+/**
+ * Sub-buckets of the latency histogram per power of two. 8 sub-buckets
+ * keep the relative error of a recorded value below 12.5 percent.
+ */
+#define METRICS_HISTOGRAM_SUB_BUCKETS 8
+
+/**
+ * Buckets of the latency histogram. Covers the values up to 2^40 ns (~18 min),
+ * larger values are counted in the last bucket.
+ */
+#define METRICS_HISTOGRAM_BUCKETS ((40 - 2) * METRICS_HISTOGRAM_SUB_BUCKETS)
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class ConnectorMetrics{
+
+public:
+    /**
+     * Merged copy of the counters of all shards.
+     */
+    struct Snapshot{
+        std::array<std::uint64_t, METRICS_OPCODES> txMessages{};
+        std::array<std::uint64_t, METRICS_OPCODES> rxMessages{};
+        std::uint64_t txBytes         = 0;
+        std::uint64_t rxBytes         = 0;
+        std::uint64_t txRejected      = 0;   // Submission queue full or pool exhausted
+        std::uint64_t txSocketBlocked = 0;   // sendmmsg had to wait for the socket
+        std::uint64_t txOverwritten   = 0;   // Waiting frames replaced by a newer frame of their CAN ID
+        std::uint64_t txRetries       = 0;   // ENOBUFS backoffs before a message was retried
+        std::uint64_t rxBadSize       = 0;   // Datagrams with a wrong size
+
+        // Pairs of errno and count, only the errno values that occurred
+        std::vector<std::pair<int, std::uint64_t>> txErrors;
+        std::vector<std::pair<int, std::uint64_t>> rxErrors;
+
+        std::size_t txQueueDepth    = 0;
+        std::size_t txQueueMaxDepth = 0;
+
+        // Submit to completion latency in nanoseconds, see bucketLowerBound
+        std::vector<std::uint64_t> latency;
+        std::uint64_t latencyCount = 0;
+        std::uint64_t latencySum   = 0;
+        std::uint64_t latencyMax   = 0;
+    };
+
+    // Function members
+    ConnectorMetrics() = default;
+    ConnectorMetrics(const ConnectorMetrics&) = delete;
+    ConnectorMetrics& operator=(const ConnectorMetrics&) = delete;
+
+    Snapshot snapshot() const;
+    void recordBatch(const BcmBatch& batch, std::int64_t completed);
+    void recordTxQueueDepth(std::size_t depth);
+
+    /**
+     * Counts messages that were rejected before they reached the socket.
+     *
+     * @param messages - The number of rejected messages.
+     */
+    void recordTxRejected(std::size_t messages = 1){
+        local().txRejected.fetch_add(messages, std::memory_order_relaxed);
+    }
+
+    /**
+     * Counts a batch that had to wait until the socket was writable.
+     */
+    void recordTxSocketBlocked(){
+        local().txSocketBlocked.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Counts a waiting frame that was replaced by a newer frame of its CAN ID.
+     */
+    void recordTxOverwritten(){
+        local().txOverwritten.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Counts a backoff after the interface rejected a message with ENOBUFS.
+     */
+    void recordTxRetry(){
+        local().txRetries.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Counts a received BCM message.
+     *
+     * @param opcode - The opcode of the bcm_msg_head.
+     * @param bytes  - The size of the datagram.
+     */
+    void recordRx(std::uint32_t opcode, std::size_t bytes){
+        Shard& shard = local();
+        shard.rxMessages[opcode < METRICS_OPCODES ? opcode : 0].fetch_add(1, std::memory_order_relaxed);
+        shard.rxBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /**
+     * Counts a datagram that was dropped because of its size.
+     */
+    void recordRxBadSize(){
+        local().rxBadSize.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Counts a failed receive operation.
+     *
+     * @param error - The errno of the operation.
+     */
+    void recordRxError(int error){
+        local().rxErrors[errnoSlot(error)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns the current time of the clock that is used for the latencies.
+     *
+     * @return The time in nanoseconds.
+     */
+    static std::int64_t now(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static std::size_t bucketIndex(std::uint64_t value);
+    static std::uint64_t bucketLowerBound(std::size_t index);
+    static std::uint64_t percentile(const Snapshot& snapshot, double quantile);
+    static std::string toPrometheus(const std::vector<std::pair<std::string, Snapshot>>& snapshots);
+
+private:
+    /**
+     * Counters of the threads that are mapped to a shard.
+     */
+    struct alignas(64) Shard{
+        std::array<std::atomic<std::uint64_t>, METRICS_OPCODES> txMessages{};
+        std::array<std::atomic<std::uint64_t>, METRICS_OPCODES> rxMessages{};
+        std::atomic<std::uint64_t> txBytes{0};
+        std::atomic<std::uint64_t> rxBytes{0};
+        std::atomic<std::uint64_t> txRejected{0};
+        std::atomic<std::uint64_t> txSocketBlocked{0};
+        std::atomic<std::uint64_t> txOverwritten{0};
+        std::atomic<std::uint64_t> txRetries{0};
+        std::atomic<std::uint64_t> rxBadSize{0};
+        std::array<std::atomic<std::uint64_t>, METRICS_ERRNO_SLOTS> txErrors{};
+        std::array<std::atomic<std::uint64_t>, METRICS_ERRNO_SLOTS> rxErrors{};
+        std::array<std::atomic<std::uint64_t>, METRICS_HISTOGRAM_BUCKETS> latency{};
+        std::atomic<std::uint64_t> latencySum{0};
+        std::atomic<std::uint64_t> latencyMax{0};
+    };
+
+    /**
+     * Returns the shard of the calling thread.
+     *
+     * @return The shard.
+     */
+    Shard& local(){
+        static thread_local const std::size_t index = threadCounter.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+        return shards[index];
+    }
+
+    /**
+     * Maps an errno to its counter slot.
+     *
+     * @param error - The errno.
+     * @return The slot.
+     */
+    static std::size_t errnoSlot(int error){
+        return (error > 0 && error < METRICS_ERRNO_SLOTS) ? static_cast<std::size_t>(error) : METRICS_ERRNO_SLOTS - 1;
+    }
+
+    // Data members
+    static std::atomic<std::size_t> threadCounter;
+    std::array<Shard, METRICS_SHARDS> shards;
+
+    // Written by the io context loop thread only
+    std::atomic<std::size_t> txQueueMaxDepth{0};
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_CONNECTORMETRICS_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,186 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      Gateway.h
+ \brief     Gateway between the CAN interfaces of a connector manager and UDP
+            links. Routing rules forward the RX_CHANGED notifications of a
+            range of CAN IDs to another interface or into UDP datagrams and
+            the frames of received datagrams back to the interfaces.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_GATEWAY_H
+#define CAN_BCM_BOOST_ASIO_GATEWAY_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "CANConnectorManager.h"
+#include "GatewayDatagram.h"
+#include "BcmReceiveRing.h"
+
+// System includes
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <linux/can.h>
+
+#include <utility>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Largest number of CAN IDs of a rule. Every CAN ID of a rule with a CAN
+ * source needs a RX filter on the source interface.
+ */
+#define GATEWAY_MAX_RULE_IDS 512
+
+/**
+ * Number of datagrams that are drained from a UDP link with a single recvmmsg call.
+ */
+#define GATEWAY_RX_RING_SIZE 32
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for a routing rule. Source and destination are the name of an
+ * interface of the connector manager or the name of a UDP link.
+ */
+struct GatewayRule{
+    std::string source;
+    std::string destination;
+    canid_t firstCanID = 0;                     // Extended CAN IDs must have the CAN_EFF_FLAG set
+    canid_t lastCanID = 0;
+    bool isCANFD = false;                       // Frame type of the RX filters on a CAN source
+    bool rewrite = false;                       // Map the range to the range starting at rewriteCanID
+    canid_t rewriteCanID = 0;
+    std::chrono::microseconds minInterval{0};   // Rate limit per CAN ID, zero forwards every frame
+    uint16_t channel = 0;                       // Channel of the UDP records, a UDP source only matches its channel
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class Gateway{
+
+public:
+    /**
+     * Snapshot of the counters of the gateway.
+     */
+    struct Statistics{
+        uint64_t forwarded = 0;             // Frames handed to a destination
+        uint64_t rateLimited = 0;
+        uint64_t datagramsSent = 0;
+        uint64_t datagramsDropped = 0;      // Datagrams the UDP socket did not take
+        uint64_t datagramsReceived = 0;
+        uint64_t malformed = 0;             // Received datagrams with a bad header or record
+    };
+
+    // Function members
+    explicit Gateway(CANConnectorManager& manager);
+    Gateway(const Gateway&) = delete;
+    Gateway& operator=(const Gateway&) = delete;
+    ~Gateway();
+
+    bool addUdpLink(const std::string& name, uint16_t localPort, const std::string& remoteAddress, uint16_t remotePort);
+    bool addRule(const GatewayRule& rule);
+    bool start();
+    Statistics statistics() const;
+
+private:
+    struct UdpLink;
+
+    /**
+     * Struct for the outgoing datagrams of a port to a UDP link.
+     */
+    struct Egress{
+        UdpLink* link = nullptr;
+        GatewayDatagramBatch batch;
+        bool flushPending = false;
+    };
+
+    /**
+     * Struct for a rule with its resolved destination and rate limit state.
+     */
+    struct Route{
+        GatewayRule rule;
+        CANConnector* connector = nullptr;
+        Egress* egress = nullptr;
+        std::vector<int64_t> lastForward;
+    };
+
+    /**
+     * Struct for the routes of one source. The routes are only used in the
+     * io context thread of the source, so they need no synchronization.
+     */
+    struct Port{
+        Port(boost::asio::io_context::executor_type executor, CANConnector* connector) :
+            executor(executor), connector(connector){}
+
+        boost::asio::io_context::executor_type executor;
+        CANConnector* connector;                // Empty for a UDP link
+        std::vector<Route> routes;
+        std::vector<std::unique_ptr<Egress>> egresses;
+    };
+
+    /**
+     * Struct for a UDP link with its receive buffers.
+     */
+    struct UdpLink{
+        explicit UdpLink(boost::asio::io_context& context) : socket(context){}
+
+        std::string name;
+        boost::asio::ip::udp::socket socket;
+        boost::asio::ip::udp::endpoint remote;
+        BcmReceiveRing ring{GATEWAY_RX_RING_SIZE, 2 * GATEWAY_DATAGRAM_SIZE};
+        Port* port = nullptr;
+    };
+
+    // Function members
+    Port* portOf(CANConnector* connector);
+    UdpLink* linkOf(const std::string& name) const;
+    void installFilters(const Port& port, bool remove);
+    void receiveOnLink(UdpLink& link);
+    void forward(Port& port, const struct canfd_frame& frame, bool isCANFD, int64_t timestamp, int channel);
+    void flush(Egress& egress);
+
+    // Data members
+    CANConnectorManager& manager;
+    boost::asio::io_context ioContext;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> workGuard;
+    std::vector<std::unique_ptr<UdpLink>> links;
+    std::vector<std::unique_ptr<Port>> ports;
+    std::thread ioContextThread;
+    bool started = false;
+
+    // Counters, written by the io context threads of the sources
+    std::atomic<uint64_t> forwardedFrames{0};
+    std::atomic<uint64_t> rateLimitedFrames{0};
+    std::atomic<uint64_t> sentDatagrams{0};
+    std::atomic<uint64_t> droppedDatagrams{0};
+    std::atomic<uint64_t> receivedDatagrams{0};
+    std::atomic<uint64_t> malformedDatagrams{0};
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_GATEWAY_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
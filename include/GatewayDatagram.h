@@ -0,0 +1,148 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      GatewayDatagram.h
+ \brief     Wire format of the UDP datagrams of the gateway. A datagram holds
+            a header and a sequence of CAN/CANFD frame records. The batch
+            packs the records into datagrams that are sent with a single
+            sendmmsg call, the reader decodes a received datagram in place.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_GATEWAYDATAGRAM_H
+#define CAN_BCM_BOOST_ASIO_GATEWAYDATAGRAM_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// System includes
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+// Marker and version of the datagrams, "CGW1"
+#define GATEWAY_DATAGRAM_MAGIC 0x43475731
+#define GATEWAY_DATAGRAM_VERSION 1
+
+/**
+ * Size of a datagram in bytes. Fits into the MTU of an Ethernet link
+ * with the IPv6 and UDP headers, so datagrams are never fragmented.
+ */
+#define GATEWAY_DATAGRAM_SIZE 1400
+
+/**
+ * Number of datagrams that are sent with a single sendmmsg call.
+ */
+#define GATEWAY_DATAGRAM_BATCH 32
+
+// Flags of a record
+#define GATEWAY_RECORD_CANFD 0x01
+#define GATEWAY_RECORD_BRS   0x02
+#define GATEWAY_RECORD_ESI   0x04
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Header of a datagram. All fields are in network byte order.
+ */
+struct GatewayDatagramHeader{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t records;
+    uint64_t sequence;                  // Counts the datagrams of a sender
+};
+
+/**
+ * Header of a record, followed by the length data bytes of the frame.
+ * All fields are in network byte order.
+ */
+struct GatewayRecordHeader{
+    uint32_t canID;                     // SocketCAN CAN ID with the EFF, RTR and ERR flags
+    uint16_t channel;                   // Channel of the routing rule
+    uint8_t flags;
+    uint8_t length;
+    int64_t timestamp;                  // Receive time of the frame in nanoseconds
+};
+
+static_assert(sizeof(GatewayDatagramHeader) == 16, "The datagram header is part of the wire format");
+static_assert(sizeof(GatewayRecordHeader) == 16, "The record header is part of the wire format");
+
+/**
+ * Struct for a decoded record.
+ */
+struct GatewayRecord{
+    uint16_t channel = 0;
+    bool isCANFD = false;
+    struct canfd_frame frame{};
+    int64_t timestamp = 0;
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class GatewayDatagramBatch{
+
+public:
+    // Function members
+    GatewayDatagramBatch();
+    GatewayDatagramBatch(const GatewayDatagramBatch&) = delete;
+    GatewayDatagramBatch& operator=(const GatewayDatagramBatch&) = delete;
+
+    bool add(uint16_t channel, const struct canfd_frame& frame, bool isCANFD, int64_t timestamp);
+    bool empty() const;
+    size_t datagrams() const;
+    int sendOn(int fileDescriptor, const struct sockaddr* destination, socklen_t destinationLength);
+
+private:
+    // Function members
+    void finishDatagram();
+
+    // Data members
+    std::array<std::array<uint8_t, GATEWAY_DATAGRAM_SIZE>, GATEWAY_DATAGRAM_BATCH> buffers;
+    std::array<struct iovec, GATEWAY_DATAGRAM_BATCH> iovecs{};
+    std::array<struct mmsghdr, GATEWAY_DATAGRAM_BATCH> headers{};
+    size_t count = 0;                   // Datagrams with records
+    size_t used = 0;                    // Bytes of the current datagram
+    uint16_t records = 0;               // Records of the current datagram
+    uint64_t sequence = 0;
+};
+
+class GatewayDatagramReader{
+
+public:
+    // Function members
+    GatewayDatagramReader(const uint8_t* data, size_t size);
+
+    bool valid() const;
+    uint64_t sequence() const;
+    bool next(GatewayRecord& record);
+
+private:
+    // Data members
+    const uint8_t* data;
+    size_t size;
+    size_t offset = 0;
+    uint16_t remaining = 0;
+    uint64_t datagramSequence = 0;
+    bool isValid = false;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_GATEWAYDATAGRAM_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,163 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      InplaceFunction.h
+ \brief     Type-erased callable with a fixed small buffer. In contrast to
+            std::function it never allocates: callables that do not fit
+            into the buffer are rejected at compile time.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_INPLACEFUNCTION_H
+#define CAN_BCM_BOOST_ASIO_INPLACEFUNCTION_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Default size in bytes of the buffer for the callable.
+ * Enough for a lambda that captures up to six pointers.
+ */
+#define INPLACE_FUNCTION_CAPACITY 48
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+template<typename Signature, size_t Capacity = INPLACE_FUNCTION_CAPACITY>
+class InplaceFunction;
+
+template<typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>{
+
+public:
+    InplaceFunction() noexcept = default;
+
+    /**
+     * Stores a copy of the callable in the buffer.
+     *
+     * @param callable - The callable that should be stored.
+     */
+    template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, InplaceFunction>>>
+    InplaceFunction(F&& callable){
+
+        using T = std::decay_t<F>;
+
+        static_assert(sizeof(T) <= Capacity, "The callable does not fit into the InplaceFunction");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "The callable is over-aligned");
+        static_assert(std::is_copy_constructible_v<T>, "The callable must be copy constructible");
+        static_assert(std::is_nothrow_move_constructible_v<T>, "The callable must be nothrow move constructible");
+
+        new(storage) T(std::forward<F>(callable));
+        invoker = &invoke<T>;
+        manager = &manage<T>;
+    }
+
+    InplaceFunction(const InplaceFunction& other) : invoker(other.invoker), manager(other.manager){
+        if(manager != nullptr){
+            manager(Operation::Copy, storage, const_cast<unsigned char*>(other.storage));
+        }
+    }
+
+    InplaceFunction(InplaceFunction&& other) noexcept : invoker(other.invoker), manager(other.manager){
+        if(manager != nullptr){
+            manager(Operation::Move, storage, other.storage);
+            other.reset();
+        }
+    }
+
+    InplaceFunction& operator=(const InplaceFunction& other){
+        if(this != &other){
+            InplaceFunction copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    InplaceFunction& operator=(InplaceFunction&& other) noexcept{
+        if(this != &other){
+            reset();
+            invoker = other.invoker;
+            manager = other.manager;
+
+            if(manager != nullptr){
+                manager(Operation::Move, storage, other.storage);
+                other.reset();
+            }
+        }
+        return *this;
+    }
+
+    ~InplaceFunction(){
+        reset();
+    }
+
+    /**
+     * Destroys the stored callable.
+     */
+    void reset() noexcept{
+        if(manager != nullptr){
+            manager(Operation::Destroy, storage, nullptr);
+            invoker = nullptr;
+            manager = nullptr;
+        }
+    }
+
+    explicit operator bool() const noexcept{
+        return invoker != nullptr;
+    }
+
+    R operator()(Args... args) const{
+        return invoker(const_cast<unsigned char*>(storage), std::forward<Args>(args)...);
+    }
+
+private:
+    enum class Operation{
+        Copy,
+        Move,
+        Destroy
+    };
+
+    template<typename T>
+    static R invoke(void* callable, Args... args){
+        return (*static_cast<T*>(callable))(std::forward<Args>(args)...);
+    }
+
+    template<typename T>
+    static void manage(Operation operation, void* destination, void* source){
+        switch(operation){
+            case Operation::Copy:
+                new(destination) T(*static_cast<const T*>(source));
+                break;
+            case Operation::Move:
+                new(destination) T(std::move(*static_cast<T*>(source)));
+                break;
+            case Operation::Destroy:
+                static_cast<T*>(destination)->~T();
+                break;
+        }
+    }
+
+    // Data members
+    alignas(std::max_align_t) unsigned char storage[Capacity]{};
+    R (*invoker)(void*, Args...) = nullptr;
+    void (*manager)(Operation, void*, void*) = nullptr;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_INPLACEFUNCTION_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,61 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      IoContextPool.h
+ \brief     A pool of io contexts with one loop thread per io context.
+            The threads can be pinned to CPU cores, so busy CAN channels
+            can be spread over the cores without sharing a thread.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_IOCONTEXTPOOL_H
+#define CAN_BCM_BOOST_ASIO_IOCONTEXTPOOL_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <vector>
+#include <thread>
+#include <cstddef>
+// Note: Boost 1.74 uses std::exchange in awaitable.hpp without including <utility>
+#include <utility>
+#include <boost/asio.hpp>
+#include <boost/make_shared.hpp>
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class IoContextPool{
+
+public:
+    // Function members
+    explicit IoContextPool(size_t threadCount, std::vector<int> cores = {});
+    IoContextPool(const IoContextPool&) = delete;
+    IoContextPool& operator=(const IoContextPool&) = delete;
+    ~IoContextPool();
+
+    void start();
+    void stop();
+
+    size_t size() const;
+    const boost::shared_ptr<boost::asio::io_context>& context(size_t index) const;
+
+private:
+    // Function members
+    void threadFunction(size_t index);
+
+    // Data members
+    std::vector<boost::shared_ptr<boost::asio::io_context>> contexts;
+    std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> workGuards;
+    std::vector<int> cores;
+    std::vector<std::thread> threads;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_IOCONTEXTPOOL_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,245 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      IsoTpChannel.h
+ \brief     ISO-TP (ISO 15765-2) transport channel on top of a CANConnector.
+            A channel segments and reassembles the messages of one pair of
+            CAN IDs with normal addressing. Consecutive frames are sent in
+            batches that are paced by the flow control frames of the peer.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_ISOTPCHANNEL_H
+#define CAN_BCM_BOOST_ASIO_ISOTPCHANNEL_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "AsyncCompletion.h"
+#include "RxDispatcher.h"
+
+// System includes
+#include <deque>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <linux/can.h>
+#include <boost/asio/post.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/async_result.hpp>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Default of the largest message a channel reassembles. Larger first
+ * frames are answered with a flow control overflow frame.
+ */
+#define ISOTP_DEFAULT_MAX_MESSAGE_SIZE (16 * 1024 * 1024)
+
+/**
+ * Number of consecutive frames in one batch if the peer allows a STmin of zero.
+ */
+#define ISOTP_TX_BATCH_FRAMES 64
+
+/**
+ * Number of batches of consecutive frames that are in flight at the same time.
+ * The next batch is built while the previous one is sent.
+ */
+#define ISOTP_TX_PIPELINE_DEPTH 2
+
+/**
+ * Number of reassembled messages a channel buffers while no receive is pending.
+ */
+#define ISOTP_RX_QUEUE_SIZE 8
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the configuration of an ISO-TP channel.
+ */
+struct IsoTpOptions{
+    canid_t txID = 0;                               // CAN ID of the sent frames
+    canid_t rxID = 0;                               // CAN ID of the received frames
+    bool isCANFD = false;
+    uint8_t frameLength = 64;                       // TX_DL of CANFD frames, 8, 12, 16, 20, 24, 32, 48 or 64
+    bool bitRateSwitch = true;                      // CANFD_BRS for CANFD frames
+    bool padding = true;                            // Pad the frames to a full DLC
+    uint8_t paddingByte = 0xCC;
+    uint8_t blockSize = 0;                          // BS of the sent flow control frames, 0 = no limit
+    std::chrono::microseconds stMin{0};             // STmin of the sent flow control frames
+    std::chrono::milliseconds timeout{1000};        // N_Bs and N_Cr
+    uint32_t maxWaitFrames = 10;                    // N_WFTmax
+    size_t maxMessageSize = ISOTP_DEFAULT_MAX_MESSAGE_SIZE;
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class CANConnector;
+class BcmBatch;
+
+class IsoTpChannel : public std::enable_shared_from_this<IsoTpChannel>{
+
+public:
+    // Completion of a send operation
+    using SendCompletion = AsyncCompletionPtr<>;
+
+    // Completion of a receive operation
+    using ReceiveCompletion = AsyncCompletionPtr<std::vector<uint8_t>>;
+
+    // Function members
+    IsoTpChannel(boost::asio::io_context& context, CANConnector& connector, const IsoTpOptions& options);
+    IsoTpChannel(const IsoTpChannel&) = delete;
+    IsoTpChannel& operator=(const IsoTpChannel&) = delete;
+
+    const IsoTpOptions& options() const;
+    size_t overruns() const;
+
+    /**
+     * Sends a message. Messages of the channel are sent one after the other,
+     * a send that is started while another one is running is queued.
+     *
+     * @param data  - The payload of the message, 1 byte up to 4 GiB.
+     * @param token - The completion token with the signature void(boost::system::error_code).
+     * @return The result of the completion token.
+     */
+    template<typename CompletionToken>
+    auto asyncSend(std::vector<uint8_t> data, CompletionToken&& token){
+
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+            [self = shared_from_this()](auto&& handler, std::vector<uint8_t> payload) mutable{
+
+                auto completion = makeAsyncCompletion<>(std::move(handler), self->executor);
+
+                // The state of the channel is only touched in the io context loop thread
+                boost::asio::post(self->executor, [self, payload = std::move(payload), completion = std::move(completion)]() mutable{
+                    self->startSend(std::move(payload), std::move(completion));
+                });
+
+            }, token, std::move(data));
+    }
+
+    /**
+     * Waits for the next reassembled message. Only one receive may be pending
+     * at a time. A failed reception completes the pending receive with
+     * timed_out or protocol_error, a closed channel with operation_aborted.
+     *
+     * @param token - The completion token with the signature void(boost::system::error_code, std::vector<uint8_t>).
+     * @return The result of the completion token.
+     */
+    template<typename CompletionToken>
+    auto asyncReceive(CompletionToken&& token){
+
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::vector<uint8_t>)>(
+            [self = shared_from_this()](auto&& handler) mutable{
+
+                auto completion = makeAsyncCompletion<std::vector<uint8_t>>(std::move(handler), self->executor);
+
+                boost::asio::post(self->executor, [self, completion = std::move(completion)]() mutable{
+                    self->startReceive(std::move(completion));
+                });
+
+            }, token);
+    }
+
+private:
+    friend class CANConnector;
+
+    enum class TxState{
+        Idle,               // No message is sent
+        SingleFrame,        // The single frame waits for its transmission
+        WaitFlowControl,    // N_Bs is running
+        Sending             // Consecutive frames are sent
+    };
+
+    /**
+     * Struct for a message that waits for its transmission.
+     */
+    struct PendingSend{
+        std::vector<uint8_t> data;
+        SendCompletion completion;
+    };
+
+    // Function members
+    void push(const BcmNotification& notification);
+    void close();
+
+    void startSend(std::vector<uint8_t> data, SendCompletion completion);
+    void startNextSend();
+    void finishSend(const boost::system::error_code& errorCode);
+    void handleFlowControl(const uint8_t* data, size_t length);
+    void pumpConsecutiveFrames();
+    void completeTxBatch(uint64_t generation, const BcmBatch& batch);
+    void armFlowControlTimeout();
+
+    void startReceive(ReceiveCompletion completion);
+    void handleFirstFrame(const uint8_t* data, size_t length);
+    void handleConsecutiveFrame(const uint8_t* data, size_t length);
+    void deliver(std::vector<uint8_t> message);
+    void abortReceive(const boost::system::error_code& errorCode);
+    void armConsecutiveTimeout();
+    void sendFlowControl(uint8_t status);
+
+    struct canfd_frame makeFrame(const uint8_t* pci, size_t pciLength, const uint8_t* payload, size_t payloadLength) const;
+    size_t frameSize(size_t used) const;
+    size_t consecutiveCapacity() const;
+    static std::chrono::microseconds decodeSeparationTime(uint8_t stMin);
+    static uint8_t encodeSeparationTime(std::chrono::microseconds stMin);
+
+    // Data members
+    boost::asio::io_context::executor_type executor;
+    CANConnector& connector;
+    IsoTpOptions channelOptions;
+    size_t txDataLength;
+    bool open = true;
+
+    // Transmission state, only accessed in the io context loop thread
+    std::deque<PendingSend> sendQueue;
+    TxState txState = TxState::Idle;
+    size_t txOffset = 0;
+    uint8_t txSequence = 0;
+    bool txBlockLimited = false;
+    uint32_t txBlockRemaining = 0;
+    uint32_t txWaitFrames = 0;
+    size_t txInFlight = 0;
+    uint64_t txGeneration = 0;
+    bool txSeparationPending = false;
+    std::chrono::microseconds txSeparation{0};
+    boost::asio::steady_timer txTimer;
+    boost::asio::steady_timer separationTimer;
+
+    // Reception state, only accessed in the io context loop thread
+    bool receiving = false;
+    std::vector<uint8_t> rxBuffer;
+    size_t rxLength = 0;
+    uint8_t rxSequence = 0;
+    uint32_t rxBlockCount = 0;
+    boost::asio::steady_timer rxTimer;
+    std::deque<std::vector<uint8_t>> received;
+    ReceiveCompletion waiter;
+    std::atomic<size_t> overrunCount{0};
+};
+
+/**
+ * Handle of an ISO-TP channel. The channel stays registered until it is closed on its connector.
+ */
+using IsoTpChannelHandle = std::shared_ptr<IsoTpChannel>;
+
+
+#endif //CAN_BCM_BOOST_ASIO_ISOTPCHANNEL_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,221 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      Log.h
+ \brief     Logging with levels that can be compiled out and an optional
+            asynchronous lock-free sink. Messages below LOG_COMPILE_LEVEL
+            cost nothing, messages below the runtime level cost a compare.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_LOG_H
+#define CAN_BCM_BOOST_ASIO_LOG_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <atomic>
+#include <thread>
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * The lowest level that is compiled into the binary. Messages with a lower
+ * level are removed by the compiler. Can be set with -DLOG_COMPILE_LEVEL=n.
+ * 0 = Debug, 1 = Info, 2 = Warning, 3 = Error, 4 = Off
+ */
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL 2
+#else
+#define LOG_COMPILE_LEVEL 0
+#endif
+#endif
+
+/**
+ * Maximum length of a single log message. Longer messages are truncated.
+ */
+#define LOG_RECORD_SIZE 256
+
+/**
+ * Number of messages the asynchronous sink can buffer. Must be a power of two.
+ * Messages are dropped and counted if the buffer is full.
+ */
+#define LOG_ASYNC_QUEUE_SIZE 1024
+
+
+/*******************************************************************************
+ * ENUMS
+ ******************************************************************************/
+
+enum class LogLevel : int{
+    Debug   = 0,
+    Info    = 1,
+    Warning = 2,
+    Error   = 3,
+    Off     = 4
+};
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for a formatted log message.
+ */
+struct LogRecord{
+    LogLevel level = LogLevel::Info;
+    size_t length = 0;
+    char text[LOG_RECORD_SIZE];
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class Log{
+
+public:
+    // Function members
+    static void setLevel(LogLevel level);
+    static LogLevel getLevel();
+
+    static void startAsync();
+    static void stopAsync();
+    static size_t dropped();
+
+    /**
+     * Checks at compile time and at runtime if a level is logged.
+     *
+     * @return True if messages of the level are logged.
+     */
+    template<LogLevel Level>
+    static bool enabled(){
+        if constexpr(static_cast<int>(Level) < LOG_COMPILE_LEVEL){
+            return false;
+        }else{
+            return static_cast<int>(Level) >= runtimeLevel.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Formats the arguments with operator<< and writes the message to the sink.
+     *
+     * @param args - The parts of the message.
+     */
+    template<LogLevel Level, typename... Args>
+    static void write(const Args&... args){
+        if constexpr(static_cast<int>(Level) >= LOG_COMPILE_LEVEL){
+
+            if(!enabled<Level>()){
+                return;
+            }
+
+            LogRecord record;
+            record.level = Level;
+
+            // Note: The stream is reused, so a message does not construct a std::ostream
+            Formatter& format = formatter();
+            format.begin(record);
+            (format.stream << ... << args);
+
+            record.length = format.buffer.length();
+            output(record);
+        }
+    }
+
+    template<typename... Args>
+    static void debug(const Args&... args){ write<LogLevel::Debug>(args...); }
+
+    template<typename... Args>
+    static void info(const Args&... args){ write<LogLevel::Info>(args...); }
+
+    template<typename... Args>
+    static void warning(const Args&... args){ write<LogLevel::Warning>(args...); }
+
+    template<typename... Args>
+    static void error(const Args&... args){ write<LogLevel::Error>(args...); }
+
+private:
+    /**
+     * Stream buffer that formats into the fixed text of a record
+     * and silently truncates the message if it is too long.
+     */
+    class RecordBuffer : public std::streambuf{
+
+    public:
+        void reset(LogRecord& record){
+            setp(record.text, record.text + LOG_RECORD_SIZE);
+        }
+
+        size_t length() const{
+            return pptr() - pbase();
+        }
+
+    protected:
+        int_type overflow(int_type ch) override{
+            return traits_type::not_eof(ch);
+        }
+    };
+
+    /**
+     * Stream of a thread that formats the messages into the record buffer.
+     */
+    struct Formatter{
+        RecordBuffer buffer;
+        std::ostream stream{&buffer};
+        std::ios_base::fmtflags flags = stream.flags();
+
+        /**
+         * Points the stream to a record and resets the format state of the previous message.
+         *
+         * @param record - The record the message is formatted into.
+         */
+        void begin(LogRecord& record){
+            buffer.reset(record);
+            stream.clear();
+            stream.flags(flags);
+            stream.width(0);
+            stream.precision(6);
+            stream.fill(' ');
+        }
+    };
+
+    /**
+     * Returns the formatter of the calling thread.
+     *
+     * @return The formatter.
+     */
+    static Formatter& formatter(){
+        thread_local Formatter instance;
+        return instance;
+    }
+
+    // Function members
+    static void output(const LogRecord& record);
+    static void drainQueue();
+    static void print(const LogRecord& record);
+    static void wakeWriter(bool force);
+    static void writerThreadFunction();
+
+    // Data members
+    static std::atomic<int> runtimeLevel;
+    static std::atomic<bool> asyncEnabled;
+    static std::atomic<size_t> droppedRecords;
+    static std::thread writerThread;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_LOG_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,97 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      MetricsEndpoint.h
+ \brief     Minimal HTTP endpoint that serves the metrics of the connectors in
+            the Prometheus text format on GET /metrics. It runs on an io
+            context of the application and is only created on demand.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_METRICSENDPOINT_H
+#define CAN_BCM_BOOST_ASIO_METRICSENDPOINT_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "InplaceFunction.h"
+
+// System includes
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstdint>
+// Note: Boost 1.74 uses std::exchange in awaitable.hpp without including <utility>
+#include <utility>
+#include <boost/asio.hpp>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Maximum size in bytes of a HTTP request header. Larger requests are dropped.
+ */
+#define METRICS_ENDPOINT_MAX_REQUEST 4096
+
+/**
+ * Backoff in milliseconds after a failed accept, e.g. with EMFILE. The backoff
+ * doubles with every further failure up to the maximum.
+ */
+#define METRICS_ENDPOINT_ACCEPT_BACKOFF_MS 10
+#define METRICS_ENDPOINT_ACCEPT_BACKOFF_MAX_MS 1000
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class MetricsEndpoint{
+
+public:
+    // Function that returns the metrics text of a scrape
+    using Provider = InplaceFunction<std::string()>;
+
+    // Function members
+    MetricsEndpoint(boost::asio::io_context& context, uint16_t port, Provider provider, const std::string& address = "0.0.0.0");
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+    ~MetricsEndpoint();
+
+    bool isOpen() const;
+    uint16_t port() const;
+
+private:
+    /**
+     * State of a single HTTP connection.
+     */
+    struct Session{
+        explicit Session(boost::asio::ip::tcp::socket socket) : socket(std::move(socket)),
+            request(METRICS_ENDPOINT_MAX_REQUEST){}
+
+        boost::asio::ip::tcp::socket socket;
+        boost::asio::streambuf request;
+        std::string response;
+    };
+
+    // Function members
+    void accept();
+    static void serve(const std::shared_ptr<Session>& session, const std::shared_ptr<Provider>& provider);
+
+    // Data members
+    boost::asio::ip::tcp::acceptor acceptor;
+    boost::asio::steady_timer acceptTimer;
+    std::chrono::milliseconds acceptBackoff{0};     // Zero while the accepts succeed
+
+    // Note: Shared with the sessions, so a running scrape survives the endpoint
+    std::shared_ptr<Provider> provider;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_METRICSENDPOINT_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
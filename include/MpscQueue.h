@@ -0,0 +1,146 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      MpscQueue.h
+ \brief     Bounded lock-free multi producer single consumer queue. The
+            producers never block and never allocate. A full queue is
+            reported to the producer instead.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_MPSCQUEUE_H
+#define CAN_BCM_BOOST_ASIO_MPSCQUEUE_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <utility>
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * Every cell has a sequence number that tells the producers and the consumer
+ * who owns the cell. A producer claims a position with a compare exchange,
+ * so only the position counters are contended.
+ *
+ * Capacity must be a power of two.
+ */
+template<typename T, size_t Capacity>
+class MpscQueue{
+
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "The capacity must be a power of two");
+
+public:
+    MpscQueue() : cells(new Cell[Capacity]){
+        for(size_t index = 0; index < Capacity; index++){
+            cells[index].sequence.store(index, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * Puts an element into the queue. Can be called from any thread.
+     *
+     * @param value - The element.
+     * @return False if the queue is full. The element is not moved then.
+     */
+    bool push(T&& value){
+
+        size_t position = enqueuePos.load(std::memory_order_relaxed);
+
+        while(true){
+
+            Cell& cell = cells[position & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+            if(difference == 0){
+
+                // The cell is free, try to claim it
+                if(enqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+
+            }else if(difference < 0){
+
+                // The consumer did not free the cell yet, the queue is full
+                return false;
+
+            }else{
+                position = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+    }
+
+    bool push(const T& value){
+        T copy(value);
+        return push(std::move(copy));
+    }
+
+    /**
+     * Takes the oldest element from the queue. Must only be called by the consumer thread.
+     *
+     * @param value - The oldest element.
+     * @return False if the queue is empty.
+     */
+    bool pop(T& value){
+
+        size_t position = dequeuePos.load(std::memory_order_relaxed);
+        Cell& cell = cells[position & (Capacity - 1)];
+
+        // Check if a producer already finished writing the cell
+        if(cell.sequence.load(std::memory_order_acquire) != position + 1){
+            return false;
+        }
+
+        value = std::move(cell.value);
+        cell.sequence.store(position + Capacity, std::memory_order_release);
+        dequeuePos.store(position + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    /**
+     * Returns the approximate number of elements in the queue.
+     *
+     * @return The number of queued elements.
+     */
+    size_t size() const{
+        size_t enqueued = enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeued = dequeuePos.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    static constexpr size_t capacity(){
+        return Capacity;
+    }
+
+private:
+    struct Cell{
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    // Data members
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) std::atomic<size_t> dequeuePos{0};
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_MPSCQUEUE_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,135 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxBroadcastRing.h
+ \brief     Single producer, multiple consumer broadcast ring of the received
+            notifications. The io context thread writes every notification
+            once, every reader follows the ring with its own cursor. A slow
+            reader never stalls the reception, it detects its overruns.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_RXBROADCASTRING_H
+#define CAN_BCM_BOOST_ASIO_RXBROADCASTRING_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "RxDispatcher.h"
+
+// System includes
+#include <array>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <linux/can.h>
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for a record of the ring. A notification with several frames is
+ * written as one record per frame, a notification without frames as one
+ * record with an empty frame. The struct is trivial, because the ring
+ * copies it word by word, so value-initialize it with {}.
+ */
+struct RxBroadcastRecord{
+    uint32_t opcode;
+    uint32_t flags;
+    canid_t canID;
+    bool isCANFD;
+    struct canfd_frame frame;
+    int64_t timestamp;              // Kernel receive time in nanoseconds since the epoch
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class RxBroadcastReader;
+
+class RxBroadcastRing{
+
+public:
+    // Function members
+    explicit RxBroadcastRing(size_t capacity);
+    RxBroadcastRing(const RxBroadcastRing&) = delete;
+    RxBroadcastRing& operator=(const RxBroadcastRing&) = delete;
+
+    void publish(const BcmNotification& notification);
+    void commit();
+    void close();
+
+    size_t capacity() const;
+    uint64_t committed() const;
+
+private:
+    friend class RxBroadcastReader;
+
+    static_assert(std::is_trivially_copyable_v<RxBroadcastRecord>, "The records are copied word by word");
+    static_assert(std::is_trivial_v<RxBroadcastRecord>, "The records must not have default member initializers");
+
+    // Number of 64 bit words of a record
+    static constexpr size_t recordWords = (sizeof(RxBroadcastRecord) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    /**
+     * Slot of the ring. The sequence is 2 * position + 1 while the record of
+     * the position is written and 2 * position + 2 once it is complete, so a
+     * reader detects a slot that was overwritten by a later position.
+     */
+    struct alignas(64) Slot{
+        std::atomic<uint64_t> sequence{0};
+        std::array<std::atomic<uint64_t>, recordWords> words{};
+    };
+
+    // Function members
+    void write(const RxBroadcastRecord& record);
+    bool read(uint64_t position, RxBroadcastRecord& record) const;
+
+    // Data members
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    uint64_t writePosition = 0;                 // Only accessed by the io context thread
+
+    // Shared with the readers
+    alignas(64) std::atomic<uint64_t> head{0};  // Positions below head are readable
+    std::atomic<uint32_t> signal{0};            // Changed to wake up waiting readers
+    std::atomic<uint32_t> waiters{0};
+    std::atomic<bool> closed{false};
+};
+
+/**
+ * Cursor of a reader. A reader is used by one thread, every thread that
+ * wants all notifications opens a reader of its own.
+ */
+class RxBroadcastReader{
+
+public:
+    // Function members
+    RxBroadcastReader() = default;
+    RxBroadcastReader(std::shared_ptr<RxBroadcastRing> ring, uint64_t position);
+
+    bool next(RxBroadcastRecord& record);
+    bool wait();
+    size_t available() const;
+    uint64_t overruns() const;
+
+private:
+    // Data members
+    std::shared_ptr<RxBroadcastRing> ring;
+    uint64_t position = 0;
+    uint64_t lost = 0;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_RXBROADCASTRING_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,160 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxDispatcher.h
+ \brief     Dispatch table for received BCM notifications. Handlers are
+            registered per CAN ID or CAN ID range for RX_CHANGED, RX_TIMEOUT
+            and TX_EXPIRED. Standard IDs are looked up in a direct-indexed
+            table, extended IDs in an open-addressed table.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_RXDISPATCHER_H
+#define CAN_BCM_BOOST_ASIO_RXDISPATCHER_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "InplaceFunction.h"
+
+// System includes
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Number of entries of the direct-indexed table for standard (11 bit) CAN IDs.
+ */
+#define RX_DISPATCH_STANDARD_IDS (CAN_SFF_MASK + 1)
+
+/**
+ * Initial capacity of the open-addressed table for extended (29 bit) CAN IDs.
+ * Must be a power of two. The table grows when it is half full.
+ */
+#define RX_DISPATCH_EXTENDED_CAPACITY 256
+
+
+/*******************************************************************************
+ * ENUMS
+ ******************************************************************************/
+
+/**
+ * The BCM notifications a handler can be registered for.
+ */
+enum class RxEvent : int{
+    Changed   = 0,  // RX_CHANGED: reception of a frame or a content change
+    Timeout   = 1,  // RX_TIMEOUT: cyclic message is detected to be absent
+    TxExpired = 2   // TX_EXPIRED: counter finished sending at ival1 interval
+};
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for a decoded BCM notification that was received on the socket.
+ * The pointers refer to the receive buffer of the notification and are
+ * only valid during the dispatch.
+ */
+struct BcmNotification{
+    const struct bcm_msg_head* head = nullptr;
+    void* frames = nullptr;
+    uint32_t nframes = 0;
+    bool isCANFD = false;
+    int64_t timestamp = 0;          // Kernel receive time in nanoseconds since the epoch
+    int64_t dispatchTimestamp = 0;  // Time the io context thread drained the socket
+};
+
+/**
+ * Handler for a received BCM notification.
+ */
+using RxHandler = InplaceFunction<void(const BcmNotification& notification)>;
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class RxDispatcher{
+
+public:
+    // Function members
+    RxDispatcher();
+
+    void subscribe(RxEvent event, canid_t firstCanID, canid_t lastCanID, const RxHandler& handler);
+    void unsubscribe(RxEvent event, canid_t firstCanID, canid_t lastCanID);
+    bool dispatch(RxEvent event, const BcmNotification& notification) const;
+
+private:
+    // Marker for an entry without a handler
+    static constexpr uint32_t NO_HANDLER = 0;
+
+    // Markers for the keys of the open-addressed table
+    static constexpr canid_t EMPTY_KEY     = 0xFFFFFFFF;
+    static constexpr canid_t TOMBSTONE_KEY = 0xFFFFFFFE;
+
+    /**
+     * A registered handler with the number of table entries that refer to it.
+     */
+    struct HandlerSlot{
+        RxHandler handler;
+        uint32_t references = 0;
+    };
+
+    /**
+     * Entry of the open-addressed table for extended CAN IDs.
+     */
+    struct ExtendedEntry{
+        canid_t canID = EMPTY_KEY;
+        uint32_t handler = NO_HANDLER;
+    };
+
+    /**
+     * Handler for a range of extended CAN IDs.
+     */
+    struct ExtendedRange{
+        canid_t first;
+        canid_t last;
+        uint32_t handler;
+    };
+
+    /**
+     * Lookup tables for a single event.
+     */
+    struct Table{
+        std::array<uint32_t, RX_DISPATCH_STANDARD_IDS> standard{};
+        std::vector<ExtendedEntry> extended;
+        size_t extendedUsed = 0;                // Entries with a CAN ID or a tombstone
+        size_t extendedLive = 0;                // Entries with a CAN ID
+        std::vector<ExtendedRange> extendedRanges;
+    };
+
+    // Function members
+    uint32_t addHandler(const RxHandler& handler);
+    void releaseHandler(uint32_t index);
+    uint32_t lookup(const Table& table, canid_t canID) const;
+    void insertExtended(Table& table, canid_t canID, uint32_t handler);
+    void eraseExtended(Table& table, canid_t canID);
+    static size_t hashExtended(canid_t canID, size_t capacity);
+
+    // Data members
+    std::array<Table, 3> tables;
+    std::vector<HandlerSlot> handlers;
+    std::vector<uint32_t> freeHandlers;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_RXDISPATCHER_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,119 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxFilterSet.h
+ \brief     Desired and installed RX_SETUP configuration of a BCM socket. The
+            difference between both is reduced to the minimal set of RX_SETUP
+            and RX_DELETE messages, so unchanged filters are never touched.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_RXFILTERSET_H
+#define CAN_BCM_BOOST_ASIO_RXFILTERSET_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "InplaceFunction.h"
+#include "RxOptions.h"
+
+// System includes
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the RX_SETUP configuration of a single CAN ID.
+ * Without masks the filter matches the CAN ID (RX_FILTER_ID).
+ */
+struct RxFilter{
+    canid_t canID = 0;
+    bool isCANFD = false;
+    uint32_t flags = 0;                     // Additional BCM flags, e.g. RX_CHECK_DLC
+    struct bcm_timeval ival1{};             // Timeout for RX_TIMEOUT, zero disables it
+    struct bcm_timeval ival2{};             // Throttle interval for RX_CHANGED, zero disables it
+    std::vector<struct canfd_frame> masks;  // Content filter, more than one mask for multiplex messages
+
+    RxFilter() = default;
+    RxFilter(canid_t canID, bool isCANFD, const RxOptions& options, std::vector<struct canfd_frame> masks = {});
+
+    bool operator==(const RxFilter& other) const;
+    bool operator!=(const RxFilter& other) const;
+};
+
+/**
+ * Struct for a single change that is needed to reach the desired configuration.
+ */
+struct RxFilterChange{
+
+    enum class Action : int{
+        Setup   = 0,    // RX_SETUP adds the filter or updates it in place
+        Replace = 1,    // RX_DELETE and RX_SETUP, the filter gets more masks than installed
+        Delete  = 2     // RX_DELETE removes the filter
+    };
+
+    Action action = Action::Setup;
+    RxFilter filter;
+};
+
+/**
+ * Struct for the result of the application of a filter set.
+ */
+struct RxFilterResult{
+    size_t added = 0;
+    size_t updated = 0;
+    size_t removed = 0;
+    size_t unchanged = 0;
+    size_t failed = 0;
+};
+
+/**
+ * Handler that is called once after a filter set was applied.
+ */
+using RxFilterHandler = InplaceFunction<void(const RxFilterResult& result)>;
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * Note: Filters that are set up directly with rxSetupCanID or rxSetupMask
+ * are not known to the filter set. The filter set is only accessed in the
+ * io context loop thread.
+ */
+class RxFilterSet{
+
+public:
+    // Function members
+    static uint64_t keyOf(canid_t canID, bool isCANFD);
+
+    void diff(const std::vector<RxFilter>& desired, std::vector<RxFilterChange>& changes, RxFilterResult& result) const;
+    void installed(const RxFilter& filter);
+    void removed(uint64_t key);
+    void failed(uint64_t key);
+
+    const RxFilter* find(canid_t canID, bool isCANFD) const;
+    size_t size() const;
+
+private:
+    // Data members
+    std::unordered_map<uint64_t, RxFilter> filters;
+    std::unordered_set<uint64_t> uncertain;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_RXFILTERSET_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
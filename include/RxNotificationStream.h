@@ -0,0 +1,127 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxNotificationStream.h
+ \brief     Awaitable stream of received BCM notifications. The notifications
+            are copied into a bounded ring in the io context loop thread and
+            handed out with asyncReceive, e.g. with co_await and use_awaitable.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_RXNOTIFICATIONSTREAM_H
+#define CAN_BCM_BOOST_ASIO_RXNOTIFICATIONSTREAM_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "AsyncCompletion.h"
+#include "RxDispatcher.h"
+
+// System includes
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <linux/can.h>
+#include <boost/asio/post.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/async_result.hpp>
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for a copy of a BCM notification that outlives the receive buffer.
+ * RX_CHANGED carries exactly one frame, RX_TIMEOUT and TX_EXPIRED carry none.
+ */
+struct BcmEvent{
+    RxEvent event = RxEvent::Changed;
+    canid_t canID = 0;
+    uint32_t flags = 0;
+    uint32_t nframes = 0;
+    bool isCANFD = false;
+    struct canfd_frame frame{};     // The first frame of the notification
+    int64_t timestamp = 0;          // Kernel receive time in nanoseconds since the epoch
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class RxNotificationStream : public std::enable_shared_from_this<RxNotificationStream>{
+
+public:
+    // Completion of a receive operation
+    using Completion = AsyncCompletionPtr<BcmEvent>;
+
+    // Function members
+    RxNotificationStream(boost::asio::io_context& context, RxEvent event, canid_t firstCanID, canid_t lastCanID, size_t capacity);
+    RxNotificationStream(const RxNotificationStream&) = delete;
+    RxNotificationStream& operator=(const RxNotificationStream&) = delete;
+
+    RxEvent event() const;
+    canid_t firstCanID() const;
+    canid_t lastCanID() const;
+    size_t overruns() const;
+
+    /**
+     * Waits for the next notification of the stream. Only one receive may be
+     * pending at a time. A closed stream completes with operation_aborted.
+     *
+     * The completion token selects how the result is delivered, e.g. a callback,
+     * boost::asio::use_future or boost::asio::use_awaitable in a coroutine.
+     *
+     * @param token - The completion token with the signature void(boost::system::error_code, BcmEvent).
+     * @return The result of the completion token.
+     */
+    template<typename CompletionToken>
+    auto asyncReceive(CompletionToken&& token){
+
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, BcmEvent)>(
+            [self = shared_from_this()](auto&& handler) mutable{
+
+                auto completion = makeAsyncCompletion<BcmEvent>(std::move(handler), self->executor);
+
+                // The ring is only touched in the io context loop thread
+                boost::asio::post(self->executor, [self, completion = std::move(completion)]() mutable{
+                    self->startReceive(std::move(completion));
+                });
+
+            }, token);
+    }
+
+private:
+    friend class CANConnector;
+
+    // Function members
+    void push(const BcmNotification& notification);
+    void close();
+    void startReceive(Completion completion);
+
+    // Data members
+    boost::asio::io_context::executor_type executor;
+    RxEvent streamEvent;
+    canid_t streamFirstCanID;
+    canid_t streamLastCanID;
+    std::vector<BcmEvent> entries;
+    size_t head = 0;
+    size_t count = 0;
+    bool open = true;
+    Completion waiter;
+    std::atomic<size_t> overrunCount{0};
+};
+
+/**
+ * Handle of a RX stream. The stream stays registered until it is closed on its connector.
+ */
+using RxStreamHandle = std::shared_ptr<RxNotificationStream>;
+
+
+#endif //CAN_BCM_BOOST_ASIO_RXNOTIFICATIONSTREAM_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
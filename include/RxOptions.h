@@ -0,0 +1,98 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxOptions.h
+ \brief     Typed options of a RX_SETUP operation. The options move the
+            throttling, the timeout monitoring and the content filtering of
+            received frames into the kernel.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_RXOPTIONS_H
+#define CAN_BCM_BOOST_ASIO_RXOPTIONS_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <chrono>
+#include <cstdint>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the options of a RX_SETUP operation. The default options
+ * notify every change of a frame without timeout monitoring.
+ */
+struct RxOptions{
+
+    // Minimum time between two RX_CHANGED notifications (ival2). Changes in
+    // between are held back by the kernel and only the last one is notified.
+    std::chrono::microseconds throttle{0};
+
+    // Time without a frame after which RX_TIMEOUT is notified (ival1)
+    std::chrono::microseconds timeout{0};
+
+    // Notify a RX_CHANGED after a timeout when the frame is received again,
+    // even if the content did not change (RX_ANNOUNCE_RESUME)
+    bool announceResume = false;
+
+    // Also notify a change of the length of the frame, needs a mask (RX_CHECK_DLC)
+    bool checkDLC = false;
+
+    // Received frames do not restart the timeout timer, so RX_TIMEOUT is notified
+    // at most once until the next RX_SETUP starts the timer again (RX_NO_AUTOTIMER)
+    bool noAutoTimer = false;
+
+    /**
+     * Returns the BCM flags of the options.
+     *
+     * @return The flags. SETTIMER is always set, so zero timers disable the timers.
+     */
+    uint32_t flags() const{
+        return SETTIMER | (announceResume ? RX_ANNOUNCE_RESUME : 0) | (checkDLC ? RX_CHECK_DLC : 0) | (noAutoTimer ? RX_NO_AUTOTIMER : 0);
+    }
+
+    /**
+     * Returns the timeout as ival1 of the bcm_msg_head.
+     *
+     * @return The timeout.
+     */
+    struct bcm_timeval ival1() const{
+        return toTimeval(timeout);
+    }
+
+    /**
+     * Returns the throttle interval as ival2 of the bcm_msg_head.
+     *
+     * @return The throttle interval.
+     */
+    struct bcm_timeval ival2() const{
+        return toTimeval(throttle);
+    }
+
+    /**
+     * Converts a duration into a bcm_timeval.
+     *
+     * @param duration - The duration.
+     * @return The duration in seconds and microseconds.
+     */
+    static struct bcm_timeval toTimeval(std::chrono::microseconds duration){
+
+        struct bcm_timeval result{};
+        result.tv_sec  = static_cast<long>(duration.count() / 1000000);
+        result.tv_usec = static_cast<long>(duration.count() % 1000000);
+
+        return result;
+    }
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_RXOPTIONS_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
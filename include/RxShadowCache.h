@@ -0,0 +1,110 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxShadowCache.h
+ \brief     Shadow state of the last received frame per CAN ID. The io context
+            thread writes the slots, any thread can read a consistent snapshot
+            of a slot without locks. Every slot is a seqlock on its own cache
+            lines, so readers of different CAN IDs never share a cache line.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_RXSHADOWCACHE_H
+#define CAN_BCM_BOOST_ASIO_RXSHADOWCACHE_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <array>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <linux/can.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Number of slots for standard (11 bit) CAN IDs. The slots are direct-indexed.
+ */
+#define RX_SHADOW_STANDARD_IDS (CAN_SFF_MASK + 1)
+
+/**
+ * Number of slots for extended (29 bit) CAN IDs. Must be a power of two.
+ * The table does not grow, so readers never see a reallocation. Frames of
+ * further extended CAN IDs are not cached and counted as dropped.
+ */
+#define RX_SHADOW_EXTENDED_SLOTS 1024
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for a consistent copy of a shadow slot.
+ */
+struct RxShadowSnapshot{
+    struct canfd_frame frame = {0};
+    int64_t timestamp = 0;      // Receive time in nanoseconds since the epoch
+    uint32_t updates = 0;       // Number of received frames of the CAN ID
+    bool isCANFD = false;
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class RxShadowCache{
+
+public:
+    // Function members
+    RxShadowCache();
+    RxShadowCache(const RxShadowCache&) = delete;
+    RxShadowCache& operator=(const RxShadowCache&) = delete;
+
+    void update(const struct canfd_frame& frame, bool isCANFD, int64_t timestamp);
+    bool read(canid_t canID, RxShadowSnapshot& snapshot) const;
+    size_t dropped() const;
+
+private:
+    // Number of 64 bit words of a canfd_frame
+    static constexpr size_t frameWords = (sizeof(struct canfd_frame) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    /**
+     * Seqlock slot. The sequence is odd while the writer changes the slot.
+     * The payload is stored in relaxed atomics, so a torn read is detected
+     * by the sequence and never is a data race.
+     */
+    struct alignas(64) Slot{
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<uint32_t> key{0};
+        std::atomic<uint32_t> updates{0};
+        std::atomic<uint32_t> isCANFD{0};
+        std::atomic<int64_t> timestamp{0};
+        std::array<std::atomic<uint64_t>, frameWords> words{};
+    };
+
+    // Function members
+    static canid_t keyOf(canid_t canID);
+    static size_t hashOf(canid_t key);
+    Slot* findSlot(canid_t key, bool insert);
+    const Slot* findSlot(canid_t key) const;
+
+    // Data members
+    std::unique_ptr<Slot[]> standardSlots;
+    std::unique_ptr<Slot[]> extendedSlots;
+    size_t extendedCount = 0;
+    std::atomic<size_t> droppedFrames{0};
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_RXSHADOWCACHE_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
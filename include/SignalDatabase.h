@@ -0,0 +1,162 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      SignalDatabase.h
+ \brief     Signal layer on top of the CAN frames. The signal descriptions of
+            a DBC file are loaded once and compiled into a shift/mask table
+            per message, so encoding and decoding never parses metadata.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_SIGNALDATABASE_H
+#define CAN_BCM_BOOST_ASIO_SIGNALDATABASE_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "TxJob.h"
+#include "RxDispatcher.h"
+#include "RxShadowCache.h"
+
+// System includes
+#include <string>
+#include <vector>
+#include <memory>
+#include <istream>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <linux/can.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Size of the zero padded copy of the payload the signals are decoded from.
+ * Every signal is read with one unaligned 8 byte load plus one extra byte,
+ * so the padding removes all bounds checks from the decode loop.
+ */
+#define SIGNAL_PAYLOAD_BUFFER_SIZE (CANFD_MAX_DLEN + 8)
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the description of a signal as found in a DBC file.
+ */
+struct SignalDefinition{
+    std::string name;
+    uint32_t startBit = 0;          // DBC start bit, the MSB for big endian signals
+    uint32_t length = 0;            // Length in bits, 1 to 64
+    bool isBigEndian = false;       // Motorola byte order (@0) instead of Intel (@1)
+    bool isSigned = false;
+    double factor = 1.0;
+    double offset = 0.0;
+    double minimum = 0.0;
+    double maximum = 0.0;
+    std::string unit;
+    bool isMultiplexor = false;     // The signal selects the multiplexed signals
+    int multiplexValue = -1;        // Multiplexor value of the signal or -1
+};
+
+/**
+ * Struct for the description of a message as found in a DBC file.
+ */
+struct MessageDefinition{
+    canid_t canID = 0;              // With CAN_EFF_FLAG for extended CAN IDs
+    std::string name;
+    uint32_t length = 0;            // Length of the payload in bytes
+    std::vector<SignalDefinition> signals;
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * The compiled layout of a message. The values of the signals are passed as
+ * an array with one entry per signal in the order of the definition.
+ */
+class MessageLayout{
+
+public:
+    // Function members
+    explicit MessageLayout(MessageDefinition definition);
+
+    canid_t canID() const;
+    const std::string& name() const;
+    uint32_t length() const;
+    size_t signalCount() const;
+    const SignalDefinition& signal(size_t index) const;
+    int signalIndex(const std::string& signalName) const;
+
+    void decode(const std::uint8_t* data, size_t length, double values[]) const;
+    void decode(const struct canfd_frame& frame, double values[]) const;
+    void decode(const BcmNotification& notification, double values[]) const;
+    void decode(const RxShadowSnapshot& snapshot, double values[]) const;
+    double decodeSignal(const std::uint8_t* data, size_t length, size_t index) const;
+
+    void encode(const double values[], std::uint8_t* data, size_t length) const;
+    void encode(const double values[], TxJob& job, uint32_t frameIndex = 0) const;
+    void encodeSignal(size_t index, double value, std::uint8_t* data, size_t length) const;
+
+private:
+    /**
+     * Precomputed extraction of a signal. The payload is viewed as a 72 bit
+     * word starting at byteOffset, the signal is (word >> shift) & mask.
+     */
+    struct CompiledSignal{
+        uint32_t byteOffset;
+        uint32_t shift;
+        uint64_t mask;
+        uint32_t signShift;         // 64 - length for signed signals, 0 otherwise
+        bool isSigned;              // Also for 64 bit signals, whose signShift is 0
+        bool isBigEndian;
+        double rawLimit;            // 2^length, 2^(length - 1) for signed signals
+        double factor;
+        double offset;
+    };
+
+    // Function members
+    static CompiledSignal compile(const SignalDefinition& signal);
+    static uint64_t extract(const CompiledSignal& signal, const std::uint8_t* payload);
+    static void insert(const CompiledSignal& signal, uint64_t raw, std::uint8_t* payload);
+    static double toPhysical(const CompiledSignal& signal, uint64_t raw);
+    static uint64_t toRaw(const CompiledSignal& signal, double value);
+
+    // Data members
+    MessageDefinition definition;
+    std::vector<CompiledSignal> compiled;
+};
+
+class SignalDatabase{
+
+public:
+    // Function members
+    bool loadDbc(const std::string& path);
+    bool parseDbc(std::istream& input);
+    const MessageLayout* addMessage(MessageDefinition definition);
+
+    const MessageLayout* find(canid_t canID) const;
+    const MessageLayout* find(const std::string& messageName) const;
+    size_t size() const;
+
+private:
+    // Data members
+    std::vector<std::unique_ptr<MessageLayout>> layouts;
+    std::unordered_map<canid_t, const MessageLayout*> layoutsByID;
+    std::unordered_map<std::string, const MessageLayout*> layoutsByName;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_SIGNALDATABASE_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
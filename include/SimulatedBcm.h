@@ -0,0 +1,230 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      SimulatedBcm.h
+ \brief     In-process simulation of the broadcast manager of one interface.
+            The simulation runs the cyclic TX jobs, the RX filters with their
+            timeouts and throttling and a loopback bus on a scaled clock.
+            Latency, lost frames, ENOBUFS and bus-off are injected with a
+            seeded random generator, so a run can be reproduced.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_SIMULATEDBCM_H
+#define CAN_BCM_BOOST_ASIO_SIMULATEDBCM_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "BcmTransport.h"
+
+// System includes
+#include <queue>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <condition_variable>
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Number of notifications the simulation holds back while the connector does
+ * not read its socket. Further notifications are lost like in the kernel.
+ */
+#define SIMULATED_BCM_DELIVERY_LIMIT 65536
+
+/**
+ * Size of the socket buffers between the simulation and the connector.
+ */
+#define SIMULATED_BCM_SOCKET_BUFFER (4 * 1024 * 1024)
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the configuration of a simulated BCM. The rates are probabilities
+ * from 0 to 1 and are rolled with a generator that is seeded with the seed.
+ */
+struct SimulatedBcmOptions{
+    uint64_t seed = 1;
+    double timeScale = 1.0;                             // Simulated time per real time, 100 runs 100 times faster
+    bool loopback = true;                               // The RX filters receive the frames of the TX jobs
+    std::chrono::microseconds latency{0};               // Delay of the notifications in simulated time
+    std::chrono::microseconds latencyJitter{0};         // Random additional delay up to this value
+    double dropRate = 0.0;                              // Frames that are lost on the bus
+    double enobufsRate = 0.0;                           // TX_SEND messages that are rejected with ENOBUFS
+    double busOffRate = 0.0;                            // Sent frames that drive the controller bus-off
+    std::chrono::milliseconds busOffDuration{100};      // Simulated time until the bus-off recovery
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class SimulatedBcm : public BcmTransport{
+
+public:
+    /**
+     * Snapshot of the counters of the simulation.
+     */
+    struct Statistics{
+        uint64_t messages = 0;              // Accepted BCM messages
+        uint64_t rejected = 0;              // Messages rejected with an errno
+        uint64_t framesSent = 0;            // Frames on the bus
+        uint64_t framesDropped = 0;         // Frames lost on the bus or during bus-off
+        uint64_t notifications = 0;         // Notifications sent to the connector
+        uint64_t notificationsLost = 0;     // Notifications lost because the connector did not read
+        uint64_t enobufsInjected = 0;
+        uint64_t busOffs = 0;
+        size_t txJobs = 0;
+        size_t rxJobs = 0;
+    };
+
+    // Function members
+    explicit SimulatedBcm(const SimulatedBcmOptions& options = SimulatedBcmOptions());
+    SimulatedBcm(const SimulatedBcm&) = delete;
+    SimulatedBcm& operator=(const SimulatedBcm&) = delete;
+    ~SimulatedBcm() override;
+
+    bool open(boost::asio::generic::datagram_protocol::socket& socket, const std::string& interfaceName, int& interfaceIndex) override;
+    int send(int fileDescriptor, struct mmsghdr* headers, unsigned int count) override;
+    bool supportsRawFastPath() const override;
+
+    void inject(const struct canfd_frame& frame, bool isCANFD);
+    void setBusOff(std::chrono::microseconds duration);
+    std::chrono::nanoseconds now() const;
+    Statistics statistics() const;
+
+private:
+    enum class TimerKind : uint8_t{
+        TxCycle,
+        RxTimeout,
+        RxThrottle
+    };
+
+    /**
+     * Struct for a timer of a job. A timer is stale if the generation of its job changed.
+     */
+    struct Timer{
+        int64_t time;
+        uint64_t key;
+        uint64_t generation;
+        TimerKind kind;
+
+        bool operator>(const Timer& other) const{
+            return time > other.time;
+        }
+    };
+
+    /**
+     * Struct for a cyclic TX job.
+     */
+    struct TxJob{
+        canid_t canID = 0;
+        bool isCANFD = false;
+        uint32_t flags = 0;
+        uint32_t count = 0;
+        int64_t ival1 = 0;
+        int64_t ival2 = 0;
+        std::vector<struct canfd_frame> frames;
+        size_t currentFrame = 0;
+        uint64_t generation = 0;
+    };
+
+    /**
+     * Struct for a RX filter with the last received content of every mask.
+     */
+    struct RxJob{
+        canid_t canID = 0;
+        bool isCANFD = false;
+        uint32_t flags = 0;
+        int64_t ival1 = 0;
+        int64_t ival2 = 0;
+        std::vector<struct canfd_frame> masks;
+        std::vector<struct canfd_frame> lastFrames;
+        std::vector<bool> received;
+        uint64_t timeoutGeneration = 0;
+        uint64_t throttleGeneration = 0;
+        int64_t lastNotification = INT64_MIN;
+        bool throttled = false;
+        bool pending = false;
+        struct canfd_frame pendingFrame{};
+    };
+
+    /**
+     * Struct for a notification that waits for its delivery time.
+     */
+    struct Delivery{
+        int64_t time;
+        std::vector<uint8_t> datagram;
+    };
+
+    // Function members
+    void run();
+    int64_t simulatedNow() const;
+    bool roll(double rate);
+
+    int process(const uint8_t* data, size_t size, int64_t time);
+    int txSetup(const bcm_msg_head* head, const struct canfd_frame* frames, bool isCANFD, int64_t time);
+    int rxSetup(const bcm_msg_head* head, const struct canfd_frame* frames, bool isCANFD, int64_t time);
+    void txCycle(TxJob& job, uint64_t key, int64_t time);
+    void rxTimeout(RxJob& job, int64_t time);
+    void rxThrottle(RxJob& job, int64_t time);
+    void scheduleTx(TxJob& job, uint64_t key, int64_t time);
+
+    bool transmit(const struct canfd_frame& frame, bool isCANFD, int64_t time);
+    void receive(const struct canfd_frame& frame, bool isCANFD, int64_t time);
+    void notifyChanged(RxJob& job, uint64_t key, const struct canfd_frame& frame, int64_t time);
+    void notify(uint32_t opcode, uint32_t flags, uint32_t count, int64_t ival1, int64_t ival2, canid_t canID,
+                const struct canfd_frame* frames, uint32_t nframes, bool isCANFD, int64_t time);
+    void flushDeliveries(int64_t time);
+
+    static uint64_t keyOf(canid_t canID, bool isCANFD);
+    static int64_t toNanoseconds(const struct bcm_timeval& interval);
+    static struct bcm_timeval toTimeval(int64_t interval);
+
+    // Data members
+    SimulatedBcmOptions simulationOptions;
+    std::chrono::steady_clock::time_point start;
+    int simulationSocket = -1;
+    bool opened = false;
+    bool stopping = false;
+    bool deliveryBlocked = false;
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    std::thread simulationThread;
+    std::mt19937_64 generator;
+    std::uniform_real_distribution<double> distribution{0.0, 1.0};
+
+    // Simulation state, guarded by the mutex
+    std::unordered_map<uint64_t, TxJob> txJobs;
+    std::unordered_map<uint64_t, RxJob> rxJobs;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    std::deque<Delivery> deliveries;
+    uint64_t nextGeneration = 1;
+    int64_t lastDeliveryTime = 0;
+    int64_t busOffUntil = 0;
+    Statistics counters;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_SIMULATEDBCM_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,269 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      Trace.h
+ \brief     Tracepoints of the TX and RX paths with per-thread lock-free trace
+            buffers that are exported in the Chrome trace format, which is
+            also read by Perfetto. The tracepoints compile to nothing unless
+            CAN_BCM_TRACE is set and cost a relaxed load while tracing is
+            stopped. With <sys/sdt.h> they are also USDT probes for perf
+            and other uprobe based tracers.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_TRACE_H
+#define CAN_BCM_BOOST_ASIO_TRACE_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Compiles the tracepoints into the binary. Can be set with -DCAN_BCM_TRACE=1.
+ * 0 = The tracepoints are removed by the preprocessor
+ * 1 = The tracepoints record into the trace buffers while tracing is started
+ */
+#ifndef CAN_BCM_TRACE
+#define CAN_BCM_TRACE 0
+#endif
+
+/**
+ * Number of events of the trace buffer of a thread. Must be a power of two.
+ * The oldest events are overwritten if the buffer is full.
+ */
+#define TRACE_BUFFER_EVENTS 16384
+
+#if CAN_BCM_TRACE && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CAN_BCM_TRACE_PROBE(name, id, canID) DTRACE_PROBE2(can_bcm, name, id, canID)
+#endif
+#endif
+
+#ifndef CAN_BCM_TRACE_PROBE
+#define CAN_BCM_TRACE_PROBE(name, id, canID) ((void)0)
+#endif
+
+#if CAN_BCM_TRACE
+
+/**
+ * Records an event of the span of a frame. The span is identified by the id
+ * and can start and end in different threads.
+ */
+#define CAN_BCM_TRACE_ASYNC(phase, name, id, canID)                                                       \
+    do{                                                                                                   \
+        if(Trace::active()){                                                                              \
+            Trace::record(phase, #name, static_cast<uint64_t>(id), static_cast<uint32_t>(canID), Trace::now(), 0); \
+        }                                                                                                 \
+        CAN_BCM_TRACE_PROBE(name, id, canID);                                                             \
+    }while(0)
+
+#define CAN_BCM_TRACE_BEGIN(name, id, canID)   CAN_BCM_TRACE_ASYNC(TracePhase::AsyncBegin, name, id, canID)
+#define CAN_BCM_TRACE_INSTANT(name, id, canID) CAN_BCM_TRACE_ASYNC(TracePhase::AsyncInstant, name, id, canID)
+#define CAN_BCM_TRACE_END(name, id, canID)     CAN_BCM_TRACE_ASYNC(TracePhase::AsyncEnd, name, id, canID)
+
+/**
+ * Records a span of the current thread that ends at end with the duration in Trace::now() nanoseconds.
+ */
+#define CAN_BCM_TRACE_COMPLETE(name, end, duration, count)                                                \
+    do{                                                                                                   \
+        if(Trace::active()){                                                                              \
+            int64_t traceEnd      = (end);                                                                \
+            int64_t traceDuration = (duration);                                                           \
+            Trace::record(TracePhase::Complete, #name, 0, static_cast<uint32_t>(count), traceEnd - traceDuration, traceDuration); \
+        }                                                                                                 \
+    }while(0)
+
+/**
+ * Records a span of the current thread for the rest of the enclosing scope.
+ */
+#define CAN_BCM_TRACE_SCOPE(scope, name) TraceScope scope(#name)
+#define CAN_BCM_TRACE_COUNT(scope, count) scope.setCount(static_cast<uint32_t>(count))
+
+#else
+
+#define CAN_BCM_TRACE_BEGIN(name, id, canID) ((void)0)
+#define CAN_BCM_TRACE_INSTANT(name, id, canID) ((void)0)
+#define CAN_BCM_TRACE_END(name, id, canID) ((void)0)
+#define CAN_BCM_TRACE_COMPLETE(name, end, duration, count) ((void)0)
+#define CAN_BCM_TRACE_SCOPE(scope, name) ((void)0)
+#define CAN_BCM_TRACE_COUNT(scope, count) ((void)0)
+
+#endif
+
+
+/*******************************************************************************
+ * ENUMS
+ ******************************************************************************/
+
+/**
+ * Phases of the Chrome trace format.
+ */
+enum class TracePhase : char{
+    AsyncBegin   = 'b',
+    AsyncInstant = 'n',
+    AsyncEnd     = 'e',
+    Complete     = 'X'
+};
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for a recorded event. The id identifies the span of an async event,
+ * the argument is the CAN ID of an async event or the count of a complete event.
+ */
+struct TraceEvent{
+    TracePhase phase = TracePhase::Complete;
+    const char* name = nullptr;
+    uint64_t id = 0;
+    uint32_t argument = 0;
+    int64_t timestamp = 0;
+    int64_t duration = 0;
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * Ring of the events of one thread. Only the owning thread records, the
+ * export reads concurrently and discards the events that were overwritten.
+ */
+class TraceBuffer{
+
+public:
+    // Function members
+    TraceBuffer(uint32_t threadID, std::string threadName);
+    TraceBuffer(const TraceBuffer&) = delete;
+    TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+    void record(const TraceEvent& event);
+    void snapshot(std::vector<TraceEvent>& events) const;
+    void clear();
+
+    uint32_t threadID() const;
+    const std::string& threadName() const;
+
+private:
+    /**
+     * Struct for a slot of the ring. The words are atomic, so the export
+     * can read a slot while it is overwritten.
+     */
+    struct Slot{
+        std::atomic<uint64_t> header{0};        // Phase and argument
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> id{0};
+        std::atomic<int64_t> timestamp{0};
+        std::atomic<int64_t> duration{0};
+    };
+
+    // Data members
+    uint32_t tid;
+    std::string name;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<uint64_t> head{0};              // Number of recorded events
+    std::atomic<uint64_t> claimed{0};           // Number of events that started to record
+    std::atomic<uint64_t> tail{0};              // First event after the last clear
+};
+
+class Trace{
+
+public:
+    // Function members
+    static void start();
+    static void stop();
+    static void clear();
+
+    static std::string chromeTrace();
+    static bool writeChromeTrace(const std::string& path);
+
+    static void record(TracePhase phase, const char* name, uint64_t id, uint32_t argument, int64_t timestamp, int64_t duration);
+
+    /**
+     * Checks if the tracepoints record events.
+     *
+     * @return True while tracing is started.
+     */
+    static bool active(){
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns the current time of the trace clock.
+     *
+     * @return The steady clock time in nanoseconds.
+     */
+    static int64_t now(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    // Function members
+    static TraceBuffer& local();
+
+    // Data members
+    static std::atomic<bool> enabled;
+};
+
+/**
+ * Records a complete event from its construction to its destruction.
+ */
+class TraceScope{
+
+public:
+    /**
+     * Starts the span of the scope.
+     *
+     * @param name - The name of the span, must be a string literal.
+     */
+    explicit TraceScope(const char* name) : name(name), start(Trace::active() ? Trace::now() : 0){}
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    /**
+     * Records the span if tracing was active at its start.
+     */
+    ~TraceScope(){
+        if(start != 0 && Trace::active()){
+            Trace::record(TracePhase::Complete, name, 0, count, start, Trace::now() - start);
+        }
+    }
+
+    /**
+     * Sets the count argument of the span, e.g. the number of processed messages.
+     *
+     * @param value - The count.
+     */
+    void setCount(uint32_t value){
+        count = value;
+    }
+
+private:
+    // Data members
+    const char* name;
+    int64_t start;
+    uint32_t count = 0;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_TRACE_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
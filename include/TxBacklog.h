@@ -0,0 +1,123 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      TxBacklog.h
+ \brief     Bounded backlog of the commands that were taken from the submission
+            queue while the socket is congested. One-shot frames are bounded
+            per CAN ID with an overflow policy, everything else waits.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_TXBACKLOG_H
+#define CAN_BCM_BOOST_ASIO_TXBACKLOG_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "BcmBatch.h"
+#include "BcmMessagePool.h"
+
+// System includes
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <linux/can.h>
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for a command of the submission queue. Either a single BCM
+ * message with an optional completion or a whole batch.
+ */
+struct TxCommand{
+    BcmMessage msg;
+    std::unique_ptr<BcmBatch> batch;
+    BcmBatch::Completion completion;
+    int64_t submitted = 0;
+};
+
+/**
+ * What happens to a one-shot frame of a CAN ID whose backlog is full.
+ */
+enum class TxOverflowPolicy : int{
+    Block           = 0,    // The frame waits, the backlog is only bounded by the shared budget
+    Drop            = 1,    // The new frame is rejected with no_buffer_space
+    OverwriteOldest = 2     // The oldest waiting frame of the CAN ID is rejected with no_buffer_space
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * Backlog of a connector. Only accessed in the io context loop thread.
+ */
+class TxBacklog{
+
+public:
+    /**
+     * Result of a push.
+     */
+    enum class Result : int{
+        Queued      = 0,    // The command waits in the backlog
+        Dropped     = 1,    // The command was rejected and is returned
+        Overwritten = 2     // The command waits, an older command of its CAN ID is returned
+    };
+
+    // Function members
+    TxBacklog() = default;
+    TxBacklog(const TxBacklog&) = delete;
+    TxBacklog& operator=(const TxBacklog&) = delete;
+
+    void setPolicy(canid_t canID, bool isCANFD, TxOverflowPolicy policy, size_t limit);
+    Result push(TxCommand&& command, TxCommand& displaced);
+    bool pop(TxCommand& command);
+
+    size_t size() const;
+    bool empty() const;
+
+private:
+    /**
+     * Struct for a waiting command.
+     */
+    struct Entry{
+        TxCommand command;
+        uint64_t key = 0;
+        bool bounded = false;   // The entry is counted in the backlog of its CAN ID
+        bool live = true;       // False once the entry was overwritten
+    };
+
+    /**
+     * Struct for the overflow policy of a CAN ID.
+     */
+    struct Limit{
+        TxOverflowPolicy policy = TxOverflowPolicy::Block;
+        size_t limit = 0;
+    };
+
+    // Function members
+    static bool keyOf(const TxCommand& command, uint64_t& key);
+
+    // Data members
+    std::deque<Entry> entries;
+    uint64_t firstSequence = 0;
+    size_t liveEntries = 0;
+    std::unordered_map<uint64_t, Limit> limits;
+
+    // Sequence numbers of the live bounded entries per CAN ID, oldest first
+    std::unordered_map<uint64_t, std::deque<uint64_t>> waiting;
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_TXBACKLOG_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
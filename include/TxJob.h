@@ -0,0 +1,118 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      TxJob.h
+ \brief     Handle of a cyclic transmission task. The job keeps a pre-built
+            TX_SETUP update message, the caller writes the signal bytes
+            straight into its frames and commits the dirty jobs.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_TXJOB_H
+#define CAN_BCM_BOOST_ASIO_TXJOB_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "BcmMessageBuilder.h"
+
+// System includes
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * The frames of a job are written and committed by the application. A commit
+ * copies the message into a pool buffer, so writing the next values may start
+ * right after the commit. Writes and commits of a job must not run concurrently.
+ */
+class TxJob{
+
+public:
+    // Function members
+    template<typename Frame, typename Source = Frame>
+    static std::shared_ptr<TxJob> create(const Source frames[], uint32_t nframes);
+
+    TxJob(canid_t canID, uint32_t nframes, bool isCANFD);
+    TxJob(const TxJob&) = delete;
+    TxJob& operator=(const TxJob&) = delete;
+
+    canid_t canID() const;
+    uint32_t frameCount() const;
+    bool isCANFD() const;
+
+    std::uint8_t* data(uint32_t frameIndex = 0);
+    void setLength(uint32_t frameIndex, std::uint8_t length);
+    void markDirty();
+    bool isDirty() const;
+
+    /**
+     * Returns a frame of the job for direct writes. The frame type must match
+     * the type the job was created with. Call markDirty() after the writes.
+     *
+     * @param frameIndex - The index of the frame in the sequence.
+     * @return The frame.
+     */
+    template<typename Frame>
+    Frame& frame(uint32_t frameIndex = 0){
+        return reinterpret_cast<Frame*>(message.get() + sizeof(bcm_msg_head))[frameIndex];
+    }
+
+private:
+    friend class CANConnector;
+
+    // Function members
+    bool takeDirty();
+    const std::uint8_t* messageData() const;
+    size_t messageSize() const;
+    size_t frameSize() const;
+
+    // Data members
+    std::unique_ptr<std::uint8_t[]> message;
+    size_t size;
+    std::atomic<bool> dirty{false};
+};
+
+/**
+ * Shared handle of a cyclic transmission task.
+ */
+using TxJobHandle = std::shared_ptr<TxJob>;
+
+/**
+ * Creates a job and copies the initial frames into its update message. The
+ * source frames can be wider than Frame, e.g. canfd_frame for a CAN task.
+ *
+ * @param frames  - The frames of the cyclic transmission task.
+ * @param nframes - The number of frames.
+ * @return The job.
+ */
+template<typename Frame, typename Source>
+std::shared_ptr<TxJob> TxJob::create(const Source frames[], uint32_t nframes){
+
+    static_assert(sizeof(Source) >= sizeof(Frame), "The source frames must not be narrower than the job frames");
+
+    auto job = std::make_shared<TxJob>(frames[0].can_id, nframes, BcmFrameTraits<Frame>::isCANFD);
+
+    for(uint32_t index = 0; index < nframes; index++){
+        std::memcpy(&job->template frame<Frame>(index), &frames[index], sizeof(Frame));
+    }
+
+    return job;
+}
+
+
+#endif //CAN_BCM_BOOST_ASIO_TXJOB_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
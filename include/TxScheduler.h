@@ -0,0 +1,188 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      TxScheduler.h
+ \brief     User-space TX scheduler for transmission patterns the BCM cannot
+            express, e.g. event-triggered bursts, jittered cycles and phase
+            aligned offsets. Deadlines are absolute CLOCK_MONOTONIC times of
+            a timerfd, purely cyclic patterns are handed off to the BCM.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_TXSCHEDULER_H
+#define CAN_BCM_BOOST_ASIO_TXSCHEDULER_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+// Project includes
+#include "MpscQueue.h"
+
+// System includes
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <linux/can.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Number of commands the scheduler queue can hold. Must be a power of two.
+ */
+#define TX_SCHEDULER_QUEUE_SIZE 256
+
+
+/*******************************************************************************
+ * STRUCTS
+ ******************************************************************************/
+
+/**
+ * Struct for the transmission pattern of a scheduled frame.
+ *
+ * Cyclic patterns send a burst every period. The cycles of all tasks are
+ * aligned to the start of the scheduler, the offset shifts the phase of a
+ * task within its period. A pattern without a period only sends on trigger.
+ */
+struct TxPattern{
+    std::chrono::nanoseconds period{0};     // Cycle time, zero for event-triggered tasks
+    std::chrono::nanoseconds offset{0};     // Phase offset within the period
+    std::chrono::nanoseconds jitter{0};     // Maximum random deviation of every cycle, does not accumulate
+    uint32_t burstCount = 1;                // Frames per cycle or trigger
+    std::chrono::nanoseconds burstGap{0};   // Time between the frames of a burst
+    uint32_t repetitions = 0;               // Number of cycles, zero for no limit
+};
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+class CANConnector;
+
+class TxScheduler{
+
+public:
+    // Identifier of a scheduled task
+    using TaskId = uint32_t;
+
+    /**
+     * Struct for the counters of the scheduler.
+     */
+    struct Statistics{
+        uint64_t sent = 0;          // Frames sent by the scheduler, a hand-off counts its announced frame
+        uint64_t handedOff = 0;     // Tasks that were handed off to the BCM
+        uint64_t ticks = 0;         // Wakeups with at least one due frame
+        int64_t maxLateness = 0;    // Maximum delay of a wakeup behind its deadline in nanoseconds
+    };
+
+    // Function members
+    explicit TxScheduler(CANConnector& connector);
+    TxScheduler(const TxScheduler&) = delete;
+    TxScheduler& operator=(const TxScheduler&) = delete;
+    ~TxScheduler();
+
+    void start();
+    void stop();
+    bool isRunning() const;
+
+    TaskId schedule(const struct canfd_frame& frame, bool isCANFD, const TxPattern& pattern);
+    bool trigger(TaskId task);
+    bool update(TaskId task, const struct canfd_frame& frame);
+    bool cancel(TaskId task);
+
+    Statistics statistics() const;
+
+private:
+    /**
+     * Struct for a command from an application thread to the scheduler thread.
+     */
+    struct Command{
+
+        enum class Type : int{
+            Schedule = 0,
+            Trigger  = 1,
+            Update   = 2,
+            Cancel   = 3
+        };
+
+        Type type = Type::Schedule;
+        TaskId task = 0;
+        struct canfd_frame frame{};
+        bool isCANFD = false;
+        TxPattern pattern;
+    };
+
+    /**
+     * Struct for the state of a task. Only accessed in the scheduler thread.
+     */
+    struct Task{
+        struct canfd_frame frame{};
+        bool isCANFD = false;
+        TxPattern pattern;
+        int64_t nominal = 0;            // Deadline of the current cycle without jitter
+        uint32_t cycles = 0;            // Finished cycles
+        uint32_t burstRemaining = 0;    // Frames of the current burst that are not sent yet
+        uint64_t generation = 0;        // Invalidates the deadlines of a rescheduled task
+        bool handedOff = false;
+    };
+
+    /**
+     * Struct for an entry of the deadline heap.
+     */
+    struct Deadline{
+        int64_t time;
+        TaskId task;
+        uint64_t generation;
+        bool cycle;     // Frame of a cycle or of a triggered burst
+
+        bool operator>(const Deadline& other) const{
+            return time > other.time;
+        }
+    };
+
+    // Function members
+    bool post(Command&& command);
+    void schedulerThreadFunction();
+    void processCommands();
+    void processDeadlines(int64_t now);
+    void pushDeadline(TaskId id, const Task& task, int64_t time, bool cycle);
+    void startCycle(TaskId id, Task& task);
+    int64_t jittered(const Task& task);
+    static bool isHandOff(const TxPattern& pattern);
+    void armTimer();
+    static int64_t monotonicNow();
+
+    // Data members
+    CANConnector& connector;
+    int timerDescriptor = -1;
+    int eventDescriptor = -1;
+    int64_t epoch = 0;
+    std::atomic<bool> running{false};
+    std::atomic<TaskId> nextTaskId{1};
+    std::thread schedulerThread;
+    MpscQueue<Command, TX_SCHEDULER_QUEUE_SIZE> commands;
+
+    // State of the scheduler thread
+    std::unordered_map<TaskId, Task> tasks;
+    std::vector<Deadline> deadlines;
+    std::minstd_rand random;
+
+    std::atomic<uint64_t> sentFrames{0};
+    std::atomic<uint64_t> handedOffTasks{0};
+    std::atomic<uint64_t> dueTicks{0};
+    std::atomic<int64_t> maxLateness{0};
+};
+
+
+#endif //CAN_BCM_BOOST_ASIO_TXSCHEDULER_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,412 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmBatch.cpp
+ \brief     A batch of BCM messages that is submitted with a single sendmmsg
+            call on the BCM socket. The batch reports the result of every
+            message and has exactly one completion per batch.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "BcmBatch.h"
+#include "BcmTransport.h"
+#include <cerrno>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+BcmBatch::BcmBatch() = default;
+
+/**
+ * Appends a built BCM message to the batch.
+ *
+ * @param msg        - The BCM message.
+ * @param completion - Optional completion that receives the result of the message.
+ * @return False if the message is empty or the batch is full.
+ */
+bool BcmBatch::add(BcmMessage msg, Completion completion){
+
+    // Error handling / Sanity check
+    if(!msg.buffer || full()){
+        return false;
+    }
+
+    // Point the message header of sendmmsg to the message
+    iovecs[count].iov_base = msg.buffer.data();
+    iovecs[count].iov_len  = msg.size;
+
+    headers[count].msg_hdr.msg_iov    = &iovecs[count];
+    headers[count].msg_hdr.msg_iovlen = 1;
+
+    messages[count]    = std::move(msg);
+    completions[count] = std::move(completion);
+    submitTimes[count] = 0;
+    rawRoutes[count]   = false;
+    count++;
+
+    return true;
+}
+
+/**
+ * Removes all messages and the handler from the batch. The
+ * buffers of the messages go back to their pools. Completions
+ * that were not invoked yet are aborted.
+ */
+void BcmBatch::clear(){
+
+    for(size_t index = 0; index < count; index++){
+        messages[index] = BcmMessage();
+        completions[index].reset();
+        errorCodes[index].clear();
+    }
+
+    count     = 0;
+    sent      = 0;
+    congested = false;
+    retries   = 0;
+    handler   = Handler();
+}
+
+/**
+ * Returns the number of messages in the batch.
+ *
+ * @return The number of messages.
+ */
+size_t BcmBatch::size() const{
+    return count;
+}
+
+/**
+ * Checks if the batch contains no messages.
+ *
+ * @return True if the batch is empty.
+ */
+bool BcmBatch::empty() const{
+    return count == 0;
+}
+
+/**
+ * Checks if no further message fits into the batch.
+ *
+ * @return True if the batch is full.
+ */
+bool BcmBatch::full() const{
+    return count == BCM_BATCH_MAX_MESSAGES;
+}
+
+/**
+ * Returns the number of messages that could not be sent.
+ *
+ * @return The number of failed messages.
+ */
+size_t BcmBatch::failed() const{
+
+    size_t failedMessages = 0;
+
+    for(size_t index = 0; index < count; index++){
+        if(errorCodes[index]){
+            failedMessages++;
+        }
+    }
+
+    return failedMessages;
+}
+
+/**
+ * Returns the bcm_msg_head of a message in the batch.
+ *
+ * @param index - The position of the message in the batch.
+ * @return The bcm_msg_head of the message.
+ */
+const bcm_msg_head* BcmBatch::head(size_t index) const{
+    return messages[index].buffer.head();
+}
+
+/**
+ * Returns the result of a message in the batch.
+ *
+ * @param index - The position of the message in the batch.
+ * @return The error code of the message. Empty if the message was sent.
+ */
+const boost::system::error_code& BcmBatch::errorCode(size_t index) const{
+    return errorCodes[index];
+}
+
+/**
+ * Returns the size of a message in the batch.
+ *
+ * @param index - The position of the message in the batch.
+ * @return The size of the message in bytes.
+ */
+size_t BcmBatch::bytes(size_t index) const{
+    return iovecs[index].iov_len;
+}
+
+/**
+ * Returns the time a message in the batch was submitted to the connector.
+ *
+ * @param index - The position of the message in the batch.
+ * @return The submit time in steady clock nanoseconds, zero if unknown.
+ */
+int64_t BcmBatch::submitted(size_t index) const{
+    return submitTimes[index];
+}
+
+/**
+ * Routes the TX_SEND messages of the batch to a CAN_RAW socket. Only the
+ * frame behind the bcm_msg_head of these messages is sent, the BCM is not
+ * involved for one-shot frames. Cyclic and RX operations stay on the BCM.
+ */
+void BcmBatch::routeRaw(){
+
+    for(size_t index = sent; index < count; index++){
+
+        const bcm_msg_head* msgHead = head(index);
+
+        if(msgHead->opcode != TX_SEND || msgHead->nframes != 1){
+            continue;
+        }
+
+        iovecs[index].iov_base = static_cast<std::uint8_t*>(messages[index].buffer.data()) + sizeof(struct bcm_msg_head);
+        iovecs[index].iov_len  = (msgHead->flags & CAN_FD_FRAME) ? sizeof(struct canfd_frame) : sizeof(struct can_frame);
+        rawRoutes[index]       = true;
+    }
+
+}
+
+/**
+ * Sends the remaining messages of the batch with sendmmsg. A message that is
+ * rejected by the kernel is marked with its errno and the rest is continued.
+ * Consecutive messages with the same route share a single sendmmsg call.
+ * A full transmit queue of the interface (ENOBUFS) stops the batch with
+ * the congested flag, so the message can be retried later.
+ *
+ * @param transport      - The transport of the BCM socket.
+ * @param fileDescriptor - The native handle of the BCM socket.
+ * @param rawDescriptor  - The native handle of the CAN_RAW socket for the routed messages.
+ * @return False if the socket would block or is congested and the batch is not finished yet.
+ */
+bool BcmBatch::sendOn(BcmTransport& transport, int fileDescriptor, int rawDescriptor){
+
+    congested = false;
+
+    while(sent < count){
+
+        // Find the end of the run of messages with the same route
+        size_t end = sent + 1;
+
+        while(end < count && rawRoutes[end] == rawRoutes[sent]){
+            end++;
+        }
+
+        int result = rawRoutes[sent] ? ::sendmmsg(rawDescriptor, &headers[sent], end - sent, MSG_DONTWAIT)
+                                     : transport.send(fileDescriptor, &headers[sent], end - sent);
+
+        if(result > 0){
+            sent += result;
+            retries = 0;
+        }else if(errno == EAGAIN || errno == EWOULDBLOCK){
+            return false;
+        }else if(errno == ENOBUFS){
+            congested = true;
+            return false;
+        }else if(errno != EINTR){
+
+            // Note: sendmmsg only reports the error of the first message
+            // that failed. We skip this message and continue with the rest.
+            errorCodes[sent] = boost::system::error_code(errno, boost::system::system_category());
+            sent++;
+            retries = 0;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Checks if the batch waits for the CAN_RAW socket.
+ *
+ * @return True if the next message is routed to the CAN_RAW socket.
+ */
+bool BcmBatch::blockedOnRaw() const{
+    return sent < count && rawRoutes[sent];
+}
+
+/**
+ * Marks all messages that were not sent yet as failed.
+ *
+ * @param errorCode - The error code for the remaining messages.
+ */
+void BcmBatch::fail(const boost::system::error_code& errorCode){
+
+    while(sent < count){
+        errorCodes[sent] = errorCode;
+        sent++;
+    }
+
+}
+
+/**
+ * Marks the next message that was not sent yet as failed.
+ *
+ * @param errorCode - The error code for the message.
+ */
+void BcmBatch::skip(const boost::system::error_code& errorCode){
+
+    if(sent < count){
+        errorCodes[sent] = errorCode;
+        sent++;
+        retries = 0;
+    }
+
+}
+
+/**
+ * Invokes the completions of the messages with their results.
+ */
+void BcmBatch::completeMessages(){
+
+    for(size_t index = 0; index < count; index++){
+        completeAsync(completions[index], errorCodes[index]);
+    }
+
+}
+
+/**
+ * Creates the pool and allocates all batches once.
+ *
+ * @param capacity - The number of batches of the pool.
+ */
+BcmBatchPool::BcmBatchPool(std::size_t capacity) :
+    slotCount(capacity),
+    batches(new std::atomic<BcmBatch*>[capacity]),
+    next(new std::atomic<std::uint32_t>[capacity]){
+
+    for(std::size_t index = 0; index < slotCount; index++){
+        batches[index].store(new BcmBatch(), std::memory_order_relaxed);
+        push(filledHead, static_cast<std::uint32_t>(index));
+    }
+
+}
+
+BcmBatchPool::~BcmBatchPool(){
+
+    for(std::size_t index = 0; index < slotCount; index++){
+        delete batches[index].load(std::memory_order_relaxed);
+    }
+
+}
+
+/**
+ * Takes an empty batch from the pool. If the pool is exhausted a new
+ * batch is allocated, it is adopted by the pool on its release.
+ *
+ * @return The empty batch.
+ */
+std::unique_ptr<BcmBatch> BcmBatchPool::acquire(){
+
+    std::uint32_t index = pop(filledHead);
+
+    if(index == INVALID_INDEX){
+        return std::make_unique<BcmBatch>();
+    }
+
+    std::unique_ptr<BcmBatch> batch(batches[index].exchange(nullptr, std::memory_order_relaxed));
+    push(emptyHead, index);
+
+    return batch;
+}
+
+/**
+ * Empties a batch and puts it back into the pool. The batch is
+ * freed if the pool is full.
+ *
+ * Note: The batch must be completed, the messages go back to their pools.
+ *
+ * @param batch - The batch.
+ */
+void BcmBatchPool::release(std::unique_ptr<BcmBatch> batch){
+
+    // Error handling / Sanity check
+    if(batch == nullptr){
+        return;
+    }
+
+    std::uint32_t index = pop(emptyHead);
+
+    if(index == INVALID_INDEX){
+        return;
+    }
+
+    batch->clear();
+    batches[index].store(batch.release(), std::memory_order_relaxed);
+    push(filledHead, index);
+}
+
+/**
+ * Returns the number of batches the pool holds at most.
+ *
+ * @return The capacity.
+ */
+std::size_t BcmBatchPool::capacity() const{
+    return slotCount;
+}
+
+/**
+ * Takes a slot from a list.
+ *
+ * @param head - The tagged head of the list.
+ * @return The index of the slot or INVALID_INDEX if the list is empty.
+ */
+std::uint32_t BcmBatchPool::pop(std::atomic<std::uint64_t>& head){
+
+    std::uint64_t current = head.load(std::memory_order_acquire);
+
+    while(true){
+
+        auto index = static_cast<std::uint32_t>(current);
+
+        if(index == INVALID_INDEX){
+            return INVALID_INDEX;
+        }
+
+        // Pop the slot and increase the tag to avoid the ABA problem
+        std::uint64_t successor = next[index].load(std::memory_order_relaxed);
+        std::uint64_t newHead   = (((current >> 32) + 1) << 32) | successor;
+
+        if(head.compare_exchange_weak(current, newHead, std::memory_order_acquire, std::memory_order_acquire)){
+            return index;
+        }
+    }
+
+}
+
+/**
+ * Puts a slot into a list.
+ *
+ * @param head  - The tagged head of the list.
+ * @param index - The index of the slot.
+ */
+void BcmBatchPool::push(std::atomic<std::uint64_t>& head, std::uint32_t index){
+
+    std::uint64_t current = head.load(std::memory_order_relaxed);
+    std::uint64_t newHead = 0;
+
+    do{
+        next[index].store(static_cast<std::uint32_t>(current), std::memory_order_relaxed);
+        newHead = (((current >> 32) + 1) << 32) | index;
+    }while(!head.compare_exchange_weak(current, newHead, std::memory_order_release, std::memory_order_relaxed));
+
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
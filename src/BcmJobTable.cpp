@@ -0,0 +1,274 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmJobTable.cpp
+ \brief     User-space copy of the TX and RX jobs that are installed in the
+            BCM of a connector. The io context thread writes the slots, any
+            thread can read a consistent copy of a job without locks.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "BcmJobTable.h"
+#include <cstring>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+BcmJobTable::BcmJobTable() : slots(new Slot[BCM_JOB_TABLE_SLOTS]){
+
+    static_assert((BCM_JOB_TABLE_SLOTS & (BCM_JOB_TABLE_SLOTS - 1)) == 0,
+                  "BCM_JOB_TABLE_SLOTS must be a power of two");
+}
+
+/**
+ * Stores the new state of a job. Must only be called by the io context thread.
+ *
+ * @param status - The state of the job.
+ */
+void BcmJobTable::update(const BcmJobStatus& status){
+
+    Slot* slot = findSlot(keyOf(status.canID, status.isCANFD, status.isTx), true);
+
+    // Error handling / Sanity check
+    if(slot == nullptr){
+        droppedJobs.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    write(*slot, status);
+}
+
+/**
+ * Marks a job as removed. Must only be called by the io context thread.
+ *
+ * @param canID   - The CAN ID of the job.
+ * @param isCANFD - Flag for a CANFD job.
+ * @param isTx    - Flag for a TX job.
+ */
+void BcmJobTable::remove(canid_t canID, bool isCANFD, bool isTx){
+
+    Slot* slot = findSlot(keyOf(canID, isCANFD, isTx), false);
+
+    if(slot == nullptr){
+        return;
+    }
+
+    // Note: The key stays in the slot, readers stop probing at a free slot
+    BcmJobStatus status{};
+    status.canID   = canID;
+    status.isCANFD = isCANFD;
+    status.isTx    = isTx;
+    status.updated = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    write(*slot, status);
+}
+
+/**
+ * Reads a consistent copy of the state of a job.
+ * Can be called from any thread and never blocks the io context thread.
+ *
+ * @param canID   - The CAN ID of the job.
+ * @param isCANFD - Flag for a CANFD job.
+ * @param isTx    - Flag for a TX job.
+ * @param status  - The copy of the state.
+ * @return False if the job is not installed.
+ */
+bool BcmJobTable::lookup(canid_t canID, bool isCANFD, bool isTx, BcmJobStatus& status) const{
+
+    const Slot* slot = findSlot(keyOf(canID, isCANFD, isTx));
+
+    // Error handling / Sanity check
+    if(slot == nullptr){
+        return false;
+    }
+
+    std::array<uint64_t, statusWords> words{};
+    uint32_t before;
+    uint32_t after;
+
+    do{
+        before = slot->sequence.load(std::memory_order_acquire);
+
+        // The writer is changing the slot right now
+        if(before & 1){
+            continue;
+        }
+
+        for(size_t index = 0; index < statusWords; index++){
+            words[index] = slot->words[index].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = slot->sequence.load(std::memory_order_relaxed);
+
+    }while((before & 1) || before != after);
+
+    std::memcpy(&status, words.data(), sizeof(status));
+
+    return status.installed;
+}
+
+/**
+ * Copies the state of all installed jobs. Must only be called by the io context thread.
+ *
+ * @param jobs - The vector the jobs are appended to.
+ */
+void BcmJobTable::collect(std::vector<BcmJobStatus>& jobs) const{
+
+    for(size_t index = 0; index < BCM_JOB_TABLE_SLOTS; index++){
+
+        const Slot& slot = slots[index];
+
+        if(slot.key.load(std::memory_order_relaxed) == 0){
+            continue;
+        }
+
+        std::array<uint64_t, statusWords> words{};
+
+        for(size_t word = 0; word < statusWords; word++){
+            words[word] = slot.words[word].load(std::memory_order_relaxed);
+        }
+
+        BcmJobStatus status{};
+        std::memcpy(&status, words.data(), sizeof(status));
+
+        if(status.installed){
+            jobs.push_back(status);
+        }
+    }
+
+}
+
+/**
+ * Returns the number of jobs that were not tracked because the table was full.
+ *
+ * @return The number of dropped jobs.
+ */
+size_t BcmJobTable::dropped() const{
+    return droppedJobs.load(std::memory_order_relaxed);
+}
+
+/**
+ * Builds the key of a job. The BCM identifies a job by its CAN ID, the
+ * CAN_FD_FRAME flag and the direction.
+ *
+ * @param canID   - The CAN ID of the job.
+ * @param isCANFD - Flag for a CANFD job.
+ * @param isTx    - Flag for a TX job.
+ * @return The key, never zero.
+ */
+uint64_t BcmJobTable::keyOf(canid_t canID, bool isCANFD, bool isTx){
+
+    canid_t id = (canID & CAN_EFF_FLAG) ? ((canID & CAN_EFF_MASK) | CAN_EFF_FLAG) : (canID & CAN_SFF_MASK);
+
+    return static_cast<uint64_t>(id) | (static_cast<uint64_t>(isCANFD) << 32) | (static_cast<uint64_t>(isTx) << 33) | (1ULL << 34);
+}
+
+/**
+ * Fibonacci hashing of a key.
+ *
+ * @param key - The key of the job.
+ * @return The first slot index to probe.
+ */
+size_t BcmJobTable::hashOf(uint64_t key){
+    return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & (BCM_JOB_TABLE_SLOTS - 1);
+}
+
+/**
+ * Looks up the slot of a key and claims a free slot if needed.
+ * Must only be called by the io context thread.
+ *
+ * @param key    - The key of the job.
+ * @param insert - Claim a free slot for an unknown key.
+ * @return The slot or nullptr if the table is full.
+ */
+BcmJobTable::Slot* BcmJobTable::findSlot(uint64_t key, bool insert){
+
+    size_t position = hashOf(key);
+
+    for(size_t probe = 0; probe < BCM_JOB_TABLE_SLOTS; probe++){
+
+        Slot& slot = slots[(position + probe) & (BCM_JOB_TABLE_SLOTS - 1)];
+        uint64_t slotKey = slot.key.load(std::memory_order_relaxed);
+
+        if(slotKey == key){
+            return &slot;
+        }
+
+        if(slotKey == 0){
+
+            if(!insert || usedSlots == BCM_JOB_TABLE_SLOTS){
+                return nullptr;
+            }
+
+            slot.key.store(key, std::memory_order_release);
+            usedSlots++;
+            return &slot;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * Looks up the slot of a key. Can be called from any thread.
+ *
+ * @param key - The key of the job.
+ * @return The slot or nullptr if the key has no slot.
+ */
+const BcmJobTable::Slot* BcmJobTable::findSlot(uint64_t key) const{
+
+    size_t position = hashOf(key);
+
+    for(size_t probe = 0; probe < BCM_JOB_TABLE_SLOTS; probe++){
+
+        const Slot& slot = slots[(position + probe) & (BCM_JOB_TABLE_SLOTS - 1)];
+        uint64_t slotKey = slot.key.load(std::memory_order_acquire);
+
+        if(slotKey == key){
+            return &slot;
+        }
+
+        if(slotKey == 0){
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * Writes a state into a slot under its seqlock.
+ *
+ * @param slot   - The slot of the job.
+ * @param status - The new state.
+ */
+void BcmJobTable::write(Slot& slot, const BcmJobStatus& status){
+
+    std::array<uint64_t, statusWords> words{};
+    std::memcpy(words.data(), &status, sizeof(status));
+
+    // Mark the slot as being written
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for(size_t index = 0; index < statusWords; index++){
+        slot.words[index].store(words[index], std::memory_order_relaxed);
+    }
+
+    // Publish the new state
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
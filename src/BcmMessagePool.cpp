@@ -0,0 +1,213 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmMessagePool.cpp
+ \brief     Fixed-capacity lock-free pool of pre-sized BCM message buffers.
+            Every buffer also carries the memory for the boost::asio send
+            operation, so the steady-state send path does not allocate.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "BcmMessagePool.h"
+#include <cstring>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates the pool and allocates the memory of all slots once.
+ *
+ * @param messageSize - The size in bytes of the biggest message of a slot.
+ * @param slotCount   - The number of slots in the pool.
+ */
+BcmMessagePool::BcmMessagePool(std::size_t messageSize, std::size_t slotCount) :
+    messageSize(messageSize),
+    handlerOffset(((messageSize + alignof(std::max_align_t) - 1) / alignof(std::max_align_t)) * alignof(std::max_align_t)),
+    slotStride(((handlerOffset + BCM_HANDLER_MEMORY_SIZE + BCM_POOL_SLOT_ALIGNMENT - 1) / BCM_POOL_SLOT_ALIGNMENT) * BCM_POOL_SLOT_ALIGNMENT),
+    slotCount(slotCount),
+    storage(new CacheLine[(slotStride / BCM_POOL_SLOT_ALIGNMENT) * slotCount]),
+    handlerMemoryInUse(new bool[slotCount]()),
+    nextFree(new std::atomic<std::uint32_t>[slotCount]),
+    freeListHead(slotCount > 0 ? 0 : INVALID_INDEX){
+
+    // Chain all slots into the free list
+    for(std::size_t index = 0; index < slotCount; index++){
+
+        if(index + 1 < slotCount){
+            nextFree[index].store(static_cast<std::uint32_t>(index + 1), std::memory_order_relaxed);
+        }else{
+            nextFree[index].store(INVALID_INDEX, std::memory_order_relaxed);
+        }
+    }
+
+}
+
+/**
+ * Takes a free slot from the pool. The bcm_msg_head of the slot is zeroed.
+ *
+ * @return The buffer of the slot or an empty buffer if the pool is exhausted.
+ */
+BcmMessagePool::Buffer BcmMessagePool::acquire(){
+
+    std::uint64_t head = freeListHead.load(std::memory_order_acquire);
+
+    while(true){
+
+        auto index = static_cast<std::uint32_t>(head);
+
+        // Check if the pool is exhausted
+        if(index == INVALID_INDEX){
+            return {};
+        }
+
+        // Pop the slot and increase the tag to avoid the ABA problem
+        std::uint64_t next = nextFree[index].load(std::memory_order_relaxed);
+        std::uint64_t newHead = (((head >> 32) + 1) << 32) | next;
+
+        if(freeListHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire)){
+            std::memset(slot(index), 0, sizeof(bcm_msg_head));
+            return {this, index};
+        }
+    }
+
+}
+
+/**
+ * Puts a slot back into the pool.
+ *
+ * @param index - The index of the slot.
+ */
+void BcmMessagePool::release(std::uint32_t index){
+
+    std::uint64_t head = freeListHead.load(std::memory_order_relaxed);
+    std::uint64_t newHead = 0;
+
+    do{
+        nextFree[index].store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | index;
+    }while(!freeListHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+
+}
+
+/**
+ * Returns the memory of a slot.
+ *
+ * @param index - The index of the slot.
+ * @return Pointer to the first byte of the slot.
+ */
+std::uint8_t* BcmMessagePool::slot(std::uint32_t index) const{
+    return reinterpret_cast<std::uint8_t*>(storage.get()) + slotStride * index;
+}
+
+/**
+ * Returns the size in bytes that is available for a message in a slot.
+ *
+ * @return The message size of a slot.
+ */
+std::size_t BcmMessagePool::messageCapacity() const{
+    return messageSize;
+}
+
+/**
+ * Returns the number of slots of the pool.
+ *
+ * @return The slot count.
+ */
+std::size_t BcmMessagePool::slotCapacity() const{
+    return slotCount;
+}
+
+BcmMessagePool::Buffer::Buffer(BcmMessagePool* pool, std::uint32_t index) : pool(pool), index(index){
+}
+
+BcmMessagePool::Buffer::Buffer(Buffer&& other) noexcept : pool(other.pool), index(other.index){
+    other.pool  = nullptr;
+    other.index = INVALID_INDEX;
+}
+
+BcmMessagePool::Buffer& BcmMessagePool::Buffer::operator=(Buffer&& other) noexcept{
+
+    if(this != &other){
+        reset();
+        pool        = other.pool;
+        index       = other.index;
+        other.pool  = nullptr;
+        other.index = INVALID_INDEX;
+    }
+
+    return *this;
+}
+
+BcmMessagePool::Buffer::~Buffer(){
+    reset();
+}
+
+/**
+ * Checks if the buffer holds a slot.
+ *
+ * @return True if the buffer holds a slot.
+ */
+BcmMessagePool::Buffer::operator bool() const{
+    return pool != nullptr;
+}
+
+/**
+ * Gives the slot back to the pool.
+ */
+void BcmMessagePool::Buffer::reset(){
+
+    if(pool != nullptr){
+        pool->release(index);
+        pool  = nullptr;
+        index = INVALID_INDEX;
+    }
+
+}
+
+/**
+ * Returns the message memory of the slot.
+ *
+ * @return Pointer to the message memory.
+ */
+void* BcmMessagePool::Buffer::data() const{
+    return pool->slot(index);
+}
+
+/**
+ * Returns the size in bytes that is available for the message.
+ *
+ * @return The message size of the slot.
+ */
+std::size_t BcmMessagePool::Buffer::capacity() const{
+    return pool->messageSize;
+}
+
+/**
+ * Returns the bcm_msg_head at the beginning of the slot.
+ *
+ * @return Pointer to the bcm_msg_head.
+ */
+bcm_msg_head* BcmMessagePool::Buffer::head() const{
+    return static_cast<bcm_msg_head*>(data());
+}
+
+/**
+ * Returns an allocator for the handler memory behind the message.
+ *
+ * @return The allocator of the slot.
+ */
+BcmMessagePool::HandlerAllocator<void> BcmMessagePool::Buffer::handlerAllocator() const{
+    return {pool->slot(index) + pool->handlerOffset, &pool->handlerMemoryInUse[index]};
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,183 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmReceiveRing.cpp
+ \brief     Ring of pre-sized receive buffers that drains the BCM socket with
+            a single recvmmsg call. It also counts how many datagrams were
+            drained on each wakeup of the socket.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "BcmReceiveRing.h"
+#include <cerrno>
+#include <ctime>
+#include <cstring>
+#include <sys/time.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates the ring and allocates the memory of all receive buffers once.
+ *
+ * @param slotCount - The number of receive buffers.
+ * @param slotSize  - The size in bytes of a receive buffer.
+ */
+BcmReceiveRing::BcmReceiveRing(size_t slotCount, size_t slotSize) :
+    slotCount(slotCount),
+    slotSize(slotSize),
+    storage(new std::uint8_t[slotCount * slotSize]()),
+    controls(new std::uint8_t[slotCount * BCM_RX_CONTROL_SIZE]()),
+    iovecs(new struct iovec[slotCount]()),
+    headers(new struct mmsghdr[slotCount]()),
+    drainedHistogram(new std::atomic<std::uint64_t>[slotCount + 2]()){
+
+    // Point every message header to its receive buffer
+    for(size_t index = 0; index < slotCount; index++){
+        iovecs[index].iov_base = storage.get() + index * slotSize;
+        iovecs[index].iov_len  = slotSize;
+
+        headers[index].msg_hdr.msg_iov    = &iovecs[index];
+        headers[index].msg_hdr.msg_iovlen = 1;
+        headers[index].msg_hdr.msg_control = controls.get() + index * BCM_RX_CONTROL_SIZE;
+    }
+
+}
+
+/**
+ * Receives all queued datagrams of the socket that fit into the ring
+ * with a single non blocking recvmmsg call.
+ *
+ * @param fileDescriptor - The native handle of the BCM socket.
+ * @return The number of received datagrams, 0 if the socket queue is
+ *         empty or -1 on an error. The errno is set on an error.
+ */
+int BcmReceiveRing::drain(int fileDescriptor){
+
+    int result = 0;
+
+    // Note: The kernel shrinks msg_controllen to the received control messages
+    for(size_t index = 0; index < slotCount; index++){
+        headers[index].msg_hdr.msg_controllen = BCM_RX_CONTROL_SIZE;
+    }
+
+    do{
+        result = ::recvmmsg(fileDescriptor, headers.get(), slotCount, MSG_DONTWAIT, nullptr);
+    }while(result < 0 && errno == EINTR);
+
+    if(result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return 0;
+    }
+
+    return result;
+}
+
+/**
+ * Counts a wakeup of the socket with the number of drained datagrams.
+ *
+ * @param drainedDatagrams - The number of datagrams drained on this wakeup.
+ */
+void BcmReceiveRing::recordWakeup(size_t drainedDatagrams){
+
+    // Note: Only the io context thread writes the counters
+    wakeups.store(wakeups.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    datagrams.store(datagrams.load(std::memory_order_relaxed) + drainedDatagrams, std::memory_order_relaxed);
+
+    // A wakeup can drain the ring more than once
+    size_t bucket = drainedDatagrams <= slotCount ? drainedDatagrams : slotCount + 1;
+    drainedHistogram[bucket].store(drainedHistogram[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/**
+ * Returns a snapshot of the drain counters.
+ *
+ * @return The statistics of the ring.
+ */
+BcmReceiveRing::Statistics BcmReceiveRing::statistics() const{
+
+    Statistics result;
+    result.wakeups   = wakeups.load(std::memory_order_relaxed);
+    result.datagrams = datagrams.load(std::memory_order_relaxed);
+
+    for(size_t bucket = 0; bucket < slotCount + 2; bucket++){
+        result.drained.push_back(drainedHistogram[bucket].load(std::memory_order_relaxed));
+    }
+
+    return result;
+}
+
+/**
+ * Returns the number of receive buffers of the ring.
+ *
+ * @return The number of receive buffers.
+ */
+size_t BcmReceiveRing::size() const{
+    return slotCount;
+}
+
+/**
+ * Returns the data of a receive buffer.
+ *
+ * @param index - The index of the receive buffer.
+ * @return Pointer to the received datagram.
+ */
+const std::uint8_t* BcmReceiveRing::data(size_t index) const{
+    return storage.get() + index * slotSize;
+}
+
+/**
+ * Returns the number of bytes the last drain received into a receive buffer.
+ *
+ * @param index - The index of the receive buffer.
+ * @return The size of the received datagram.
+ */
+size_t BcmReceiveRing::bytes(size_t index) const{
+    return headers[index].msg_len;
+}
+
+/**
+ * Returns the kernel receive timestamp of the datagram in a receive buffer.
+ * Requires SO_TIMESTAMPNS or SO_TIMESTAMP on the socket. For RX_CHANGED and
+ * RX_TIMEOUT the BCM stamps the time of the frame or of the timeout.
+ *
+ * @param index - The index of the receive buffer.
+ * @return The timestamp in nanoseconds since the epoch or 0 if there is none.
+ */
+std::int64_t BcmReceiveRing::timestamp(size_t index) const{
+
+    const struct msghdr& header = headers[index].msg_hdr;
+
+    for(const struct cmsghdr* control = CMSG_FIRSTHDR(&header); control != nullptr;
+        control = CMSG_NXTHDR(const_cast<struct msghdr*>(&header), const_cast<struct cmsghdr*>(control))){
+
+        if(control->cmsg_level != SOL_SOCKET){
+            continue;
+        }
+
+        if(control->cmsg_type == SCM_TIMESTAMPNS){
+            struct timespec time = {0};
+            std::memcpy(&time, CMSG_DATA(control), sizeof(time));
+            return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+        }
+
+        if(control->cmsg_type == SCM_TIMESTAMP){
+            struct timeval time = {0};
+            std::memcpy(&time, CMSG_DATA(control), sizeof(time));
+            return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + static_cast<std::int64_t>(time.tv_usec) * 1000;
+        }
+    }
+
+    return 0;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
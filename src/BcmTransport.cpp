@@ -0,0 +1,96 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      BcmTransport.cpp
+ \brief     Transport of the BCM messages of a connector. The kernel transport
+            talks to the CAN_BCM socket of an interface, other transports like
+            the simulated BCM provide a socket that speaks the same protocol.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "BcmTransport.h"
+#include "InterfaceIndexIO.h"
+#include "Log.h"
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+int BcmTransport::send(int fileDescriptor, struct mmsghdr* headers, unsigned int count){
+    return ::sendmmsg(fileDescriptor, headers, count, MSG_DONTWAIT);
+}
+
+bool BcmTransport::supportsRawFastPath() const{
+    return true;
+}
+
+/**
+ * Opens a CAN_BCM socket and connects it to the interface.
+ *
+ * @param socket         - The socket that is opened.
+ * @param interfaceName  - The name of the CAN interface e.g. "can0".
+ * @param interfaceIndex - The index of the interface, set if it could be resolved.
+ * @return True if the socket is connected to the interface.
+ */
+bool KernelBcmTransport::open(boost::asio::generic::datagram_protocol::socket& socket, const std::string& interfaceName, int& interfaceIndex){
+
+    // Error code return value
+    boost::system::error_code errorCode;
+
+    // Define Address family and protocol
+    boost::asio::generic::datagram_protocol bcmProtocol(PF_CAN, CAN_BCM);
+
+    // Create a BCM socket
+    socket.open(bcmProtocol, errorCode);
+
+    // Check if we could open the socket correctly
+    if(errorCode){
+        Log::error("An error occurred on the open operation: ", errorCode.message());
+        return false;
+    }
+
+    // Create an I/O command and resolve the interface name to an interface index
+    InterfaceIndexIO interfaceIndexIO(interfaceName.c_str());
+    socket.io_control(interfaceIndexIO, errorCode);
+
+    // Check if we could resolve the interface correctly
+    if(errorCode){
+        Log::error("An error occurred on the io control operation for interface ", interfaceName, ": ", errorCode.message());
+        return false;
+    }
+
+    // Note: The index is reused by the CAN_RAW socket
+    interfaceIndex = interfaceIndexIO.index();
+
+    // Connect the socket
+    sockaddr_can addr = {0};
+    addr.can_family   = AF_CAN;
+    addr.can_ifindex  = interfaceIndex;
+
+    boost::asio::generic::datagram_protocol::endpoint bcmEndpoint{&addr, sizeof(addr)};
+    socket.connect(bcmEndpoint, errorCode);
+
+    // Check if we could connect correctly
+    if(errorCode){
+        Log::error("An error occurred on the connect operation: ", errorCode.message());
+        return false;
+    }
+
+    // Note: In contrast to a raw CAN socket there is no need to
+    // explicitly enable CANFD for an BCM socket with setsockopt!
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -13,71 +13,206 @@
  * INCLUDES
  ******************************************************************************/
 #include "CANConnector.h"
+#include "Trace.h"
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <linux/can/raw.h>
 
 
 /*******************************************************************************
  * FUNCTION DEFINITIONS
  ******************************************************************************/
 
-CANConnector::CANConnector() : ioContext(boost::make_shared<boost::asio::io_context>()), bcmSocket(createBcmSocket()){
+/**
+ * Creates a connector for the interface of the environment variable
+ * INTERFACE_ENVIRONMENT_VARIABLE or for INTERFACE if it is not set.
+ */
+CANConnector::CANConnector() : CANConnector(defaultInterfaceName()){}
+
+/**
+ * Creates a connector for an interface with its own io context loop thread.
+ *
+ * @param interfaceName - The name of the CAN interface e.g. "can0".
+ * @param transport     - The transport of the BCM messages, the kernel BCM if empty.
+ */
+CANConnector::CANConnector(const std::string& interfaceName, std::shared_ptr<BcmTransport> transport) :
+    CANConnector(interfaceName, boost::make_shared<boost::asio::io_context>(), true, std::move(transport)){}
+
+/**
+ * Creates a connector for an interface on a shared io context. The io context
+ * must be run by exactly one thread, e.g. a thread of an IoContextPool.
+ *
+ * @param interfaceName - The name of the CAN interface e.g. "can0".
+ * @param context       - The shared io context.
+ * @param transport     - The transport of the BCM messages, the kernel BCM if empty.
+ */
+CANConnector::CANConnector(const std::string& interfaceName, boost::shared_ptr<boost::asio::io_context> context,
+                           std::shared_ptr<BcmTransport> transport) :
+    CANConnector(interfaceName, std::move(context), false, std::move(transport)){}
+
+CANConnector::CANConnector(const std::string& interfaceName, boost::shared_ptr<boost::asio::io_context> context, bool ownsIoContext,
+                           std::shared_ptr<BcmTransport> transport) :
+    interfaceName(interfaceName), ownsIoContext(ownsIoContext), ioContext(std::move(context)),
+    transport(transport ? std::move(transport) : std::make_shared<KernelBcmTransport>()), bcmSocket(createBcmSocket()),
+    rawSocket(createRawSocket()),
+    txQueueEvent(*ioContext, ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), txBackoffTimer(*ioContext), captureTimer(*ioContext){
 
     // Create the first receive operation
-    receiveOnSocket();
+    if(connected){
+        receiveOnSocket();
+    }
+
+    // Create the first wait operation for the submission queue
+    waitForTxQueue();
 
     // Start the io context loop
-    startProcessing();
+    if(ownsIoContext){
+        startProcessing();
+    }
 
-    std::cout << "CAN Connector created" << std::endl;
+    Log::info("CAN Connector created for interface ", interfaceName);
 }
 
 CANConnector::~CANConnector(){
 
-    // Stop the io context
-    stopProcessing();
+    // Stop the io context or leave the shared io context
+    if(ownsIoContext){
+        stopProcessing();
+    }else{
+        detachFromIoContext();
+    }
+
+    // Readers of the broadcast ring may outlive the connector
+    if(rxBroadcast != nullptr){
+        rxBroadcast->close();
+    }
+
+    Log::info("CAN Connector destroyed for interface ", interfaceName);
+}
+
+/**
+ * Returns the name of the interface a default constructed connector uses.
+ *
+ * @return The interface name.
+ */
+std::string CANConnector::defaultInterfaceName(){
+
+    const char* name = std::getenv(INTERFACE_ENVIRONMENT_VARIABLE);
+
+    return (name != nullptr && *name != '\0') ? std::string(name) : std::string(INTERFACE);
+}
+
+/**
+ * Returns the name of the CAN interface of the connector.
+ *
+ * @return The interface name.
+ */
+const std::string& CANConnector::getInterfaceName() const{
+    return interfaceName;
+}
+
+/**
+ * Returns the executor of the io context thread the handlers of the connector run in.
+ *
+ * @return The executor.
+ */
+boost::asio::io_context::executor_type CANConnector::getExecutor() const{
+    return ioContext->get_executor();
+}
+
+/**
+ * Checks if the BCM socket could be connected to the interface.
+ *
+ * @return True if the interface was resolved and the socket is connected.
+ */
+bool CANConnector::isConnected() const{
+    return connected;
+}
 
-    std::cout << "CAN Connector destroyed" << std::endl;
+/**
+ * Checks if one-shot frames are sent on the CAN_RAW socket.
+ *
+ * @return True if the CAN_RAW socket is bound to the interface.
+ */
+bool CANConnector::hasRawFastPath() const{
+    return rawSocket.is_open();
 }
 
 /**
- * Creates the bcmSocket data member.
+ * Creates the bcmSocket data member with the transport of the connector.
  *
  * @return The BCM socket.
  */
 boost::asio::generic::datagram_protocol::socket CANConnector::createBcmSocket() {
 
+    boost::asio::generic::datagram_protocol::socket socket(*ioContext);
+
+    connected = transport->open(socket, interfaceName, interfaceIndex);
+
+    // Let the kernel stamp every received datagram
+    int enable = 1;
+
+    if(socket.is_open() && ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0){
+        Log::warning("Could not enable kernel receive timestamps: ", std::strerror(errno));
+    }
+
+    return socket;
+}
+
+/**
+ * Creates the rawSocket data member. The socket is bound to the interface of
+ * the BCM socket and only sends the frames of TX_SEND operations. The socket
+ * is closed if any step fails, the frames are then sent by the BCM.
+ *
+ * @return The CAN_RAW socket.
+ */
+boost::asio::generic::raw_protocol::socket CANConnector::createRawSocket(){
+
+    boost::asio::generic::raw_protocol::socket socket(*ioContext);
+
+    // Error handling / Sanity check
+    if(!TX_RAW_FAST_PATH || !connected || !transport->supportsRawFastPath()){
+        return socket;
+    }
+
     // Error code return value
     boost::system::error_code errorCode;
 
-    // Define Address family and protocol
-    boost::asio::generic::datagram_protocol bcmProtocol(PF_CAN, CAN_BCM);
+    // Create a CAN_RAW socket
+    socket.open(boost::asio::generic::raw_protocol(PF_CAN, CAN_RAW), errorCode);
 
-    // Create a BCM socket
-    boost::asio::generic::datagram_protocol::socket socket(*ioContext, bcmProtocol);
+    // Check if we could open the socket correctly
+    if(errorCode){
+        Log::warning("Could not open the CAN_RAW socket, one-shot frames are sent by the BCM: ", errorCode.message());
+        return socket;
+    }
 
-    // Create an I/O command and resolve the interface name to an interface index
-    InterfaceIndexIO interfaceIndexIO(INTERFACE);
-    socket.io_control(interfaceIndexIO, errorCode);
+    // Disable all receive filters and allow CANFD frames
+    int enable = 1;
 
-    // Check if we could resolve the interface correctly
-    if(errorCode){
-        std::cout << "An error occurred on the io control operation: " << errorCode.message() << std::endl;
+    if((::setsockopt(socket.native_handle(), SOL_CAN_RAW, CAN_RAW_FILTER, nullptr, 0) < 0 ||
+                      ::setsockopt(socket.native_handle(), SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)) < 0)){
+        errorCode = boost::system::error_code(errno, boost::system::system_category());
     }
 
-    // Connect the socket
-    sockaddr_can addr = {0};
-    addr.can_family   = AF_CAN;
-    addr.can_ifindex  = interfaceIndexIO.index();
+    // Bind the socket to the interface
+    if(!errorCode){
+        sockaddr_can addr = {0};
+        addr.can_family   = AF_CAN;
+        addr.can_ifindex  = interfaceIndex;
 
-    boost::asio::generic::datagram_protocol::endpoint bcmEndpoint{&addr, sizeof(addr)};
-    socket.connect(bcmEndpoint, errorCode);
+        socket.bind(boost::asio::generic::raw_protocol::endpoint{&addr, sizeof(addr)}, errorCode);
+    }
 
-    // Check if we could connect correctly
     if(errorCode){
-        std::cout << "An error occurred on the connect operation: " << errorCode.message() << std::endl;
-    }
+        Log::warning("Could not set up the CAN_RAW socket, one-shot frames are sent by the BCM: ", errorCode.message());
 
-    // Note: In contrast to a raw CAN socket there is no need to
-    // explicitly enable CANFD for an BCM socket with setsockopt!
+        boost::system::error_code closeError;
+        socket.close(closeError);
+    }
 
     return socket;
 }
@@ -90,7 +225,7 @@ void CANConnector::startProcessing(){
     // Run the io context in its own thread
     ioContextThread = std::thread(&CANConnector::ioContextThreadFunction, this, std::ref(ioContext));
 
-    std::cout << "CAN Connector starting io context loop processing" << std::endl;
+    Log::info("CAN Connector starting io context loop processing");
 }
 
 /**
@@ -107,10 +242,40 @@ void CANConnector::stopProcessing(){
     if(ioContextThread.joinable()){
         ioContextThread.join();
     }else{
-        std::cout << "Error ioContextThread was not joinable" << std::endl;
+        Log::error("Error ioContextThread was not joinable");
+    }
+
+    Log::info("CAN Connector stopped io context loop processing");
+}
+
+/**
+ * Closes the socket and the eventfd of the connector on a shared io context and
+ * waits until the completion handlers that refer to the connector are finished.
+ */
+void CANConnector::detachFromIoContext(){
+
+    // Error handling / Sanity check
+    if(ioContext->stopped()){
+        return;
     }
 
-    std::cout << "CAN Connector stopped io context loop processing" << std::endl;
+    std::promise<void> detached;
+
+    boost::asio::post(*ioContext, [this, &detached](){
+
+        boost::system::error_code errorCode;
+        bcmSocket.close(errorCode);
+        rawSocket.close(errorCode);
+        txQueueEvent.close(errorCode);
+        txBackoffTimer.cancel();
+        captureTimer.cancel();
+
+        // Note: Closing queues the aborted completion handlers,
+        // this handler is queued behind them.
+        boost::asio::post(*ioContext, [&detached](){ detached.set_value(); });
+    });
+
+    detached.get_future().wait();
 }
 
 /**
@@ -121,63 +286,122 @@ void CANConnector::ioContextThreadFunction(const boost::shared_ptr<boost::asio::
 }
 
 /**
- * Receives on the BCM socket. The received data is stored in the rxBuffer.
- * After processing the receive operation the next receive operation is
- * created to keep  the io context loop running.
+ * Calculates the size in bytes of a BCM message with a bcm_msg_head
+ * that is followed by exactly nframes CAN or CANFD frames.
+ *
+ * @param nframes - The number of frames behind the bcm_msg_head.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return The size of the message in bytes.
+ */
+size_t CANConnector::bcmMessageSize(uint32_t nframes, bool isCANFD){
+
+    if(isCANFD){
+        return BcmMessageBuilder<canfd_frame>::messageSize(nframes);
+    }else{
+        return BcmMessageBuilder<can_frame>::messageSize(nframes);
+    }
+
+}
+
+/**
+ * Takes a buffer for a BCM message from the smallest pool that fits the message.
+ *
+ * @param msgSize - The size of the message in bytes.
+ * @return The buffer or an empty buffer if the pool is exhausted.
+ */
+BcmMessagePool::Buffer CANConnector::acquireMessage(size_t msgSize){
+
+    if(msgSize <= singleFramePool.messageCapacity()){
+        return singleFramePool.acquire();
+    }
+
+    if(msgSize <= multipleFramesPool.messageCapacity()){
+        return multipleFramesPool.acquire();
+    }
+
+    return {};
+}
+
+/**
+ * Waits until the BCM socket is readable and drains all queued datagrams
+ * into the rxRing with recvmmsg. The decoded notifications of every drain
+ * are handed over as a batch. After processing the wakeup the next wait
+ * operation is created to keep the io context loop running.
  */
 void CANConnector::receiveOnSocket(){
 
-    std::cout << "CAN Connector created new receive operation" << std::endl;
+    Log::debug("CAN Connector created new receive operation");
 
-    // Create an async receive operation on the BCM socket
-    bcmSocket.async_receive(boost::asio::buffer(rxBuffer),
-                            [this](boost::system::error_code errorCode, std::size_t receivedBytes){
+    // Create an async wait operation on the BCM socket
+    bcmSocket.async_wait(boost::asio::socket_base::wait_read, [this](boost::system::error_code errorCode){
 
-        // Lambda completion function for the async receive operation
+        // Lambda completion function for the async wait operation
+
+        // The socket was closed or the operation was cancelled
+        if(errorCode == boost::asio::error::operation_aborted){
+            return;
+        }
 
         // Check the error code of the operation
         if(!errorCode){
 
-            std::cout << "CAN Connector received: " << receivedBytes << " bytes" << std::endl;
+            CAN_BCM_TRACE_SCOPE(traceScope, rx_drain);
+            size_t drainedDatagrams = 0;
 
-            // We need to receive at least a whole bcm_msg_head
-            if(receivedBytes >= sizeof(bcm_msg_head)){
+            // Drain the socket until it is empty. A full ring means there may be more datagrams.
+            while(true){
 
-                // Get the bcm_msg_head
-                const auto* head = reinterpret_cast<const bcm_msg_head*>(rxBuffer.data());
+                int receivedDatagrams = rxRing.drain(bcmSocket.native_handle());
 
-                // Check if the message contains CAN or CANFD frames
-                bool isCANFD = false;
-
-                if(head->flags & CAN_FD_FRAME){
-                    isCANFD = true;
+                if(receivedDatagrams < 0){
+                    metrics.recordRxError(errno);
+                    Log::error("An error occurred on the recvmmsg operation: ", std::strerror(errno));
+                    break;
                 }
 
-                // Calculate the expected size in bytes of the whole
-                // message based upon the bcm_msg_head information.
-                size_t expectedBytes = 0;
+                // Decode all datagrams of this drain
+                size_t nnotifications = 0;
 
-                if(isCANFD){
-                    expectedBytes = head->nframes * sizeof(canfd_frame) + sizeof(bcm_msg_head);
-                }else{
-                    expectedBytes = head->nframes * sizeof(can_frame)   + sizeof(bcm_msg_head);
-                }
+                // Note: All datagrams of one drain share the same dispatch time
+                int64_t dispatchTimestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
 
-                // Check if we received the whole message
-                if(receivedBytes == expectedBytes){
+                for(int index = 0; index < receivedDatagrams; index++){
 
-                    // Get the pointer to the frames and call the next function to process the data
-                    auto frames = reinterpret_cast<void *>(rxBuffer.data() + sizeof(bcm_msg_head));
-                    handleReceivedData(head, frames, head->nframes, isCANFD);
+                    BcmNotification& notification = rxNotifications[nnotifications];
 
-                }else{
-                    std::cout << "The expected amount of bytes is not equal to the received bytes" << std::endl;
+                    if(decodeMessage(rxRing.data(index), rxRing.bytes(index), notification)){
+
+                        // Fall back to the dispatch time if the kernel did not stamp the datagram
+                        notification.dispatchTimestamp = dispatchTimestamp;
+                        notification.timestamp         = rxRing.timestamp(index);
+
+                        if(notification.timestamp == 0){
+                            notification.timestamp = dispatchTimestamp;
+                        }
+
+                        // The time from the kernel receive to the drain of the socket
+                        CAN_BCM_TRACE_COMPLETE(rx_kernel, Trace::now(), dispatchTimestamp - notification.timestamp, notification.head->can_id);
+
+                        nnotifications++;
+                    }
                 }
 
+                handleReceivedBatch(rxNotifications.data(), nnotifications);
+
+                drainedDatagrams += receivedDatagrams;
+
+                if(static_cast<size_t>(receivedDatagrams) < rxRing.size()){
+                    break;
+                }
             }
 
+            Log::debug("CAN Connector drained: ", drainedDatagrams, " datagrams");
+            CAN_BCM_TRACE_COUNT(traceScope, drainedDatagrams);
+            rxRing.recordWakeup(drainedDatagrams);
+
         }else{
-            std::cout << "An error occurred on the async receive operation: " << errorCode.message() << std::endl;
+            Log::error("An error occurred on the async wait operation: ", errorCode.message());
         }
 
         // Create the next receive operation
@@ -188,461 +412,2157 @@ void CANConnector::receiveOnSocket(){
 }
 
 /**
- * Create a non cyclic transmission task for a single CAN/CANFD frame.
+ * Checks a received datagram and decodes the bcm_msg_head and the frames.
  *
- * @param frame   - The frame that should be send.
- * @param isCANFD - Flag for a CANFD frame.
+ * @param data          - The received datagram.
+ * @param receivedBytes - The size of the received datagram.
+ * @param notification  - The decoded notification.
+ * @return True if the datagram contains a whole BCM message.
  */
-void CANConnector::txSendSingleFrame(struct canfd_frame frame, bool isCANFD){
+bool CANConnector::decodeMessage(const std::uint8_t* data, size_t receivedBytes, BcmNotification& notification){
 
-    // BCM message we are sending with a single CAN or CANFD frame
-    std::shared_ptr<void> msg = nullptr;
-    size_t msgSize = 0;
+    Log::debug("CAN Connector received: ", receivedBytes, " bytes");
 
-    // Check if we are sending CAN or CANFD frames
-    // and create the according struct
-    if(isCANFD){
-        msgSize = sizeof(struct bcmMsgSingleFrameCanFD);
-        auto msgCANFD = std::make_shared<bcmMsgSingleFrameCanFD>();
-        msg = std::reinterpret_pointer_cast<void>(msgCANFD);
-    }else {
-        msgSize = sizeof(struct bcmMsgSingleFrameCan);
-        auto msgCAN = std::make_shared<bcmMsgSingleFrameCan>();
-        msg = std::reinterpret_pointer_cast<void>(msgCAN);
+    // We need to receive at least a whole bcm_msg_head
+    if(receivedBytes < sizeof(bcm_msg_head)){
+        metrics.recordRxBadSize();
+        return false;
+    }
+
+    // Get the bcm_msg_head
+    const auto* head = reinterpret_cast<const bcm_msg_head*>(data);
+
+    // Check if the message contains CAN or CANFD frames
+    bool isCANFD = false;
+
+    if(head->flags & CAN_FD_FRAME){
+        isCANFD = true;
+    }
+
+    // Calculate the expected size in bytes of the whole
+    // message based upon the bcm_msg_head information.
+    size_t expectedBytes = bcmMessageSize(head->nframes, isCANFD);
+
+    // Check if we received the whole message
+    if(receivedBytes != expectedBytes){
+        Log::warning("The expected amount of bytes is not equal to the received bytes");
+        metrics.recordRxBadSize();
+        return false;
     }
 
+    metrics.recordRx(head->opcode, receivedBytes);
+
+    // Get the pointer to the frames
+    notification.head    = head;
+    notification.frames  = const_cast<std::uint8_t*>(data) + sizeof(bcm_msg_head);
+    notification.nframes = head->nframes;
+    notification.isCANFD = isCANFD;
+
+    return true;
+}
+
+/**
+ * Stores the frames of a RX_CHANGED notification in the shadow cache.
+ *
+ * @param notification - The RX_CHANGED notification.
+ */
+void CANConnector::updateShadowCache(const BcmNotification& notification){
+
+    for(uint32_t index = 0; index < notification.nframes; index++){
+
+        struct canfd_frame frame = {0};
+
+        if(notification.isCANFD){
+            frame = static_cast<const struct canfd_frame*>(notification.frames)[index];
+        }else{
+            std::memcpy(&frame, static_cast<const struct can_frame*>(notification.frames) + index, sizeof(struct can_frame));
+        }
+
+        rxShadowCache.update(frame, notification.isCANFD, notification.timestamp);
+    }
+
+}
+
+/**
+ * Reads the last received frame of a CAN ID from the shadow cache.
+ * Can be called from any thread without touching the io context thread.
+ *
+ * @param canID    - The CAN ID.
+ * @param snapshot - The copy of the last received frame and its receive time.
+ * @return False if no frame of the CAN ID was received yet.
+ */
+bool CANConnector::getLatestFrame(canid_t canID, RxShadowSnapshot& snapshot) const{
+    return rxShadowCache.read(canID, snapshot);
+}
+
+/**
+ * Returns the state of a TX job from the job table without a syscall.
+ * Can be called from any thread.
+ *
+ * @param canID   - The CAN ID of the TX job.
+ * @param isCANFD - Flag for a CANFD job.
+ * @param status  - The copy of the state.
+ * @return False if no TX job is installed for the CAN ID.
+ */
+bool CANConnector::getTxJob(canid_t canID, bool isCANFD, BcmJobStatus& status) const{
+    return jobTable.lookup(canID, isCANFD, true, status);
+}
+
+/**
+ * Returns the state of a RX job from the job table without a syscall.
+ * Can be called from any thread.
+ *
+ * @param canID   - The CAN ID of the RX job.
+ * @param isCANFD - Flag for a CANFD job.
+ * @param status  - The copy of the state.
+ * @return False if no RX job is installed for the CAN ID.
+ */
+bool CANConnector::getRxJob(canid_t canID, bool isCANFD, BcmJobStatus& status) const{
+    return jobTable.lookup(canID, isCANFD, false, status);
+}
+
+/**
+ * Returns the occupancy of the transmission path. Can be called from any
+ * thread, e.g. by a producer that throttles itself before the queue is full.
+ *
+ * @return The occupancy.
+ */
+TxQueueStatus CANConnector::getTxQueueStatus() const{
+
+    TxQueueStatus status;
+    status.queued    = txQueue.size();
+    status.backlog   = txBacklogDepth.load(std::memory_order_relaxed);
+    status.congested = txCongested.load(std::memory_order_relaxed);
+
+    return status;
+}
+
+/**
+ * Sets what happens to the one-shot frames of a CAN ID while the socket is
+ * congested. With Block the frames wait until the backlog budget is used up
+ * and the submission queue fills. With Drop or OverwriteOldest at most limit
+ * frames of the CAN ID wait, the surplus is completed with no_buffer_space.
+ *
+ * @param canID   - The CAN ID of the frames.
+ * @param isCANFD - Flag for CANFD frames.
+ * @param policy  - The overflow policy.
+ * @param limit   - The number of frames of the CAN ID that may wait.
+ */
+void CANConnector::setTxOverflowPolicy(canid_t canID, bool isCANFD, TxOverflowPolicy policy, size_t limit){
+
+    // The backlog is only accessed in the io context loop thread
+    boost::asio::post(*ioContext, [this, canID, isCANFD, policy, limit](){
+        txBacklog.setPolicy(canID, isCANFD, policy, limit);
+    });
+
+}
+
+/**
+ * Hands over the decoded notifications of one drain of the socket.
+ *
+ * @param notifications  - The decoded notifications.
+ * @param nnotifications - The number of notifications.
+ */
+void CANConnector::handleReceivedBatch(const BcmNotification notifications[], size_t nnotifications){
+
+    CAN_BCM_TRACE_SCOPE(traceScope, rx_dispatch);
+    CAN_BCM_TRACE_COUNT(traceScope, nnotifications);
+
+    // Write the batch once into the broadcast ring, the readers see it with a single commit
+    RxBroadcastRing* ring = rxBroadcastRing.load(std::memory_order_acquire);
+
+    if(ring != nullptr){
+
+        for(size_t index = 0; index < nnotifications; index++){
+            ring->publish(notifications[index]);
+        }
+
+        ring->commit();
+    }
+
+    for(size_t index = 0; index < nnotifications; index++){
+        handleReceivedData(notifications[index]);
+    }
+
+}
+
+/**
+ * Puts a single BCM message into the submission queue. The io context loop
+ * thread sends the queued messages in batches. Can be called from any thread,
+ * it never blocks, never allocates and never touches the socket.
+ *
+ * @param msg         - The built BCM message.
+ * @param description - The description of the operation for the log output.
+ * @param completion  - Optional completion that receives the result of the message.
+ * @return False if the message is empty or the submission queue is full.
+ */
+bool CANConnector::sendMessage(BcmMessage msg, const char* description, BcmBatch::Completion completion){
+
     // Error handling / Sanity check
-    if(msg == nullptr){
-        std::cout << "Error could not make message structure" << std::endl;
+    if(!msg.buffer){
+        Log::error("Error could not make message structure");
+        metrics.recordTxRejected();
+        completeAsync(completion, boost::asio::error::no_buffer_space);
+        return false;
     }
 
-    // Fill out the message
-    if(isCANFD){
-        std::shared_ptr<bcmMsgSingleFrameCanFD> msgCANFD = std::reinterpret_pointer_cast<bcmMsgSingleFrameCanFD>(msg);
+    TxCommand command{std::move(msg), nullptr, std::move(completion), ConnectorMetrics::now()};
 
-        msgCANFD->msg_head.opcode  = TX_SEND;
-        msgCANFD->msg_head.flags   = CAN_FD_FRAME;
-        msgCANFD->msg_head.can_id  = frame.can_id;
-        msgCANFD->msg_head.nframes = 1;
-        msgCANFD->canfdFrame[0]    = frame;
-    }else{
-        std::shared_ptr<bcmMsgSingleFrameCan> msgCAN = std::reinterpret_pointer_cast<bcmMsgSingleFrameCan>(msg);
-        auto canFrame = (struct can_frame *) &frame;
+    // Note: The span of a message is identified by its pooled buffer, which is unique while it is in flight
+    CAN_BCM_TRACE_BEGIN(tx_message, reinterpret_cast<uintptr_t>(command.msg.buffer.head()), command.msg.buffer.head()->can_id);
+
+    // Note: A rejected command is not moved, so we still own the completion
+    if(!enqueue(std::move(command))){
+        CAN_BCM_TRACE_END(tx_message, reinterpret_cast<uintptr_t>(command.msg.buffer.head()), command.msg.buffer.head()->can_id);
+        Log::error("Transmission of ", description, " failed: the submission queue is full");
+        metrics.recordTxRejected();
+        completeAsync(command.completion, boost::asio::error::no_buffer_space);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Puts a batch into the submission queue. The messages are sent with a
+ * single sendmmsg call on the BCM socket by the io context loop thread.
+ * The handler is called exactly once after all messages were processed.
+ * The result of every message can be read with BcmBatch::errorCode.
+ *
+ * @param batch   - The batch with the messages that should be send.
+ * @param handler - The completion function for the whole batch.
+ */
+void CANConnector::submitBatch(std::unique_ptr<BcmBatch> batch, BcmBatch::Handler handler){
 
-        msgCAN->msg_head.opcode    = TX_SEND;
-        msgCAN->msg_head.can_id    = canFrame->can_id;
-        msgCAN->msg_head.nframes   = 1;
-        msgCAN->canFrame[0]        = *canFrame;
+    // Error handling / Sanity check
+    if(batch == nullptr){
+        return;
     }
 
-    // Note: buffer doesn't accept smart pointers. Need to use a regular pointer.
-    boost::asio::const_buffer buffer = boost::asio::buffer(msg.get(), msgSize);
+    batch->handler = std::move(handler);
+    batch->submitTimes.fill(ConnectorMetrics::now());
 
-    // Note: Must guarantee the validity of the argument until the handler is invoked.
-    // We guarantee the validity through the lambda capture of the smart pointer.
+    for(size_t index = 0; index < batch->size(); index++){
+        CAN_BCM_TRACE_BEGIN(tx_message, reinterpret_cast<uintptr_t>(batch->head(index)), batch->head(index)->can_id);
+    }
 
-    // Note: The TX_SEND operation can only handle exactly one frame!
-    bcmSocket.async_send(buffer, [msg](boost::system::error_code errorCode, std::size_t size){
+    TxCommand command{{}, std::move(batch), {}};
+
+    // Note: A rejected command is not moved, so we still own the batch
+    if(!enqueue(std::move(command))){
+        Log::error("Transmission of batch failed: the submission queue is full");
+        metrics.recordTxRejected(command.batch->size());
+        command.batch->fail(boost::asio::error::no_buffer_space);
+        command.batch->completeMessages();
+
+        for(size_t index = 0; index < command.batch->size(); index++){
+            CAN_BCM_TRACE_END(tx_message, reinterpret_cast<uintptr_t>(command.batch->head(index)), command.batch->head(index)->can_id);
+        }
+
+        if(command.batch->handler){
+            command.batch->handler(*command.batch);
+        }
+    }
+
+}
+
+/**
+ * Puts a command into the submission queue and wakes up the
+ * io context loop thread if no wakeup is pending yet.
+ *
+ * @param command - The command.
+ * @return False if the submission queue is full.
+ */
+bool CANConnector::enqueue(TxCommand&& command){
+
+    if(!txQueue.push(std::move(command))){
+        return false;
+    }
+
+    // Note: Only the first producer after a drain writes to the eventfd. The exchange is
+    // sequentially consistent, so it is ordered with the fence of the consumer in waitForTxQueue
+    if(!txQueueWakeupPending.exchange(true, std::memory_order_seq_cst)){
+        uint64_t wakeup = 1;
+
+        if(::write(txQueueEvent.native_handle(), &wakeup, sizeof(wakeup)) < 0){
+            Log::error("An error occurred on the write to the submission queue eventfd: ", std::strerror(errno));
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Waits until the submission queue eventfd is signalled and drains the queue.
+ */
+void CANConnector::waitForTxQueue(){
+
+    txQueueEvent.async_wait(boost::asio::posix::descriptor_base::wait_read, [this](boost::system::error_code errorCode){
 
-        // Lambda completion function for the async TX_SEND operation
+        // Lambda completion function for the async wait operation
+
+        // The descriptor was closed or the operation was cancelled
+        if(errorCode == boost::asio::error::operation_aborted){
+            return;
+        }
 
-        // Check boost asio error code
         if(!errorCode){
-            std::cout << "Transmission of TX_SEND completed successfully" << std::endl;
+
+            // Reset the eventfd before draining so no wakeup gets lost
+            uint64_t wakeups = 0;
+
+            if(::read(txQueueEvent.native_handle(), &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN){
+                Log::error("An error occurred on the read of the submission queue eventfd: ", std::strerror(errno));
+            }
+
+            // Note: The fence orders the store before the loads of the drain. Without it a producer
+            // could still see the pending flag while the drain misses its message, which loses the wakeup
+            txQueueWakeupPending.store(false, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            drainTxQueue();
+
         }else{
-            std::cerr << "Transmission of TX_SEND failed" << std::endl;
+            Log::error("An error occurred on the async wait operation: ", errorCode.message());
+        }
+
+        // Create the next wait operation
+        waitForTxQueue();
+
+    });
+
+}
+
+/**
+ * Takes all commands from the submission queue. Single messages are collected
+ * in batches, so a burst of messages only needs a single sendmmsg call.
+ * Only called in the io context loop thread.
+ */
+void CANConnector::drainTxQueue(){
+
+    TxCommand command;
+    std::unique_ptr<BcmBatch> batch;
+
+    metrics.recordTxQueueDepth(txQueue.size());
+
+    // Note: While a batch waits for the socket we keep the order and stop sending
+    while(blockedBatch == nullptr){
+
+        // A queued batch that had to wait for the collected messages
+        if(pendingBatch != nullptr){
+            sendBatch(std::move(pendingBatch));
+            continue;
         }
 
+        // The commands of the backlog are older than the queued ones
+        if(!txBacklog.pop(command) && !txQueue.pop(command)){
+            break;
+        }
+
+        if(command.batch != nullptr){
+
+            // Send the collected messages first to keep the order
+            if(batch != nullptr){
+                flushBatch(std::move(batch));
+            }
+
+            pendingBatch = std::move(command.batch);
+            continue;
+        }
+
+        if(batch == nullptr){
+            batch = acquireBatch();
+        }
+
+        batch->add(std::move(command.msg), std::move(command.completion));
+        batch->submitTimes[batch->size() - 1] = command.submitted;
+
+        if(batch->full()){
+            flushBatch(std::move(batch));
+        }
+    }
+
+    if(batch != nullptr){
+        flushBatch(std::move(batch));
+    }
+
+    // While the socket is congested the queued commands move into the backlog,
+    // where the overflow policies of their CAN IDs apply
+    while(blockedBatch != nullptr && txBacklog.size() < TX_BACKLOG_BUDGET && txQueue.pop(command)){
+
+        TxCommand displaced;
+        TxBacklog::Result result = txBacklog.push(std::move(command), displaced);
+
+        if(result == TxBacklog::Result::Dropped){
+            metrics.recordTxRejected();
+        }else if(result == TxBacklog::Result::Overwritten){
+            metrics.recordTxOverwritten();
+        }
+
+        completeAsync(displaced.completion, boost::asio::error::no_buffer_space);
+    }
+
+    txBacklogDepth.store(txBacklog.size(), std::memory_order_relaxed);
+}
+
+/**
+ * Sends a batch with the single messages that were collected from the submission queue.
+ *
+ * @param batch - The batch with the collected messages.
+ */
+void CANConnector::flushBatch(std::unique_ptr<BcmBatch> batch){
+
+    batch->handler = [](const BcmBatch& result){ logBatchResult(result, "queued BCM messages"); };
+    sendBatch(std::move(batch));
+}
+
+/**
+ * Sends the remaining messages of a batch. If the socket would block we wait
+ * until the socket is writable again and continue with the remaining messages.
+ * If the transmit queue of the interface is full (ENOBUFS) we retry the message
+ * after an exponential backoff and fail it after TX_ENOBUFS_MAX_RETRIES retries.
+ * Only called in the io context loop thread.
+ *
+ * @param batch - The batch with the messages that should be send.
+ */
+void CANConnector::sendBatch(std::unique_ptr<BcmBatch> batch){
+
+    int rawDescriptor = -1;
+
+    // The time from the submission to the first send attempt is spent in the queue and the io context
+    if(batch->sent == 0){
+        for(size_t index = 0; index < batch->size(); index++){
+            CAN_BCM_TRACE_INSTANT(tx_send, reinterpret_cast<uintptr_t>(batch->head(index)), batch->head(index)->can_id);
+        }
+    }
+
+    // One-shot frames bypass the BCM if the CAN_RAW socket is available
+    if(rawSocket.is_open()){
+        rawDescriptor = rawSocket.native_handle();
+
+        if(batch->sent == 0){
+            batch->routeRaw();
+        }
+    }
+
+    // The span covers the sendmmsg calls and the completions of the batch
+    CAN_BCM_TRACE_SCOPE(traceScope, tx_batch);
+    CAN_BCM_TRACE_COUNT(traceScope, batch->size() - batch->sent);
+
+    // Check if all messages were processed
+    while(!batch->sendOn(*transport, bcmSocket.native_handle(), rawDescriptor)){
+
+        // The interface stays congested, the message fails and the rest is continued
+        if(batch->congested && batch->retries >= TX_ENOBUFS_MAX_RETRIES){
+            batch->skip(boost::system::error_code(ENOBUFS, boost::system::system_category()));
+            continue;
+        }
+
+        waitForSocket(std::move(batch));
+        return;
+    }
+
+    completeBatch(std::move(batch));
+}
+
+/**
+ * Parks a batch until its socket is writable or the ENOBUFS backoff is over.
+ * The draining of the submission queue continues into the backlog meanwhile.
+ *
+ * @param batch - The batch that could not be finished.
+ */
+void CANConnector::waitForSocket(std::unique_ptr<BcmBatch> batch){
+
+    bool blockedOnRaw = batch->blockedOnRaw();
+    bool congested = batch->congested;
+    uint32_t retries = congested ? batch->retries++ : 0;
+
+    blockedBatch = std::move(batch);
+    txCongested.store(true, std::memory_order_relaxed);
+
+    auto resume = [this](boost::system::error_code errorCode){
+
+        // Lambda completion function for the async wait operations
+
+        txCongested.store(false, std::memory_order_relaxed);
+
+        // The socket was closed or the operation was cancelled
+        if(errorCode == boost::asio::error::operation_aborted){
+            blockedBatch->fail(errorCode);
+            completeBatch(std::move(blockedBatch));
+            return;
+        }
+
+        // Check the error code of the operation
+        if(errorCode){
+            Log::error("An error occurred on the async wait operation: ", errorCode.message());
+            blockedBatch->fail(errorCode);
+        }
+
+        sendBatch(std::move(blockedBatch));
+
+        // Continue with the commands that were queued in the meantime
+        drainTxQueue();
+
+    };
+
+    // Note: A full transmit queue does not make the socket unwritable, so we back off
+    if(congested){
+        metrics.recordTxRetry();
+
+        uint64_t backoff = static_cast<uint64_t>(TX_ENOBUFS_BACKOFF_MIN_US) << std::min<uint32_t>(retries, 16);
+        txBackoffTimer.expires_after(std::chrono::microseconds(std::min<uint64_t>(backoff, TX_ENOBUFS_BACKOFF_MAX_US)));
+        txBackoffTimer.async_wait(std::move(resume));
+        return;
+    }
+
+    metrics.recordTxSocketBlocked();
+
+    // Create an async wait operation on the socket of the remaining messages
+    if(blockedOnRaw){
+        rawSocket.async_wait(boost::asio::socket_base::wait_write, std::move(resume));
+    }else{
+        bcmSocket.async_wait(boost::asio::socket_base::wait_write, std::move(resume));
+    }
+
+}
+
+/**
+ * Calls the completion function of a processed batch and keeps
+ * the batch for the next drain of the submission queue.
+ *
+ * @param batch - The processed batch.
+ */
+void CANConnector::completeBatch(std::unique_ptr<BcmBatch> batch){
+
+    metrics.recordBatch(*batch, ConnectorMetrics::now());
+    updateJobTable(*batch);
+
+    for(size_t index = 0; index < batch->size(); index++){
+        CAN_BCM_TRACE_END(tx_message, reinterpret_cast<uintptr_t>(batch->head(index)), batch->head(index)->can_id);
+    }
+
+    if(capture != nullptr){
+        captureBatch(*batch);
+    }
+
+    batch->completeMessages();
+
+    if(batch->handler){
+        batch->handler(*batch);
+    }
+
+    // Reuse the batch so the steady state does not allocate
+    batchPool.release(std::move(batch));
+}
+
+/**
+ * Returns an empty batch from the batch pool of the connector. The batch
+ * goes back to the pool after its completion. Can be called from any thread.
+ *
+ * @return The empty batch.
+ */
+std::unique_ptr<BcmBatch> CANConnector::acquireBatch(){
+    return batchPool.acquire();
+}
+
+/**
+ * Logs the result of a batch that was submitted by one of the wrappers.
+ *
+ * @param batch       - The processed batch.
+ * @param description - The description of the operation for the log output.
+ */
+void CANConnector::logBatchResult(const BcmBatch& batch, const char* description){
+
+    // Check if there was an error on any of the messages
+    if(batch.failed() == 0){
+        Log::debug("Transmission of ", batch.size(), " ", description, " completed successfully");
+        return;
+    }
+
+    for(size_t index = 0; index < batch.size(); index++){
+        if(batch.errorCode(index)){
+            Log::error("Transmission of ", opcodeName(batch.head(index)->opcode), " for CAN ID ", std::hex, batch.head(index)->can_id,
+                       std::dec, " failed: ", batch.errorCode(index).message());
+        }
+    }
+
+}
+
+/**
+ * Returns the name of a BCM opcode for the log output.
+ *
+ * @param opcode - The opcode of the bcm_msg_head.
+ * @return The name of the opcode.
+ */
+const char* CANConnector::opcodeName(uint32_t opcode){
+
+    switch(opcode){
+        case TX_SETUP:   return "TX_SETUP";
+        case TX_DELETE:  return "TX_DELETE";
+        case TX_READ:    return "TX_READ";
+        case TX_SEND:    return "TX_SEND";
+        case RX_SETUP:   return "RX_SETUP";
+        case RX_DELETE:  return "RX_DELETE";
+        case RX_READ:    return "RX_READ";
+        case TX_STATUS:  return "TX_STATUS";
+        case TX_EXPIRED: return "TX_EXPIRED";
+        case RX_STATUS:  return "RX_STATUS";
+        case RX_TIMEOUT: return "RX_TIMEOUT";
+        case RX_CHANGED: return "RX_CHANGED";
+        default:         return "unknown opcode";
+    }
+
+}
+
+/**
+ * Builds a TX_SETUP message for a cyclic transmission task of a sequence of frames.
+ *
+ * @param frames  - The array of frames that should be send cyclic.
+ * @param nframes - The number of frames that should be send cyclic.
+ * @param count   - Number of times the frame is send with the first interval.
+ * @param ival1   - First interval.
+ * @param ival2   - Second interval.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+template<typename Frame, typename Source>
+BcmMessage CANConnector::buildSequence(const Source frames[], int nframes, uint32_t count,
+                                       struct bcm_timeval ival1, struct bcm_timeval ival2){
+
+    // Error handling / Sanity check
+    if(nframes < 1 || nframes > MAXFRAMES){
+        Log::error("Error the sequence must contain between 1 and ", MAXFRAMES, " frames");
+        return {};
+    }
+
+    // Note: Only the used frames are copied into the kernel, not MAXFRAMES.
+    return BcmMessageBuilder<Frame>::txSetupSequence(acquireFrames<Frame>(nframes), frames, nframes, count, ival1, ival2);
+}
+
+/**
+ * Builds a TX_SEND message for a single CAN/CANFD frame.
+ *
+ * @param frame   - The frame that should be send.
+ * @param isCANFD - Flag for a CANFD frame.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+BcmMessage CANConnector::buildTxSend(const struct canfd_frame& frame, bool isCANFD){
+
+    if(isCANFD){
+        return BcmMessageBuilder<canfd_frame>::txSend(acquireFrames<canfd_frame>(1), frame);
+    }
+
+    return BcmMessageBuilder<can_frame>::txSend(acquireFrames<can_frame>(1), asCANFrame(frame));
+}
+
+/**
+ * Builds a TX_SETUP message for a cyclic transmission task of a CAN/CANFD frame.
+ *
+ * @param frame   - The frame that should be send cyclic.
+ * @param count   - Number of times the frame is send with the first interval.
+ * @param ival1   - First interval.
+ * @param ival2   - Second interval.
+ * @param isCANFD - Flag for a CANFD frames.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+BcmMessage CANConnector::buildTxSetup(const struct canfd_frame& frame, uint32_t count, struct bcm_timeval ival1,
+                                      struct bcm_timeval ival2, bool isCANFD){
+
+    if(isCANFD){
+        return BcmMessageBuilder<canfd_frame>::txSetup(acquireFrames<canfd_frame>(1), frame, count, ival1, ival2);
+    }
+
+    return BcmMessageBuilder<can_frame>::txSetup(acquireFrames<can_frame>(1), asCANFrame(frame), count, ival1, ival2);
+}
+
+/**
+ * Builds a TX_SETUP message for a cyclic transmission task of a sequence of CAN/CANFD frames.
+ *
+ * @param frames  - The array of CAN/CANFD frames that should be send cyclic.
+ * @param nframes - The number of CAN/CANFD frames that should be send cyclic.
+ * @param count   - Number of times the frame is send with the first interval.
+ * @param ival1   - First interval.
+ * @param ival2   - Second interval.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+BcmMessage CANConnector::buildTxSetupSequence(const struct canfd_frame frames[], int nframes, uint32_t count,
+                                              struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD){
+
+    if(isCANFD){
+        return buildSequence<canfd_frame>(frames, nframes, count, ival1, ival2);
+    }
+
+    return buildSequence<can_frame>(frames, nframes, count, ival1, ival2);
+}
+
+/**
+ * Builds a TX_SETUP message that updates a cyclic transmission task of a CAN/CANFD frame.
+ *
+ * @param frame    - The updated CAN/CANFD frame data.
+ * @param isCANFD  - Flag for CANFD frames.
+ * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+BcmMessage CANConnector::buildTxSetupUpdate(const struct canfd_frame& frame, bool isCANFD, bool announce){
+
+    if(isCANFD){
+        return BcmMessageBuilder<canfd_frame>::txSetupUpdate(acquireFrames<canfd_frame>(1), frame, announce);
+    }
+
+    return BcmMessageBuilder<can_frame>::txSetupUpdate(acquireFrames<can_frame>(1), asCANFrame(frame), announce);
+}
+
+/**
+ * Builds a TX_DELETE message for the given CAN ID.
+ *
+ * @param canID   - The CAN ID of the task that should be removed.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+BcmMessage CANConnector::buildTxDelete(canid_t canID, bool isCANFD){
+
+    if(isCANFD){
+        return BcmMessageBuilder<canfd_frame>::txDelete(acquireFrames<canfd_frame>(0), canID);
+    }
+
+    return BcmMessageBuilder<can_frame>::txDelete(acquireFrames<can_frame>(0), canID);
+}
+
+/**
+ * Builds a RX_SETUP message that filters on the given CAN ID.
+ *
+ * @param canID   - The CAN ID that should be added to the RX filter.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+BcmMessage CANConnector::buildRxSetupCanID(canid_t canID, bool isCANFD){
+
+    if(isCANFD){
+        return BcmMessageBuilder<canfd_frame>::rxSetupCanID(acquireFrames<canfd_frame>(0), canID);
+    }
+
+    return BcmMessageBuilder<can_frame>::rxSetupCanID(acquireFrames<can_frame>(0), canID);
+}
+
+/**
+ * Builds a RX_SETUP message that filters on the CAN ID and the relevant bits of the frame.
+ *
+ * @param canID   - The CAN ID that should be added to the RX filter.
+ * @param mask    - The mask for the relevant bits of the frame.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+BcmMessage CANConnector::buildRxSetupMask(canid_t canID, const struct canfd_frame& mask, bool isCANFD){
+
+    if(isCANFD){
+        return BcmMessageBuilder<canfd_frame>::rxSetupMask(acquireFrames<canfd_frame>(1), canID, mask);
+    }
+
+    return BcmMessageBuilder<can_frame>::rxSetupMask(acquireFrames<can_frame>(1), canID, asCANFrame(mask));
+}
+
+/**
+ * Builds a RX_DELETE message for the given CAN ID.
+ *
+ * @param canID   - The CAN ID that should be removed from the RX filter.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+BcmMessage CANConnector::buildRxDelete(canid_t canID, bool isCANFD){
+
+    if(isCANFD){
+        return BcmMessageBuilder<canfd_frame>::rxDelete(acquireFrames<canfd_frame>(0), canID);
+    }
+
+    return BcmMessageBuilder<can_frame>::rxDelete(acquireFrames<can_frame>(0), canID);
+}
+
+/**
+ * Build a RX_SETUP message with typed options.
+ *
+ * @param canID   - The CAN ID that should be added to the RX filter.
+ * @param masks   - The can_frame or canfd_frame masks, nullptr to filter on the CAN ID.
+ * @param nmasks  - The number of masks.
+ * @param options - The throttling, timeout and content options.
+ * @return The built message or an empty message if the options are invalid.
+ */
+template<typename Frame>
+BcmMessage CANConnector::buildRxSetup(canid_t canID, const Frame masks[], int nmasks, const RxOptions& options){
+
+    // Error handling / Sanity check
+    if(nmasks < 0 || nmasks > MAXFRAMES || (nmasks > 0 && masks == nullptr)){
+        Log::error("Error invalid number of RX masks for CAN ID ", std::hex, canID);
+        return {};
+    }
+
+    if(options.throttle.count() < 0 || options.timeout.count() < 0){
+        Log::error("Error negative RX timer for CAN ID ", std::hex, canID);
+        return {};
+    }
+
+    if(options.announceResume && options.timeout.count() == 0){
+        Log::warning("RX_ANNOUNCE_RESUME for CAN ID ", std::hex, canID, " has no effect without a timeout");
+    }
+
+    if(options.checkDLC && nmasks == 0){
+        Log::warning("RX_CHECK_DLC for CAN ID ", std::hex, canID, " has no effect without a mask");
+    }
+
+    auto nframes = static_cast<uint32_t>(nmasks);
+
+    return BcmMessageBuilder<Frame>::rxSetup(acquireFrames<Frame>(nframes), canID, options.flags(),
+                                             options.ival1(), options.ival2(), masks, nframes);
+}
+
+/**
+ * Build the RX_SETUP message of a filter of a filter set. The timers are always
+ * set, so a filter that was throttled before loses its throttle interval.
+ *
+ * @param filter - The filter.
+ * @return The built message or an empty message if the filter has too many masks.
+ */
+BcmMessage CANConnector::buildRxFilter(const RxFilter& filter){
+
+    auto nframes = static_cast<uint32_t>(filter.masks.size());
+
+    // Error handling / Sanity check
+    if(nframes > MAXFRAMES){
+        return {};
+    }
+
+    if(filter.isCANFD){
+        return BcmMessageBuilder<canfd_frame>::rxSetup(acquireFrames<canfd_frame>(nframes), filter.canID, filter.flags | SETTIMER,
+                                                       filter.ival1, filter.ival2, filter.masks.data(), nframes);
+    }
+
+    return BcmMessageBuilder<can_frame>::rxSetup(acquireFrames<can_frame>(nframes), filter.canID, filter.flags | SETTIMER,
+                                                 filter.ival1, filter.ival2, filter.masks.data(), nframes);
+}
+
+/**
+ * Create a non cyclic transmission task for a single frame. The frame type
+ * selects CAN or CANFD at compile time, a can_frame is sent as it is.
+ *
+ * @param frame - The can_frame or canfd_frame that should be send.
+ */
+template<typename Frame>
+void CANConnector::txSend(const Frame& frame){
+
+    sendMessage(BcmMessageBuilder<Frame>::txSend(acquireFrames<Frame>(1), frame), "TX_SEND");
+}
+
+/**
+ * Create a cyclic transmission task for a single frame.
+ *
+ * @param frame - The can_frame or canfd_frame that should be send cyclic.
+ * @param count - Number of times the frame is send with the first interval.
+ * @param ival1 - First interval.
+ * @param ival2 - Second interval.
+ * @return The handle of the task or nullptr if the task could not be created.
+ */
+template<typename Frame>
+TxJobHandle CANConnector::txSetup(const Frame& frame, uint32_t count, struct bcm_timeval ival1, struct bcm_timeval ival2){
+
+    if(!sendMessage(BcmMessageBuilder<Frame>::txSetup(acquireFrames<Frame>(1), frame, count, ival1, ival2), "TX_SETUP")){
+        return nullptr;
+    }
+
+    return TxJob::create<Frame>(&frame, 1);
+}
+
+/**
+ * Create a cyclic transmission task for a sequence of frames.
+ *
+ * @param frames  - The array of can_frame or canfd_frame that should be send cyclic.
+ * @param nframes - The number of frames that should be send cyclic.
+ * @param count   - Number of times the frame is send with the first interval.
+ * @param ival1   - First interval.
+ * @param ival2   - Second interval.
+ * @return The handle of the task or nullptr if the task could not be created.
+ */
+template<typename Frame>
+TxJobHandle CANConnector::txSetupSequence(const Frame frames[], int nframes, uint32_t count,
+                                          struct bcm_timeval ival1, struct bcm_timeval ival2){
+
+    if(!sendMessage(buildSequence<Frame>(frames, nframes, count, ival1, ival2), "TX_SETUP sequence")){
+        return nullptr;
+    }
+
+    return TxJob::create<Frame>(frames, nframes);
+}
+
+/**
+ * Updates the data of a cyclic transmission task.
+ *
+ * @param frame    - The can_frame or canfd_frame with the updated data.
+ * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ */
+template<typename Frame>
+void CANConnector::txSetupUpdate(const Frame& frame, bool announce){
+
+    sendMessage(BcmMessageBuilder<Frame>::txSetupUpdate(acquireFrames<Frame>(1), frame, announce), "TX_SETUP update");
+}
+
+/**
+ * Removes a cyclic transmission task of the frame type for the given CAN ID.
+ *
+ * @param canID - The CAN ID of the task that should be removed.
+ */
+template<typename Frame>
+void CANConnector::txDelete(canid_t canID){
+
+    sendMessage(BcmMessageBuilder<Frame>::txDelete(acquireFrames<Frame>(0), canID), "TX_DELETE");
+}
+
+/**
+ * Creates a RX filter of the frame type for the given CAN ID.
+ *
+ * @param canID - The CAN ID that should be added to the RX filter.
+ */
+template<typename Frame>
+void CANConnector::rxSetupCanID(canid_t canID){
+
+    sendMessage(BcmMessageBuilder<Frame>::rxSetupCanID(acquireFrames<Frame>(0), canID), "RX_SETUP based on a CAN ID");
+}
+
+/**
+ * Creates a RX filter for the CAN ID and the relevant bits of the frame.
+ *
+ * @param canID - The CAN ID that should be added to the RX filter.
+ * @param mask  - The can_frame or canfd_frame mask for the relevant bits.
+ */
+template<typename Frame>
+void CANConnector::rxSetupMask(canid_t canID, const Frame& mask){
+
+    sendMessage(BcmMessageBuilder<Frame>::rxSetupMask(acquireFrames<Frame>(1), canID, mask), "RX_SETUP with mask");
+}
+
+/**
+ * Removes the RX filter of the frame type for the given CAN ID.
+ *
+ * @param canID - The CAN ID that should be removed from the RX filter.
+ */
+template<typename Frame>
+void CANConnector::rxDelete(canid_t canID){
+
+    sendMessage(BcmMessageBuilder<Frame>::rxDelete(acquireFrames<Frame>(0), canID), "RX_DELETE");
+}
+
+/**
+ * Creates a RX filter for the CAN ID with kernel side throttling and timeout monitoring.
+ * With a throttle interval the process is woken up at most once per interval.
+ *
+ * @param canID   - The CAN ID that should be added to the RX filter.
+ * @param options - The throttling and timeout options.
+ */
+template<typename Frame>
+void CANConnector::rxSetup(canid_t canID, const RxOptions& options){
+
+    sendMessage(buildRxSetup<Frame>(canID, nullptr, 0, options), "RX_SETUP with options");
+}
+
+/**
+ * Creates a RX filter for the relevant bits of the frame with kernel side
+ * throttling and timeout monitoring. Only content changes are notified.
+ *
+ * @param canID   - The CAN ID that should be added to the RX filter.
+ * @param mask    - The can_frame or canfd_frame mask for the relevant bits.
+ * @param options - The throttling, timeout and content options.
+ */
+template<typename Frame>
+void CANConnector::rxSetupMask(canid_t canID, const Frame& mask, const RxOptions& options){
+
+    sendMessage(buildRxSetup<Frame>(canID, &mask, 1, options), "RX_SETUP with mask");
+}
+
+/**
+ * Creates a RX filter for a multiplex message. The first mask selects the
+ * multiplex bits, every further mask holds a multiplex value in these bits
+ * and the relevant bits of the content for this value.
+ *
+ * @param canID   - The CAN ID that should be added to the RX filter.
+ * @param masks   - The multiplex mask followed by the masks per multiplex value.
+ * @param nmasks  - The number of masks, at least two.
+ * @param options - The throttling, timeout and content options.
+ */
+template<typename Frame>
+void CANConnector::rxSetupMultiplex(canid_t canID, const Frame masks[], int nmasks, const RxOptions& options){
+
+    // Error handling / Sanity check
+    if(nmasks < 2){
+        Log::error("Error a multiplex RX filter needs the multiplex mask and at least one value");
+        return;
+    }
+
+    sendMessage(buildRxSetup<Frame>(canID, masks, nmasks, options), "RX_SETUP multiplex");
+}
+
+/**
+ * Adds a RX_SETUP message with typed options to a batch.
+ *
+ * @param batch   - The batch the message is added to.
+ * @param canID   - The CAN ID that should be added to the RX filter.
+ * @param masks   - The can_frame or canfd_frame masks, nullptr to filter on the CAN ID.
+ * @param nmasks  - The number of masks.
+ * @param options - The throttling, timeout and content options.
+ * @return False if the message could not be built or the batch is full.
+ */
+template<typename Frame>
+bool CANConnector::addRxSetup(BcmBatch& batch, canid_t canID, const Frame masks[], int nmasks, const RxOptions& options){
+    return batch.add(buildRxSetup<Frame>(canID, masks, nmasks, options));
+}
+
+/**
+ * Adds a TX_SEND message for a single frame to a batch.
+ *
+ * @param batch - The batch the message is added to.
+ * @param frame - The can_frame or canfd_frame that should be send.
+ * @return False if the message could not be built or the batch is full.
+ */
+template<typename Frame>
+bool CANConnector::addTxSend(BcmBatch& batch, const Frame& frame){
+    return batch.add(BcmMessageBuilder<Frame>::txSend(acquireFrames<Frame>(1), frame));
+}
+
+/**
+ * Adds a TX_SETUP message that updates a cyclic transmission task to a batch.
+ *
+ * @param batch    - The batch the message is added to.
+ * @param frame    - The can_frame or canfd_frame with the updated data.
+ * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ * @return False if the message could not be built or the batch is full.
+ */
+template<typename Frame>
+bool CANConnector::addTxSetupUpdate(BcmBatch& batch, const Frame& frame, bool announce){
+    return batch.add(BcmMessageBuilder<Frame>::txSetupUpdate(acquireFrames<Frame>(1), frame, announce));
+}
+
+/**
+ * Create a non cyclic transmission task for a single CAN/CANFD frame.
+ *
+ * @param frame   - The frame that should be send.
+ * @param isCANFD - Flag for a CANFD frame.
+ */
+void CANConnector::txSendSingleFrame(struct canfd_frame frame, bool isCANFD){
+
+    // Note: The TX_SEND operation can only handle exactly one frame!
+    sendMessage(buildTxSend(frame, isCANFD), "TX_SEND");
+}
+
+/**
+ * Create a non cyclic transmission task for multiple CAN/CANFD frames.
+ * 
+ * @param frames  - The frames that should be send.
+ * @param nframes - The number of frames that should be send.
+ * @param isCANFD - Flag for CANFD frames.
+ */
+void CANConnector::txSendMultipleFrames(struct canfd_frame frames[], int nframes, bool isCANFD){
+
+    // Note: The TX_SEND operation can only handle exactly one frame!
+    // That's why we put a TX_SEND message for each frame into a batch.
+    auto batch = acquireBatch();
+
+    for(int index = 0; index < nframes; index++){
+
+        // Submit the batch if it is full and continue with a new one
+        if(batch->full()){
+            submitBatch(std::move(batch), [](const BcmBatch& result){ logBatchResult(result, "TX_SEND"); });
+            batch = acquireBatch();
+        }
+
+        if(!addTxSend(*batch, frames[index], isCANFD)){
+            Log::error("Error could not make message structure");
+        }
+    }
+
+    if(!batch->empty()){
+        submitBatch(std::move(batch), [](const BcmBatch& result){ logBatchResult(result, "TX_SEND"); });
+    }
+
+}
+
+/**
+ * Create a cyclic transmission task for a CAN/CANFD frame.
+ *
+ * @param frame   - The frame that should be send cyclic.
+ * @param count   - Number of times the frame is send with the first interval.
+ *                  If count is zero only the second interval is being used.
+ * @param ival1   - First interval.
+ * @param ival2   - Second interval.
+ * @param isCANFD - Flag for a CANFD frames.
+ * @return The handle of the task or nullptr if the task could not be created.
+ */
+TxJobHandle CANConnector::txSetupSingleFrame(struct canfd_frame frame, uint32_t count, struct bcm_timeval ival1,
+                                             struct bcm_timeval ival2, bool isCANFD){
+
+    if(!sendMessage(buildTxSetup(frame, count, ival1, ival2, isCANFD), "TX_SETUP")){
+        return nullptr;
+    }
+
+    if(isCANFD){
+        return TxJob::create<canfd_frame>(&frame, 1);
+    }
+
+    return TxJob::create<can_frame>(&frame, 1);
+}
+
+/**
+ * Create a cyclic transmission task for multiple CAN/CANFD frames.
+ *
+ * Note: The frames will not be send as a atomic sequence. We send for each TX_SETUP
+ * a single CAN/CANFD frame with its CAN ID in the bcm_msg_head. This way we do not
+ * create a cyclic transmission sequence which can only be removed with the CAN ID
+ * that was set in the bcm_msg_head. Another benefit is that each CAN/CANFD frame
+ * can have different count, ival1, and ival2 values.
+ *
+ * @param frames  - The frames that should be send cyclic.
+ * @param nframes - The number of frames that should be send cyclic.
+ * @param count   - Number of times the frame is send with the first interval.
+ *                  If count is zero only the second interval is being used.
+ * @param ival1   - First interval.
+ * @param ival2   - Second interval.
+ * @param isCANFD - Flag for CANFD frames.
+ */
+void CANConnector::txSetupMultipleFrames(struct canfd_frame frames[], int nframes, uint32_t count[], struct bcm_timeval ival1[],
+                                         struct bcm_timeval ival2[], bool isCANFD){
+
+    auto batch = acquireBatch();
+
+    for(int index = 0; index < nframes; index++){
+
+        // Submit the batch if it is full and continue with a new one
+        if(batch->full()){
+            submitBatch(std::move(batch), [](const BcmBatch& result){ logBatchResult(result, "TX_SETUP"); });
+            batch = acquireBatch();
+        }
+
+        if(!addTxSetup(*batch, frames[index], count[index], ival1[index], ival2[index], isCANFD)){
+            Log::error("Error could not make message structure");
+        }
+    }
+
+    if(!batch->empty()){
+        submitBatch(std::move(batch), [](const BcmBatch& result){ logBatchResult(result, "TX_SETUP"); });
+    }
+
+}
+
+/**
+ * Create a cyclic transmission task for one or multiple CAN/CANFD frames.
+ * If more than one frame should be send cyclic the provided sequence of
+ * the frames is kept by the BCM.
+ *
+ * Note: The cyclic transmission task for the sequence can only be deleted
+ * with the CAN ID that was set in the bcm_msg_head.
+ *
+ * @param frames   - The array of CAN/CANFD frames that should be send cyclic.
+ * @param nframes  - The number of CAN/CANFD frames that should be send cyclic.
+ * @param count    - Number of times the frame is send with the first interval.
+ *                   If count is zero only the second interval is being used.
+ * @param ival1    - First interval.
+ * @param ival2    - Second interval.
+ * @param isCANFD  - Flag for CANFD frames.
+ * @return The handle of the task or nullptr if the task could not be created.
+ */
+TxJobHandle CANConnector::txSetupSequence(struct canfd_frame frames[], int nframes, uint32_t count,
+                                          struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD){
+
+    if(!sendMessage(buildTxSetupSequence(frames, nframes, count, ival1, ival2, isCANFD), "TX_SETUP sequence")){
+        return nullptr;
+    }
+
+    if(isCANFD){
+        return TxJob::create<canfd_frame>(frames, nframes);
+    }
+
+    return TxJob::create<can_frame>(frames, nframes);
+}
+
+/**
+ * Sends the frames of a job as update of its cyclic transmission task if the
+ * job is dirty. The frames are copied, so the job can be written right away.
+ *
+ * @param job      - The job.
+ * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ * @return True if an update was sent.
+ */
+bool CANConnector::commitTxJob(TxJob& job, bool announce){
+
+    if(!job.takeDirty()){
+        return false;
+    }
+
+    BcmMessagePool::Buffer msg = acquireMessage(job.messageSize());
+
+    // Error handling / Sanity check
+    if(!msg){
+        Log::error("Error could not make message structure");
+        job.markDirty();
+        return false;
+    }
+
+    std::memcpy(msg.data(), job.messageData(), job.messageSize());
+
+    if(announce){
+        msg.head()->flags = msg.head()->flags | TX_ANNOUNCE;
+    }
+
+    return sendMessage({std::move(msg), job.messageSize()}, "TX_SETUP job update");
+}
+
+/**
+ * Sends the updates of all dirty jobs. The io context thread submits the
+ * updates that are queued together with a single sendmmsg call.
+ *
+ * @param jobs     - The jobs, clean jobs are skipped.
+ * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ * @return The number of sent updates.
+ */
+size_t CANConnector::commitTxJobs(const std::vector<TxJobHandle>& jobs, bool announce){
+
+    size_t committed = 0;
+
+    for(const auto& job : jobs){
+        if(job != nullptr && commitTxJob(*job, announce)){
+            committed++;
+        }
+    }
+
+    return committed;
+}
+
+/**
+ * Updates a cyclic transmission task for a CAN/CANFD frame.
+ *
+ * @param frames   - The updated CAN/CANFD frame data.
+ * @param nframes  - The number of CAN/CANFD frames that should be updated.
+ * @param isCANFD  - Flag for CANFD frames.
+ * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ */
+void CANConnector::txSetupUpdateSingleFrame(struct canfd_frame frame, bool isCANFD, bool announce){
+
+    sendMessage(buildTxSetupUpdate(frame, isCANFD, announce), "TX_SETUP update");
+}
+
+/**
+ * Updates a cyclic transmission task for one or multiple CAN/CANFD frames.
+ *
+ * @param frames   - The array of CAN/CANFD frames with the updated data.
+ * @param nframes  - The number of CAN/CANFD frames that should be updated.
+ * @param isCANFD  - Flag for CANFD frames.
+ * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ */
+void CANConnector::txSetupUpdateMultipleFrames(struct canfd_frame frames[], int nframes, bool isCANFD, bool announce){
+
+    auto batch = acquireBatch();
+
+    for(int index = 0; index < nframes; index++){
+
+        // Submit the batch if it is full and continue with a new one
+        if(batch->full()){
+            submitBatch(std::move(batch), [](const BcmBatch& result){ logBatchResult(result, "TX_SETUP update"); });
+            batch = acquireBatch();
+        }
+
+        if(!addTxSetupUpdate(*batch, frames[index], isCANFD, announce)){
+            Log::error("Error could not make message structure");
+        }
+    }
+
+    if(!batch->empty()){
+        submitBatch(std::move(batch), [](const BcmBatch& result){ logBatchResult(result, "TX_SETUP update"); });
+    }
+
+}
+
+/**
+ * Removes a cyclic transmission task for the given CAN ID.
+ *
+ * Note: A cyclic transmission task for a sequence of frames can only
+ * be deleted with the CAN ID that was set in the bcm_msg_head.
+ *
+ * @param canID - The CAN ID of the task that should be removed.
+ */
+void CANConnector::txDelete(canid_t canID, bool isCANFD){
+
+    sendMessage(buildTxDelete(canID, isCANFD), "TX_DELETE");
+}
+
+/**
+ * Creates a RX filter for the given CAN ID.
+ * I. e. we get notified on all received frames with this CAN ID.
+ *
+ * @param canID    - The CAN ID that should be added to the RX filter.
+ * @param isCANFD  - Flag for CANFD frames.
+ */
+void CANConnector::rxSetupCanID(canid_t canID, bool isCANFD){
+
+    sendMessage(buildRxSetupCanID(canID, isCANFD), "RX_SETUP based on a CAN ID");
+}
+
+/**
+ * Creates a RX filter for the CAN ID and the relevant bits of the frame.
+ * I. e. we only get notified on changes for the set bits in the mask.
+ *
+ * @param canID    - The CAN ID that should be added to the RX filter.
+ * @param mask     - The mask for the relevant bits of the frame.
+ * @param isCANFD  - Flag for CANFD frames.
+ */
+void CANConnector::rxSetupMask(canid_t canID, struct canfd_frame mask, bool isCANFD){
+
+    sendMessage(buildRxSetupMask(canID, mask, isCANFD), "RX_SETUP with mask");
+}
+
+/**
+ * Removes the RX filter for the given CAN ID.
+ *
+ * @param canID   - The CAN ID that should be removed from the RX filter.
+ * @param isCANFD - Flag for CANFD frames.
+ */
+void CANConnector::rxDelete(canid_t canID, bool isCANFD){
+
+    sendMessage(buildRxDelete(canID, isCANFD), "RX_DELETE");
+}
+
+/**
+ * Adds a TX_SEND message for a single CAN/CANFD frame to a batch.
+ *
+ * @param batch   - The batch the message is added to.
+ * @param frame   - The frame that should be send.
+ * @param isCANFD - Flag for a CANFD frame.
+ * @return False if the message could not be built or the batch is full.
+ */
+bool CANConnector::addTxSend(BcmBatch& batch, struct canfd_frame frame, bool isCANFD){
+    return batch.add(buildTxSend(frame, isCANFD));
+}
+
+/**
+ * Adds a TX_SETUP message for a cyclic transmission task of a CAN/CANFD frame to a batch.
+ *
+ * @param batch   - The batch the message is added to.
+ * @param frame   - The frame that should be send cyclic.
+ * @param count   - Number of times the frame is send with the first interval.
+ * @param ival1   - First interval.
+ * @param ival2   - Second interval.
+ * @param isCANFD - Flag for a CANFD frames.
+ * @return False if the message could not be built or the batch is full.
+ */
+bool CANConnector::addTxSetup(BcmBatch& batch, struct canfd_frame frame, uint32_t count, struct bcm_timeval ival1,
+                              struct bcm_timeval ival2, bool isCANFD){
+    return batch.add(buildTxSetup(frame, count, ival1, ival2, isCANFD));
+}
+
+/**
+ * Adds a TX_SETUP message for a cyclic transmission task of a sequence of CAN/CANFD frames to a batch.
+ *
+ * @param batch   - The batch the message is added to.
+ * @param frames  - The array of CAN/CANFD frames that should be send cyclic.
+ * @param nframes - The number of CAN/CANFD frames that should be send cyclic.
+ * @param count   - Number of times the frame is send with the first interval.
+ * @param ival1   - First interval.
+ * @param ival2   - Second interval.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return False if the message could not be built or the batch is full.
+ */
+bool CANConnector::addTxSetupSequence(BcmBatch& batch, struct canfd_frame frames[], int nframes, uint32_t count,
+                                      struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD){
+    return batch.add(buildTxSetupSequence(frames, nframes, count, ival1, ival2, isCANFD));
+}
+
+/**
+ * Adds a TX_SETUP message that updates a cyclic transmission task to a batch.
+ *
+ * @param batch    - The batch the message is added to.
+ * @param frame    - The updated CAN/CANFD frame data.
+ * @param isCANFD  - Flag for CANFD frames.
+ * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ * @return False if the message could not be built or the batch is full.
+ */
+bool CANConnector::addTxSetupUpdate(BcmBatch& batch, struct canfd_frame frame, bool isCANFD, bool announce){
+    return batch.add(buildTxSetupUpdate(frame, isCANFD, announce));
+}
+
+/**
+ * Adds a TX_DELETE message for the given CAN ID to a batch.
+ *
+ * @param batch   - The batch the message is added to.
+ * @param canID   - The CAN ID of the task that should be removed.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return False if the message could not be built or the batch is full.
+ */
+bool CANConnector::addTxDelete(BcmBatch& batch, canid_t canID, bool isCANFD){
+    return batch.add(buildTxDelete(canID, isCANFD));
+}
+
+/**
+ * Adds a RX_SETUP message that filters on the given CAN ID to a batch.
+ *
+ * @param batch   - The batch the message is added to.
+ * @param canID   - The CAN ID that should be added to the RX filter.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return False if the message could not be built or the batch is full.
+ */
+bool CANConnector::addRxSetupCanID(BcmBatch& batch, canid_t canID, bool isCANFD){
+    return batch.add(buildRxSetupCanID(canID, isCANFD));
+}
+
+/**
+ * Adds a RX_SETUP message that filters on the CAN ID and the relevant bits of the frame to a batch.
+ *
+ * @param batch   - The batch the message is added to.
+ * @param canID   - The CAN ID that should be added to the RX filter.
+ * @param mask    - The mask for the relevant bits of the frame.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return False if the message could not be built or the batch is full.
+ */
+bool CANConnector::addRxSetupMask(BcmBatch& batch, canid_t canID, struct canfd_frame mask, bool isCANFD){
+    return batch.add(buildRxSetupMask(canID, mask, isCANFD));
+}
+
+/**
+ * Adds a RX_DELETE message for the given CAN ID to a batch.
+ *
+ * @param batch   - The batch the message is added to.
+ * @param canID   - The CAN ID that should be removed from the RX filter.
+ * @param isCANFD - Flag for CANFD frames.
+ * @return False if the message could not be built or the batch is full.
+ */
+bool CANConnector::addRxDelete(BcmBatch& batch, canid_t canID, bool isCANFD){
+    return batch.add(buildRxDelete(canID, isCANFD));
+}
+
+/**
+ * Returns how many datagrams the receive operations drained per wakeup.
+ *
+ * @return Snapshot of the receive statistics.
+ */
+BcmReceiveRing::Statistics CANConnector::getReceiveStatistics() const{
+    return rxRing.statistics();
+}
+
+/**
+ * Returns the per-operation counters and the submit to completion latency
+ * histogram of the connector. Can be called from any thread.
+ *
+ * @return Snapshot of the metrics.
+ */
+ConnectorMetrics::Snapshot CANConnector::getMetrics() const{
+
+    ConnectorMetrics::Snapshot snapshot = metrics.snapshot();
+    snapshot.txQueueDepth = txQueue.size();
+
+    return snapshot;
+}
+
+/**
+ * Decides what to do with the data we received on the socket.
+ *
+ * @param notification - The received bcm msg head and the CAN or CANFD frames.
+ */
+void CANConnector::handleReceivedData(const BcmNotification& notification){
+
+    Log::debug("Handling the received data");
+
+    if(capture != nullptr){
+        captureNotification(notification);
+    }
+
+    switch(notification.head->opcode){
+
+        case RX_CHANGED:
+
+            // Simple reception of a CAN/CANFD frame or a content change occurred.
+            updateShadowCache(notification);
+
+            if(!rxDispatcher.dispatch(RxEvent::Changed, notification)){
+                Log::debug("No RX_CHANGED handler for CAN ID ", std::hex, notification.head->can_id);
+            }
+            break;
+
+        case RX_TIMEOUT:
+
+            // Cyclic message is detected to be absent.
+            if(!rxDispatcher.dispatch(RxEvent::Timeout, notification)){
+                Log::debug("No RX_TIMEOUT handler for CAN ID ", std::hex, notification.head->can_id);
+            }
+            break;
+
+        case TX_EXPIRED:
+
+            // Notification when counter finishes sending at ival1 interval.
+            // Requires TX_COUNTEVT flag to be set at TX_SETUP.
+            {
+                BcmJobStatus status{};
+
+                // The kernel continues with ival2 once the count is used up
+                if(jobTable.lookup(notification.head->can_id, notification.isCANFD, true, status)){
+                    status.count = 0;
+                    jobTable.update(status);
+                }
+            }
+
+            if(!rxDispatcher.dispatch(RxEvent::TxExpired, notification)){
+                Log::debug("No TX_EXPIRED handler for CAN ID ", std::hex, notification.head->can_id);
+            }
+            break;
+
+        case RX_STATUS:
+
+            // Reply to a RX_READ request that returns the RX content filter properties for a given CAN ID.
+            handleJobStatus(notification);
+            break;
+
+        case TX_STATUS:
+
+            // Reply to a TX_READ request that returns the TX transmission properties for a given CAN ID.
+            handleJobStatus(notification);
+            break;
+
+        default:
+
+            Log::error("Received unkown opcode!");
+    }
+
+}
+
+/**
+ * Builds a TX_READ or RX_READ message.
+ *
+ * @param opcode  - TX_READ or RX_READ.
+ * @param canID   - The CAN ID of the job.
+ * @param isCANFD - Flag for a CANFD job.
+ * @return The message or an empty message if the pool is exhausted.
+ */
+BcmMessage CANConnector::buildJobRead(uint32_t opcode, canid_t canID, bool isCANFD){
+
+    if(isCANFD){
+        return opcode == TX_READ ? BcmMessageBuilder<canfd_frame>::txRead(acquireFrames<canfd_frame>(0), canID)
+                                 : BcmMessageBuilder<canfd_frame>::rxRead(acquireFrames<canfd_frame>(0), canID);
+    }
+
+    return opcode == TX_READ ? BcmMessageBuilder<can_frame>::txRead(acquireFrames<can_frame>(0), canID)
+                             : BcmMessageBuilder<can_frame>::rxRead(acquireFrames<can_frame>(0), canID);
+}
+
+/**
+ * Registers a query that waits for the status reply of its CAN ID. The
+ * replies of a CAN ID arrive in the order of the requests. Only called
+ * in the io context loop thread.
+ *
+ * @param opcode     - TX_READ or RX_READ.
+ * @param canID      - The CAN ID of the job.
+ * @param isCANFD    - Flag for a CANFD job.
+ * @param completion - The completion that receives the status.
+ * @return The completion of the request message. It fails the query if the request is rejected.
+ */
+BcmBatch::Completion CANConnector::registerJobQuery(uint32_t opcode, canid_t canID, bool isCANFD,
+                                                    AsyncCompletionPtr<BcmJobStatus> completion){
+
+    bool isTx = opcode == TX_READ;
+    uint64_t key = BcmJobTable::keyOf(canID, isCANFD, isTx);
+    uint64_t id = nextJobQuery++;
+
+    jobQueries[key].push_back(JobQuery{id, canID, isCANFD, isTx, std::move(completion)});
+
+    // Note: The reply can be received before the completion of the request runs
+    return makeAsyncCompletion<>([this, key, id](const boost::system::error_code& errorCode){
+        if(errorCode){
+            failJobQuery(key, id, errorCode);
+        }
+    }, ioContext->get_executor());
+}
+
+/**
+ * Completes a query whose request was rejected. The BCM rejects a read of an
+ * unknown job with EINVAL, the job is removed from the job table in this case.
+ *
+ * @param key       - The key of the job.
+ * @param id        - The id of the query.
+ * @param errorCode - The error of the request.
+ */
+void CANConnector::failJobQuery(uint64_t key, uint64_t id, const boost::system::error_code& errorCode){
+
+    auto queries = jobQueries.find(key);
+
+    // Error handling / Sanity check
+    if(queries == jobQueries.end()){
+        return;
+    }
+
+    for(auto query = queries->second.begin(); query != queries->second.end(); ++query){
+
+        if(query->id != id){
+            continue;
+        }
+
+        boost::system::error_code result = errorCode;
+        BcmJobStatus status{};
+        status.canID   = query->canID;
+        status.isCANFD = query->isCANFD;
+        status.isTx    = query->isTx;
+
+        if(errorCode == boost::system::errc::invalid_argument){
+            jobTable.remove(query->canID, query->isCANFD, query->isTx);
+            result = boost::asio::error::not_found;
+        }
+
+        AsyncCompletionPtr<BcmJobStatus> completion = std::move(query->completion);
+        queries->second.erase(query);
+
+        if(queries->second.empty()){
+            jobQueries.erase(queries);
+        }
+
+        completeAsync(completion, result, status);
+        return;
+    }
+
+}
+
+/**
+ * Stores a TX_STATUS or RX_STATUS reply in the job table and completes
+ * the oldest query of its CAN ID.
+ *
+ * @param notification - The status reply.
+ */
+void CANConnector::handleJobStatus(const BcmNotification& notification){
+
+    BcmJobStatus status = jobStatusOf(notification.head, notification.head->opcode == TX_STATUS);
+    status.confirmed = true;
+
+    jobTable.update(status);
+
+    auto queries = jobQueries.find(BcmJobTable::keyOf(status.canID, status.isCANFD, status.isTx));
+
+    if(queries == jobQueries.end()){
+        Log::debug("Received ", opcodeName(notification.head->opcode), " without a query for CAN ID ", std::hex, status.canID);
+        return;
+    }
+
+    AsyncCompletionPtr<BcmJobStatus> completion = std::move(queries->second.front().completion);
+    queries->second.pop_front();
+
+    if(queries->second.empty()){
+        jobQueries.erase(queries);
+    }
+
+    completeAsync(completion, boost::system::error_code(), status);
+}
+
+/**
+ * Follows the setup and delete messages the kernel accepted in the job table.
+ *
+ * @param batch - The processed batch.
+ */
+void CANConnector::updateJobTable(const BcmBatch& batch){
+
+    for(size_t index = 0; index < batch.size(); index++){
+
+        const bcm_msg_head* head = batch.head(index);
+        bool isCANFD = (head->flags & CAN_FD_FRAME) != 0;
+        bool isTx = head->opcode == TX_SETUP || head->opcode == TX_DELETE;
+
+        if(head->opcode != TX_SETUP && head->opcode != RX_SETUP && head->opcode != TX_DELETE && head->opcode != RX_DELETE){
+            continue;
+        }
+
+        // A delete of an unknown job shows that the table drifted
+        if(batch.errorCode(index)){
+
+            if((head->opcode == TX_DELETE || head->opcode == RX_DELETE) &&
+               batch.errorCode(index) == boost::system::errc::invalid_argument){
+                jobTable.remove(head->can_id, isCANFD, isTx);
+            }
+
+            continue;
+        }
+
+        if(head->opcode == TX_DELETE || head->opcode == RX_DELETE){
+            jobTable.remove(head->can_id, isCANFD, isTx);
+            continue;
+        }
+
+        BcmJobStatus status = jobStatusOf(head, isTx);
+        BcmJobStatus previous{};
+
+        // Note: Without SETTIMER the kernel keeps the timers of an existing job
+        if(!(head->flags & SETTIMER)){
+
+            bool known = jobTable.lookup(head->can_id, isCANFD, isTx, previous);
+
+            status.count = known ? previous.count : 0;
+            status.ival1 = known ? previous.ival1 : bcm_timeval{};
+            status.ival2 = known ? previous.ival2 : bcm_timeval{};
+        }
+
+        jobTable.update(status);
+    }
+
+}
+
+/**
+ * Starts the reconciliation of the job table in the io context loop thread.
+ *
+ * @param completion - The completion that receives the result.
+ */
+void CANConnector::startJobReconcile(AsyncCompletionPtr<BcmJobReconcileResult> completion){
+
+    auto reconcile = std::make_shared<JobReconcile>();
+    reconcile->completion = std::move(completion);
+    jobTable.collect(reconcile->jobs);
+
+    if(reconcile->jobs.empty()){
+        completeAsync(reconcile->completion, boost::system::error_code(), reconcile->result);
+        return;
+    }
+
+    submitJobReconcileBatch(reconcile);
+}
+
+/**
+ * Submits the next batch of read requests of a reconciliation. The next
+ * batch follows when the replies of the previous one arrived, so a large
+ * table does not exhaust the message pool.
+ *
+ * @param reconcile - The state of the reconciliation.
+ */
+void CANConnector::submitJobReconcileBatch(const std::shared_ptr<JobReconcile>& reconcile){
+
+    std::unique_ptr<BcmBatch> batch = acquireBatch();
+
+    while(reconcile->submitted < reconcile->jobs.size() && !batch->full()){
+
+        const BcmJobStatus& job = reconcile->jobs[reconcile->submitted++];
+        uint32_t opcode = job.isTx ? TX_READ : RX_READ;
+
+        auto completion = makeAsyncCompletion<BcmJobStatus>([this, reconcile](const boost::system::error_code& errorCode, BcmJobStatus){
+
+            if(!errorCode){
+                reconcile->result.confirmed++;
+            }else if(errorCode == boost::asio::error::not_found){
+                reconcile->result.missing++;
+            }else{
+                reconcile->result.failed++;
+            }
+
+            reconcile->remaining--;
+
+            if(reconcile->remaining > 0){
+                return;
+            }
+
+            if(reconcile->submitted < reconcile->jobs.size()){
+                submitJobReconcileBatch(reconcile);
+            }else{
+                completeAsync(reconcile->completion, boost::system::error_code(), reconcile->result);
+            }
+
+        }, ioContext->get_executor());
+
+        reconcile->remaining++;
+
+        // Note: A message that is not added aborts its query, which is counted as failed
+        batch->add(buildJobRead(opcode, job.canID, job.isCANFD), registerJobQuery(opcode, job.canID, job.isCANFD, std::move(completion)));
+    }
+
+    submitBatch(std::move(batch), [](const BcmBatch& result){ logBatchResult(result, "TX_READ/RX_READ"); });
+}
+
+/**
+ * Builds the job state of a setup message or a status reply.
+ *
+ * @param head - The bcm_msg_head, followed by its frames.
+ * @param isTx - Flag for a TX job.
+ * @return The job state.
+ */
+BcmJobStatus CANConnector::jobStatusOf(const bcm_msg_head* head, bool isTx){
+
+    BcmJobStatus status{};
+    status.canID     = head->can_id;
+    status.isCANFD   = (head->flags & CAN_FD_FRAME) != 0;
+    status.isTx      = isTx;
+    status.installed = true;
+    status.flags     = head->flags;
+    status.count     = head->count;
+    status.nframes   = head->nframes;
+    status.ival1     = head->ival1;
+    status.ival2     = head->ival2;
+    status.updated   = ConnectorMetrics::now();
+
+    if(head->nframes > 0){
+        const auto* frames = reinterpret_cast<const std::uint8_t*>(head) + sizeof(struct bcm_msg_head);
+        std::memcpy(&status.frame, frames, status.isCANFD ? sizeof(struct canfd_frame) : sizeof(struct can_frame));
+    }
+
+    return status;
+}
+
+/**
+ * Registers a handler for the notifications of a single CAN ID.
+ * Extended CAN IDs must have the CAN_EFF_FLAG set.
+ *
+ * Note: The handler is called in the io context loop thread.
+ *
+ * @param event   - The event the handler is registered for.
+ * @param canID   - The CAN ID.
+ * @param handler - The handler that is called for the notifications.
+ */
+void CANConnector::subscribe(RxEvent event, canid_t canID, const RxHandler& handler){
+    subscribe(event, canID, canID, handler);
+}
+
+/**
+ * Registers a handler for the notifications of a range of CAN IDs.
+ * Extended CAN IDs must have the CAN_EFF_FLAG set.
+ *
+ * Note: The handler is called in the io context loop thread.
+ *
+ * @param event      - The event the handler is registered for.
+ * @param firstCanID - The first CAN ID of the range.
+ * @param lastCanID  - The last CAN ID of the range.
+ * @param handler    - The handler that is called for the notifications.
+ */
+void CANConnector::subscribe(RxEvent event, canid_t firstCanID, canid_t lastCanID, const RxHandler& handler){
+
+    // The dispatch table is only modified in the io context loop thread
+    boost::asio::post(*ioContext, [this, event, firstCanID, lastCanID, handler](){
+        rxDispatcher.subscribe(event, firstCanID, lastCanID, handler);
     });
 
 }
 
 /**
- * Create a non cyclic transmission task for multiple CAN/CANFD frames.
- * 
- * @param frames  - The frames that should be send.
- * @param nframes - The number of frames that should be send.
- * @param isCANFD - Flag for CANFD frames.
+ * Starts to capture the received notifications and the sent messages of the
+ * connector into a capture file. A running capture is replaced.
+ *
+ * @param path    - The path of the capture file. An existing file is truncated.
+ * @param useMmap - Flag for writing into a memory-mapped file instead of using write.
+ * @return False if the capture file could not be created.
  */
-void CANConnector::txSendMultipleFrames(struct canfd_frame frames[], int nframes, bool isCANFD){
+bool CANConnector::startCapture(const std::string& path, bool useMmap){
 
-    // Note: The TX_SEND operation can only handle exactly one frame!
-    // That's why we should use this wrapper for multiple frames.
-    for(int index = 0; index < nframes; index++){
-        txSendSingleFrame(frames[index], isCANFD);
+    auto writer = std::make_unique<CaptureWriter>(path, useMmap);
+
+    // Error handling / Sanity check
+    if(!writer->isOpen()){
+        return false;
     }
 
+    // The capture is only accessed in the io context loop thread
+    boost::asio::post(*ioContext, [this, writer = std::move(writer)]() mutable{
+        capture = std::move(writer);
+        waitForCaptureFlush();
+    });
+
+    return true;
 }
 
 /**
- * Create a cyclic transmission task for a CAN/CANFD frame.
+ * Stops the capture and waits until all records were written.
  *
- * @param frame   - The frame that should be send cyclic.
- * @param count   - Number of times the frame is send with the first interval.
- *                  If count is zero only the second interval is being used.
- * @param ival1   - First interval.
- * @param ival2   - Second interval.
- * @param isCANFD - Flag for a CANFD frames.
+ * @return The number of written and dropped records.
  */
-void CANConnector::txSetupSingleFrame(struct canfd_frame frame, uint32_t count, struct bcm_timeval ival1,
-                                      struct bcm_timeval ival2, bool isCANFD){
+CaptureWriter::Statistics CANConnector::stopCapture(){
 
-    // BCM message we are sending with a single CAN or CANFD frame
-    std::shared_ptr<void> msg = nullptr;
-    size_t msgSize = 0;
+    CaptureWriter::Statistics statistics;
 
-    // Check if we are sending CAN or CANFD frames
-    // and create the according struct
-    if(isCANFD){
-        msgSize = sizeof(struct bcmMsgSingleFrameCanFD);
-        auto msgCANFD = std::make_shared<bcmMsgSingleFrameCanFD>();
-        msg = std::reinterpret_pointer_cast<void>(msgCANFD);
-    }else{
-        msgSize = sizeof(struct bcmMsgSingleFrameCan);
-        auto msgCAN = std::make_shared<bcmMsgSingleFrameCan>();
-        msg = std::reinterpret_pointer_cast<void>(msgCAN);
-    }
+    auto stop = [this, &statistics](){
 
-    // Error handling / Sanity check
-    if(msg == nullptr){
-        std::cout << "Error could not make message structure" << std::endl;
-    }
+        captureTimer.cancel();
 
-    // Note: By combining the flags SETTIMER and STARTTIMER
-    // the BCM will start sending the messages immediately
+        if(capture != nullptr){
+            capture->flush();
+            statistics = capture->statistics();
+            capture.reset();
+        }
 
-    // Fill out the message
-    if(isCANFD){
-        std::shared_ptr<bcmMsgSingleFrameCanFD> msgCANFD = std::reinterpret_pointer_cast<bcmMsgSingleFrameCanFD>(msg);
-
-        msgCANFD->msg_head.opcode  = TX_SETUP;
-        msgCANFD->msg_head.flags   = CAN_FD_FRAME | SETTIMER | STARTTIMER;
-        msgCANFD->msg_head.can_id  = frame.can_id;
-        msgCANFD->msg_head.count   = count;
-        msgCANFD->msg_head.ival1   = ival1;
-        msgCANFD->msg_head.ival2   = ival2;
-        msgCANFD->msg_head.nframes = 1;
-        msgCANFD->canfdFrame[0]    = frame;
-    }else{
-        std::shared_ptr<bcmMsgSingleFrameCan> msgCAN = std::reinterpret_pointer_cast<bcmMsgSingleFrameCan>(msg);
-        auto canFrame = (struct can_frame *) &frame;
+    };
 
-        msgCAN->msg_head.opcode    = TX_SETUP;
-        msgCAN->msg_head.flags     = SETTIMER | STARTTIMER;
-        msgCAN->msg_head.can_id    = canFrame->can_id;
-        msgCAN->msg_head.count     = count;
-        msgCAN->msg_head.ival1     = ival1;
-        msgCAN->msg_head.ival2     = ival2;
-        msgCAN->msg_head.nframes   = 1;
-        msgCAN->canFrame[0]        = *canFrame;
+    // Note: Without a running io context loop thread nobody else touches the capture
+    if(ioContext->get_executor().running_in_this_thread() || ioContext->stopped()){
+        stop();
+        return statistics;
     }
 
-    // Note: buffer doesn't accept smart pointers. Need to use a regular pointer.
-    boost::asio::const_buffer buffer = boost::asio::buffer(msg.get(), msgSize);
+    std::promise<void> stopped;
 
-    bcmSocket.async_send(buffer, [msg](boost::system::error_code errorCode, std::size_t size){
+    boost::asio::post(*ioContext, [&stop, &stopped](){
+        stop();
+        stopped.set_value();
+    });
 
-        // Lambda completion function for the async TX_SETUP operation
+    stopped.get_future().wait();
 
-        // Check boost asio error code
-        if(!errorCode){
-            std::cout << "Transmission of TX_SETUP completed successfully" << std::endl;
-        }else{
-            std::cerr << "Transmission of TX_SETUP failed" << std::endl;
+    return statistics;
+}
+
+/**
+ * Hands the partially filled buffer of the capture over to the writer
+ * thread in a fixed interval, so the records of a quiet bus are written too.
+ */
+void CANConnector::waitForCaptureFlush(){
+
+    captureTimer.expires_after(std::chrono::milliseconds(CAPTURE_FLUSH_INTERVAL_MS));
+    captureTimer.async_wait([this](boost::system::error_code errorCode){
+
+        // Lambda completion function for the async wait operation
+
+        // The timer was cancelled or the capture was stopped
+        if(errorCode == boost::asio::error::operation_aborted || capture == nullptr){
+            return;
         }
 
+        capture->handOver();
+        waitForCaptureFlush();
+
     });
 
 }
 
 /**
- * Create a cyclic transmission task for multiple CAN/CANFD frames.
- *
- * Note: The frames will not be send as a atomic sequence. We send for each TX_SETUP
- * a single CAN/CANFD frame with its CAN ID in the bcm_msg_head. This way we do not
- * create a cyclic transmission sequence which can only be removed with the CAN ID
- * that was set in the bcm_msg_head. Another benefit is that each CAN/CANFD frame
- * can have different count, ival1, and ival2 values.
+ * Appends a received notification to the capture. Only called in the io context loop thread.
  *
- * @param frames  - The frames that should be send cyclic.
- * @param nframes - The number of frames that should be send cyclic.
- * @param count   - Number of times the frame is send with the first interval.
- *                  If count is zero only the second interval is being used.
- * @param ival1   - First interval.
- * @param ival2   - Second interval.
- * @param isCANFD - Flag for CANFD frames.
+ * @param notification - The received notification.
  */
-void CANConnector::txSetupMultipleFrames(struct canfd_frame frames[], int nframes, uint32_t count[], struct bcm_timeval ival1[],
-                                         struct bcm_timeval ival2[], bool isCANFD){
+void CANConnector::captureNotification(const BcmNotification& notification){
+
+    CaptureRecord record{};
+    record.timestamp = notification.timestamp;
+    record.opcode    = notification.head->opcode;
+    record.flags     = notification.head->flags;
+    record.canID     = notification.head->can_id;
+    record.direction = CaptureDirection::Rx;
+
+    if(notification.nframes == 0){
+        capture->append(record);
+        return;
+    }
 
-    for(int index = 0; index < nframes; index++){
-        txSetupSingleFrame(frames[index], count[index], ival1[index], ival2[index], isCANFD);
+    size_t frameSize = notification.isCANFD ? sizeof(struct canfd_frame) : sizeof(struct can_frame);
+    record.info = CAPTURE_INFO_FRAME | (notification.isCANFD ? CAPTURE_INFO_CANFD : 0);
+
+    for(uint32_t index = 0; index < notification.nframes; index++){
+        std::memcpy(&record.frame, static_cast<const std::uint8_t*>(notification.frames) + index * frameSize, frameSize);
+        capture->append(record);
     }
 
 }
 
 /**
- * Create a cyclic transmission task for one or multiple CAN/CANFD frames.
- * If more than one frame should be send cyclic the provided sequence of
- * the frames is kept by the BCM.
- *
- * Note: The cyclic transmission task for the sequence can only be deleted
- * with the CAN ID that was set in the bcm_msg_head.
+ * Appends the sent messages of a processed batch to the capture.
+ * Only called in the io context loop thread.
  *
- * @param frames   - The array of CAN/CANFD frames that should be send cyclic.
- * @param nframes  - The number of CAN/CANFD frames that should be send cyclic.
- * @param count    - Number of times the frame is send with the first interval.
- *                   If count is zero only the second interval is being used.
- * @param ival1    - First interval.
- * @param ival2    - Second interval.
- * @param isCANFD  - Flag for CANFD frames.
+ * @param batch - The processed batch.
  */
-void CANConnector::txSetupSequence(struct canfd_frame frames[], int nframes, uint32_t count,
-                           struct bcm_timeval ival1, struct bcm_timeval ival2, bool isCANFD){
+void CANConnector::captureBatch(const BcmBatch& batch){
 
-    // BCM message we are sending with a single CAN or CANFD frame
-    std::shared_ptr<void> msg = nullptr;
-    size_t msgSize = 0;
+    int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count();
 
-    // Check if we are sending CAN or CANFD frames
-    // and create the according struct
-    if(isCANFD){
-        msgSize = sizeof(struct bcmMsgMultipleFramesCanFD);
-        auto msgCANFD = std::make_shared<bcmMsgMultipleFramesCanFD>();
-        msg = std::reinterpret_pointer_cast<void>(msgCANFD);
-    }else {
-        msgSize = sizeof(struct bcmMsgMultipleFramesCan);
-        auto msgCAN = std::make_shared<bcmMsgMultipleFramesCan>();
-        msg = std::reinterpret_pointer_cast<void>(msgCAN);
-    }
-
-    // Error handling / Sanity check
-    if(msg == nullptr){
-        std::cout << "Error could not make message structure" << std::endl;
-    }
-
-    // Note: By combining the flags SETTIMER and STARTTIMER
-    // the BCM will start sending the messages immediately
+    for(size_t index = 0; index < batch.size(); index++){
 
-    // Fill out the message
-    if(isCANFD){
-        std::shared_ptr<bcmMsgMultipleFramesCanFD> msgCANFD = std::reinterpret_pointer_cast<bcmMsgMultipleFramesCanFD>(msg);
-
-        msgCANFD->msg_head.opcode  = TX_SETUP;
-        msgCANFD->msg_head.flags   = CAN_FD_FRAME | SETTIMER | STARTTIMER;
-        msgCANFD->msg_head.can_id  = frames[0].can_id;
-        msgCANFD->msg_head.count   = count;
-        msgCANFD->msg_head.ival1   = ival1;
-        msgCANFD->msg_head.ival2   = ival2;
-        msgCANFD->msg_head.nframes = nframes;
-
-        size_t arrSize = sizeof(struct canfd_frame) * nframes;
-        std::memcpy(msgCANFD->canfdFrames, frames, arrSize);
-    }else{
-        std::shared_ptr<bcmMsgMultipleFramesCan> msgCAN = std::reinterpret_pointer_cast<bcmMsgMultipleFramesCan>(msg);
-        auto firstCanFrame = (struct can_frame*) &frames[0];
-
-        msgCAN->msg_head.opcode    = TX_SETUP;
-        msgCAN->msg_head.flags     = SETTIMER | STARTTIMER;
-        msgCAN->msg_head.can_id    = firstCanFrame->can_id;
-        msgCAN->msg_head.count     = count;
-        msgCAN->msg_head.ival1     = ival1;
-        msgCAN->msg_head.ival2     = ival2;
-        msgCAN->msg_head.nframes   = nframes;
-
-        for(int index = 0; index < nframes; index++){
-            auto canFrame = (struct can_frame*) &frames[index];
-            msgCAN->canFrames[index] = *canFrame;
+        // Only the messages the kernel accepted are captured
+        if(batch.errorCode(index)){
+            continue;
         }
-    }
-
-    // Note: buffer doesn't accept smart pointers. Need to use a regular pointer.
-    boost::asio::const_buffer buffer = boost::asio::buffer(msg.get(), msgSize);
 
-    bcmSocket.async_send(buffer, [msg](boost::system::error_code errorCode, std::size_t size){
+        const bcm_msg_head* head = batch.head(index);
+        bool isCANFD = (head->flags & CAN_FD_FRAME) != 0;
 
-        // Lambda completion function for the async TX_SETUP operation
+        CaptureRecord record{};
+        record.timestamp = timestamp;
+        record.opcode    = head->opcode;
+        record.flags     = head->flags;
+        record.canID     = head->can_id;
+        record.direction = CaptureDirection::Tx;
 
-        // Check boost asio error code
-        if(!errorCode){
-            std::cout << "Transmission of TX_SETUP sequence completed successfully" << std::endl;
-        }else{
-            std::cerr << "Transmission of TX_SETUP sequence failed" << std::endl;
+        if(head->nframes == 0){
+            capture->append(record);
+            continue;
         }
 
-    });
+        size_t frameSize = isCANFD ? sizeof(struct canfd_frame) : sizeof(struct can_frame);
+        const auto* frames = reinterpret_cast<const std::uint8_t*>(head) + sizeof(struct bcm_msg_head);
+        record.info = CAPTURE_INFO_FRAME | (isCANFD ? CAPTURE_INFO_CANFD : 0);
+
+        for(uint32_t frame = 0; frame < head->nframes; frame++){
+            std::memcpy(&record.frame, frames + frame * frameSize, frameSize);
+            capture->append(record);
+        }
+    }
 
 }
 
 /**
- * Updates a cyclic transmission task for a CAN/CANFD frame.
+ * Applies a complete RX filter configuration. Only the filters that differ
+ * from the last applied configuration are set up or deleted, unchanged
+ * filters keep receiving without a gap. The messages are sent in batches.
  *
- * @param frames   - The updated CAN/CANFD frame data.
- * @param nframes  - The number of CAN/CANFD frames that should be updated.
- * @param isCANFD  - Flag for CANFD frames.
- * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ * @param filters - The desired RX filter configuration.
+ * @param handler - Optional handler that is called with the result in the io context loop thread.
  */
-void CANConnector::txSetupUpdateSingleFrame(struct canfd_frame frame, bool isCANFD, bool announce){
-
-    // BCM message we are sending with a single CAN or CANFD frame
-    std::shared_ptr<void> msg = nullptr;
-    size_t msgSize = 0;
-
-    // Check if we are sending CAN or CANFD frames
-    // and create the according struct
-    if(isCANFD){
-        msgSize = sizeof(struct bcmMsgSingleFrameCanFD);
-        auto msgCANFD = std::make_shared<bcmMsgSingleFrameCanFD>();
-        msg = std::reinterpret_pointer_cast<void>(msgCANFD);
-    }else{
-        msgSize = sizeof(struct bcmMsgSingleFrameCan);
-        auto msgCAN = std::make_shared<bcmMsgSingleFrameCan>();
-        msg = std::reinterpret_pointer_cast<void>(msgCAN);
-    }
-
-    // Error handling / Sanity check
-    if(msg == nullptr){
-        std::cout << "Error could not make message structure" << std::endl;
-    }
+void CANConnector::applyRxFilters(std::vector<RxFilter> filters, RxFilterHandler handler){
 
-    // Note: By combining the flags SETTIMER and STARTTIMER
-    // the BCM will start sending the messages immediately
+    auto desired = std::make_shared<std::vector<RxFilter>>(std::move(filters));
 
-    // Fill out the message
-    if(isCANFD){
-        std::shared_ptr<bcmMsgSingleFrameCanFD> msgCANFD = std::reinterpret_pointer_cast<bcmMsgSingleFrameCanFD>(msg);
+    // The filter set is only accessed in the io context loop thread
+    boost::asio::post(*ioContext, [this, desired, handler](){
+        applyRxFilterChanges(*desired, handler);
+    });
 
-        msgCANFD->msg_head.opcode  = TX_SETUP;
-        msgCANFD->msg_head.flags   = CAN_FD_FRAME;
-        msgCANFD->msg_head.can_id  = frame.can_id;
-        msgCANFD->msg_head.nframes = 1;
-        msgCANFD->canfdFrame[0]    = frame;
+}
 
-        if(announce){
-            msgCANFD->msg_head.flags = msgCANFD->msg_head.flags | TX_ANNOUNCE;
+/**
+ * Provisions the cyclic TX jobs and the RX filters of an interface configuration.
+ * The TX_SETUP messages are sent in batches ahead of the RX filters. The handler
+ * is called when the TX_SETUP batches and the RX filters were processed.
+ *
+ * @param config  - The configuration of the interface.
+ * @param handler - Optional handler that is called with the result of the TX jobs and RX filters in the io context loop thread.
+ */
+void CANConnector::provision(const InterfaceConfig& config, ProvisionHandler handler){
+
+    auto state = std::make_shared<ProvisionState>();
+    state->txJobs  = config.txSchedules.size();
+    state->handler = std::move(handler);
+
+    // Note: A rejected batch calls its handler before submitBatch returns
+    auto submit = [this, &state](std::unique_ptr<BcmBatch> batch){
+        state->pending.fetch_add(1, std::memory_order_relaxed);
+        submitBatch(std::move(batch), [state](const BcmBatch& result){
+            logBatchResult(result, "TX_SETUP");
+            state->txFailed.fetch_add(result.failed(), std::memory_order_relaxed);
+            completeProvision(*state);
+        });
+    };
+
+    auto batch = acquireBatch();
+    size_t unbuilt = 0;
+
+    for(const TxScheduleConfig& schedule : config.txSchedules){
+
+        // Submit the batch if it is full and continue with a new one
+        if(batch->full()){
+            submit(std::move(batch));
+            batch = acquireBatch();
         }
 
-    }else{
-        std::shared_ptr<bcmMsgSingleFrameCan> msgCAN = std::reinterpret_pointer_cast<bcmMsgSingleFrameCan>(msg);
-        auto canFrame = (struct can_frame *) &frame;
-
-        msgCAN->msg_head.opcode    = TX_SETUP;
-        msgCAN->msg_head.can_id    = canFrame->can_id;
-        msgCAN->msg_head.nframes   = 1;
-        msgCAN->canFrame[0]        = *canFrame;
-
-        if(announce){
-            msgCAN->msg_head.flags = TX_ANNOUNCE;
+        if(!addTxSetup(*batch, schedule.frame, schedule.count, schedule.ival1, schedule.ival2, schedule.isCANFD)){
+            Log::error("Error could not make message structure");
+            unbuilt++;
         }
-
     }
 
-    // Note: buffer doesn't accept smart pointers. Need to use a regular pointer.
-    boost::asio::const_buffer buffer = boost::asio::buffer(msg.get(), msgSize);
-
-    bcmSocket.async_send(buffer, [msg](boost::system::error_code errorCode, std::size_t size){
-
-        // Lambda completion function for the async TX_SETUP operation
-
-        // Check boost asio error code
-        if(!errorCode){
-            std::cout << "Transmission of TX_SETUP update completed successfully" << std::endl;
-        }else{
-            std::cerr << "Transmission of TX_SETUP update failed" << std::endl;
-        }
+    if(!batch->empty()){
+        submit(std::move(batch));
+    }
 
+    applyRxFilters(config.rxFilters, [state, unbuilt](const RxFilterResult& result){
+        state->rxFilters = result;
+        state->txFailed.fetch_add(unbuilt, std::memory_order_relaxed);
+        completeProvision(*state);
     });
-
 }
 
 /**
- * Updates a cyclic transmission task for one or multiple CAN/CANFD frames.
+ * Completes a part of a provisioning and calls the handler after the last part.
  *
- * @param frames   - The array of CAN/CANFD frames with the updated data.
- * @param nframes  - The number of CAN/CANFD frames that should be updated.
- * @param isCANFD  - Flag for CANFD frames.
- * @param announce - Flag for immediately sending out the changes once will retaining the cycle.
+ * @param state - The state of the provisioning.
  */
-void CANConnector::txSetupUpdateMultipleFrames(struct canfd_frame frames[], int nframes, bool isCANFD, bool announce){
+void CANConnector::completeProvision(ProvisionState& state){
 
-    for(int index = 0; index < nframes; index++){
-        txSetupUpdateSingleFrame(frames[index], isCANFD, announce);
+    if(state.pending.fetch_sub(1, std::memory_order_acq_rel) != 1){
+        return;
+    }
+
+    ProvisionResult result;
+    result.txJobs    = state.txJobs;
+    result.txFailed  = state.txFailed.load(std::memory_order_relaxed);
+    result.rxFilters = state.rxFilters;
+
+    if(state.handler){
+        state.handler(result);
     }
 
 }
 
 /**
- * Removes a cyclic transmission task for the given CAN ID.
- *
- * Note: A cyclic transmission task for a sequence of frames can only
- * be deleted with the CAN ID that was set in the bcm_msg_head.
+ * Calculates the changes of a filter configuration and submits them in batches.
+ * Only called in the io context loop thread.
  *
- * @param canID - The CAN ID of the task that should be removed.
+ * @param filters - The desired RX filter configuration.
+ * @param handler - The handler for the result.
  */
-void CANConnector::txDelete(canid_t canID, bool isCANFD){
+void CANConnector::applyRxFilterChanges(const std::vector<RxFilter>& filters, const RxFilterHandler& handler){
 
-    // BCM message we are sending
-    auto msg = std::make_shared<bcm_msg_head>();
+    auto apply = std::make_shared<RxFilterApply>();
+    apply->handler = handler;
 
-    // Fill out the message
-    msg->opcode = TX_DELETE;
-    msg->can_id = canID;
+    rxFilterSet.diff(filters, apply->changes, apply->result);
 
-    if(isCANFD){
-        msg->flags = CAN_FD_FRAME;
-    }
+    std::unique_ptr<BcmBatch> batch;
 
-    // Note: buffer doesn't accept smart pointers. Need to use a regular pointer.
-    boost::asio::const_buffer buffer = boost::asio::buffer(msg.get(), sizeof(bcm_msg_head));
+    for(size_t index = 0; index < apply->changes.size(); index++){
 
-    bcmSocket.async_send(buffer, [msg](boost::system::error_code errorCode, std::size_t size){
+        const RxFilterChange& change = apply->changes[index];
+        const RxFilter& filter = change.filter;
 
-        // Lambda completion function for the async TX_DELETE operation
+        apply->changeIndex[RxFilterSet::keyOf(filter.canID, filter.isCANFD)] = index;
 
-        // Check boost asio error code
-        if(!errorCode){
-            std::cout << "Transmission of TX_DELETE completed successfully" << std::endl;
-        }else{
-            std::cerr << "Transmission of TX_DELETE failed" << std::endl;
+        // Note: A replace needs two messages, both must be in the same batch
+        if(batch != nullptr && batch->size() + 2 > BCM_BATCH_MAX_MESSAGES){
+            submitRxFilterBatch(apply, std::move(batch));
         }
 
-    });
+        if(batch == nullptr){
+            batch = acquireBatch();
+        }
 
-}
+        bool added = true;
 
-/**
- * Creates a RX filter for the given CAN ID.
- * I. e. we get notified on all received frames with this CAN ID.
- *
- * @param canID    - The CAN ID that should be added to the RX filter.
- * @param isCANFD  - Flag for CANFD frames.
- */
-void CANConnector::rxSetupCanID(canid_t canID, bool isCANFD){
+        if(change.action != RxFilterChange::Action::Setup){
+            added = batch->add(buildRxDelete(filter.canID, filter.isCANFD));
+        }
 
-    // BCM message we are sending
-    auto msg = std::make_shared<bcm_msg_head>();
+        if(added && change.action != RxFilterChange::Action::Delete){
+            added = batch->add(buildRxFilter(filter));
+        }
 
-    // Fill out the message
-    msg->opcode = RX_SETUP;
-    msg->flags  = RX_FILTER_ID;
-    msg->can_id = canID;
+        if(!added){
+            Log::error("Error could not make RX filter message for CAN ID ", std::hex, filter.canID);
+            apply->result.failed++;
+        }
+    }
 
-    if(isCANFD){
-        msg->flags = msg->flags | CAN_FD_FRAME;
+    if(batch != nullptr && !batch->empty()){
+        submitRxFilterBatch(apply, std::move(batch));
     }
 
-    // Note: buffer doesn't accept smart pointers. Need to use a regular pointer.
-    boost::asio::const_buffer buffer = boost::asio::buffer(msg.get(), sizeof(bcm_msg_head));
+    apply->submitting = false;
 
-    bcmSocket.async_send(buffer, [msg](boost::system::error_code errorCode, std::size_t size){
+    if(apply->pendingBatches == 0 && apply->handler){
+        apply->handler(apply->result);
+    }
 
-        // Lambda completion function for the async RX_SETUP operation
+}
 
-        // Check boost asio error code
-        if(!errorCode){
-            std::cout << "Transmission of RX_SETUP based on a CAN ID completed successfully" << std::endl;
-        }else{
-            std::cerr << "Transmission of RX_SETUP based on a CAN ID failed" << std::endl;
+/**
+ * Submits a batch of a filter configuration.
+ *
+ * @param apply - The state of the filter configuration.
+ * @param batch - The batch with RX_SETUP and RX_DELETE messages.
+ */
+void CANConnector::submitRxFilterBatch(const std::shared_ptr<RxFilterApply>& apply, std::unique_ptr<BcmBatch> batch){
+
+    apply->pendingBatches++;
+
+    submitBatch(std::move(batch), [this, apply](const BcmBatch& result){
+
+        completeRxFilterBatch(*apply, result);
+        apply->pendingBatches--;
+
+        if(apply->pendingBatches == 0 && !apply->submitting && apply->handler){
+            apply->handler(apply->result);
         }
 
     });
@@ -650,164 +2570,192 @@ void CANConnector::rxSetupCanID(canid_t canID, bool isCANFD){
 }
 
 /**
- * Creates a RX filter for the CAN ID and the relevant bits of the frame.
- * I. e. we only get notified on changes for the set bits in the mask.
+ * Records the results of a batch of a filter configuration in the filter set.
  *
- * @param canID    - The CAN ID that should be added to the RX filter.
- * @param mask     - The mask for the relevant bits of the frame.
- * @param isCANFD  - Flag for CANFD frames.
+ * @param apply - The state of the filter configuration.
+ * @param batch - The processed batch.
  */
-void CANConnector::rxSetupMask(canid_t canID, struct canfd_frame mask, bool isCANFD){
-
-    // BCM message we are sending with a single CAN or CANFD frame
-    std::shared_ptr<void> msg = nullptr;
-    size_t msgSize = 0;
+void CANConnector::completeRxFilterBatch(RxFilterApply& apply, const BcmBatch& batch){
 
-    // Check if we are sending CAN or CANFD frames
-    // and create the according struct
-    if(isCANFD){
-        msgSize = sizeof(struct bcmMsgSingleFrameCanFD);
-        auto msgCANFD = std::make_shared<bcmMsgSingleFrameCanFD>();
-        msg = std::reinterpret_pointer_cast<void>(msgCANFD);
-    }else {
-        msgSize = sizeof(struct bcmMsgSingleFrameCan);
-        auto msgCAN = std::make_shared<bcmMsgSingleFrameCan>();
-        msg = std::reinterpret_pointer_cast<void>(msgCAN);
-    }
+    for(size_t index = 0; index < batch.size(); index++){
 
-    // Error handling / Sanity check
-    if(msg == nullptr){
-        std::cout << "Error could not make message structure" << std::endl;
-    }
+        const bcm_msg_head* head = batch.head(index);
+        uint64_t key = RxFilterSet::keyOf(head->can_id, (head->flags & CAN_FD_FRAME) != 0);
 
-    // Fill out the message
-    if(isCANFD){
-        std::shared_ptr<bcmMsgSingleFrameCanFD> msgCANFD = std::reinterpret_pointer_cast<bcmMsgSingleFrameCanFD>(msg);
+        const RxFilterChange& change = apply.changes[apply.changeIndex[key]];
+        const boost::system::error_code& errorCode = batch.errorCode(index);
 
-        msgCANFD->msg_head.opcode  = RX_SETUP;
-        msgCANFD->msg_head.flags   = CAN_FD_FRAME;
-        msgCANFD->msg_head.can_id  = canID;
-        msgCANFD->msg_head.nframes = 1;
+        if(head->opcode == RX_DELETE){
 
-        msgCANFD->canfdFrame[0]    = mask;
-    }else{
-        std::shared_ptr<bcmMsgSingleFrameCan> msgCAN = std::reinterpret_pointer_cast<bcmMsgSingleFrameCan>(msg);
-        auto maskCAN = (struct can_frame*) &mask;
+            // Note: The BCM reports EINVAL for a filter that does not exist
+            bool deleted = !errorCode || errorCode.value() == EINVAL;
 
-        msgCAN->msg_head.opcode    = RX_SETUP;
-        msgCAN->msg_head.can_id    = canID;
-        msgCAN->msg_head.nframes   = 1;
+            if(change.action == RxFilterChange::Action::Delete){
 
-        msgCAN->canFrame[0]        = *maskCAN;
-    }
+                if(deleted){
+                    rxFilterSet.removed(key);
+                    apply.result.removed++;
+                }else{
+                    Log::error("RX_DELETE of the RX filter for CAN ID ", std::hex, head->can_id, std::dec, " failed: ", errorCode.message());
+                    rxFilterSet.failed(key);
+                    apply.result.failed++;
+                }
 
-    // Note: buffer doesn't accept smart pointers. Need to use a regular pointer.
-    boost::asio::const_buffer buffer = boost::asio::buffer(msg.get(), msgSize);
+            }else if(deleted){
+                rxFilterSet.removed(key);
+            }
 
-    bcmSocket.async_send(buffer, [msg](boost::system::error_code errorCode, std::size_t size){
+            continue;
+        }
 
-        // Lambda completion function for the async RX_SETUP operation
+        if(errorCode){
+            Log::error("RX_SETUP of the RX filter for CAN ID ", std::hex, head->can_id, std::dec, " failed: ", errorCode.message());
+            rxFilterSet.failed(key);
+            apply.result.failed++;
+            continue;
+        }
 
-        // Check boost asio error code
-        if(!errorCode){
-            std::cout << "Transmission of RX_SETUP with mask completed successfully" << std::endl;
+        if(change.action == RxFilterChange::Action::Replace || rxFilterSet.find(change.filter.canID, change.filter.isCANFD) != nullptr){
+            apply.result.updated++;
         }else{
-            std::cerr << "Transmission of RX_SETUP with mask failed" << std::endl;
+            apply.result.added++;
         }
 
-    });
+        rxFilterSet.installed(change.filter);
+    }
+
 }
 
 /**
- * Removes the RX filter for the given CAN ID.
+ * Opens an awaitable stream for the notifications of a range of CAN IDs.
+ * The stream replaces the handlers of the range like a subscription.
+ * Extended CAN IDs must have the CAN_EFF_FLAG set.
  *
- * @param canID   - The CAN ID that should be removed from the RX filter.
- * @param isCANFD - Flag for CANFD frames.
+ * @param event      - The event of the notifications.
+ * @param firstCanID - The first CAN ID of the range.
+ * @param lastCanID  - The last CAN ID of the range.
+ * @param capacity   - The number of notifications the stream buffers.
+ * @return The handle of the stream.
  */
-void CANConnector::rxDelete(canid_t canID, bool isCANFD){
-
-    // BCM message we are sending
-    auto msg = std::make_shared<bcm_msg_head>();
-
-    // Fill out the message
-    msg->opcode = RX_DELETE;
-    msg->can_id = canID;
+RxStreamHandle CANConnector::openRxStream(RxEvent event, canid_t firstCanID, canid_t lastCanID, size_t capacity){
 
-    if(isCANFD){
-        msg->flags = CAN_FD_FRAME;
-    }
+    auto stream = std::make_shared<RxNotificationStream>(*ioContext, event, firstCanID, lastCanID, capacity);
 
-    // Note: buffer doesn't accept smart pointers. Need to use a regular pointer.
-    boost::asio::const_buffer buffer = boost::asio::buffer(msg.get(), sizeof(bcm_msg_head));
+    subscribe(event, firstCanID, lastCanID, [stream](const BcmNotification& notification){
+        stream->push(notification);
+    });
 
-    bcmSocket.async_send(buffer, [msg](boost::system::error_code errorCode, std::size_t size){
+    return stream;
+}
 
-        // Lambda completion function for the async TX_DELETE operation
+/**
+ * Closes a stream and removes its subscription. A pending receive
+ * of the stream completes with operation_aborted.
+ *
+ * @param stream - The handle of the stream.
+ */
+void CANConnector::closeRxStream(const RxStreamHandle& stream){
 
-        // Check boost asio error code
-        if(!errorCode){
-            std::cout << "Transmission of RX_DELETE completed successfully" << std::endl;
-        }else{
-            std::cerr << "Transmission of RX_DELETE failed" << std::endl;
-        }
+    // Error handling / Sanity check
+    if(stream == nullptr){
+        return;
+    }
 
+    boost::asio::post(*ioContext, [this, stream](){
+        rxDispatcher.unsubscribe(stream->event(), stream->firstCanID(), stream->lastCanID());
+        stream->close();
     });
 
 }
 
 /**
- * Decides what to do with the data we received on the socket.
+ * Opens a reader of the RX broadcast ring. Every received notification is
+ * written once into the ring and every reader follows it with its own cursor,
+ * so many consumer threads see all notifications without a subscription or
+ * a copy per consumer. The reader starts with the notifications received
+ * after this call. A reader that falls behind by more than the capacity of
+ * the ring skips the overwritten records and counts them as overruns.
+ * The ring is created with the first reader. Can be called from any thread.
  *
- * @param head    - The received bcm msg head.
- * @param frames  - The received CAN or CANFD frames.
- * @param nframes - The number of the received frames.
- * @param isCANFD - Flag for CANFD frames.
+ * @return The reader.
  */
-void CANConnector::handleReceivedData(const bcm_msg_head *head, void *frames, uint32_t nframes, bool isCANFD){
+RxBroadcastReader CANConnector::openRxBroadcast(){
 
-    std::cout << "Handling the received data" << std::endl;
+    std::call_once(rxBroadcastOnce, [this](){
+        rxBroadcast = std::make_shared<RxBroadcastRing>(RX_BROADCAST_CAPACITY);
+        rxBroadcastRing.store(rxBroadcast.get(), std::memory_order_release);
+    });
 
-    switch(head->opcode){
+    // Start at the records that are committed by now
+    return RxBroadcastReader(rxBroadcast, rxBroadcast->committed());
+}
 
-        case RX_CHANGED:
+/**
+ * Opens an ISO-TP channel for a pair of CAN IDs. The RX filter of the rx CAN ID
+ * is set up and every received frame of it is handed to the channel. Many
+ * channels can run concurrently, all of them in the io context loop thread.
+ *
+ * @param options - The configuration of the channel.
+ * @return The handle of the channel.
+ */
+IsoTpChannelHandle CANConnector::openIsoTpChannel(const IsoTpOptions& options){
 
-            // Simple reception of a CAN/CANFD frame or a content change occurred.
-            // TODO: Implement handling
-            std::cout << "RX_CHANGED is not implemented" << std::endl;
-            break;
+    auto channel = std::make_shared<IsoTpChannel>(*ioContext, *this, options);
 
-        case RX_TIMEOUT:
+    subscribe(RxEvent::Changed, options.rxID, [channel](const BcmNotification& notification){
+        channel->push(notification);
+    });
 
-            // Cyclic message is detected to be absent.
-            // TODO: Implement handling
-            std::cout << "RX_TIMEOUT is not implemented" << std::endl;
-            break;
+    // Note: Without masks the BCM notifies every received frame, not only the changed ones
+    rxSetupCanID(options.rxID, options.isCANFD);
 
-        case TX_EXPIRED:
+    return channel;
+}
 
-            // Notification when counter finishes sending at ival1 interval.
-            // Requires TX_COUNTEVT flag to be set at TX_SETUP.
-            std::cerr << "TX_EXPIRED is not implemented" << std::endl;
-            break;
+/**
+ * Closes an ISO-TP channel, removes its subscription and its RX filter.
+ * Pending operations of the channel complete with operation_aborted.
+ *
+ * @param channel - The handle of the channel.
+ */
+void CANConnector::closeIsoTpChannel(const IsoTpChannelHandle& channel){
 
-        case RX_STATUS:
+    // Error handling / Sanity check
+    if(channel == nullptr){
+        return;
+    }
 
-            // Reply to a RX_READ request that returns the RX content filter properties for a given CAN ID.
-            // This should not occur on a regular receive.
-            std::cerr << "Received unexpected RX_STATUS message" << std::endl;
-            break;
+    rxDelete(channel->options().rxID, channel->options().isCANFD);
 
-        case TX_STATUS:
+    boost::asio::post(*ioContext, [this, channel](){
+        rxDispatcher.unsubscribe(RxEvent::Changed, channel->options().rxID, channel->options().rxID);
+        channel->close();
+    });
 
-            // Reply to a TX_READ request that returns the TX transmission properties for a given CAN ID.
-            // This should not occur on a regular receive.
-            std::cerr << "Received unexpected TX_STATUS message" << std::endl;
-            break;
+}
 
-        default:
+/**
+ * Removes the handler of a single CAN ID.
+ *
+ * @param event - The event the handler was registered for.
+ * @param canID - The CAN ID.
+ */
+void CANConnector::unsubscribe(RxEvent event, canid_t canID){
+    unsubscribe(event, canID, canID);
+}
 
-            std::cerr << "Received unkown opcode!" << std::endl;
-    }
+/**
+ * Removes the handlers of a range of CAN IDs.
+ *
+ * @param event      - The event the handlers were registered for.
+ * @param firstCanID - The first CAN ID of the range.
+ * @param lastCanID  - The last CAN ID of the range.
+ */
+void CANConnector::unsubscribe(RxEvent event, canid_t firstCanID, canid_t lastCanID){
+
+    boost::asio::post(*ioContext, [this, event, firstCanID, lastCanID](){
+        rxDispatcher.unsubscribe(event, firstCanID, lastCanID);
+    });
 
 }
 
@@ -1022,6 +2970,32 @@ void CANConnector::handleSendingData(){
 }
 
 
+/*******************************************************************************
+ * TEMPLATE INSTANTIATIONS
+ ******************************************************************************/
+
+#define CAN_CONNECTOR_INSTANTIATE(Frame)                                                                        \
+    template void CANConnector::txSend<Frame>(const Frame&);                                                    \
+    template TxJobHandle CANConnector::txSetup<Frame>(const Frame&, uint32_t, struct bcm_timeval, struct bcm_timeval); \
+    template TxJobHandle CANConnector::txSetupSequence<Frame>(const Frame[], int, uint32_t, struct bcm_timeval, struct bcm_timeval); \
+    template void CANConnector::txSetupUpdate<Frame>(const Frame&, bool);                                       \
+    template void CANConnector::txDelete<Frame>(canid_t);                                                       \
+    template void CANConnector::rxSetupCanID<Frame>(canid_t);                                                   \
+    template void CANConnector::rxSetupMask<Frame>(canid_t, const Frame&);                                      \
+    template void CANConnector::rxDelete<Frame>(canid_t);                                                       \
+    template bool CANConnector::addTxSend<Frame>(BcmBatch&, const Frame&);                                      \
+    template bool CANConnector::addTxSetupUpdate<Frame>(BcmBatch&, const Frame&, bool);                         \
+    template BcmMessage CANConnector::buildSequence<Frame, Frame>(const Frame[], int, uint32_t, struct bcm_timeval, struct bcm_timeval); \
+    template BcmMessage CANConnector::buildRxSetup<Frame>(canid_t, const Frame[], int, const RxOptions&);         \
+    template void CANConnector::rxSetup<Frame>(canid_t, const RxOptions&);                                      \
+    template void CANConnector::rxSetupMask<Frame>(canid_t, const Frame&, const RxOptions&);                    \
+    template void CANConnector::rxSetupMultiplex<Frame>(canid_t, const Frame[], int, const RxOptions&);         \
+    template bool CANConnector::addRxSetup<Frame>(BcmBatch&, canid_t, const Frame[], int, const RxOptions&);
+
+CAN_CONNECTOR_INSTANTIATE(struct can_frame)
+CAN_CONNECTOR_INSTANTIATE(struct canfd_frame)
+
+
 /*******************************************************************************
  * END OF FILE
  ******************************************************************************/
\ No newline at end of file
@@ -0,0 +1,279 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      CANConnectorManager.cpp
+ \brief     The manager opens a CANConnector for each of many CAN interfaces.
+            The connectors are spread over the threads of an IoContextPool.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "CANConnectorManager.h"
+#include <future>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates the manager and starts the io context threads.
+ *
+ * @param threadCount - The number of io context threads.
+ * @param cores       - Optional CPU core for every io context thread.
+ */
+CANConnectorManager::CANConnectorManager(size_t threadCount, std::vector<int> cores) :
+    ioContextPool(threadCount, std::move(cores)), connectorsPerThread(ioContextPool.size(), 0){
+
+    ioContextPool.start();
+
+    Log::info("CAN Connector Manager created");
+}
+
+CANConnectorManager::~CANConnectorManager(){
+
+    // Note: The connectors detach from the running io contexts first
+    connectors.clear();
+    ioContextPool.stop();
+
+    Log::info("CAN Connector Manager destroyed");
+}
+
+/**
+ * Opens a connector for an interface on the io context thread with the fewest connectors.
+ *
+ * @param interfaceName - The name of the CAN interface e.g. "can0".
+ * @return The connector or nullptr if the interface could not be opened.
+ */
+CANConnector* CANConnectorManager::addInterface(const std::string& interfaceName){
+    return addInterface(interfaceName, leastLoadedThread());
+}
+
+/**
+ * Opens a connector for an interface on a specific io context thread.
+ * A busy channel can be given a thread of its own this way.
+ *
+ * @param interfaceName - The name of the CAN interface e.g. "can0".
+ * @param threadIndex   - The index of the io context thread.
+ * @return The connector or nullptr if the interface could not be opened.
+ */
+CANConnector* CANConnectorManager::addInterface(const std::string& interfaceName, size_t threadIndex){
+    return addInterface(interfaceName, threadIndex, nullptr);
+}
+
+/**
+ * Opens a connector with a transport, e.g. a SimulatedBcm, on the io context
+ * thread with the fewest connectors.
+ *
+ * @param interfaceName - The name of the interface.
+ * @param transport     - The transport of the BCM messages.
+ * @return The connector or nullptr if the interface could not be opened.
+ */
+CANConnector* CANConnectorManager::addInterface(const std::string& interfaceName, std::shared_ptr<BcmTransport> transport){
+    return addInterface(interfaceName, leastLoadedThread(), std::move(transport));
+}
+
+/**
+ * Opens a connector with a transport on a specific io context thread.
+ *
+ * @param interfaceName - The name of the interface.
+ * @param threadIndex   - The index of the io context thread.
+ * @param transport     - The transport of the BCM messages, the kernel BCM if empty.
+ * @return The connector or nullptr if the interface could not be opened.
+ */
+CANConnector* CANConnectorManager::addInterface(const std::string& interfaceName, size_t threadIndex, std::shared_ptr<BcmTransport> transport){
+
+    // Error handling / Sanity check
+    if(getConnector(interfaceName) != nullptr){
+        Log::error("Error interface ", interfaceName, " was already added");
+        return nullptr;
+    }
+
+    threadIndex %= ioContextPool.size();
+
+    auto connector = std::make_unique<CANConnector>(interfaceName, ioContextPool.context(threadIndex), std::move(transport));
+
+    // Check if the interface could be resolved and connected
+    if(!connector->isConnected()){
+        Log::error("Error could not open interface ", interfaceName);
+        return nullptr;
+    }
+
+    connectorsPerThread[threadIndex]++;
+    connectors.push_back(std::move(connector));
+
+    Log::info("CAN Connector Manager added interface ", interfaceName, " on io context thread ", threadIndex);
+
+    return connectors.back().get();
+}
+
+/**
+ * Opens and provisions the connectors of all interfaces of a configuration.
+ * The sockets of the connectors are created in parallel and every connector
+ * provisions its RX filters and TX jobs in batches. Returns when all
+ * connectors are provisioned. Must not be called in an io context thread.
+ *
+ * @param config - The configuration of the interfaces.
+ * @return The number of interfaces that were opened and provisioned without TX or RX errors.
+ */
+size_t CANConnectorManager::addInterfaces(const ConnectorConfig& config){
+
+    const std::vector<InterfaceConfig>& interfaces = config.interfaces();
+
+    std::vector<size_t> threadIndices;
+    std::vector<std::future<std::unique_ptr<CANConnector>>> created;
+    std::vector<size_t> load = connectorsPerThread;
+
+    // Spread the interfaces over the threads and create their sockets in parallel
+    for(const InterfaceConfig& interface : interfaces){
+
+        size_t threadIndex = 0;
+
+        for(size_t index = 1; index < load.size(); index++){
+            if(load[index] < load[threadIndex]){
+                threadIndex = index;
+            }
+        }
+
+        load[threadIndex]++;
+        threadIndices.push_back(threadIndex);
+
+        boost::shared_ptr<boost::asio::io_context> context = ioContextPool.context(threadIndex);
+
+        created.push_back(std::async(std::launch::async, [name = interface.name, context](){
+            return std::make_unique<CANConnector>(name, context);
+        }));
+    }
+
+    std::vector<std::future<bool>> provisioned;
+
+    for(size_t index = 0; index < interfaces.size(); index++){
+
+        const InterfaceConfig& interface = interfaces[index];
+        std::unique_ptr<CANConnector> connector = created[index].get();
+
+        // Error handling / Sanity check
+        if(getConnector(interface.name) != nullptr){
+            Log::error("Error interface ", interface.name, " was already added");
+            continue;
+        }
+
+        // Check if the interface could be resolved and connected
+        if(!connector->isConnected()){
+            Log::error("Error could not open interface ", interface.name);
+            continue;
+        }
+
+        connectorsPerThread[threadIndices[index]]++;
+        connectors.push_back(std::move(connector));
+
+        Log::info("CAN Connector Manager added interface ", interface.name, " on io context thread ", threadIndices[index]);
+
+        auto promise = std::make_shared<std::promise<bool>>();
+        provisioned.push_back(promise->get_future());
+
+        connectors.back()->provision(interface, [promise, name = interface.name](const ProvisionResult& result){
+
+            if(result.txFailed > 0){
+                Log::error("Error ", result.txFailed, " of ", result.txJobs, " TX jobs of interface ", name, " could not be set up");
+            }
+
+            if(result.rxFilters.failed > 0){
+                Log::error("Error ", result.rxFilters.failed, " RX filters of interface ", name, " could not be set up");
+            }
+
+            promise->set_value(result.txFailed == 0 && result.rxFilters.failed == 0);
+        });
+    }
+
+    size_t ready = 0;
+
+    for(std::future<bool>& future : provisioned){
+        if(future.get()){
+            ready++;
+        }
+    }
+
+    return ready;
+}
+
+/**
+ * Returns the connector of an interface.
+ *
+ * @param interfaceName - The name of the CAN interface.
+ * @return The connector or nullptr if the interface was not added.
+ */
+CANConnector* CANConnectorManager::getConnector(const std::string& interfaceName) const{
+
+    for(const auto& connector : connectors){
+        if(connector->getInterfaceName() == interfaceName){
+            return connector.get();
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * Returns the number of connectors.
+ *
+ * @return The number of connectors.
+ */
+size_t CANConnectorManager::size() const{
+    return connectors.size();
+}
+
+/**
+ * Returns the number of io context threads.
+ *
+ * @return The number of io context threads.
+ */
+size_t CANConnectorManager::threadCount() const{
+    return ioContextPool.size();
+}
+
+/**
+ * Returns the metrics of all connectors in the Prometheus text format,
+ * e.g. for the provider of a MetricsEndpoint. Must not be called
+ * concurrently with addInterface.
+ *
+ * @return The metrics text.
+ */
+std::string CANConnectorManager::getPrometheusMetrics() const{
+
+    std::vector<std::pair<std::string, ConnectorMetrics::Snapshot>> snapshots;
+    snapshots.reserve(connectors.size());
+
+    for(const auto& connector : connectors){
+        snapshots.emplace_back(connector->getInterfaceName(), connector->getMetrics());
+    }
+
+    return ConnectorMetrics::toPrometheus(snapshots);
+}
+
+/**
+ * Returns the io context thread with the fewest connectors.
+ *
+ * @return The index of the io context thread.
+ */
+size_t CANConnectorManager::leastLoadedThread() const{
+
+    size_t threadIndex = 0;
+
+    for(size_t index = 1; index < connectorsPerThread.size(); index++){
+        if(connectorsPerThread[index] < connectorsPerThread[threadIndex]){
+            threadIndex = index;
+        }
+    }
+
+    return threadIndex;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
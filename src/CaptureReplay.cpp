@@ -0,0 +1,242 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      CaptureReplay.cpp
+ \brief     Replay of a capture file on a connector. The file is mapped and
+            streamed record by record, so captures larger than the memory can
+            be replayed at the original or at an accelerated speed.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "CaptureReplay.h"
+#include "CANConnector.h"
+#include "Log.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Maps a capture file and checks its header. A partially written
+ * last record is ignored.
+ *
+ * @param path - The path of the capture file.
+ */
+CaptureReplay::CaptureReplay(const std::string& path){
+
+    int fileDescriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    // Error handling / Sanity check
+    if(fileDescriptor < 0){
+        Log::error("Error could not open capture file ", path, ": ", std::strerror(errno));
+        return;
+    }
+
+    struct stat status{};
+
+    if(::fstat(fileDescriptor, &status) < 0 || static_cast<size_t>(status.st_size) < sizeof(CaptureFileHeader)){
+        Log::error("Error capture file ", path, " has no header");
+        ::close(fileDescriptor);
+        return;
+    }
+
+    mappingSize = static_cast<size_t>(status.st_size);
+    void* file = ::mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+
+    // Note: The mapping keeps the file open
+    ::close(fileDescriptor);
+
+    if(file == MAP_FAILED){
+        Log::error("An error occurred on the mapping of the capture file: ", std::strerror(errno));
+        mappingSize = 0;
+        return;
+    }
+
+    mapping = static_cast<const std::uint8_t*>(file);
+    ::madvise(file, mappingSize, MADV_SEQUENTIAL);
+
+    const auto* header = reinterpret_cast<const CaptureFileHeader*>(mapping);
+
+    if(std::memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0 || header->version != CAPTURE_VERSION ||
+       header->recordSize != sizeof(CaptureRecord)){
+        Log::error("Error capture file ", path, " has an unsupported format");
+        return;
+    }
+
+    records     = reinterpret_cast<const CaptureRecord*>(mapping + sizeof(CaptureFileHeader));
+    recordCount = (mappingSize - sizeof(CaptureFileHeader)) / sizeof(CaptureRecord);
+}
+
+CaptureReplay::~CaptureReplay(){
+
+    if(mapping != nullptr){
+        ::munmap(const_cast<std::uint8_t*>(mapping), mappingSize);
+    }
+
+}
+
+/**
+ * Checks if the capture file could be mapped.
+ *
+ * @return True if the records can be replayed.
+ */
+bool CaptureReplay::isOpen() const{
+    return records != nullptr;
+}
+
+/**
+ * Returns the number of records of the capture file.
+ *
+ * @return The number of records.
+ */
+size_t CaptureReplay::size() const{
+    return recordCount;
+}
+
+/**
+ * Returns a record of the capture file.
+ *
+ * @param index - The index of the record.
+ * @return The record.
+ */
+const CaptureRecord& CaptureReplay::record(size_t index) const{
+    return records[index];
+}
+
+/**
+ * Replays the frames of the capture file on a connector in the calling thread.
+ * Every frame is sent with TX_SEND when it is due relative to the first
+ * replayed frame. Frames that are due at the same time are collected into a
+ * single sendmmsg call by the submission queue of the connector.
+ *
+ * @param connector - The connector the frames are sent on.
+ * @param options   - The options of the replay.
+ * @return The number of replayed frames.
+ */
+size_t CaptureReplay::replay(CANConnector& connector, const CaptureReplayOptions& options){
+
+    stopRequested.store(false, std::memory_order_relaxed);
+
+    // Note: The pages of an earlier replay are mapped again on access, the release starts over
+    releasedSize = 0;
+
+    size_t replayed = 0;
+    int64_t firstTimestamp = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for(size_t index = 0; index < recordCount; index++){
+
+        if(stopRequested.load(std::memory_order_relaxed)){
+            Log::info("Replay stopped after ", replayed, " frames");
+            break;
+        }
+
+        const CaptureRecord& current = records[index];
+
+        if(!matches(current, options.direction)){
+            continue;
+        }
+
+        if(replayed == 0){
+            firstTimestamp = current.timestamp;
+            start = std::chrono::steady_clock::now();
+        }
+
+        if(options.speed > 0){
+            auto offset = static_cast<int64_t>(static_cast<double>(current.timestamp - firstTimestamp) / options.speed);
+            waitUntil(start + std::chrono::nanoseconds(offset));
+        }
+
+        if(current.info & CAPTURE_INFO_CANFD){
+            connector.txSend(current.frame);
+        }else{
+            connector.txSend(asCANFrame(current.frame));
+        }
+
+        replayed++;
+        release(index);
+    }
+
+    return replayed;
+}
+
+/**
+ * Stops a running replay. Can be called from any thread.
+ */
+void CaptureReplay::stop(){
+    stopRequested.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * Checks if a record is replayed.
+ *
+ * @param record    - The record.
+ * @param direction - The direction of the replayed records.
+ * @return True for the frames of RX_CHANGED or TX_SEND records of the direction.
+ */
+bool CaptureReplay::matches(const CaptureRecord& record, CaptureDirection direction){
+
+    if(record.direction != direction || !(record.info & CAPTURE_INFO_FRAME)){
+        return false;
+    }
+
+    return direction == CaptureDirection::Rx ? record.opcode == RX_CHANGED : record.opcode == TX_SEND;
+}
+
+/**
+ * Waits until a deadline. Sleeps for most of the time and spins shortly before the deadline.
+ *
+ * @param deadline - The deadline.
+ */
+void CaptureReplay::waitUntil(std::chrono::steady_clock::time_point deadline){
+
+    auto sleepUntil = deadline - std::chrono::microseconds(CAPTURE_REPLAY_SPIN_US);
+
+    if(std::chrono::steady_clock::now() < sleepUntil){
+        std::this_thread::sleep_until(sleepUntil);
+    }
+
+    while(std::chrono::steady_clock::now() < deadline){
+        // Spin until the deadline
+    }
+
+}
+
+/**
+ * Releases the pages of the mapping that were replayed, so a long replay only
+ * keeps a window of the capture file in memory.
+ *
+ * @param index - The index of the last replayed record.
+ */
+void CaptureReplay::release(size_t index){
+
+    size_t position = sizeof(CaptureFileHeader) + index * sizeof(CaptureRecord);
+
+    if(position < releasedSize || position - releasedSize < CAPTURE_REPLAY_RELEASE_SIZE){
+        return;
+    }
+
+    // Note: Release whole pages only, the current record stays mapped
+    size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t end = (position / pageSize) * pageSize;
+
+    ::madvise(const_cast<std::uint8_t*>(mapping) + releasedSize, end - releasedSize, MADV_DONTNEED);
+    releasedSize = end;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,312 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      CaptureWriter.cpp
+ \brief     Append-only writer of a capture file. The producer fills one of
+            two record buffers while a background thread writes the other
+            one, either with write or into a memory-mapped file.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "CaptureWriter.h"
+#include "Log.h"
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/mman.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates the capture file, writes the header and starts the writer thread.
+ *
+ * @param path    - The path of the capture file. An existing file is truncated.
+ * @param useMmap - Flag for writing into a memory-mapped file instead of using write.
+ */
+CaptureWriter::CaptureWriter(const std::string& path, bool useMmap) : useMmap(useMmap){
+
+    // Note: A shared writable mapping needs read access to the file
+    fileDescriptor = ::open(path.c_str(), (useMmap ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    // Error handling / Sanity check
+    if(fileDescriptor < 0){
+        Log::error("Error could not open capture file ", path, ": ", std::strerror(errno));
+        return;
+    }
+
+    CaptureFileHeader header{};
+    std::memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version    = CAPTURE_VERSION;
+    header.recordSize = sizeof(CaptureRecord);
+    header.created    = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if(!writeRecords(&header, sizeof(header))){
+        closeFile();
+        return;
+    }
+
+    buffers[0].reset(new CaptureRecord[CAPTURE_BUFFER_RECORDS]);
+    buffers[1].reset(new CaptureRecord[CAPTURE_BUFFER_RECORDS]);
+
+    writerThread = std::thread(&CaptureWriter::writerThreadFunction, this);
+
+    Log::info("Capture started to ", path);
+}
+
+/**
+ * Writes the remaining records and closes the capture file.
+ * Must be called by the producer thread or after the producer stopped.
+ */
+CaptureWriter::~CaptureWriter(){
+
+    if(writerThread.joinable()){
+
+        flush();
+
+        writing.store(STOP, std::memory_order_release);
+        writing.notify_one();
+        writerThread.join();
+    }
+
+    closeFile();
+}
+
+/**
+ * Checks if the capture file was created.
+ *
+ * @return True if records can be appended.
+ */
+bool CaptureWriter::isOpen() const{
+    return writerThread.joinable();
+}
+
+/**
+ * Appends a record to the active buffer. A full buffer is handed over to
+ * the writer thread. The record is dropped and counted if both buffers are full.
+ *
+ * @param record - The record.
+ */
+void CaptureWriter::append(const CaptureRecord& record){
+
+    if(counts[active] == CAPTURE_BUFFER_RECORDS && !handOver()){
+        droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffers[active][counts[active]] = record;
+    counts[active]++;
+
+    if(counts[active] == CAPTURE_BUFFER_RECORDS){
+        handOver();
+    }
+
+}
+
+/**
+ * Hands the active buffer over to the writer thread if the writer thread is idle.
+ * Never blocks.
+ *
+ * @return False if the writer thread is still busy with the other buffer.
+ */
+bool CaptureWriter::handOver(){
+
+    if(counts[active] == 0){
+        return true;
+    }
+
+    if(writing.load(std::memory_order_acquire) != NO_BUFFER){
+        return false;
+    }
+
+    writing.store(active, std::memory_order_release);
+    writing.notify_one();
+
+    active = 1 - active;
+    counts[active] = 0;
+
+    return true;
+}
+
+/**
+ * Hands over the active buffer and waits until all records were written.
+ */
+void CaptureWriter::flush(){
+
+    int state;
+
+    // Wait for the writer thread, hand over and wait again
+    for(int round = 0; round < 2; round++){
+
+        while((state = writing.load(std::memory_order_acquire)) != NO_BUFFER){
+            writing.wait(state, std::memory_order_acquire);
+        }
+
+        handOver();
+    }
+
+}
+
+/**
+ * Returns the counters of the capture.
+ *
+ * @return The number of written and dropped records.
+ */
+CaptureWriter::Statistics CaptureWriter::statistics() const{
+
+    Statistics result;
+    result.written = writtenRecords.load(std::memory_order_relaxed);
+    result.dropped = droppedRecords.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+/**
+ * Thread of the writer. Writes every buffer that is handed over.
+ */
+void CaptureWriter::writerThreadFunction(){
+
+    while(true){
+
+        int index = writing.load(std::memory_order_acquire);
+
+        if(index == NO_BUFFER){
+            writing.wait(NO_BUFFER, std::memory_order_acquire);
+            continue;
+        }
+
+        if(index == STOP){
+            break;
+        }
+
+        size_t count = counts[index];
+
+        if(writeRecords(buffers[index].get(), count * sizeof(CaptureRecord))){
+            writtenRecords.fetch_add(count, std::memory_order_relaxed);
+        }else{
+            droppedRecords.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        writing.store(NO_BUFFER, std::memory_order_release);
+        writing.notify_all();
+    }
+
+}
+
+/**
+ * Appends data to the capture file.
+ *
+ * @param data - The data.
+ * @param size - The size of the data in bytes.
+ * @return False if the data could not be written.
+ */
+bool CaptureWriter::writeRecords(const void* data, size_t size){
+
+    const auto* bytes = static_cast<const std::uint8_t*>(data);
+
+    while(size > 0){
+
+        ssize_t result;
+
+        if(useMmap){
+
+            if((mapping == nullptr || mappingUsed == CAPTURE_MMAP_CHUNK_SIZE) && !mapChunk()){
+                return false;
+            }
+
+            result = static_cast<ssize_t>(std::min(size, CAPTURE_MMAP_CHUNK_SIZE - mappingUsed));
+            std::memcpy(mapping + mappingUsed, bytes, result);
+            mappingUsed += result;
+
+        }else{
+
+            result = ::write(fileDescriptor, bytes, size);
+
+            if(result < 0){
+
+                if(errno == EINTR){
+                    continue;
+                }
+
+                Log::error("An error occurred on the write to the capture file: ", std::strerror(errno));
+                return false;
+            }
+        }
+
+        bytes    += result;
+        size     -= result;
+        fileSize += result;
+    }
+
+    return true;
+}
+
+/**
+ * Maps the next chunk of the capture file. The file grows by the size of the chunk.
+ *
+ * @return False if the file could not be extended or mapped.
+ */
+bool CaptureWriter::mapChunk(){
+
+    if(mapping != nullptr){
+        ::munmap(mapping, CAPTURE_MMAP_CHUNK_SIZE);
+        mapping = nullptr;
+        mappingOffset += CAPTURE_MMAP_CHUNK_SIZE;
+        mappingUsed = 0;
+    }
+
+    if(::ftruncate(fileDescriptor, static_cast<off_t>(mappingOffset + CAPTURE_MMAP_CHUNK_SIZE)) < 0){
+        Log::error("An error occurred on the extension of the capture file: ", std::strerror(errno));
+        return false;
+    }
+
+    void* chunk = ::mmap(nullptr, CAPTURE_MMAP_CHUNK_SIZE, PROT_WRITE, MAP_SHARED, fileDescriptor, static_cast<off_t>(mappingOffset));
+
+    if(chunk == MAP_FAILED){
+        Log::error("An error occurred on the mapping of the capture file: ", std::strerror(errno));
+        return false;
+    }
+
+    mapping = static_cast<std::uint8_t*>(chunk);
+
+    return true;
+}
+
+/**
+ * Unmaps and closes the capture file. A memory-mapped file is
+ * truncated to the size of the written records.
+ */
+void CaptureWriter::closeFile(){
+
+    if(fileDescriptor < 0){
+        return;
+    }
+
+    if(mapping != nullptr){
+        ::munmap(mapping, CAPTURE_MMAP_CHUNK_SIZE);
+        mapping = nullptr;
+    }
+
+    if(useMmap && ::ftruncate(fileDescriptor, static_cast<off_t>(fileSize)) < 0){
+        Log::error("An error occurred on the truncation of the capture file: ", std::strerror(errno));
+    }
+
+    ::close(fileDescriptor);
+    fileDescriptor = -1;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
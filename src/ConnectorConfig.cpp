@@ -0,0 +1,369 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      ConnectorConfig.cpp
+ \brief     Runtime configuration of the interfaces with their pre-declared
+            RX filters and cyclic TX jobs. The configuration is loaded once
+            at startup and provisioned with batched submissions.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "ConnectorConfig.h"
+#include "Log.h"
+#include <cmath>
+#include <cerrno>
+#include <cctype>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Loads a configuration file.
+ *
+ * @param path - The path of the configuration file.
+ * @return False if the file could not be opened or contains no interface.
+ */
+bool ConnectorConfig::load(const std::string& path){
+
+    std::ifstream input(path);
+
+    // Error handling / Sanity check
+    if(!input){
+        Log::error("Error could not open configuration file ", path);
+        return false;
+    }
+
+    return parse(input);
+}
+
+/**
+ * Parses a configuration. Invalid lines are skipped with a warning.
+ *
+ * @param input - The configuration.
+ * @return False if the configuration contains no interface.
+ */
+bool ConnectorConfig::parse(std::istream& input){
+
+    std::vector<InterfaceConfig> interfaces;
+    std::string line;
+    size_t lineNumber = 0;
+
+    while(std::getline(input, line)){
+
+        lineNumber++;
+
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+
+        if(keyword.empty() || keyword[0] == '#'){
+            continue;
+        }
+
+        if(keyword == "interface"){
+
+            InterfaceConfig interface;
+            tokens >> interface.name;
+
+            if(interface.name.empty()){
+                Log::warning("Config line ", lineNumber, ": missing interface name");
+                continue;
+            }
+
+            interfaces.push_back(std::move(interface));
+            continue;
+        }
+
+        if(keyword != "rx" && keyword != "tx"){
+            Log::warning("Config line ", lineNumber, ": unknown keyword ", keyword);
+            continue;
+        }
+
+        // Error handling / Sanity check
+        if(interfaces.empty()){
+            Log::warning("Config line ", lineNumber, ": ", keyword, " before the first interface");
+            continue;
+        }
+
+        std::string idToken;
+        canid_t canID = 0;
+        tokens >> idToken;
+
+        if(!parseCanID(idToken, canID)){
+            Log::warning("Config line ", lineNumber, ": invalid CAN ID ", idToken);
+            continue;
+        }
+
+        // Collect the flags first, the CANFD flag decides how the data is parsed
+        std::vector<std::string> arguments;
+        std::string argument;
+        bool isCANFD = false;
+
+        while(tokens >> argument){
+
+            if(argument == "fd"){
+                isCANFD = true;
+            }else if(argument == "ext"){
+                canID = (canID & CAN_EFF_MASK) | CAN_EFF_FLAG;
+            }else{
+                arguments.push_back(argument);
+            }
+        }
+
+        bool valid = true;
+
+        if(keyword == "rx"){
+
+            RxOptions options;
+            std::vector<struct canfd_frame> masks;
+
+            for(const std::string& token : arguments){
+
+                size_t separator = token.find('=');
+                std::string key   = token.substr(0, separator);
+                std::string value = separator == std::string::npos ? std::string() : token.substr(separator + 1);
+
+                if(key == "resume"){
+                    options.announceResume = true;
+                }else if(key == "dlc"){
+                    options.checkDLC = true;
+                }else if(key == "noautotimer"){
+                    options.noAutoTimer = true;
+                }else if(key == "timeout"){
+                    valid &= parseDuration(value, options.timeout);
+                }else if(key == "throttle"){
+                    valid &= parseDuration(value, options.throttle);
+                }else if(key == "mask"){
+                    struct canfd_frame mask{};
+                    valid &= parseHex(value, mask, isCANFD);
+                    masks.push_back(mask);
+                }else{
+                    valid = false;
+                }
+
+                if(!valid){
+                    Log::warning("Config line ", lineNumber, ": invalid argument ", token);
+                    break;
+                }
+            }
+
+            if(valid){
+                interfaces.back().rxFilters.emplace_back(canID, isCANFD, options, std::move(masks));
+            }
+
+        }else{
+
+            TxScheduleConfig schedule;
+            schedule.isCANFD = isCANFD;
+            std::chrono::microseconds ival1{0};
+            std::chrono::microseconds ival2{0};
+
+            for(const std::string& token : arguments){
+
+                size_t separator = token.find('=');
+                std::string key   = token.substr(0, separator);
+                std::string value = separator == std::string::npos ? std::string() : token.substr(separator + 1);
+
+                if(key == "period" || key == "ival2"){
+                    valid &= parseDuration(value, ival2);
+                }else if(key == "ival1"){
+                    valid &= parseDuration(value, ival1);
+                }else if(key == "count"){
+                    valid &= parseCount(value, schedule.count);
+                }else if(key == "data"){
+                    valid &= parseHex(value, schedule.frame, isCANFD);
+                }else{
+                    valid = false;
+                }
+
+                if(!valid){
+                    Log::warning("Config line ", lineNumber, ": invalid argument ", token);
+                    break;
+                }
+            }
+
+            // A cyclic job needs at least one interval
+            if(valid && ival2.count() == 0 && (schedule.count == 0 || ival1.count() == 0)){
+                Log::warning("Config line ", lineNumber, ": tx job without a period");
+                valid = false;
+            }
+
+            if(valid){
+                schedule.frame.can_id = canID;
+                schedule.ival1 = RxOptions::toTimeval(ival1);
+                schedule.ival2 = RxOptions::toTimeval(ival2);
+                interfaces.back().txSchedules.push_back(schedule);
+            }
+        }
+    }
+
+    // Error handling / Sanity check
+    if(interfaces.empty()){
+        Log::error("Error the configuration contains no interface");
+        return false;
+    }
+
+    entries = std::move(interfaces);
+
+    return true;
+}
+
+/**
+ * Returns the configured interfaces.
+ *
+ * @return The interfaces in the order of the configuration.
+ */
+const std::vector<InterfaceConfig>& ConnectorConfig::interfaces() const{
+    return entries;
+}
+
+/**
+ * Returns the configuration of an interface.
+ *
+ * @param interfaceName - The name of the CAN interface.
+ * @return The configuration or nullptr if the interface is not configured.
+ */
+const InterfaceConfig* ConnectorConfig::find(const std::string& interfaceName) const{
+
+    for(const InterfaceConfig& interface : entries){
+        if(interface.name == interfaceName){
+            return &interface;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * Parses a decimal or 0x prefixed hexadecimal CAN ID. CAN IDs
+ * above 0x7FF get the CAN_EFF_FLAG.
+ *
+ * @param token - The text of the CAN ID.
+ * @param canID - The parsed CAN ID.
+ * @return False if the text is no valid CAN ID.
+ */
+bool ConnectorConfig::parseCanID(const std::string& token, canid_t& canID){
+
+    char* end = nullptr;
+    unsigned long value = std::strtoul(token.c_str(), &end, 0);
+
+    // Error handling / Sanity check
+    if(token.empty() || *end != '\0' || value > CAN_EFF_MASK){
+        return false;
+    }
+
+    canID = static_cast<canid_t>(value);
+
+    if(value > CAN_SFF_MASK){
+        canID |= CAN_EFF_FLAG;
+    }
+
+    return true;
+}
+
+/**
+ * Parses a duration with the unit s, ms or us.
+ *
+ * @param token    - The text of the duration, e.g. 10ms.
+ * @param duration - The parsed duration.
+ * @return False if the text is no valid duration.
+ */
+bool ConnectorConfig::parseDuration(const std::string& token, std::chrono::microseconds& duration){
+
+    char* end = nullptr;
+    double value = std::strtod(token.c_str(), &end);
+    std::string unit(end);
+
+    // Error handling / Sanity check
+    if(end == token.c_str() || !std::isfinite(value) || value < 0){
+        return false;
+    }
+
+    if(unit == "s"){
+        value *= 1000000.0;
+    }else if(unit == "ms"){
+        value *= 1000.0;
+    }else if(unit != "us"){
+        return false;
+    }
+
+    // Note: The cast of a value that does not fit into an int64_t is undefined
+    if(value >= static_cast<double>(std::numeric_limits<int64_t>::max())){
+        return false;
+    }
+
+    duration = std::chrono::microseconds(static_cast<int64_t>(value));
+
+    return true;
+}
+
+/**
+ * Parses a decimal frame count.
+ *
+ * @param token - The text of the count.
+ * @param count - The parsed count.
+ * @return False if the text is no valid count or does not fit into 32 bit.
+ */
+bool ConnectorConfig::parseCount(const std::string& token, uint32_t& count){
+
+    // Note: strtoul accepts signs and whitespace, so the digits are checked first
+    if(token.empty() || !std::all_of(token.begin(), token.end(), [](unsigned char character){ return std::isdigit(character) != 0; })){
+        return false;
+    }
+
+    errno = 0;
+    char* end = nullptr;
+    unsigned long value = std::strtoul(token.c_str(), &end, 10);
+
+    // Error handling / Sanity check
+    if(errno == ERANGE || *end != '\0' || value > std::numeric_limits<uint32_t>::max()){
+        return false;
+    }
+
+    count = static_cast<uint32_t>(value);
+
+    return true;
+}
+
+/**
+ * Parses the hexadecimal bytes of a payload, e.g. 0102AABB.
+ *
+ * @param token   - The text of the payload.
+ * @param frame   - The frame that receives the payload and its length.
+ * @param isCANFD - Flag for a CANFD frame with up to 64 bytes.
+ * @return False if the text is no valid payload.
+ */
+bool ConnectorConfig::parseHex(const std::string& token, struct canfd_frame& frame, bool isCANFD){
+
+    size_t length = token.size() / 2;
+
+    // Error handling / Sanity check
+    if(token.size() % 2 != 0 || length > (isCANFD ? CANFD_MAX_DLEN : CAN_MAX_DLEN) ||
+       !std::all_of(token.begin(), token.end(), [](unsigned char character){ return std::isxdigit(character) != 0; })){
+        return false;
+    }
+
+    for(size_t index = 0; index < length; index++){
+        frame.data[index] = static_cast<uint8_t>(std::stoul(token.substr(index * 2, 2), nullptr, 16));
+    }
+
+    frame.len = static_cast<uint8_t>(length);
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
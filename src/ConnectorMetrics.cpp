@@ -0,0 +1,317 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      ConnectorMetrics.cpp
+ \brief     Per-operation counters and a latency histogram of a CANConnector.
+            Every thread writes relaxed atomics of its own shard, the shards
+            are merged when a snapshot is read.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "ConnectorMetrics.h"
+#include "CANConnector.h"
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+
+/*******************************************************************************
+ * VARIABLES
+ ******************************************************************************/
+
+std::atomic<std::size_t> ConnectorMetrics::threadCounter{0};
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Merges the counters of all shards. Can be called from any thread. The
+ * counters are read one by one, so a snapshot that is taken under load
+ * is not an atomic view of all counters.
+ *
+ * @return The merged counters.
+ */
+ConnectorMetrics::Snapshot ConnectorMetrics::snapshot() const{
+
+    Snapshot result;
+    std::array<std::uint64_t, METRICS_ERRNO_SLOTS> txErrors{};
+    std::array<std::uint64_t, METRICS_ERRNO_SLOTS> rxErrors{};
+
+    result.latency.resize(METRICS_HISTOGRAM_BUCKETS);
+
+    for(const Shard& shard : shards){
+
+        for(size_t opcode = 0; opcode < METRICS_OPCODES; opcode++){
+            result.txMessages[opcode] += shard.txMessages[opcode].load(std::memory_order_relaxed);
+            result.rxMessages[opcode] += shard.rxMessages[opcode].load(std::memory_order_relaxed);
+        }
+
+        result.txBytes         += shard.txBytes.load(std::memory_order_relaxed);
+        result.rxBytes         += shard.rxBytes.load(std::memory_order_relaxed);
+        result.txRejected      += shard.txRejected.load(std::memory_order_relaxed);
+        result.txSocketBlocked += shard.txSocketBlocked.load(std::memory_order_relaxed);
+        result.txOverwritten   += shard.txOverwritten.load(std::memory_order_relaxed);
+        result.txRetries       += shard.txRetries.load(std::memory_order_relaxed);
+        result.rxBadSize       += shard.rxBadSize.load(std::memory_order_relaxed);
+
+        for(size_t slot = 0; slot < METRICS_ERRNO_SLOTS; slot++){
+            txErrors[slot] += shard.txErrors[slot].load(std::memory_order_relaxed);
+            rxErrors[slot] += shard.rxErrors[slot].load(std::memory_order_relaxed);
+        }
+
+        for(size_t bucket = 0; bucket < METRICS_HISTOGRAM_BUCKETS; bucket++){
+            std::uint64_t count = shard.latency[bucket].load(std::memory_order_relaxed);
+            result.latency[bucket] += count;
+            result.latencyCount    += count;
+        }
+
+        result.latencySum += shard.latencySum.load(std::memory_order_relaxed);
+        result.latencyMax  = std::max(result.latencyMax, shard.latencyMax.load(std::memory_order_relaxed));
+    }
+
+    for(size_t slot = 0; slot < METRICS_ERRNO_SLOTS; slot++){
+
+        if(txErrors[slot] != 0){
+            result.txErrors.emplace_back(static_cast<int>(slot), txErrors[slot]);
+        }
+
+        if(rxErrors[slot] != 0){
+            result.rxErrors.emplace_back(static_cast<int>(slot), rxErrors[slot]);
+        }
+    }
+
+    result.txQueueMaxDepth = txQueueMaxDepth.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+/**
+ * Counts the messages of a processed batch and records their latencies.
+ *
+ * @param batch     - The processed batch.
+ * @param completed - The completion time in steady clock nanoseconds, see now.
+ */
+void ConnectorMetrics::recordBatch(const BcmBatch& batch, std::int64_t completed){
+
+    Shard& shard = local();
+    std::uint64_t maximum = shard.latencyMax.load(std::memory_order_relaxed);
+    std::uint64_t sum = 0;
+    std::uint64_t bytes = 0;
+
+    for(size_t index = 0; index < batch.size(); index++){
+
+        const boost::system::error_code& errorCode = batch.errorCode(index);
+
+        if(errorCode){
+            shard.txErrors[errnoSlot(errorCode.value())].fetch_add(1, std::memory_order_relaxed);
+        }else{
+            std::uint32_t opcode = batch.head(index)->opcode;
+            shard.txMessages[opcode < METRICS_OPCODES ? opcode : 0].fetch_add(1, std::memory_order_relaxed);
+            bytes += batch.bytes(index);
+        }
+
+        if(batch.submitted(index) == 0){
+            continue;
+        }
+
+        std::uint64_t latency = static_cast<std::uint64_t>(std::max<std::int64_t>(0, completed - batch.submitted(index)));
+
+        shard.latency[bucketIndex(latency)].fetch_add(1, std::memory_order_relaxed);
+        sum    += latency;
+        maximum = std::max(maximum, latency);
+    }
+
+    shard.txBytes.fetch_add(bytes, std::memory_order_relaxed);
+    shard.latencySum.fetch_add(sum, std::memory_order_relaxed);
+
+    // Note: Only raised, so a lost race with another thread of the shard is harmless
+    if(maximum > shard.latencyMax.load(std::memory_order_relaxed)){
+        shard.latencyMax.store(maximum, std::memory_order_relaxed);
+    }
+
+}
+
+/**
+ * Records the depth of the submission queue at the start of a drain.
+ * Only called in the io context loop thread.
+ *
+ * @param depth - The number of queued commands.
+ */
+void ConnectorMetrics::recordTxQueueDepth(std::size_t depth){
+
+    if(depth > txQueueMaxDepth.load(std::memory_order_relaxed)){
+        txQueueMaxDepth.store(depth, std::memory_order_relaxed);
+    }
+
+}
+
+/**
+ * Maps a value to its bucket of the latency histogram. The values below
+ * the number of sub-buckets have their own bucket, every following power
+ * of two is split into METRICS_HISTOGRAM_SUB_BUCKETS linear buckets.
+ *
+ * @param value - The value in nanoseconds.
+ * @return The index of the bucket.
+ */
+std::size_t ConnectorMetrics::bucketIndex(std::uint64_t value){
+
+    if(value < METRICS_HISTOGRAM_SUB_BUCKETS){
+        return static_cast<std::size_t>(value);
+    }
+
+    // Position of the highest set bit, at least 3 since value >= 8
+    std::size_t magnitude = 63 - __builtin_clzll(value);
+    std::size_t index = (magnitude - 2) * METRICS_HISTOGRAM_SUB_BUCKETS + ((value >> (magnitude - 3)) & (METRICS_HISTOGRAM_SUB_BUCKETS - 1));
+
+    return std::min<std::size_t>(index, METRICS_HISTOGRAM_BUCKETS - 1);
+}
+
+/**
+ * Returns the smallest value of a bucket of the latency histogram.
+ *
+ * @param index - The index of the bucket. The index METRICS_HISTOGRAM_BUCKETS is the end of the last bucket.
+ * @return The smallest value in nanoseconds.
+ */
+std::uint64_t ConnectorMetrics::bucketLowerBound(std::size_t index){
+
+    if(index < METRICS_HISTOGRAM_SUB_BUCKETS){
+        return index;
+    }
+
+    std::size_t magnitude = index / METRICS_HISTOGRAM_SUB_BUCKETS + 2;
+    std::size_t subBucket = index % METRICS_HISTOGRAM_SUB_BUCKETS;
+
+    return static_cast<std::uint64_t>(METRICS_HISTOGRAM_SUB_BUCKETS + subBucket) << (magnitude - 3);
+}
+
+/**
+ * Estimates a quantile of the latency histogram with the upper bound of its bucket.
+ *
+ * @param snapshot - The snapshot of the counters.
+ * @param quantile - The quantile, e.g. 0.99.
+ * @return The latency in nanoseconds or zero if nothing was recorded.
+ */
+std::uint64_t ConnectorMetrics::percentile(const Snapshot& snapshot, double quantile){
+
+    if(snapshot.latencyCount == 0){
+        return 0;
+    }
+
+    std::uint64_t rank = static_cast<std::uint64_t>(std::ceil(quantile * static_cast<double>(snapshot.latencyCount)));
+    std::uint64_t cumulative = 0;
+
+    rank = std::clamp<std::uint64_t>(rank, 1, snapshot.latencyCount);
+
+    for(size_t index = 0; index < snapshot.latency.size(); index++){
+
+        cumulative += snapshot.latency[index];
+
+        if(cumulative >= rank){
+            return std::min(bucketLowerBound(index + 1) - 1, snapshot.latencyMax);
+        }
+    }
+
+    return snapshot.latencyMax;
+}
+
+/**
+ * Formats the snapshots of several interfaces in the Prometheus text exposition format.
+ *
+ * @param snapshots - Pairs of interface name and snapshot.
+ * @return The text of all metric families.
+ */
+std::string ConnectorMetrics::toPrometheus(const std::vector<std::pair<std::string, Snapshot>>& snapshots){
+
+    std::ostringstream out;
+
+    auto family = [&out](const char* name, const char* type, const char* help){
+        out << "# HELP " << name << ' ' << help << '\n' << "# TYPE " << name << ' ' << type << '\n';
+    };
+
+    family("can_bcm_tx_messages_total", "counter", "BCM messages sent by opcode.");
+    for(const auto& [interface, snapshot] : snapshots){
+        for(size_t opcode = 1; opcode < METRICS_OPCODES; opcode++){
+            if(snapshot.txMessages[opcode] != 0){
+                out << "can_bcm_tx_messages_total{interface=\"" << interface << "\",opcode=\"" << CANConnector::opcodeName(opcode) << "\"} " << snapshot.txMessages[opcode] << '\n';
+            }
+        }
+    }
+
+    family("can_bcm_rx_messages_total", "counter", "BCM messages received by opcode.");
+    for(const auto& [interface, snapshot] : snapshots){
+        for(size_t opcode = 1; opcode < METRICS_OPCODES; opcode++){
+            if(snapshot.rxMessages[opcode] != 0){
+                out << "can_bcm_rx_messages_total{interface=\"" << interface << "\",opcode=\"" << CANConnector::opcodeName(opcode) << "\"} " << snapshot.rxMessages[opcode] << '\n';
+            }
+        }
+    }
+
+    auto scalar = [&out, &family, &snapshots](const char* name, const char* type, const char* help, auto member){
+        family(name, type, help);
+        for(const auto& [interface, snapshot] : snapshots){
+            out << name << "{interface=\"" << interface << "\"} " << snapshot.*member << '\n';
+        }
+    };
+
+    scalar("can_bcm_tx_bytes_total", "counter", "Bytes of the sent BCM messages.", &Snapshot::txBytes);
+    scalar("can_bcm_rx_bytes_total", "counter", "Bytes of the received BCM messages.", &Snapshot::rxBytes);
+    scalar("can_bcm_tx_rejected_total", "counter", "BCM messages rejected before the socket.", &Snapshot::txRejected);
+    scalar("can_bcm_tx_socket_blocked_total", "counter", "Batches that waited for the socket.", &Snapshot::txSocketBlocked);
+    scalar("can_bcm_tx_overwritten_total", "counter", "Waiting frames replaced by a newer frame of their CAN ID.", &Snapshot::txOverwritten);
+    scalar("can_bcm_tx_retries_total", "counter", "ENOBUFS backoffs of the sent messages.", &Snapshot::txRetries);
+    scalar("can_bcm_rx_bad_size_total", "counter", "Received datagrams dropped for their size.", &Snapshot::rxBadSize);
+    scalar("can_bcm_tx_queue_depth", "gauge", "Commands in the submission queue.", &Snapshot::txQueueDepth);
+    scalar("can_bcm_tx_queue_max_depth", "gauge", "Highest depth of the submission queue.", &Snapshot::txQueueMaxDepth);
+
+    family("can_bcm_tx_errors_total", "counter", "Failed BCM messages by errno.");
+    for(const auto& [interface, snapshot] : snapshots){
+        for(const auto& [error, count] : snapshot.txErrors){
+            out << "can_bcm_tx_errors_total{interface=\"" << interface << "\",errno=\"" << error << "\"} " << count << '\n';
+        }
+    }
+
+    family("can_bcm_rx_errors_total", "counter", "Failed receive operations by errno.");
+    for(const auto& [interface, snapshot] : snapshots){
+        for(const auto& [error, count] : snapshot.rxErrors){
+            out << "can_bcm_rx_errors_total{interface=\"" << interface << "\",errno=\"" << error << "\"} " << count << '\n';
+        }
+    }
+
+    // Note: The histogram is exported with power of two bounds from 2^10 ns (~1 us) to 2^34 ns (~17.2 s)
+    family("can_bcm_tx_latency_seconds", "histogram", "Submit to completion latency of the BCM messages.");
+    for(const auto& [interface, snapshot] : snapshots){
+
+        std::uint64_t cumulative = 0;
+        size_t bucket = 0;
+
+        for(size_t exponent = 10; exponent <= 34; exponent++){
+
+            size_t end = bucketIndex(std::uint64_t(1) << exponent);
+
+            while(bucket < end){
+                cumulative += snapshot.latency[bucket++];
+            }
+
+            out << "can_bcm_tx_latency_seconds_bucket{interface=\"" << interface << "\",le=\""
+                << static_cast<double>(std::uint64_t(1) << exponent) * 1e-9 << "\"} " << cumulative << '\n';
+        }
+
+        out << "can_bcm_tx_latency_seconds_bucket{interface=\"" << interface << "\",le=\"+Inf\"} " << snapshot.latencyCount << '\n';
+        out << "can_bcm_tx_latency_seconds_sum{interface=\"" << interface << "\"} " << static_cast<double>(snapshot.latencySum) * 1e-9 << '\n';
+        out << "can_bcm_tx_latency_seconds_count{interface=\"" << interface << "\"} " << snapshot.latencyCount << '\n';
+    }
+
+    return out.str();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,561 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      Gateway.cpp
+ \brief     Gateway between the CAN interfaces of a connector manager and UDP
+            links. Routing rules forward the RX_CHANGED notifications of a
+            range of CAN IDs to another interface or into UDP datagrams and
+            the frames of received datagrams back to the interfaces.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "Gateway.h"
+#include "ConnectorMetrics.h"
+#include "Log.h"
+
+#include <future>
+#include <cstring>
+#include <algorithm>
+#include <boost/asio/post.hpp>
+#include <boost/asio/ip/address.hpp>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates a gateway for the interfaces of a connector manager.
+ *
+ * Note: The manager must outlive the gateway.
+ *
+ * @param manager - The connector manager with the interfaces.
+ */
+Gateway::Gateway(CANConnectorManager& manager) : manager(manager), workGuard(boost::asio::make_work_guard(ioContext)){
+    Log::info("Gateway created");
+}
+
+/**
+ * Removes the subscriptions and RX filters of the rules and stops the UDP links.
+ */
+Gateway::~Gateway(){
+
+    if(started){
+
+        std::vector<std::future<void>> barriers;
+
+        for(const std::unique_ptr<Port>& port : ports){
+
+            if(port->connector == nullptr){
+                continue;
+            }
+
+            for(const Route& route : port->routes){
+                port->connector->unsubscribe(RxEvent::Changed, route.rule.firstCanID, route.rule.lastCanID);
+            }
+
+            installFilters(*port, true);
+
+            // Note: The unsubscriptions are posted to the io context of the connector.
+            // A barrier behind them guarantees that no handler or flush uses the port anymore.
+            auto barrier = std::make_shared<std::promise<void>>();
+            barriers.push_back(barrier->get_future());
+            boost::asio::post(port->executor, [barrier](){ barrier->set_value(); });
+        }
+
+        for(std::future<void>& barrier : barriers){
+            barrier.wait();
+        }
+
+        workGuard.reset();
+        ioContext.stop();
+
+        if(ioContextThread.joinable()){
+            ioContextThread.join();
+        }
+    }
+
+    Log::info("Gateway destroyed");
+}
+
+/**
+ * Adds a UDP link that sends the datagrams of its rules to a remote address
+ * and receives the datagrams for its rules on a local port.
+ *
+ * @param name          - The name of the link for the rules.
+ * @param localPort     - The local UDP port, zero for an ephemeral port.
+ * @param remoteAddress - The IPv4 or IPv6 address of the remote gateway.
+ * @param remotePort    - The UDP port of the remote gateway.
+ * @return False if the name is taken or the socket could not be opened.
+ */
+bool Gateway::addUdpLink(const std::string& name, uint16_t localPort, const std::string& remoteAddress, uint16_t remotePort){
+
+    // Error handling / Sanity check
+    if(started){
+        Log::error("Error the links of the gateway are fixed after the start");
+        return false;
+    }
+
+    if(linkOf(name) != nullptr || manager.getConnector(name) != nullptr){
+        Log::error("Error gateway link name ", name, " is already used");
+        return false;
+    }
+
+    boost::system::error_code errorCode;
+    boost::asio::ip::address address = boost::asio::ip::make_address(remoteAddress, errorCode);
+
+    if(errorCode){
+        Log::error("Error invalid remote address ", remoteAddress, " for gateway link ", name);
+        return false;
+    }
+
+    auto link    = std::make_unique<UdpLink>(ioContext);
+    link->name   = name;
+    link->remote = boost::asio::ip::udp::endpoint(address, remotePort);
+
+    link->socket.open(link->remote.protocol(), errorCode);
+
+    if(!errorCode){
+        link->socket.bind(boost::asio::ip::udp::endpoint(link->remote.protocol(), localPort), errorCode);
+    }
+
+    if(!errorCode){
+        link->socket.non_blocking(true, errorCode);
+    }
+
+    if(errorCode){
+        Log::error("Error could not open gateway link ", name, ": ", errorCode.message());
+        return false;
+    }
+
+    Log::info("Gateway added link ", name, " to ", remoteAddress, ":", remotePort);
+    links.push_back(std::move(link));
+
+    return true;
+}
+
+/**
+ * Adds a routing rule. A frame is forwarded by every rule whose source and
+ * range match, so a range can be sent to more than one destination.
+ *
+ * Note: The gateway subscribes RX_CHANGED for the range on a CAN source.
+ * This replaces other subscriptions of these CAN IDs on the connector.
+ *
+ * @param rule - The routing rule.
+ * @return False if the rule is invalid.
+ */
+bool Gateway::addRule(const GatewayRule& rule){
+
+    // Error handling / Sanity check
+    if(started){
+        Log::error("Error the rules of the gateway are fixed after the start");
+        return false;
+    }
+
+    if(rule.source == rule.destination){
+        Log::error("Error gateway rule routes ", rule.source, " to itself");
+        return false;
+    }
+
+    CANConnector* sourceConnector = manager.getConnector(rule.source);
+    UdpLink* sourceLink           = linkOf(rule.source);
+    CANConnector* destConnector   = manager.getConnector(rule.destination);
+    UdpLink* destLink             = linkOf(rule.destination);
+
+    if((sourceConnector == nullptr && sourceLink == nullptr) || (destConnector == nullptr && destLink == nullptr)){
+        Log::error("Error unknown source or destination of gateway rule ", rule.source, " -> ", rule.destination);
+        return false;
+    }
+
+    bool isExtended  = (rule.firstCanID & CAN_EFF_FLAG) != 0;
+    canid_t idMask   = isExtended ? CAN_EFF_MASK : CAN_SFF_MASK;
+    canid_t rangeIDs = (rule.lastCanID & idMask) - (rule.firstCanID & idMask) + 1;
+
+    if(((rule.lastCanID & CAN_EFF_FLAG) != 0) != isExtended || (rule.lastCanID & idMask) < (rule.firstCanID & idMask) ||
+       (rule.firstCanID & ~(idMask | CAN_EFF_FLAG)) != 0 || (rule.lastCanID & ~(idMask | CAN_EFF_FLAG)) != 0){
+        Log::error("Error invalid CAN ID range of gateway rule ", rule.source, " -> ", rule.destination);
+        return false;
+    }
+
+    if(rangeIDs > GATEWAY_MAX_RULE_IDS){
+        Log::error("Error gateway rule ", rule.source, " -> ", rule.destination, " has more than ", GATEWAY_MAX_RULE_IDS, " CAN IDs");
+        return false;
+    }
+
+    if(rule.rewrite){
+
+        canid_t rewriteMask = (rule.rewriteCanID & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK;
+
+        if((rule.rewriteCanID & ~(rewriteMask | CAN_EFF_FLAG)) != 0 || (rule.rewriteCanID & rewriteMask) + (rangeIDs - 1) > rewriteMask){
+            Log::error("Error rewritten CAN IDs of gateway rule ", rule.source, " -> ", rule.destination, " are out of range");
+            return false;
+        }
+    }
+
+    // Find the port of the source
+    Port* port = nullptr;
+
+    if(sourceConnector != nullptr){
+        port = portOf(sourceConnector);
+    }else{
+
+        if(sourceLink->port == nullptr){
+            ports.push_back(std::make_unique<Port>(ioContext.get_executor(), nullptr));
+            sourceLink->port = ports.back().get();
+        }
+
+        port = sourceLink->port;
+    }
+
+    Route route;
+    route.rule      = rule;
+    route.connector = destConnector;
+    route.lastForward.assign(rangeIDs, INT64_MIN);
+
+    // The datagrams of a port to a link are batched together for all rules
+    if(destLink != nullptr){
+
+        auto egress = std::find_if(port->egresses.begin(), port->egresses.end(), [destLink](const std::unique_ptr<Egress>& entry){
+            return entry->link == destLink;
+        });
+
+        if(egress == port->egresses.end()){
+            port->egresses.push_back(std::make_unique<Egress>());
+            port->egresses.back()->link = destLink;
+            egress = std::prev(port->egresses.end());
+        }
+
+        route.egress = egress->get();
+    }
+
+    port->routes.push_back(std::move(route));
+
+    return true;
+}
+
+/**
+ * Subscribes the rules on their sources, sets up the RX filters and starts
+ * the thread of the UDP links.
+ *
+ * @return False if the gateway was already started.
+ */
+bool Gateway::start(){
+
+    // Error handling / Sanity check
+    if(started){
+        Log::error("Error the gateway was already started");
+        return false;
+    }
+
+    started = true;
+
+    for(const std::unique_ptr<Port>& entry : ports){
+
+        Port* port = entry.get();
+
+        if(port->connector == nullptr){
+            continue;
+        }
+
+        for(const Route& route : port->routes){
+
+            port->connector->subscribe(RxEvent::Changed, route.rule.firstCanID, route.rule.lastCanID, [this, port](const BcmNotification& notification){
+
+                // Note: Both frame types share the layout of the first 16 bytes
+                for(uint32_t index = 0; index < notification.nframes; index++){
+
+                    if(notification.isCANFD){
+                        forward(*port, static_cast<const struct canfd_frame*>(notification.frames)[index], true, notification.timestamp, -1);
+                    }else{
+                        struct canfd_frame frame{};
+                        std::memcpy(&frame, static_cast<const struct can_frame*>(notification.frames) + index, sizeof(struct can_frame));
+                        forward(*port, frame, false, notification.timestamp, -1);
+                    }
+                }
+            });
+        }
+
+        installFilters(*port, false);
+    }
+
+    for(const std::unique_ptr<UdpLink>& link : links){
+        receiveOnLink(*link);
+    }
+
+    ioContextThread = std::thread([this](){ ioContext.run(); });
+
+    Log::info("Gateway started with ", ports.size(), " sources and ", links.size(), " links");
+
+    return true;
+}
+
+/**
+ * Returns the counters of the gateway.
+ *
+ * @return The statistics.
+ */
+Gateway::Statistics Gateway::statistics() const{
+
+    Statistics result;
+
+    result.forwarded         = forwardedFrames.load(std::memory_order_relaxed);
+    result.rateLimited       = rateLimitedFrames.load(std::memory_order_relaxed);
+    result.datagramsSent     = sentDatagrams.load(std::memory_order_relaxed);
+    result.datagramsDropped  = droppedDatagrams.load(std::memory_order_relaxed);
+    result.datagramsReceived = receivedDatagrams.load(std::memory_order_relaxed);
+    result.malformed         = malformedDatagrams.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+/**
+ * Returns the port of a CAN source and creates it on the first use.
+ *
+ * @param connector - The connector of the source.
+ * @return The port.
+ */
+Gateway::Port* Gateway::portOf(CANConnector* connector){
+
+    for(const std::unique_ptr<Port>& port : ports){
+        if(port->connector == connector){
+            return port.get();
+        }
+    }
+
+    ports.push_back(std::make_unique<Port>(connector->getExecutor(), connector));
+
+    return ports.back().get();
+}
+
+/**
+ * Returns the UDP link with the given name.
+ *
+ * @param name - The name of the link.
+ * @return The link or an empty pointer.
+ */
+Gateway::UdpLink* Gateway::linkOf(const std::string& name) const{
+
+    for(const std::unique_ptr<UdpLink>& link : links){
+        if(link->name == name){
+            return link.get();
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * Sets up or removes the RX filters of all CAN IDs of the routes of a CAN source.
+ *
+ * @param port   - The port of the source.
+ * @param remove - Flag for removing the filters.
+ */
+void Gateway::installFilters(const Port& port, bool remove){
+
+    // Overlapping rules share the filter of a CAN ID
+    std::vector<std::pair<canid_t, bool>> filters;
+
+    for(const Route& route : port.routes){
+        for(canid_t canID = route.rule.firstCanID; canID <= route.rule.lastCanID; canID++){
+            filters.emplace_back(canID, route.rule.isCANFD);
+        }
+    }
+
+    std::sort(filters.begin(), filters.end());
+    filters.erase(std::unique(filters.begin(), filters.end()), filters.end());
+
+    const char* description = remove ? "RX_DELETE" : "RX_SETUP";
+    auto batch = port.connector->acquireBatch();
+
+    auto submit = [&](){
+        port.connector->submitBatch(std::move(batch), [description](const BcmBatch& result){
+            if(result.failed() > 0){
+                Log::error("Error gateway ", description, " failed for ", result.failed(), " CAN IDs");
+            }
+        });
+        batch = port.connector->acquireBatch();
+    };
+
+    for(const std::pair<canid_t, bool>& filter : filters){
+
+        // Submit the batch if it is full and continue with a new one
+        if(batch->full()){
+            submit();
+        }
+
+        bool added = remove ? port.connector->addRxDelete(*batch, filter.first, filter.second)
+                            : port.connector->addRxSetupCanID(*batch, filter.first, filter.second);
+
+        if(!added){
+            Log::error("Error could not make message structure");
+        }
+    }
+
+    if(!batch->empty()){
+        submit();
+    }
+
+}
+
+/**
+ * Waits for datagrams on a UDP link and forwards their records. All queued
+ * datagrams are drained with a single recvmmsg call and decoded in place.
+ *
+ * @param link - The UDP link.
+ */
+void Gateway::receiveOnLink(UdpLink& link){
+
+    link.socket.async_wait(boost::asio::ip::udp::socket::wait_read, [this, &link](const boost::system::error_code& errorCode){
+
+        // Error handling / Sanity check
+        if(errorCode){
+            if(errorCode != boost::asio::error::operation_aborted){
+                Log::error("Error waiting on gateway link ", link.name, ": ", errorCode.message());
+            }
+            return;
+        }
+
+        int drained = link.ring.drain(link.socket.native_handle());
+
+        if(drained < 0){
+            Log::error("Error receiving on gateway link ", link.name, ": ", std::strerror(errno));
+        }
+
+        for(int index = 0; index < drained; index++){
+
+            receivedDatagrams.fetch_add(1, std::memory_order_relaxed);
+
+            GatewayDatagramReader reader(link.ring.data(index), link.ring.bytes(index));
+            GatewayRecord record;
+
+            while(reader.next(record)){
+                if(link.port != nullptr){
+                    forward(*link.port, record.frame, record.isCANFD, record.timestamp, record.channel);
+                }
+            }
+
+            if(!reader.valid()){
+                malformedDatagrams.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if(drained > 0){
+            link.ring.recordWakeup(drained);
+        }
+
+        receiveOnLink(link);
+    });
+
+}
+
+/**
+ * Forwards a frame with every matching route of a port. The frame is copied
+ * into the submission queue of the destination connector or into the
+ * datagram of the destination link.
+ *
+ * Note: Called in the thread of the port.
+ *
+ * @param port      - The port of the source.
+ * @param frame     - The received frame.
+ * @param isCANFD   - Flag for a CANFD frame.
+ * @param timestamp - The receive time of the frame in nanoseconds.
+ * @param channel   - The channel of a UDP record, -1 for a CAN source.
+ */
+void Gateway::forward(Port& port, const struct canfd_frame& frame, bool isCANFD, int64_t timestamp, int channel){
+
+    canid_t canID = frame.can_id & ~(CAN_RTR_FLAG | CAN_ERR_FLAG);
+    int64_t now   = 0;
+
+    for(Route& route : port.routes){
+
+        if(canID < route.rule.firstCanID || canID > route.rule.lastCanID || (channel >= 0 && channel != route.rule.channel)){
+            continue;
+        }
+
+        // Rate limit per CAN ID
+        size_t offset = canID - route.rule.firstCanID;
+
+        if(route.rule.minInterval.count() > 0){
+
+            if(now == 0){
+                now = ConnectorMetrics::now();
+            }
+
+            if(route.lastForward[offset] != INT64_MIN && now - route.lastForward[offset] < std::chrono::nanoseconds(route.rule.minInterval).count()){
+                rateLimitedFrames.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            route.lastForward[offset] = now;
+        }
+
+        if(route.connector != nullptr){
+
+            if(route.rule.rewrite){
+                struct canfd_frame rewritten = frame;
+                rewritten.can_id = (route.rule.rewriteCanID + offset) | (frame.can_id & CAN_RTR_FLAG);
+                route.connector->txSendSingleFrame(rewritten, isCANFD);
+            }else{
+                route.connector->txSendSingleFrame(frame, isCANFD);
+            }
+
+        }else{
+
+            Egress& egress = *route.egress;
+            const struct canfd_frame* record = &frame;
+            struct canfd_frame rewritten;
+
+            if(route.rule.rewrite){
+                rewritten = frame;
+                rewritten.can_id = (route.rule.rewriteCanID + offset) | (frame.can_id & CAN_RTR_FLAG);
+                record = &rewritten;
+            }
+
+            // A full batch is sent right away, otherwise once per turn of the io context
+            if(!egress.batch.add(route.rule.channel, *record, isCANFD, timestamp)){
+                flush(egress);
+                egress.batch.add(route.rule.channel, *record, isCANFD, timestamp);
+            }
+
+            if(!egress.flushPending){
+                egress.flushPending = true;
+                boost::asio::post(port.executor, [this, &egress](){
+                    egress.flushPending = false;
+                    flush(egress);
+                });
+            }
+        }
+
+        forwardedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+}
+
+/**
+ * Sends the pending datagrams of an egress to the remote address of its link.
+ *
+ * @param egress - The egress.
+ */
+void Gateway::flush(Egress& egress){
+
+    if(egress.batch.empty()){
+        return;
+    }
+
+    size_t pending = egress.batch.datagrams();
+    int sent       = egress.batch.sendOn(egress.link->socket.native_handle(), egress.link->remote.data(),
+                                         static_cast<socklen_t>(egress.link->remote.size()));
+
+    sentDatagrams.fetch_add(sent, std::memory_order_relaxed);
+    droppedDatagrams.fetch_add(pending - sent, std::memory_order_relaxed);
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,254 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      GatewayDatagram.cpp
+ \brief     Wire format of the UDP datagrams of the gateway. A datagram holds
+            a header and a sequence of CAN/CANFD frame records. The batch
+            packs the records into datagrams that are sent with a single
+            sendmmsg call, the reader decodes a received datagram in place.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "GatewayDatagram.h"
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <endian.h>
+#include <arpa/inet.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+GatewayDatagramBatch::GatewayDatagramBatch(){
+
+    for(size_t index = 0; index < GATEWAY_DATAGRAM_BATCH; index++){
+        iovecs[index].iov_base = buffers[index].data();
+        headers[index].msg_hdr.msg_iov    = &iovecs[index];
+        headers[index].msg_hdr.msg_iovlen = 1;
+    }
+
+}
+
+/**
+ * Appends the record of a frame. A record that does not fit into the current
+ * datagram starts the next one.
+ *
+ * @param channel   - The channel of the routing rule.
+ * @param frame     - The frame.
+ * @param isCANFD   - Flag for a CANFD frame.
+ * @param timestamp - The receive time of the frame in nanoseconds.
+ * @return False if all datagrams of the batch are full.
+ */
+bool GatewayDatagramBatch::add(uint16_t channel, const struct canfd_frame& frame, bool isCANFD, int64_t timestamp){
+
+    uint8_t length = std::min<uint8_t>(frame.len, isCANFD ? CANFD_MAX_DLEN : CAN_MAX_DLEN);
+    size_t recordSize = sizeof(GatewayRecordHeader) + length;
+
+    if(records > 0 && used + recordSize > GATEWAY_DATAGRAM_SIZE){
+        finishDatagram();
+    }
+
+    if(count == GATEWAY_DATAGRAM_BATCH){
+        return false;
+    }
+
+    // Leave room for the header of a new datagram
+    if(records == 0){
+        used = sizeof(GatewayDatagramHeader);
+    }
+
+    GatewayRecordHeader header;
+    header.canID     = htonl(frame.can_id);
+    header.channel   = htons(channel);
+    header.flags     = (isCANFD ? GATEWAY_RECORD_CANFD : 0) |
+                       (isCANFD && (frame.flags & CANFD_BRS) ? GATEWAY_RECORD_BRS : 0) |
+                       (isCANFD && (frame.flags & CANFD_ESI) ? GATEWAY_RECORD_ESI : 0);
+    header.length    = length;
+    header.timestamp = static_cast<int64_t>(htobe64(static_cast<uint64_t>(timestamp)));
+
+    uint8_t* record = buffers[count].data() + used;
+    std::memcpy(record, &header, sizeof(header));
+    std::memcpy(record + sizeof(header), frame.data, length);
+
+    used += recordSize;
+    records++;
+
+    return true;
+}
+
+/**
+ * Checks if the batch holds no record.
+ *
+ * @return True if the batch is empty.
+ */
+bool GatewayDatagramBatch::empty() const{
+    return count == 0 && records == 0;
+}
+
+/**
+ * Returns the number of datagrams with records.
+ *
+ * @return The number of datagrams.
+ */
+size_t GatewayDatagramBatch::datagrams() const{
+    return count + (records > 0 ? 1 : 0);
+}
+
+/**
+ * Sends the datagrams of the batch with sendmmsg and empties the batch.
+ * Datagrams the socket does not take are dropped, UDP is best effort.
+ *
+ * @param fileDescriptor    - The native handle of the UDP socket.
+ * @param destination       - The address of the receiver.
+ * @param destinationLength - The size of the address.
+ * @return The number of sent datagrams.
+ */
+int GatewayDatagramBatch::sendOn(int fileDescriptor, const struct sockaddr* destination, socklen_t destinationLength){
+
+    if(records > 0){
+        finishDatagram();
+    }
+
+    for(size_t index = 0; index < count; index++){
+        headers[index].msg_hdr.msg_name    = const_cast<struct sockaddr*>(destination);
+        headers[index].msg_hdr.msg_namelen = destinationLength;
+    }
+
+    size_t sent = 0;
+
+    while(sent < count){
+
+        int result = ::sendmmsg(fileDescriptor, &headers[sent], count - sent, MSG_DONTWAIT);
+
+        if(result > 0){
+            sent += result;
+        }else if(result < 0 && errno == EINTR){
+            continue;
+        }else{
+            break;
+        }
+    }
+
+    count = 0;
+
+    return static_cast<int>(sent);
+}
+
+/**
+ * Writes the header of the current datagram and continues with the next one.
+ */
+void GatewayDatagramBatch::finishDatagram(){
+
+    GatewayDatagramHeader header;
+    header.magic    = htonl(GATEWAY_DATAGRAM_MAGIC);
+    header.version  = htons(GATEWAY_DATAGRAM_VERSION);
+    header.records  = htons(records);
+    header.sequence = htobe64(sequence++);
+
+    std::memcpy(buffers[count].data(), &header, sizeof(header));
+    iovecs[count].iov_len = used;
+
+    count++;
+    used    = 0;
+    records = 0;
+}
+
+/**
+ * Creates a reader for a received datagram and checks its header.
+ * The reader refers to the datagram, it is not copied.
+ *
+ * @param data - The datagram.
+ * @param size - The size of the datagram in bytes.
+ */
+GatewayDatagramReader::GatewayDatagramReader(const uint8_t* data, size_t size) : data(data), size(size){
+
+    // Error handling / Sanity check
+    if(data == nullptr || size < sizeof(GatewayDatagramHeader)){
+        return;
+    }
+
+    GatewayDatagramHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    if(ntohl(header.magic) != GATEWAY_DATAGRAM_MAGIC || ntohs(header.version) != GATEWAY_DATAGRAM_VERSION){
+        return;
+    }
+
+    remaining        = ntohs(header.records);
+    datagramSequence = be64toh(header.sequence);
+    offset           = sizeof(header);
+    isValid          = true;
+}
+
+/**
+ * Checks if the datagram is well-formed so far.
+ *
+ * @return False if the header or a record is malformed.
+ */
+bool GatewayDatagramReader::valid() const{
+    return isValid;
+}
+
+/**
+ * Returns the sequence number of the datagram.
+ *
+ * @return The sequence number.
+ */
+uint64_t GatewayDatagramReader::sequence() const{
+    return datagramSequence;
+}
+
+/**
+ * Decodes the next record of the datagram.
+ *
+ * @param record - The decoded record.
+ * @return False if there is no further record or the datagram is malformed.
+ */
+bool GatewayDatagramReader::next(GatewayRecord& record){
+
+    if(!isValid || remaining == 0){
+        return false;
+    }
+
+    GatewayRecordHeader header;
+
+    if(offset + sizeof(header) > size){
+        isValid = false;
+        return false;
+    }
+
+    std::memcpy(&header, data + offset, sizeof(header));
+
+    bool isCANFD = (header.flags & GATEWAY_RECORD_CANFD) != 0;
+
+    if(header.length > (isCANFD ? CANFD_MAX_DLEN : CAN_MAX_DLEN) || offset + sizeof(header) + header.length > size){
+        isValid = false;
+        return false;
+    }
+
+    record.channel      = ntohs(header.channel);
+    record.isCANFD      = isCANFD;
+    record.timestamp    = static_cast<int64_t>(be64toh(static_cast<uint64_t>(header.timestamp)));
+    record.frame        = canfd_frame{};
+    record.frame.can_id = ntohl(header.canID);
+    record.frame.len    = header.length;
+    record.frame.flags  = ((header.flags & GATEWAY_RECORD_BRS) ? CANFD_BRS : 0) | ((header.flags & GATEWAY_RECORD_ESI) ? CANFD_ESI : 0);
+    std::memcpy(record.frame.data, data + offset + sizeof(header), header.length);
+
+    offset += sizeof(header) + header.length;
+    remaining--;
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
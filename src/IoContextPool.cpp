@@ -0,0 +1,147 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      IoContextPool.cpp
+ \brief     A pool of io contexts with one loop thread per io context.
+            The threads can be pinned to CPU cores, so busy CAN channels
+            can be spread over the cores without sharing a thread.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "IoContextPool.h"
+#include "Log.h"
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates the io contexts of the pool. The threads are started with start().
+ *
+ * @param threadCount - The number of io contexts and loop threads.
+ * @param cores       - Optional CPU core for every thread. A negative core or
+ *                      a missing entry leaves the thread unpinned.
+ */
+IoContextPool::IoContextPool(size_t threadCount, std::vector<int> cores) : cores(std::move(cores)){
+
+    // Error handling / Sanity check
+    if(threadCount == 0){
+        threadCount = 1;
+    }
+
+    for(size_t index = 0; index < threadCount; index++){
+
+        // Note: Only one thread runs each io context, so its handlers
+        // never run concurrently and need no strand.
+        contexts.push_back(boost::make_shared<boost::asio::io_context>(1));
+
+        // Keep the loop running while no operation is pending
+        workGuards.push_back(boost::asio::make_work_guard(*contexts.back()));
+    }
+
+}
+
+IoContextPool::~IoContextPool(){
+    stop();
+}
+
+/**
+ * Starts one loop thread per io context.
+ */
+void IoContextPool::start(){
+
+    // Error handling / Sanity check
+    if(!threads.empty()){
+        return;
+    }
+
+    for(size_t index = 0; index < contexts.size(); index++){
+        threads.emplace_back(&IoContextPool::threadFunction, this, index);
+    }
+
+    Log::info("IoContextPool started ", threads.size(), " io context threads");
+}
+
+/**
+ * Stops all io contexts and joins the loop threads.
+ */
+void IoContextPool::stop(){
+
+    if(threads.empty()){
+        return;
+    }
+
+    workGuards.clear();
+
+    for(auto& context : contexts){
+        context->stop();
+    }
+
+    for(auto& thread : threads){
+        if(thread.joinable()){
+            thread.join();
+        }
+    }
+
+    threads.clear();
+
+    Log::info("IoContextPool stopped io context threads");
+}
+
+/**
+ * Returns the number of io contexts.
+ *
+ * @return The number of io contexts.
+ */
+size_t IoContextPool::size() const{
+    return contexts.size();
+}
+
+/**
+ * Returns an io context of the pool.
+ *
+ * @param index - The index of the io context.
+ * @return The io context.
+ */
+const boost::shared_ptr<boost::asio::io_context>& IoContextPool::context(size_t index) const{
+    return contexts[index % contexts.size()];
+}
+
+/**
+ * Thread for the io context loop. Pins itself to the configured core first.
+ *
+ * @param index - The index of the io context.
+ */
+void IoContextPool::threadFunction(size_t index){
+
+    if(index < cores.size() && cores[index] >= 0){
+
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cores[index], &cpuSet);
+
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+
+        if(result != 0){
+            Log::error("Error could not pin io context thread ", index, " to core ", cores[index], ": ", std::strerror(result));
+        }else{
+            Log::info("IoContextPool pinned io context thread ", index, " to core ", cores[index]);
+        }
+    }
+
+    contexts[index]->run();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,742 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      IsoTpChannel.cpp
+ \brief     ISO-TP (ISO 15765-2) transport channel on top of a CANConnector.
+            A channel segments and reassembles the messages of one pair of
+            CAN IDs with normal addressing. Consecutive frames are sent in
+            batches that are paced by the flow control frames of the peer.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "IsoTpChannel.h"
+#include "CANConnector.h"
+#include "Log.h"
+#include <cstring>
+#include <algorithm>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates a channel. Use CANConnector::openIsoTpChannel to register the channel.
+ *
+ * @param context   - The io context of the connector the channel belongs to.
+ * @param connector - The connector the frames are sent and received on.
+ * @param options   - The configuration of the channel.
+ */
+IsoTpChannel::IsoTpChannel(boost::asio::io_context& context, CANConnector& connector, const IsoTpOptions& options) :
+    executor(context.get_executor()), connector(connector), channelOptions(options), txDataLength(8),
+    txTimer(context), separationTimer(context), rxTimer(context){
+
+    if(channelOptions.isCANFD){
+
+        static const uint8_t validLengths[] = {8, 12, 16, 20, 24, 32, 48, 64};
+
+        txDataLength = 64;
+
+        if(std::find(std::begin(validLengths), std::end(validLengths), channelOptions.frameLength) != std::end(validLengths)){
+            txDataLength = channelOptions.frameLength;
+        }else{
+            Log::warning("Invalid ISO-TP frame length ", static_cast<int>(channelOptions.frameLength), ", using 64 bytes");
+        }
+    }
+
+}
+
+/**
+ * Returns the configuration of the channel.
+ *
+ * @return The configuration.
+ */
+const IsoTpOptions& IsoTpChannel::options() const{
+    return channelOptions;
+}
+
+/**
+ * Returns the number of reassembled messages that were dropped because no receive was pending.
+ *
+ * @return The number of dropped messages.
+ */
+size_t IsoTpChannel::overruns() const{
+    return overrunCount.load(std::memory_order_relaxed);
+}
+
+/**
+ * Handles the received frames of the rx CAN ID. Only called in the io context loop thread.
+ *
+ * @param notification - The RX_CHANGED notification with the received frame.
+ */
+void IsoTpChannel::push(const BcmNotification& notification){
+
+    for(uint32_t index = 0; open && index < notification.nframes; index++){
+
+        struct canfd_frame frame = {0};
+
+        if(notification.isCANFD){
+            frame = static_cast<const struct canfd_frame*>(notification.frames)[index];
+        }else{
+            std::memcpy(&frame, static_cast<const struct can_frame*>(notification.frames) + index, sizeof(struct can_frame));
+        }
+
+        // Note: The len of a canfd_frame is at the position of the can_dlc of a can_frame
+        size_t length = std::min<size_t>(frame.len, CANFD_MAX_DLEN);
+
+        if(length == 0){
+            continue;
+        }
+
+        switch(frame.data[0] >> 4){
+
+            case 0:{
+                // Single frame with a 4 bit length or an escaped 8 bit length for CANFD
+                size_t messageLength = frame.data[0] & 0x0F;
+                size_t offset = 1;
+
+                if(messageLength == 0 && length > 8){
+                    messageLength = frame.data[1];
+                    offset = 2;
+                }
+
+                if(messageLength == 0 || offset + messageLength > length){
+                    break;
+                }
+
+                // Note: A single frame terminates a running reception
+                if(receiving){
+                    abortReceive(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+                }
+
+                deliver(std::vector<uint8_t>(frame.data + offset, frame.data + offset + messageLength));
+                break;
+            }
+
+            case 1:
+                handleFirstFrame(frame.data, length);
+                break;
+
+            case 2:
+                handleConsecutiveFrame(frame.data, length);
+                break;
+
+            case 3:
+                handleFlowControl(frame.data, length);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+}
+
+/**
+ * Closes the channel. Pending and queued operations are completed with
+ * operation_aborted. Only called in the io context loop thread.
+ */
+void IsoTpChannel::close(){
+
+    open = false;
+
+    while(!sendQueue.empty()){
+        finishSend(boost::asio::error::operation_aborted);
+    }
+
+    receiving = false;
+    rxTimer.cancel();
+    received.clear();
+
+    completeAsync(waiter, boost::asio::error::operation_aborted, std::vector<uint8_t>());
+}
+
+/**
+ * Queues a message for the transmission. Only called in the io context loop thread.
+ *
+ * @param data       - The payload of the message.
+ * @param completion - The completion of the send operation.
+ */
+void IsoTpChannel::startSend(std::vector<uint8_t> data, SendCompletion completion){
+
+    // Error handling / Sanity check
+    if(!open){
+        completeAsync(completion, boost::asio::error::operation_aborted);
+        return;
+    }
+
+    if(data.empty() || data.size() > UINT32_MAX){
+        completeAsync(completion, boost::asio::error::invalid_argument);
+        return;
+    }
+
+    sendQueue.push_back({std::move(data), std::move(completion)});
+    startNextSend();
+}
+
+/**
+ * Starts the transmission of the next queued message with a single frame or a first frame.
+ */
+void IsoTpChannel::startNextSend(){
+
+    if(!open || txState != TxState::Idle || sendQueue.empty()){
+        return;
+    }
+
+    const std::vector<uint8_t>& data = sendQueue.front().data;
+    size_t singleCapacity = txDataLength == 8 ? 7 : txDataLength - 2;
+
+    uint8_t pci[6];
+    size_t pciLength;
+    size_t payloadLength;
+
+    if(data.size() <= singleCapacity){
+
+        // Single frame, CANFD uses the escaped length above 7 bytes
+        if(data.size() <= 7){
+            pci[0] = static_cast<uint8_t>(data.size());
+            pciLength = 1;
+        }else{
+            pci[0] = 0x00;
+            pci[1] = static_cast<uint8_t>(data.size());
+            pciLength = 2;
+        }
+
+        payloadLength = data.size();
+        txState = TxState::SingleFrame;
+
+    }else{
+
+        // First frame with a 12 bit length or an escaped 32 bit length
+        if(data.size() <= 0xFFF){
+            pci[0] = static_cast<uint8_t>(0x10 | (data.size() >> 8));
+            pci[1] = static_cast<uint8_t>(data.size());
+            pciLength = 2;
+        }else{
+            uint32_t length = static_cast<uint32_t>(data.size());
+            pci[0] = 0x10;
+            pci[1] = 0x00;
+            pci[2] = static_cast<uint8_t>(length >> 24);
+            pci[3] = static_cast<uint8_t>(length >> 16);
+            pci[4] = static_cast<uint8_t>(length >> 8);
+            pci[5] = static_cast<uint8_t>(length);
+            pciLength = 6;
+        }
+
+        payloadLength = txDataLength - pciLength;
+        txOffset      = payloadLength;
+        txSequence    = 1;
+        txWaitFrames  = 0;
+        txState       = TxState::WaitFlowControl;
+
+        armFlowControlTimeout();
+    }
+
+    auto batch = connector.acquireBatch();
+
+    if(!connector.addTxSend(*batch, makeFrame(pci, pciLength, data.data(), payloadLength), channelOptions.isCANFD)){
+        finishSend(boost::asio::error::no_buffer_space);
+        return;
+    }
+
+    txInFlight++;
+
+    connector.submitBatch(std::move(batch), [self = shared_from_this(), generation = txGeneration](const BcmBatch& result){
+        self->completeTxBatch(generation, result);
+    });
+
+}
+
+/**
+ * Completes the message that is sent and starts the next queued message.
+ *
+ * @param errorCode - The result of the transmission.
+ */
+void IsoTpChannel::finishSend(const boost::system::error_code& errorCode){
+
+    // Error handling / Sanity check
+    if(sendQueue.empty()){
+        return;
+    }
+
+    if(errorCode && errorCode != boost::asio::error::operation_aborted){
+        Log::warning("ISO-TP transmission on CAN ID ", std::hex, channelOptions.txID, " failed: ", errorCode.message());
+    }
+
+    PendingSend pending = std::move(sendQueue.front());
+    sendQueue.pop_front();
+
+    // Note: The generation invalidates the batches and timers of the finished message
+    txGeneration++;
+    txState             = TxState::Idle;
+    txInFlight          = 0;
+    txSeparationPending = false;
+    txTimer.cancel();
+    separationTimer.cancel();
+
+    completeAsync(pending.completion, errorCode);
+    startNextSend();
+}
+
+/**
+ * Handles a flow control frame of the peer.
+ *
+ * @param data   - The data of the frame.
+ * @param length - The length of the frame.
+ */
+void IsoTpChannel::handleFlowControl(const uint8_t* data, size_t length){
+
+    // Error handling / Sanity check
+    if(length < 3 || txState != TxState::WaitFlowControl){
+        return;
+    }
+
+    switch(data[0] & 0x0F){
+
+        case 0:
+            // Clear to send
+            txTimer.cancel();
+            txBlockLimited   = data[1] != 0;
+            txBlockRemaining = data[1];
+            txSeparation     = decodeSeparationTime(data[2]);
+            txState          = TxState::Sending;
+
+            pumpConsecutiveFrames();
+            break;
+
+        case 1:
+            // Wait
+            if(++txWaitFrames > channelOptions.maxWaitFrames){
+                finishSend(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+            }else{
+                armFlowControlTimeout();
+            }
+            break;
+
+        case 2:
+            // Overflow
+            finishSend(boost::asio::error::message_size);
+            break;
+
+        default:
+            finishSend(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+            break;
+    }
+
+}
+
+/**
+ * Sends the consecutive frames that the peer allows. Without STmin up to
+ * ISOTP_TX_PIPELINE_DEPTH batches of ISOTP_TX_BATCH_FRAMES frames are in
+ * flight, with STmin every frame is sent after the separation time.
+ */
+void IsoTpChannel::pumpConsecutiveFrames(){
+
+    const std::vector<uint8_t>& data = sendQueue.front().data;
+    size_t capacity = consecutiveCapacity();
+
+    while(txState == TxState::Sending && txOffset < data.size() && txInFlight < ISOTP_TX_PIPELINE_DEPTH && !txSeparationPending){
+
+        size_t frames = txSeparation.count() > 0 ? 1 : ISOTP_TX_BATCH_FRAMES;
+
+        if(txBlockLimited){
+            frames = std::min<size_t>(frames, txBlockRemaining);
+        }
+
+        auto batch = connector.acquireBatch();
+
+        for(size_t index = 0; index < frames && txOffset < data.size(); index++){
+
+            uint8_t pci = static_cast<uint8_t>(0x20 | txSequence);
+            size_t payloadLength = std::min(capacity, data.size() - txOffset);
+
+            if(!connector.addTxSend(*batch, makeFrame(&pci, 1, data.data() + txOffset, payloadLength), channelOptions.isCANFD)){
+                finishSend(boost::asio::error::no_buffer_space);
+                return;
+            }
+
+            txOffset  += payloadLength;
+            txSequence = (txSequence + 1) & 0x0F;
+
+            if(txBlockLimited){
+                txBlockRemaining--;
+            }
+        }
+
+        txInFlight++;
+
+        connector.submitBatch(std::move(batch), [self = shared_from_this(), generation = txGeneration](const BcmBatch& result){
+            self->completeTxBatch(generation, result);
+        });
+
+        // The last frame of a message needs no separation time
+        if(txSeparation.count() > 0 && txOffset < data.size()){
+
+            txSeparationPending = true;
+            separationTimer.expires_after(txSeparation);
+            separationTimer.async_wait([self = shared_from_this(), generation = txGeneration](boost::system::error_code errorCode){
+
+                if(errorCode || generation != self->txGeneration){
+                    return;
+                }
+
+                self->txSeparationPending = false;
+                self->pumpConsecutiveFrames();
+            });
+        }
+
+        // Wait for the next flow control frame after a complete block
+        if(txBlockLimited && txBlockRemaining == 0 && txOffset < data.size()){
+            txState = TxState::WaitFlowControl;
+            armFlowControlTimeout();
+        }
+    }
+
+}
+
+/**
+ * Handles the result of a batch of the message that is sent.
+ *
+ * @param generation - The generation of the message the batch belongs to.
+ * @param batch      - The processed batch.
+ */
+void IsoTpChannel::completeTxBatch(uint64_t generation, const BcmBatch& batch){
+
+    // Error handling / Sanity check
+    if(generation != txGeneration || sendQueue.empty()){
+        return;
+    }
+
+    txInFlight--;
+
+    for(size_t index = 0; index < batch.size(); index++){
+        if(batch.errorCode(index)){
+            finishSend(batch.errorCode(index));
+            return;
+        }
+    }
+
+    if(txState == TxState::SingleFrame ||
+       (txState == TxState::Sending && txOffset == sendQueue.front().data.size() && txInFlight == 0)){
+        finishSend(boost::system::error_code());
+        return;
+    }
+
+    if(txState == TxState::Sending){
+        pumpConsecutiveFrames();
+    }
+
+}
+
+/**
+ * Starts N_Bs, the time until the next flow control frame is expected.
+ */
+void IsoTpChannel::armFlowControlTimeout(){
+
+    txTimer.expires_after(channelOptions.timeout);
+    txTimer.async_wait([self = shared_from_this(), generation = txGeneration](boost::system::error_code errorCode){
+
+        // Note: A timer that expired while it was re-armed is not a timeout
+        if(errorCode || generation != self->txGeneration || self->txState != TxState::WaitFlowControl ||
+           self->txTimer.expiry() > std::chrono::steady_clock::now()){
+            return;
+        }
+
+        self->finishSend(boost::asio::error::timed_out);
+    });
+
+}
+
+/**
+ * Starts a receive operation. Only called in the io context loop thread.
+ *
+ * @param completion - The completion of the receive operation.
+ */
+void IsoTpChannel::startReceive(ReceiveCompletion completion){
+
+    // Error handling / Sanity check
+    if(!open){
+        completeAsync(completion, boost::asio::error::operation_aborted, std::vector<uint8_t>());
+        return;
+    }
+
+    if(waiter){
+        completeAsync(completion, boost::asio::error::already_started, std::vector<uint8_t>());
+        return;
+    }
+
+    if(!received.empty()){
+        std::vector<uint8_t> message = std::move(received.front());
+        received.pop_front();
+
+        completeAsync(completion, boost::system::error_code(), std::move(message));
+        return;
+    }
+
+    waiter = std::move(completion);
+}
+
+/**
+ * Handles a first frame of the peer and answers with a flow control frame.
+ *
+ * @param data   - The data of the frame.
+ * @param length - The length of the frame.
+ */
+void IsoTpChannel::handleFirstFrame(const uint8_t* data, size_t length){
+
+    // Error handling / Sanity check
+    if(length < 8){
+        return;
+    }
+
+    size_t messageLength = (static_cast<size_t>(data[0] & 0x0F) << 8) | data[1];
+    size_t offset = 2;
+
+    if(messageLength == 0){
+        messageLength = (static_cast<size_t>(data[2]) << 24) | (static_cast<size_t>(data[3]) << 16) |
+                        (static_cast<size_t>(data[4]) << 8) | data[5];
+        offset = 6;
+    }
+
+    // Note: A first frame terminates a running reception
+    if(receiving){
+        abortReceive(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+    }
+
+    if(messageLength > channelOptions.maxMessageSize){
+        Log::warning("ISO-TP message of ", messageLength, " bytes on CAN ID ", std::hex, channelOptions.rxID, " is too large");
+        sendFlowControl(2);
+        return;
+    }
+
+    // A message that fits into a single frame must not be segmented
+    if(messageLength <= length - offset){
+        return;
+    }
+
+    rxBuffer.clear();
+    rxBuffer.reserve(messageLength);
+    rxBuffer.insert(rxBuffer.end(), data + offset, data + length);
+
+    rxLength     = messageLength;
+    rxSequence   = 1;
+    rxBlockCount = 0;
+    receiving    = true;
+
+    sendFlowControl(0);
+    armConsecutiveTimeout();
+}
+
+/**
+ * Handles a consecutive frame of the peer.
+ *
+ * @param data   - The data of the frame.
+ * @param length - The length of the frame.
+ */
+void IsoTpChannel::handleConsecutiveFrame(const uint8_t* data, size_t length){
+
+    // Error handling / Sanity check
+    if(!receiving){
+        return;
+    }
+
+    if((data[0] & 0x0F) != rxSequence){
+        abortReceive(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+        return;
+    }
+
+    size_t payloadLength = std::min(length - 1, rxLength - rxBuffer.size());
+    rxBuffer.insert(rxBuffer.end(), data + 1, data + 1 + payloadLength);
+    rxSequence = (rxSequence + 1) & 0x0F;
+
+    if(rxBuffer.size() == rxLength){
+        receiving = false;
+        rxTimer.cancel();
+
+        deliver(std::move(rxBuffer));
+        rxBuffer = std::vector<uint8_t>();
+        return;
+    }
+
+    // Allow the next block
+    if(channelOptions.blockSize != 0 && ++rxBlockCount == channelOptions.blockSize){
+        rxBlockCount = 0;
+        sendFlowControl(0);
+    }
+
+    armConsecutiveTimeout();
+}
+
+/**
+ * Hands over a reassembled message. A pending receive is completed directly, otherwise
+ * the message is buffered. If the buffer is full the oldest message is dropped.
+ *
+ * @param message - The reassembled message.
+ */
+void IsoTpChannel::deliver(std::vector<uint8_t> message){
+
+    if(waiter){
+        completeAsync(waiter, boost::system::error_code(), std::move(message));
+        return;
+    }
+
+    if(received.size() == ISOTP_RX_QUEUE_SIZE){
+        received.pop_front();
+        overrunCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    received.push_back(std::move(message));
+}
+
+/**
+ * Terminates the running reception and reports the error to a pending receive.
+ *
+ * @param errorCode - The reason of the termination.
+ */
+void IsoTpChannel::abortReceive(const boost::system::error_code& errorCode){
+
+    Log::warning("ISO-TP reception on CAN ID ", std::hex, channelOptions.rxID, " failed: ", errorCode.message());
+
+    receiving = false;
+    rxBuffer.clear();
+    rxTimer.cancel();
+
+    completeAsync(waiter, errorCode, std::vector<uint8_t>());
+}
+
+/**
+ * Starts N_Cr, the time until the next consecutive frame is expected.
+ */
+void IsoTpChannel::armConsecutiveTimeout(){
+
+    rxTimer.expires_after(channelOptions.timeout);
+    rxTimer.async_wait([self = shared_from_this()](boost::system::error_code errorCode){
+
+        // Note: A timer that expired while it was re-armed is not a timeout
+        if(errorCode || !self->receiving || self->rxTimer.expiry() > std::chrono::steady_clock::now()){
+            return;
+        }
+
+        self->abortReceive(boost::asio::error::timed_out);
+    });
+
+}
+
+/**
+ * Sends a flow control frame with the block size and STmin of the channel.
+ *
+ * @param status - The flow status, 0 = clear to send, 1 = wait, 2 = overflow.
+ */
+void IsoTpChannel::sendFlowControl(uint8_t status){
+
+    uint8_t pci[3] = {static_cast<uint8_t>(0x30 | status), channelOptions.blockSize, encodeSeparationTime(channelOptions.stMin)};
+
+    connector.txSendSingleFrame(makeFrame(pci, sizeof(pci), nullptr, 0), channelOptions.isCANFD);
+}
+
+/**
+ * Builds a frame of the tx CAN ID with a protocol control information and a payload.
+ *
+ * @param pci           - The protocol control information.
+ * @param pciLength     - The length of the protocol control information.
+ * @param payload       - The payload.
+ * @param payloadLength - The length of the payload.
+ * @return The padded frame.
+ */
+struct canfd_frame IsoTpChannel::makeFrame(const uint8_t* pci, size_t pciLength, const uint8_t* payload, size_t payloadLength) const{
+
+    struct canfd_frame frame = {0};
+    size_t used = pciLength + payloadLength;
+
+    frame.can_id = channelOptions.txID;
+    frame.len    = static_cast<uint8_t>(frameSize(used));
+
+    if(channelOptions.isCANFD && channelOptions.bitRateSwitch){
+        frame.flags = CANFD_BRS;
+    }
+
+    std::memcpy(frame.data, pci, pciLength);
+
+    if(payloadLength > 0){
+        std::memcpy(frame.data + pciLength, payload, payloadLength);
+    }
+
+    std::memset(frame.data + used, channelOptions.paddingByte, frame.len - used);
+
+    return frame;
+}
+
+/**
+ * Calculates the length of a frame with the used bytes. A CANFD frame
+ * with more than 8 bytes always needs the length of a valid DLC.
+ *
+ * @param used - The used bytes of the frame.
+ * @return The length of the frame.
+ */
+size_t IsoTpChannel::frameSize(size_t used) const{
+
+    if(used <= 8){
+        return channelOptions.padding ? 8 : used;
+    }
+
+    static const size_t lengths[] = {12, 16, 20, 24, 32, 48, 64};
+
+    return *std::lower_bound(std::begin(lengths), std::end(lengths), used);
+}
+
+/**
+ * Returns the payload of a consecutive frame.
+ *
+ * @return The number of payload bytes.
+ */
+size_t IsoTpChannel::consecutiveCapacity() const{
+    return txDataLength - 1;
+}
+
+/**
+ * Decodes the STmin of a flow control frame. Reserved values are treated as the maximum.
+ *
+ * @param stMin - The STmin byte.
+ * @return The separation time.
+ */
+std::chrono::microseconds IsoTpChannel::decodeSeparationTime(uint8_t stMin){
+
+    if(stMin <= 0x7F){
+        return std::chrono::milliseconds(stMin);
+    }
+
+    if(stMin >= 0xF1 && stMin <= 0xF9){
+        return std::chrono::microseconds((stMin - 0xF0) * 100);
+    }
+
+    return std::chrono::milliseconds(0x7F);
+}
+
+/**
+ * Encodes a separation time as STmin byte. The time is rounded down.
+ *
+ * @param stMin - The separation time.
+ * @return The STmin byte.
+ */
+uint8_t IsoTpChannel::encodeSeparationTime(std::chrono::microseconds stMin){
+
+    if(stMin >= std::chrono::milliseconds(1)){
+        return static_cast<uint8_t>(std::min<int64_t>(stMin.count() / 1000, 0x7F));
+    }
+
+    if(stMin >= std::chrono::microseconds(100)){
+        return static_cast<uint8_t>(0xF0 + stMin.count() / 100);
+    }
+
+    return 0;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
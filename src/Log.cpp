@@ -0,0 +1,255 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      Log.cpp
+ \brief     Logging with levels that can be compiled out and an optional
+            asynchronous lock-free sink. Messages below LOG_COMPILE_LEVEL
+            cost nothing, messages below the runtime level cost a compare.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "Log.h"
+#include "MpscQueue.h"
+#include <mutex>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+
+/*******************************************************************************
+ * VARIABLES
+ ******************************************************************************/
+
+std::atomic<int> Log::runtimeLevel{static_cast<int>(LogLevel::Info)};
+std::atomic<bool> Log::asyncEnabled{false};
+std::atomic<size_t> Log::droppedRecords{0};
+std::thread Log::writerThread;
+
+static MpscQueue<LogRecord, LOG_ASYNC_QUEUE_SIZE> logQueue;
+
+// Serializes the consumers of the queue: the writer thread and the drains after a stop
+static std::mutex logQueueMutex;
+
+// Serializes startAsync and stopAsync
+static std::mutex logSinkMutex;
+
+// Wakes up the writer thread, only the first producer after a drain writes to it
+static std::atomic<int> logEvent{-1};
+static std::atomic<bool> logWakeupPending{false};
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Sets the lowest level that is logged at runtime.
+ *
+ * @param level - The new runtime level.
+ */
+void Log::setLevel(LogLevel level){
+    runtimeLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+/**
+ * Returns the lowest level that is logged at runtime.
+ *
+ * @return The runtime level.
+ */
+LogLevel Log::getLevel(){
+    return static_cast<LogLevel>(runtimeLevel.load(std::memory_order_relaxed));
+}
+
+/**
+ * Starts the writer thread of the asynchronous sink. From now on the
+ * logging threads only copy the message into a lock-free queue. The
+ * sink is stopped at the exit of the process if it is still running.
+ */
+void Log::startAsync(){
+
+    std::lock_guard<std::mutex> lock(logSinkMutex);
+
+    if(logEvent.load(std::memory_order_relaxed) < 0){
+
+        int descriptor = ::eventfd(0, EFD_CLOEXEC);
+
+        // Error handling / Sanity check
+        if(descriptor < 0){
+            std::cerr << "Error could not create the eventfd of the asynchronous log sink: " << std::strerror(errno) << std::endl;
+            return;
+        }
+
+        logEvent.store(descriptor, std::memory_order_relaxed);
+
+        // Note: Registered after the construction of the static members, so it runs before their destruction
+        std::atexit(&Log::stopAsync);
+    }
+
+    if(asyncEnabled.exchange(true)){
+        return;
+    }
+
+    // A wakeup that was pending at the last stop is not seen by the new writer thread
+    logWakeupPending.store(false, std::memory_order_relaxed);
+
+    writerThread = std::thread(&Log::writerThreadFunction);
+}
+
+/**
+ * Stops the writer thread of the asynchronous sink after all
+ * queued messages were written. Messages are printed directly again.
+ */
+void Log::stopAsync(){
+
+    std::lock_guard<std::mutex> lock(logSinkMutex);
+
+    if(!asyncEnabled.exchange(false)){
+        return;
+    }
+
+    wakeWriter(true);
+
+    if(writerThread.joinable()){
+        writerThread.join();
+    }
+
+    // Write the messages of producers that saw the sink still enabled after the last drain of the writer
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    drainQueue();
+    std::cout.flush();
+}
+
+/**
+ * Returns the number of messages that were dropped because the queue was full.
+ *
+ * @return The number of dropped messages.
+ */
+size_t Log::dropped(){
+    return droppedRecords.load(std::memory_order_relaxed);
+}
+
+/**
+ * Writes a formatted message to the active sink.
+ *
+ * @param record - The formatted message.
+ */
+void Log::output(const LogRecord& record){
+
+    // Note: Acquire, so the eventfd of the sink is visible to the producer
+    if(asyncEnabled.load(std::memory_order_acquire)){
+
+        if(!logQueue.push(record)){
+            droppedRecords.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // Note: If the sink was stopped meanwhile the writer thread may have drained
+        // the queue already, so the producer writes the message itself. The fence pairs
+        // with the one in stopAsync, so either this check or the last drain sees the message.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(!asyncEnabled.load(std::memory_order_relaxed)){
+            drainQueue();
+            return;
+        }
+
+        wakeWriter(false);
+        return;
+    }
+
+    print(record);
+}
+
+/**
+ * Prints a message. Warnings and errors go to std::cerr.
+ *
+ * @param record - The formatted message.
+ */
+void Log::print(const LogRecord& record){
+
+    if(record.level >= LogLevel::Warning){
+        std::cerr.write(record.text, static_cast<std::streamsize>(record.length)) << std::endl;
+    }else{
+        std::cout.write(record.text, static_cast<std::streamsize>(record.length)) << '\n';
+    }
+
+}
+
+/**
+ * Prints all queued messages.
+ */
+void Log::drainQueue(){
+
+    std::lock_guard<std::mutex> lock(logQueueMutex);
+    LogRecord record;
+
+    while(logQueue.pop(record)){
+        print(record);
+    }
+
+}
+
+/**
+ * Wakes up the writer thread if no wakeup is pending yet.
+ *
+ * @param force - Flag for writing to the eventfd even if a wakeup is pending, e.g. for the stop.
+ */
+void Log::wakeWriter(bool force){
+
+    // Note: The exchange is sequentially consistent, so it is ordered with the fence of the writer thread
+    if(!logWakeupPending.exchange(true, std::memory_order_seq_cst) || force){
+
+        uint64_t wakeup = 1;
+
+        // Note: A failed write cannot be logged, the writer thread prints the message with its next drain
+        [[maybe_unused]] ssize_t written = ::write(logEvent.load(std::memory_order_relaxed), &wakeup, sizeof(wakeup));
+    }
+
+}
+
+/**
+ * Thread of the asynchronous sink. Prints the queued messages and
+ * sleeps on the eventfd until a producer or the stop wakes it up.
+ */
+void Log::writerThreadFunction(){
+
+    int descriptor = logEvent.load(std::memory_order_relaxed);
+
+    while(true){
+
+        bool running = asyncEnabled.load();
+
+        drainQueue();
+        std::cout.flush();
+
+        if(!running){
+            break;
+        }
+
+        uint64_t wakeups = 0;
+
+        while(::read(descriptor, &wakeups, sizeof(wakeups)) < 0 && errno == EINTR){
+            // Retry the interrupted read
+        }
+
+        // Note: The fence orders the store before the loads of the next drain. Without it a producer
+        // could still see the pending flag while the drain misses its message, which loses the wakeup
+        logWakeupPending.store(false, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,197 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      MetricsEndpoint.cpp
+ \brief     Minimal HTTP endpoint that serves the metrics of the connectors in
+            the Prometheus text format on GET /metrics. It runs on an io
+            context of the application and is only created on demand.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "MetricsEndpoint.h"
+#include "Log.h"
+#include <algorithm>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Opens the listening socket and starts to accept connections.
+ *
+ * @param context  - The io context that runs the endpoint.
+ * @param port     - The TCP port, zero for a free port.
+ * @param provider - The function that returns the metrics text of a scrape.
+ * @param address  - The address the endpoint listens on.
+ */
+MetricsEndpoint::MetricsEndpoint(boost::asio::io_context& context, uint16_t port, Provider provider, const std::string& address) :
+    acceptor(context), acceptTimer(context), provider(std::make_shared<Provider>(std::move(provider))){
+
+    boost::system::error_code errorCode;
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address(address, errorCode), port);
+
+    if(!errorCode){
+        acceptor.open(endpoint.protocol(), errorCode);
+    }
+
+    if(!errorCode){
+        acceptor.set_option(boost::asio::socket_base::reuse_address(true), errorCode);
+        acceptor.bind(endpoint, errorCode);
+    }
+
+    if(!errorCode){
+        acceptor.listen(boost::asio::socket_base::max_listen_connections, errorCode);
+    }
+
+    // Error handling / Sanity check
+    if(errorCode){
+        Log::error("Error could not open the metrics endpoint on ", address, ":", port, ": ", errorCode.message());
+        acceptor.close(errorCode);
+        return;
+    }
+
+    Log::info("Metrics endpoint listens on ", address, ":", this->port());
+
+    accept();
+}
+
+MetricsEndpoint::~MetricsEndpoint(){
+
+    boost::system::error_code errorCode;
+    acceptor.close(errorCode);
+    acceptTimer.cancel();
+}
+
+/**
+ * Checks if the endpoint accepts connections.
+ *
+ * @return True if the listening socket is open.
+ */
+bool MetricsEndpoint::isOpen() const{
+    return acceptor.is_open();
+}
+
+/**
+ * Returns the port the endpoint listens on.
+ *
+ * @return The TCP port or zero if the endpoint is not open.
+ */
+uint16_t MetricsEndpoint::port() const{
+
+    boost::system::error_code errorCode;
+    auto endpoint = acceptor.local_endpoint(errorCode);
+
+    return errorCode ? 0 : endpoint.port();
+}
+
+/**
+ * Accepts the next connection.
+ */
+void MetricsEndpoint::accept(){
+
+    acceptor.async_accept([this](boost::system::error_code errorCode, boost::asio::ip::tcp::socket socket){
+
+        // Lambda completion function for the async accept operation
+
+        // The endpoint was closed or the operation was cancelled
+        if(errorCode == boost::asio::error::operation_aborted){
+            return;
+        }
+
+        if(!errorCode){
+            acceptBackoff = std::chrono::milliseconds(0);
+            serve(std::make_shared<Session>(std::move(socket)), provider);
+            accept();
+            return;
+        }
+
+        // Note: Errors like EMFILE persist, so the next accept waits instead of spinning.
+        // Only the first error of a series is logged
+        if(acceptBackoff.count() == 0){
+            Log::error("An error occurred on the async accept operation: ", errorCode.message());
+            acceptBackoff = std::chrono::milliseconds(METRICS_ENDPOINT_ACCEPT_BACKOFF_MS);
+        }else{
+            acceptBackoff = std::min(acceptBackoff * 2, std::chrono::milliseconds(METRICS_ENDPOINT_ACCEPT_BACKOFF_MAX_MS));
+        }
+
+        acceptTimer.expires_after(acceptBackoff);
+        acceptTimer.async_wait([this](boost::system::error_code timerError){
+
+            // The endpoint was destroyed
+            if(timerError == boost::asio::error::operation_aborted){
+                return;
+            }
+
+            accept();
+        });
+
+    });
+
+}
+
+/**
+ * Reads the request header of a connection and answers with the metrics
+ * text. Every connection serves a single request and is closed afterwards.
+ *
+ * @param session  - The connection.
+ * @param provider - The function that returns the metrics text.
+ */
+void MetricsEndpoint::serve(const std::shared_ptr<Session>& session, const std::shared_ptr<Provider>& provider){
+
+    boost::asio::async_read_until(session->socket, session->request, "\r\n\r\n",
+                                  [session, provider](boost::system::error_code errorCode, size_t){
+
+        // Lambda completion function for the async read operation
+
+        // Drop requests that are too large or incomplete
+        if(errorCode){
+            return;
+        }
+
+        std::istream stream(&session->request);
+        std::string method;
+        std::string target;
+        stream >> method >> target;
+
+        std::string body;
+        const char* status = "200 OK";
+
+        if(method == "GET" && (target == "/metrics" || target.rfind("/metrics?", 0) == 0)){
+            body = (*provider)();
+        }else{
+            status = "404 Not Found";
+            body   = "Not Found\n";
+        }
+
+        session->response = std::string("HTTP/1.1 ") + status + "\r\n"
+                            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                            "Connection: close\r\n\r\n" + body;
+
+        boost::asio::async_write(session->socket, boost::asio::buffer(session->response),
+                                 [session](boost::system::error_code errorCode, size_t){
+
+            // Lambda completion function for the async write operation
+            if(errorCode && errorCode != boost::asio::error::operation_aborted){
+                Log::warning("An error occurred on the write of the metrics response: ", errorCode.message());
+            }
+
+            session->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, errorCode);
+            session->socket.close(errorCode);
+
+        });
+
+    });
+
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
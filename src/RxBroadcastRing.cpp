@@ -0,0 +1,287 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxBroadcastRing.cpp
+ \brief     Single producer, multiple consumer broadcast ring of the received
+            notifications. The io context thread writes every notification
+            once, every reader follows the ring with its own cursor. A slow
+            reader never stalls the reception, it detects its overruns.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "RxBroadcastRing.h"
+#include <cstring>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates a ring.
+ *
+ * @param capacity - The number of records, rounded up to a power of two.
+ */
+RxBroadcastRing::RxBroadcastRing(size_t capacity){
+
+    size_t size = 1;
+
+    while(size < capacity){
+        size <<= 1;
+    }
+
+    mask  = size - 1;
+    slots = std::unique_ptr<Slot[]>(new Slot[size]);
+}
+
+/**
+ * Writes the records of a notification. The records become visible to the
+ * readers with the next commit. Must only be called by the io context thread.
+ *
+ * @param notification - The decoded notification.
+ */
+void RxBroadcastRing::publish(const BcmNotification& notification){
+
+    RxBroadcastRecord record{};
+    record.opcode    = notification.head->opcode;
+    record.flags     = notification.head->flags;
+    record.canID     = notification.head->can_id;
+    record.isCANFD   = notification.isCANFD;
+    record.timestamp = notification.timestamp;
+
+    if(notification.nframes == 0){
+        write(record);
+        return;
+    }
+
+    for(uint32_t index = 0; index < notification.nframes; index++){
+
+        if(notification.isCANFD){
+            record.frame = static_cast<const struct canfd_frame*>(notification.frames)[index];
+        }else{
+            std::memcpy(&record.frame, static_cast<const struct can_frame*>(notification.frames) + index, sizeof(struct can_frame));
+        }
+
+        write(record);
+    }
+
+}
+
+/**
+ * Makes the published records visible and wakes up the waiting readers.
+ * Called once per drain of the socket. Must only be called by the io context thread.
+ */
+void RxBroadcastRing::commit(){
+
+    head.store(writePosition, std::memory_order_seq_cst);
+
+    // Note: The futex is only touched if a reader sleeps
+    if(waiters.load(std::memory_order_seq_cst) > 0){
+        signal.fetch_add(1, std::memory_order_seq_cst);
+        signal.notify_all();
+    }
+
+}
+
+/**
+ * Closes the ring. Waiting readers return and wait does not block anymore.
+ */
+void RxBroadcastRing::close(){
+
+    closed.store(true, std::memory_order_seq_cst);
+    signal.fetch_add(1, std::memory_order_seq_cst);
+    signal.notify_all();
+}
+
+/**
+ * Returns the number of records the ring holds.
+ *
+ * @return The capacity.
+ */
+size_t RxBroadcastRing::capacity() const{
+    return mask + 1;
+}
+
+/**
+ * Returns the position behind the last committed record.
+ *
+ * @return The position.
+ */
+uint64_t RxBroadcastRing::committed() const{
+    return head.load(std::memory_order_seq_cst);
+}
+
+/**
+ * Writes a record at the next position.
+ *
+ * @param record - The record.
+ */
+void RxBroadcastRing::write(const RxBroadcastRecord& record){
+
+    uint64_t position = writePosition++;
+    Slot& slot = slots[position & mask];
+
+    std::array<uint64_t, recordWords> words{};
+    std::memcpy(words.data(), &record, sizeof(record));
+
+    // Mark the slot as being written
+    slot.sequence.store(2 * position + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for(size_t index = 0; index < recordWords; index++){
+        slot.words[index].store(words[index], std::memory_order_relaxed);
+    }
+
+    // Publish the record of the position
+    slot.sequence.store(2 * position + 2, std::memory_order_release);
+}
+
+/**
+ * Reads the record of a position.
+ *
+ * @param position - The position of the record.
+ * @param record   - The copy of the record.
+ * @return False if the slot holds another position by now.
+ */
+bool RxBroadcastRing::read(uint64_t position, RxBroadcastRecord& record) const{
+
+    const Slot& slot = slots[position & mask];
+    uint64_t expected = 2 * position + 2;
+
+    if(slot.sequence.load(std::memory_order_acquire) != expected){
+        return false;
+    }
+
+    std::array<uint64_t, recordWords> words{};
+
+    for(size_t index = 0; index < recordWords; index++){
+        words[index] = slot.words[index].load(std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // The writer started to overwrite the slot while we copied it
+    if(slot.sequence.load(std::memory_order_relaxed) != expected){
+        return false;
+    }
+
+    std::memcpy(&record, words.data(), sizeof(record));
+
+    return true;
+}
+
+/**
+ * Creates a reader at a position of a ring.
+ *
+ * @param ring     - The ring.
+ * @param position - The first position the reader reads.
+ */
+RxBroadcastReader::RxBroadcastReader(std::shared_ptr<RxBroadcastRing> ring, uint64_t position) :
+    ring(std::move(ring)), position(position){}
+
+/**
+ * Reads the next record without blocking. If the writer lapped the reader
+ * the reader continues with the oldest record and counts the lost ones.
+ *
+ * @param record - The copy of the record.
+ * @return False if no record is available.
+ */
+bool RxBroadcastReader::next(RxBroadcastRecord& record){
+
+    // Error handling / Sanity check
+    if(ring == nullptr){
+        return false;
+    }
+
+    while(true){
+
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+
+        if(position >= head){
+            return false;
+        }
+
+        // Skip the records that were overwritten already
+        if(head - position > ring->capacity()){
+            lost    += head - ring->capacity() - position;
+            position = head - ring->capacity();
+        }
+
+        if(ring->read(position++, record)){
+            return true;
+        }
+
+        // The record was overwritten while it was read
+        lost++;
+    }
+
+}
+
+/**
+ * Blocks until a record is available.
+ *
+ * @return False if the ring was closed and no record is left.
+ */
+bool RxBroadcastReader::wait(){
+
+    // Error handling / Sanity check
+    if(ring == nullptr){
+        return false;
+    }
+
+    while(available() == 0){
+
+        if(ring->closed.load(std::memory_order_seq_cst)){
+            return false;
+        }
+
+        ring->waiters.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t observed = ring->signal.load(std::memory_order_seq_cst);
+
+        // Note: A commit after the check changes the signal, so no wakeup is lost
+        if(available() == 0 && !ring->closed.load(std::memory_order_seq_cst)){
+            ring->signal.wait(observed, std::memory_order_seq_cst);
+        }
+
+        ring->waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    return true;
+}
+
+/**
+ * Returns the number of records the reader did not read yet, including the
+ * records that are already overwritten.
+ *
+ * @return The number of records.
+ */
+size_t RxBroadcastReader::available() const{
+
+    if(ring == nullptr){
+        return 0;
+    }
+
+    uint64_t head = ring->head.load(std::memory_order_seq_cst);
+
+    return head > position ? static_cast<size_t>(head - position) : 0;
+}
+
+/**
+ * Returns the number of records the reader lost because the writer lapped it.
+ *
+ * @return The number of lost records.
+ */
+uint64_t RxBroadcastReader::overruns() const{
+    return lost;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
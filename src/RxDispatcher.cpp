@@ -0,0 +1,350 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxDispatcher.cpp
+ \brief     Dispatch table for received BCM notifications. Handlers are
+            registered per CAN ID or CAN ID range for RX_CHANGED, RX_TIMEOUT
+            and TX_EXPIRED. Standard IDs are looked up in a direct-indexed
+            table, extended IDs in an open-addressed table.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "RxDispatcher.h"
+#include <algorithm>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+RxDispatcher::RxDispatcher(){
+
+    // The first handler slot is the marker for no handler
+    handlers.emplace_back();
+
+    for(Table& table : tables){
+        table.extended.resize(RX_DISPATCH_EXTENDED_CAPACITY);
+    }
+
+}
+
+/**
+ * Registers a handler for a CAN ID or a range of CAN IDs. An existing handler
+ * of a CAN ID is replaced. Extended CAN IDs must have the CAN_EFF_FLAG set.
+ *
+ * Note: Not thread safe. Must be called in the same thread as dispatch.
+ *
+ * @param event      - The event the handler is registered for.
+ * @param firstCanID - The first CAN ID of the range.
+ * @param lastCanID  - The last CAN ID of the range. Equal to firstCanID for a single CAN ID.
+ * @param handler    - The handler that is called for the notifications.
+ */
+void RxDispatcher::subscribe(RxEvent event, canid_t firstCanID, canid_t lastCanID, const RxHandler& handler){
+
+    Table& table = tables[static_cast<int>(event)];
+    uint32_t index = addHandler(handler);
+
+    if(!(firstCanID & CAN_EFF_FLAG)){
+
+        // Standard CAN IDs are directly indexed
+        for(canid_t canID = firstCanID & CAN_SFF_MASK; canID <= (lastCanID & CAN_SFF_MASK); canID++){
+            releaseHandler(table.standard[canID]);
+            table.standard[canID] = index;
+            handlers[index].references++;
+        }
+
+    }else if((firstCanID & CAN_EFF_MASK) == (lastCanID & CAN_EFF_MASK)){
+
+        // A single extended CAN ID is put into the open-addressed table
+        insertExtended(table, firstCanID & CAN_EFF_MASK, index);
+
+    }else{
+
+        // Ranges of extended CAN IDs are kept sorted by their first CAN ID
+        ExtendedRange range{firstCanID & CAN_EFF_MASK, lastCanID & CAN_EFF_MASK, index};
+        auto position = std::lower_bound(table.extendedRanges.begin(), table.extendedRanges.end(), range,
+                                         [](const ExtendedRange& a, const ExtendedRange& b){ return a.first < b.first; });
+        table.extendedRanges.insert(position, range);
+        handlers[index].references++;
+    }
+
+    // Free the handler again if no entry refers to it
+    if(handlers[index].references == 0){
+        handlers[index].references = 1;
+        releaseHandler(index);
+    }
+
+}
+
+/**
+ * Removes the handlers of a CAN ID or a range of CAN IDs.
+ *
+ * Note: Not thread safe. Must be called in the same thread as dispatch.
+ *
+ * @param event      - The event the handler was registered for.
+ * @param firstCanID - The first CAN ID of the range.
+ * @param lastCanID  - The last CAN ID of the range. Equal to firstCanID for a single CAN ID.
+ */
+void RxDispatcher::unsubscribe(RxEvent event, canid_t firstCanID, canid_t lastCanID){
+
+    Table& table = tables[static_cast<int>(event)];
+
+    if(!(firstCanID & CAN_EFF_FLAG)){
+
+        for(canid_t canID = firstCanID & CAN_SFF_MASK; canID <= (lastCanID & CAN_SFF_MASK); canID++){
+            releaseHandler(table.standard[canID]);
+            table.standard[canID] = NO_HANDLER;
+        }
+
+    }else if((firstCanID & CAN_EFF_MASK) == (lastCanID & CAN_EFF_MASK)){
+
+        eraseExtended(table, firstCanID & CAN_EFF_MASK);
+
+    }else{
+
+        // Only a range with exactly the same bounds is removed
+        for(auto range = table.extendedRanges.begin(); range != table.extendedRanges.end(); range++){
+            if(range->first == (firstCanID & CAN_EFF_MASK) && range->last == (lastCanID & CAN_EFF_MASK)){
+                releaseHandler(range->handler);
+                table.extendedRanges.erase(range);
+                break;
+            }
+        }
+    }
+
+}
+
+/**
+ * Calls the handler that is registered for the CAN ID of the notification.
+ * The dispatch does not allocate and standard CAN IDs are not hashed.
+ *
+ * @param event        - The event of the notification.
+ * @param notification - The received notification.
+ * @return False if no handler is registered.
+ */
+bool RxDispatcher::dispatch(RxEvent event, const BcmNotification& notification) const{
+
+    uint32_t index = lookup(tables[static_cast<int>(event)], notification.head->can_id);
+
+    if(index == NO_HANDLER){
+        return false;
+    }
+
+    handlers[index].handler(notification);
+    return true;
+}
+
+/**
+ * Stores a handler in a free handler slot.
+ *
+ * @param handler - The handler.
+ * @return The index of the handler slot.
+ */
+uint32_t RxDispatcher::addHandler(const RxHandler& handler){
+
+    uint32_t index = 0;
+
+    if(!freeHandlers.empty()){
+        index = freeHandlers.back();
+        freeHandlers.pop_back();
+    }else{
+        index = static_cast<uint32_t>(handlers.size());
+        handlers.emplace_back();
+    }
+
+    handlers[index].handler    = handler;
+    handlers[index].references = 0;
+
+    return index;
+}
+
+/**
+ * Drops a reference to a handler slot and frees the slot with the last reference.
+ *
+ * @param index - The index of the handler slot.
+ */
+void RxDispatcher::releaseHandler(uint32_t index){
+
+    if(index == NO_HANDLER){
+        return;
+    }
+
+    if(--handlers[index].references == 0){
+        handlers[index].handler.reset();
+        freeHandlers.push_back(index);
+    }
+
+}
+
+/**
+ * Looks up the handler of a CAN ID. An exact extended CAN ID
+ * has priority over a range that contains the CAN ID.
+ *
+ * @param table - The table of the event.
+ * @param canID - The CAN ID with the CAN_EFF_FLAG for extended CAN IDs.
+ * @return The index of the handler slot or NO_HANDLER.
+ */
+uint32_t RxDispatcher::lookup(const Table& table, canid_t canID) const{
+
+    // Standard CAN IDs are a single array access
+    if(!(canID & CAN_EFF_FLAG)){
+        return table.standard[canID & CAN_SFF_MASK];
+    }
+
+    canid_t key = canID & CAN_EFF_MASK;
+    size_t mask = table.extended.size() - 1;
+
+    // Linear probing until we find the key or an empty entry
+    for(size_t position = hashExtended(key, table.extended.size()); ; position = (position + 1) & mask){
+
+        const ExtendedEntry& entry = table.extended[position];
+
+        if(entry.canID == key){
+            return entry.handler;
+        }
+
+        if(entry.canID == EMPTY_KEY){
+            break;
+        }
+    }
+
+    for(const ExtendedRange& range : table.extendedRanges){
+
+        if(range.first > key){
+            break;
+        }
+
+        if(key <= range.last){
+            return range.handler;
+        }
+    }
+
+    return NO_HANDLER;
+}
+
+/**
+ * Inserts or replaces the handler of an extended CAN ID. The table is
+ * rehashed when it is half full with entries and tombstones. The capacity
+ * is only doubled if at least a quarter of the table are live entries,
+ * otherwise the rehash just drops the tombstones.
+ *
+ * @param table   - The table of the event.
+ * @param canID   - The extended CAN ID without the CAN_EFF_FLAG.
+ * @param handler - The index of the handler slot.
+ */
+void RxDispatcher::insertExtended(Table& table, canid_t canID, uint32_t handler){
+
+    // Rehash the table before the probe sequences get long. Tombstones count as used
+    // entries, so the table is only doubled if the live entries need the room.
+    if((table.extendedUsed + 1) * 2 > table.extended.size()){
+
+        size_t capacity = table.extended.size();
+
+        if((table.extendedLive + 1) * 4 > capacity){
+            capacity *= 2;
+        }
+
+        std::vector<ExtendedEntry> entries(capacity);
+        size_t mask = entries.size() - 1;
+
+        for(const ExtendedEntry& entry : table.extended){
+
+            if(entry.canID == EMPTY_KEY || entry.canID == TOMBSTONE_KEY){
+                continue;
+            }
+
+            size_t position = hashExtended(entry.canID, entries.size());
+
+            while(entries[position].canID != EMPTY_KEY){
+                position = (position + 1) & mask;
+            }
+
+            entries[position] = entry;
+        }
+
+        table.extended.swap(entries);
+        table.extendedUsed = table.extendedLive;
+    }
+
+    size_t mask = table.extended.size() - 1;
+    size_t position = hashExtended(canID, table.extended.size());
+    ExtendedEntry* free = nullptr;
+
+    while(table.extended[position].canID != EMPTY_KEY){
+
+        ExtendedEntry& entry = table.extended[position];
+
+        // Replace the handler of an existing entry
+        if(entry.canID == canID){
+            releaseHandler(entry.handler);
+            entry.handler = handler;
+            handlers[handler].references++;
+            return;
+        }
+
+        if(entry.canID == TOMBSTONE_KEY && free == nullptr){
+            free = &entry;
+        }
+
+        position = (position + 1) & mask;
+    }
+
+    // Reuse the first tombstone of the probe sequence or take the empty entry
+    if(free == nullptr){
+        free = &table.extended[position];
+        table.extendedUsed++;
+    }
+
+    table.extendedLive++;
+
+    free->canID   = canID;
+    free->handler = handler;
+    handlers[handler].references++;
+}
+
+/**
+ * Removes the handler of an extended CAN ID.
+ *
+ * @param table - The table of the event.
+ * @param canID - The extended CAN ID without the CAN_EFF_FLAG.
+ */
+void RxDispatcher::eraseExtended(Table& table, canid_t canID){
+
+    size_t mask = table.extended.size() - 1;
+
+    for(size_t position = hashExtended(canID, table.extended.size()); table.extended[position].canID != EMPTY_KEY;
+        position = (position + 1) & mask){
+
+        ExtendedEntry& entry = table.extended[position];
+
+        if(entry.canID == canID){
+            releaseHandler(entry.handler);
+            entry.canID   = TOMBSTONE_KEY;
+            entry.handler = NO_HANDLER;
+            table.extendedLive--;
+            return;
+        }
+    }
+
+}
+
+/**
+ * Fibonacci hashing of an extended CAN ID.
+ *
+ * @param canID    - The extended CAN ID without the CAN_EFF_FLAG.
+ * @param capacity - The capacity of the table. Must be a power of two.
+ * @return The start position of the probe sequence.
+ */
+size_t RxDispatcher::hashExtended(canid_t canID, size_t capacity){
+    return static_cast<size_t>((static_cast<uint64_t>(canID) * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,199 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxFilterSet.cpp
+ \brief     Desired and installed RX_SETUP configuration of a BCM socket. The
+            difference between both is reduced to the minimal set of RX_SETUP
+            and RX_DELETE messages, so unchanged filters are never touched.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "RxFilterSet.h"
+#include "Log.h"
+#include <cstring>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates a filter with typed options.
+ *
+ * @param canID   - The CAN ID, with CAN_EFF_FLAG for extended CAN IDs.
+ * @param isCANFD - Flag for a CANFD filter.
+ * @param options - The throttling, timeout and content options.
+ * @param masks   - The content filter. The first mask is the multiplex mask if there is more than one.
+ */
+RxFilter::RxFilter(canid_t canID, bool isCANFD, const RxOptions& options, std::vector<struct canfd_frame> masks) :
+    canID(canID), isCANFD(isCANFD), flags(options.flags()), ival1(options.ival1()), ival2(options.ival2()), masks(std::move(masks)){}
+
+/**
+ * Compares two filters. Masks are compared byte by byte.
+ *
+ * @param other - The other filter.
+ * @return True if both filters result in the same RX_SETUP message.
+ */
+bool RxFilter::operator==(const RxFilter& other) const{
+
+    return canID == other.canID && isCANFD == other.isCANFD && flags == other.flags &&
+           ival1.tv_sec == other.ival1.tv_sec && ival1.tv_usec == other.ival1.tv_usec &&
+           ival2.tv_sec == other.ival2.tv_sec && ival2.tv_usec == other.ival2.tv_usec &&
+           masks.size() == other.masks.size() &&
+           (masks.empty() || std::memcmp(masks.data(), other.masks.data(), masks.size() * sizeof(struct canfd_frame)) == 0);
+}
+
+bool RxFilter::operator!=(const RxFilter& other) const{
+    return !(*this == other);
+}
+
+/**
+ * Returns the key of a filter. The BCM keeps CAN and CANFD filters of
+ * the same CAN ID apart, so the frame type is part of the key.
+ *
+ * @param canID   - The CAN ID, with CAN_EFF_FLAG for extended CAN IDs.
+ * @param isCANFD - Flag for a CANFD filter.
+ * @return The key.
+ */
+uint64_t RxFilterSet::keyOf(canid_t canID, bool isCANFD){
+    return static_cast<uint64_t>(canID) | (static_cast<uint64_t>(isCANFD) << 32);
+}
+
+/**
+ * Calculates the changes from the installed to the desired configuration.
+ * The deletes come first, so the kernel frees the filters before new ones
+ * are added. If a CAN ID is listed more than once the last filter wins.
+ *
+ * @param desired - The desired configuration.
+ * @param changes - The changes. Cleared first.
+ * @param result  - Counts the unchanged filters. Cleared first.
+ */
+void RxFilterSet::diff(const std::vector<RxFilter>& desired, std::vector<RxFilterChange>& changes, RxFilterResult& result) const{
+
+    changes.clear();
+    result = RxFilterResult();
+
+    std::unordered_map<uint64_t, const RxFilter*> wanted;
+    wanted.reserve(desired.size());
+
+    for(const auto& filter : desired){
+        if(!wanted.insert_or_assign(keyOf(filter.canID, filter.isCANFD), &filter).second){
+            Log::warning("RX filter for CAN ID ", std::hex, filter.canID, std::dec, " is listed more than once");
+        }
+    }
+
+    // Filters that are installed or in an unknown state but no longer wanted
+    for(const auto& [key, filter] : filters){
+        if(wanted.count(key) == 0){
+            changes.push_back({RxFilterChange::Action::Delete, filter});
+        }
+    }
+
+    for(uint64_t key : uncertain){
+        if(wanted.count(key) == 0 && filters.count(key) == 0){
+
+            RxFilter filter;
+            filter.canID   = static_cast<canid_t>(key);
+            filter.isCANFD = (key >> 32) != 0;
+
+            changes.push_back({RxFilterChange::Action::Delete, filter});
+        }
+    }
+
+    // Keep the order of the desired configuration for the setups
+    for(const auto& filter : desired){
+
+        uint64_t key = keyOf(filter.canID, filter.isCANFD);
+
+        if(wanted[key] != &filter){
+            continue;
+        }
+
+        auto installedFilter = filters.find(key);
+
+        if(installedFilter == filters.end()){
+
+            // A failed setup may have left a filter with more masks in the kernel
+            auto action = uncertain.count(key) != 0 ? RxFilterChange::Action::Replace : RxFilterChange::Action::Setup;
+            changes.push_back({action, filter});
+
+        }else if(installedFilter->second == filter){
+            result.unchanged++;
+
+        }else if(filter.masks.size() > installedFilter->second.masks.size()){
+
+            // Note: The kernel rejects a RX_SETUP with more frames than the installed filter
+            changes.push_back({RxFilterChange::Action::Replace, filter});
+
+        }else{
+            changes.push_back({RxFilterChange::Action::Setup, filter});
+        }
+    }
+
+}
+
+/**
+ * Records a filter the kernel accepted.
+ *
+ * @param filter - The filter.
+ */
+void RxFilterSet::installed(const RxFilter& filter){
+
+    uint64_t key = keyOf(filter.canID, filter.isCANFD);
+
+    filters.insert_or_assign(key, filter);
+    uncertain.erase(key);
+}
+
+/**
+ * Records a filter that was removed from the kernel.
+ *
+ * @param key - The key of the filter.
+ */
+void RxFilterSet::removed(uint64_t key){
+    filters.erase(key);
+    uncertain.erase(key);
+}
+
+/**
+ * Records a filter that is in an unknown state after a failed message.
+ * The next diff replaces or deletes the filter.
+ *
+ * @param key - The key of the filter.
+ */
+void RxFilterSet::failed(uint64_t key){
+    filters.erase(key);
+    uncertain.insert(key);
+}
+
+/**
+ * Returns an installed filter.
+ *
+ * @param canID   - The CAN ID, with CAN_EFF_FLAG for extended CAN IDs.
+ * @param isCANFD - Flag for a CANFD filter.
+ * @return The filter or nullptr if no filter is installed.
+ */
+const RxFilter* RxFilterSet::find(canid_t canID, bool isCANFD) const{
+
+    auto filter = filters.find(keyOf(canID, isCANFD));
+    return filter == filters.end() ? nullptr : &filter->second;
+}
+
+/**
+ * Returns the number of installed filters.
+ *
+ * @return The number of filters.
+ */
+size_t RxFilterSet::size() const{
+    return filters.size();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
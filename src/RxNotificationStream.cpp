@@ -0,0 +1,161 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxNotificationStream.cpp
+ \brief     Awaitable stream of received BCM notifications. The notifications
+            are copied into a bounded ring in the io context loop thread and
+            handed out with asyncReceive, e.g. with co_await and use_awaitable.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "RxNotificationStream.h"
+#include <cstring>
+#include <algorithm>
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates a stream. The ring is allocated once, the steady state does not allocate.
+ *
+ * @param context    - The io context of the connector the stream belongs to.
+ * @param event      - The event of the notifications.
+ * @param firstCanID - The first CAN ID of the range.
+ * @param lastCanID  - The last CAN ID of the range.
+ * @param capacity   - The number of buffered notifications.
+ */
+RxNotificationStream::RxNotificationStream(boost::asio::io_context& context, RxEvent event, canid_t firstCanID,
+                                           canid_t lastCanID, size_t capacity) :
+    executor(context.get_executor()), streamEvent(event), streamFirstCanID(firstCanID), streamLastCanID(lastCanID),
+    entries(std::max<size_t>(capacity, 1)){}
+
+/**
+ * Returns the event of the notifications of the stream.
+ *
+ * @return The event.
+ */
+RxEvent RxNotificationStream::event() const{
+    return streamEvent;
+}
+
+/**
+ * Returns the first CAN ID of the range of the stream.
+ *
+ * @return The first CAN ID.
+ */
+canid_t RxNotificationStream::firstCanID() const{
+    return streamFirstCanID;
+}
+
+/**
+ * Returns the last CAN ID of the range of the stream.
+ *
+ * @return The last CAN ID.
+ */
+canid_t RxNotificationStream::lastCanID() const{
+    return streamLastCanID;
+}
+
+/**
+ * Returns the number of notifications that were dropped because the ring was full.
+ *
+ * @return The number of dropped notifications.
+ */
+size_t RxNotificationStream::overruns() const{
+    return overrunCount.load(std::memory_order_relaxed);
+}
+
+/**
+ * Copies a notification into the stream. A pending receive is completed
+ * directly, otherwise the notification is buffered. If the ring is full
+ * the oldest notification is dropped. Only called in the io context loop thread.
+ *
+ * @param notification - The received notification.
+ */
+void RxNotificationStream::push(const BcmNotification& notification){
+
+    if(!open){
+        return;
+    }
+
+    BcmEvent entry;
+    entry.event     = streamEvent;
+    entry.canID     = notification.head->can_id;
+    entry.flags     = notification.head->flags;
+    entry.nframes   = notification.nframes;
+    entry.isCANFD   = notification.isCANFD;
+    entry.timestamp = notification.timestamp;
+
+    if(notification.nframes > 0){
+        std::memcpy(&entry.frame, notification.frames, notification.isCANFD ? sizeof(struct canfd_frame) : sizeof(struct can_frame));
+    }
+
+    if(waiter){
+        completeAsync(waiter, boost::system::error_code(), entry);
+        return;
+    }
+
+    if(count == entries.size()){
+        head = (head + 1) % entries.size();
+        count--;
+        overrunCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    entries[(head + count) % entries.size()] = entry;
+    count++;
+}
+
+/**
+ * Closes the stream. A pending receive is completed with operation_aborted.
+ * Only called in the io context loop thread.
+ */
+void RxNotificationStream::close(){
+
+    open  = false;
+    count = 0;
+
+    completeAsync(waiter, boost::asio::error::operation_aborted, BcmEvent());
+}
+
+/**
+ * Starts a receive operation. Only called in the io context loop thread.
+ *
+ * @param completion - The completion of the receive operation.
+ */
+void RxNotificationStream::startReceive(Completion completion){
+
+    // Error handling / Sanity check
+    if(!open){
+        completeAsync(completion, boost::asio::error::operation_aborted, BcmEvent());
+        return;
+    }
+
+    if(waiter){
+        completeAsync(completion, boost::asio::error::already_started, BcmEvent());
+        return;
+    }
+
+    if(count > 0){
+        BcmEvent entry = entries[head];
+        head = (head + 1) % entries.size();
+        count--;
+
+        completeAsync(completion, boost::system::error_code(), entry);
+        return;
+    }
+
+    waiter = std::move(completion);
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
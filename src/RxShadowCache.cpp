@@ -0,0 +1,231 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      RxShadowCache.cpp
+ \brief     Shadow state of the last received frame per CAN ID. The io context
+            thread writes the slots, any thread can read a consistent snapshot
+            of a slot without locks. Every slot is a seqlock on its own cache
+            lines, so readers of different CAN IDs never share a cache line.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "RxShadowCache.h"
+#include <cstring>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+RxShadowCache::RxShadowCache() : standardSlots(new Slot[RX_SHADOW_STANDARD_IDS]),
+                                 extendedSlots(new Slot[RX_SHADOW_EXTENDED_SLOTS]){
+
+    static_assert((RX_SHADOW_EXTENDED_SLOTS & (RX_SHADOW_EXTENDED_SLOTS - 1)) == 0,
+                  "RX_SHADOW_EXTENDED_SLOTS must be a power of two");
+}
+
+/**
+ * Stores a received frame as the new shadow state of its CAN ID.
+ * Must only be called by the io context thread.
+ *
+ * @param frame     - The received frame.
+ * @param isCANFD   - Flag for a CANFD frame.
+ * @param timestamp - The receive time in nanoseconds.
+ */
+void RxShadowCache::update(const struct canfd_frame& frame, bool isCANFD, int64_t timestamp){
+
+    Slot* slot = findSlot(keyOf(frame.can_id), true);
+
+    // Error handling / Sanity check
+    if(slot == nullptr){
+        droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::array<uint64_t, frameWords> words{};
+    std::memcpy(words.data(), &frame, sizeof(frame));
+
+    // Mark the slot as being written
+    uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for(size_t index = 0; index < frameWords; index++){
+        slot->words[index].store(words[index], std::memory_order_relaxed);
+    }
+
+    slot->timestamp.store(timestamp, std::memory_order_relaxed);
+    slot->isCANFD.store(isCANFD ? 1 : 0, std::memory_order_relaxed);
+    slot->updates.store(slot->updates.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    // Publish the new state
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/**
+ * Reads a consistent snapshot of the shadow state of a CAN ID.
+ * Can be called from any thread and never blocks the io context thread.
+ *
+ * @param canID    - The CAN ID.
+ * @param snapshot - The copy of the last received frame.
+ * @return False if no frame of the CAN ID was received yet.
+ */
+bool RxShadowCache::read(canid_t canID, RxShadowSnapshot& snapshot) const{
+
+    const Slot* slot = findSlot(keyOf(canID));
+
+    // Error handling / Sanity check
+    if(slot == nullptr){
+        return false;
+    }
+
+    std::array<uint64_t, frameWords> words{};
+    uint32_t before;
+    uint32_t after;
+
+    do{
+        before = slot->sequence.load(std::memory_order_acquire);
+
+        // The writer is changing the slot right now
+        if(before & 1){
+            continue;
+        }
+
+        for(size_t index = 0; index < frameWords; index++){
+            words[index] = slot->words[index].load(std::memory_order_relaxed);
+        }
+
+        snapshot.timestamp = slot->timestamp.load(std::memory_order_relaxed);
+        snapshot.isCANFD   = slot->isCANFD.load(std::memory_order_relaxed) != 0;
+        snapshot.updates   = slot->updates.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = slot->sequence.load(std::memory_order_relaxed);
+
+    }while((before & 1) || before != after);
+
+    // Nothing was written yet
+    if(before == 0){
+        return false;
+    }
+
+    std::memcpy(&snapshot.frame, words.data(), sizeof(snapshot.frame));
+
+    return true;
+}
+
+/**
+ * Returns the number of frames that were not cached because the table was full.
+ *
+ * @return The number of dropped frames.
+ */
+size_t RxShadowCache::dropped() const{
+    return droppedFrames.load(std::memory_order_relaxed);
+}
+
+/**
+ * Removes the RTR and error flags of a CAN ID.
+ *
+ * @param canID - The CAN ID with flags.
+ * @return The CAN ID with the EFF flag for extended CAN IDs.
+ */
+canid_t RxShadowCache::keyOf(canid_t canID){
+
+    if(canID & CAN_EFF_FLAG){
+        return (canID & CAN_EFF_MASK) | CAN_EFF_FLAG;
+    }
+
+    return canID & CAN_SFF_MASK;
+}
+
+/**
+ * Fibonacci hashing of an extended CAN ID.
+ *
+ * @param key - The CAN ID without RTR and error flags.
+ * @return The first slot index to probe.
+ */
+size_t RxShadowCache::hashOf(canid_t key){
+    return static_cast<size_t>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL) >> 32) & (RX_SHADOW_EXTENDED_SLOTS - 1);
+}
+
+/**
+ * Looks up the slot of a CAN ID and claims a free slot if needed.
+ * Must only be called by the io context thread.
+ *
+ * @param key    - The CAN ID without RTR and error flags.
+ * @param insert - Claim a free slot for an unknown extended CAN ID.
+ * @return The slot or nullptr if the table is full.
+ */
+RxShadowCache::Slot* RxShadowCache::findSlot(canid_t key, bool insert){
+
+    if(!(key & CAN_EFF_FLAG)){
+        return &standardSlots[key];
+    }
+
+    size_t position = hashOf(key);
+
+    for(size_t probe = 0; probe < RX_SHADOW_EXTENDED_SLOTS; probe++){
+
+        Slot& slot = extendedSlots[(position + probe) & (RX_SHADOW_EXTENDED_SLOTS - 1)];
+        canid_t slotKey = slot.key.load(std::memory_order_relaxed);
+
+        if(slotKey == key){
+            return &slot;
+        }
+
+        if(slotKey == 0){
+
+            // Note: Keys are never removed, readers can stop probing at a free slot
+            if(!insert || extendedCount == RX_SHADOW_EXTENDED_SLOTS){
+                return nullptr;
+            }
+
+            slot.key.store(key, std::memory_order_release);
+            extendedCount++;
+            return &slot;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * Looks up the slot of a CAN ID. Can be called from any thread.
+ *
+ * @param key - The CAN ID without RTR and error flags.
+ * @return The slot or nullptr if the CAN ID has no slot.
+ */
+const RxShadowCache::Slot* RxShadowCache::findSlot(canid_t key) const{
+
+    if(!(key & CAN_EFF_FLAG)){
+        return &standardSlots[key];
+    }
+
+    size_t position = hashOf(key);
+
+    for(size_t probe = 0; probe < RX_SHADOW_EXTENDED_SLOTS; probe++){
+
+        const Slot& slot = extendedSlots[(position + probe) & (RX_SHADOW_EXTENDED_SLOTS - 1)];
+        canid_t slotKey = slot.key.load(std::memory_order_acquire);
+
+        if(slotKey == key){
+            return &slot;
+        }
+
+        if(slotKey == 0){
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,628 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      SignalDatabase.cpp
+ \brief     Signal layer on top of the CAN frames. The signal descriptions of
+            a DBC file are loaded once and compiled into a shift/mask table
+            per message, so encoding and decoding never parses metadata.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "SignalDatabase.h"
+#include "Log.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+// Note: The 8 byte loads of the payload assume a little endian host
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The signal layer requires a little endian host");
+
+// Messages of a DBC file with bit 31 of the ID set have an extended CAN ID
+#define DBC_EXTENDED_ID_FLAG 0x80000000U
+
+// Pseudo message of a DBC file for signals that are not mapped to a message
+#define DBC_INDEPENDENT_SIGNALS_ID 0xC0000000U
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Compiles the signals of a message definition.
+ *
+ * @param definition - The message definition with valid signals.
+ */
+MessageLayout::MessageLayout(MessageDefinition definition) : definition(std::move(definition)){
+
+    compiled.reserve(this->definition.signals.size());
+
+    for(const auto& signal : this->definition.signals){
+        compiled.push_back(compile(signal));
+    }
+
+}
+
+/**
+ * Returns the CAN ID of the message.
+ *
+ * @return The CAN ID, with CAN_EFF_FLAG for extended CAN IDs.
+ */
+canid_t MessageLayout::canID() const{
+    return definition.canID;
+}
+
+/**
+ * Returns the name of the message.
+ *
+ * @return The name.
+ */
+const std::string& MessageLayout::name() const{
+    return definition.name;
+}
+
+/**
+ * Returns the length of the payload of the message.
+ *
+ * @return The length in bytes.
+ */
+uint32_t MessageLayout::length() const{
+    return definition.length;
+}
+
+/**
+ * Returns the number of signals of the message.
+ *
+ * @return The number of signals and the size of the value arrays.
+ */
+size_t MessageLayout::signalCount() const{
+    return definition.signals.size();
+}
+
+/**
+ * Returns the definition of a signal.
+ *
+ * @param index - The index of the signal.
+ * @return The signal definition.
+ */
+const SignalDefinition& MessageLayout::signal(size_t index) const{
+    return definition.signals[index];
+}
+
+/**
+ * Looks up the index of a signal. Meant for the setup, not for the hot loop.
+ *
+ * @param signalName - The name of the signal.
+ * @return The index of the signal or -1 if the message has no such signal.
+ */
+int MessageLayout::signalIndex(const std::string& signalName) const{
+
+    for(size_t index = 0; index < definition.signals.size(); index++){
+        if(definition.signals[index].name == signalName){
+            return static_cast<int>(index);
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Decodes all signals of a payload into physical values.
+ *
+ * Note: Multiplexed signals are decoded regardless of the multiplexor,
+ * their values are only meaningful if the multiplexor matches.
+ *
+ * @param data   - The payload.
+ * @param length - The length of the payload in bytes.
+ * @param values - The physical values, one per signal.
+ */
+void MessageLayout::decode(const std::uint8_t* data, size_t length, double values[]) const{
+
+    std::uint8_t payload[SIGNAL_PAYLOAD_BUFFER_SIZE] = {0};
+    std::memcpy(payload, data, std::min<size_t>(length, CANFD_MAX_DLEN));
+
+    for(size_t index = 0; index < compiled.size(); index++){
+        values[index] = toPhysical(compiled[index], extract(compiled[index], payload));
+    }
+
+}
+
+/**
+ * Decodes all signals of a CAN/CANFD frame into physical values.
+ *
+ * @param frame  - The frame.
+ * @param values - The physical values, one per signal.
+ */
+void MessageLayout::decode(const struct canfd_frame& frame, double values[]) const{
+    decode(frame.data, frame.len, values);
+}
+
+/**
+ * Decodes all signals of the first frame of a BCM notification.
+ * Meant to be called from a RX_CHANGED handler.
+ *
+ * @param notification - The notification.
+ * @param values       - The physical values, one per signal.
+ */
+void MessageLayout::decode(const BcmNotification& notification, double values[]) const{
+
+    // Error handling / Sanity check
+    if(notification.nframes == 0){
+        return;
+    }
+
+    // Note: can_frame and canfd_frame have the length and the data at the same offset
+    const auto* frame = static_cast<const struct canfd_frame*>(notification.frames);
+    size_t maxLength  = notification.isCANFD ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+
+    decode(frame->data, std::min<size_t>(frame->len, maxLength), values);
+}
+
+/**
+ * Decodes all signals of the last received frame in the shadow cache.
+ *
+ * @param snapshot - The snapshot of the shadow cache.
+ * @param values   - The physical values, one per signal.
+ */
+void MessageLayout::decode(const RxShadowSnapshot& snapshot, double values[]) const{
+    decode(snapshot.frame, values);
+}
+
+/**
+ * Decodes a single signal of a payload into its physical value.
+ *
+ * @param data   - The payload.
+ * @param length - The length of the payload in bytes.
+ * @param index  - The index of the signal.
+ * @return The physical value.
+ */
+double MessageLayout::decodeSignal(const std::uint8_t* data, size_t length, size_t index) const{
+
+    std::uint8_t payload[SIGNAL_PAYLOAD_BUFFER_SIZE] = {0};
+    std::memcpy(payload, data, std::min<size_t>(length, CANFD_MAX_DLEN));
+
+    return toPhysical(compiled[index], extract(compiled[index], payload));
+}
+
+/**
+ * Encodes the physical values of all signals into a payload. Bits
+ * that do not belong to a signal keep their value.
+ *
+ * @param values - The physical values, one per signal.
+ * @param data   - The payload.
+ * @param length - The length of the payload in bytes.
+ */
+void MessageLayout::encode(const double values[], std::uint8_t* data, size_t length) const{
+
+    length = std::min<size_t>(length, CANFD_MAX_DLEN);
+
+    std::uint8_t payload[SIGNAL_PAYLOAD_BUFFER_SIZE] = {0};
+    std::memcpy(payload, data, length);
+
+    for(size_t index = 0; index < compiled.size(); index++){
+        insert(compiled[index], toRaw(compiled[index], values[index]), payload);
+    }
+
+    std::memcpy(data, payload, length);
+}
+
+/**
+ * Encodes the physical values of all signals straight into a frame of a TX job.
+ * The job is marked dirty and sent with the next commit.
+ *
+ * @param values     - The physical values, one per signal.
+ * @param job        - The TX job of the message.
+ * @param frameIndex - The index of the frame in the sequence of the job.
+ */
+void MessageLayout::encode(const double values[], TxJob& job, uint32_t frameIndex) const{
+
+    size_t maxLength = job.isCANFD() ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+    size_t length    = std::min<size_t>(definition.length, maxLength);
+
+    job.setLength(frameIndex, static_cast<std::uint8_t>(length));
+    encode(values, job.data(frameIndex), length);
+}
+
+/**
+ * Encodes the physical value of a single signal into a payload.
+ *
+ * @param index  - The index of the signal.
+ * @param value  - The physical value.
+ * @param data   - The payload.
+ * @param length - The length of the payload in bytes.
+ */
+void MessageLayout::encodeSignal(size_t index, double value, std::uint8_t* data, size_t length) const{
+
+    length = std::min<size_t>(length, CANFD_MAX_DLEN);
+
+    std::uint8_t payload[SIGNAL_PAYLOAD_BUFFER_SIZE] = {0};
+    std::memcpy(payload, data, length);
+
+    insert(compiled[index], toRaw(compiled[index], value), payload);
+
+    std::memcpy(data, payload, length);
+}
+
+/**
+ * Precomputes the byte offset, shift and mask of a signal.
+ *
+ * Intel signals: The start bit is the LSB, the 72 bit word is the little
+ * endian load at the byte of the LSB. Motorola signals: The start bit is
+ * the MSB in the sawtooth numbering of the DBC, the 72 bit word is the
+ * big endian load at the byte of the MSB.
+ *
+ * @param signal - The signal definition.
+ * @return The compiled signal.
+ */
+MessageLayout::CompiledSignal MessageLayout::compile(const SignalDefinition& signal){
+
+    CompiledSignal result{};
+    result.mask        = signal.length >= 64 ? UINT64_MAX : (UINT64_C(1) << signal.length) - 1;
+    result.signShift   = signal.isSigned ? 64 - signal.length : 0;
+    result.isSigned    = signal.isSigned;
+    result.isBigEndian = signal.isBigEndian;
+    result.rawLimit    = std::ldexp(1.0, static_cast<int>(signal.isSigned ? signal.length - 1 : signal.length));
+    result.factor      = signal.factor;
+    result.offset      = signal.offset;
+
+    if(signal.isBigEndian){
+
+        // Position of the MSB if the bits are counted MSB first
+        uint32_t msb = (signal.startBit / 8) * 8 + (7 - signal.startBit % 8);
+
+        result.byteOffset = msb / 8;
+        result.shift      = 72 - msb % 8 - signal.length;
+    }else{
+        result.byteOffset = signal.startBit / 8;
+        result.shift      = signal.startBit % 8;
+    }
+
+    return result;
+}
+
+/**
+ * Extracts the raw value of a signal from a zero padded payload.
+ *
+ * @param signal  - The compiled signal.
+ * @param payload - The payload with SIGNAL_PAYLOAD_BUFFER_SIZE bytes.
+ * @return The raw value.
+ */
+uint64_t MessageLayout::extract(const CompiledSignal& signal, const std::uint8_t* payload){
+
+    uint64_t bytes;
+    std::memcpy(&bytes, payload + signal.byteOffset, sizeof(bytes));
+
+    unsigned __int128 word;
+
+    if(signal.isBigEndian){
+        word = (static_cast<unsigned __int128>(__builtin_bswap64(bytes)) << 8) | payload[signal.byteOffset + 8];
+    }else{
+        word = static_cast<unsigned __int128>(bytes) | (static_cast<unsigned __int128>(payload[signal.byteOffset + 8]) << 64);
+    }
+
+    return static_cast<uint64_t>(word >> signal.shift) & signal.mask;
+}
+
+/**
+ * Inserts the raw value of a signal into a zero padded payload.
+ *
+ * @param signal  - The compiled signal.
+ * @param raw     - The raw value.
+ * @param payload - The payload with SIGNAL_PAYLOAD_BUFFER_SIZE bytes.
+ */
+void MessageLayout::insert(const CompiledSignal& signal, uint64_t raw, std::uint8_t* payload){
+
+    uint64_t bytes;
+    std::memcpy(&bytes, payload + signal.byteOffset, sizeof(bytes));
+
+    std::uint8_t* extra = payload + signal.byteOffset + 8;
+    unsigned __int128 word;
+
+    if(signal.isBigEndian){
+        word = (static_cast<unsigned __int128>(__builtin_bswap64(bytes)) << 8) | *extra;
+    }else{
+        word = static_cast<unsigned __int128>(bytes) | (static_cast<unsigned __int128>(*extra) << 64);
+    }
+
+    unsigned __int128 mask = static_cast<unsigned __int128>(signal.mask) << signal.shift;
+    word = (word & ~mask) | (static_cast<unsigned __int128>(raw & signal.mask) << signal.shift);
+
+    if(signal.isBigEndian){
+        bytes  = __builtin_bswap64(static_cast<uint64_t>(word >> 8));
+        *extra = static_cast<std::uint8_t>(word);
+    }else{
+        bytes  = static_cast<uint64_t>(word);
+        *extra = static_cast<std::uint8_t>(word >> 64);
+    }
+
+    std::memcpy(payload + signal.byteOffset, &bytes, sizeof(bytes));
+}
+
+/**
+ * Converts a raw value into the physical value.
+ *
+ * @param signal - The compiled signal.
+ * @param raw    - The raw value.
+ * @return The physical value.
+ */
+double MessageLayout::toPhysical(const CompiledSignal& signal, uint64_t raw){
+
+    // Note: A 64 bit signal needs no sign extension, the cast already makes it negative
+    if(signal.isSigned){
+        auto value = static_cast<int64_t>(raw << signal.signShift) >> signal.signShift;
+        return static_cast<double>(value) * signal.factor + signal.offset;
+    }
+
+    return static_cast<double>(raw) * signal.factor + signal.offset;
+}
+
+/**
+ * Converts a physical value into the raw value. The value is rounded
+ * to the next raw value and clamped to the raw range of the signal.
+ *
+ * @param signal - The compiled signal.
+ * @param value  - The physical value.
+ * @return The raw value, zero for NaN.
+ */
+uint64_t MessageLayout::toRaw(const CompiledSignal& signal, double value){
+
+    double raw = std::nearbyint((value - signal.offset) / signal.factor);
+
+    // Note: The cast of a value outside of the integer range is undefined, the limits are exact powers of two
+    if(std::isnan(raw)){
+        return 0;
+    }
+
+    if(signal.isSigned){
+
+        if(raw >= signal.rawLimit){
+            return signal.mask >> 1;
+        }
+
+        if(raw < -signal.rawLimit){
+            return static_cast<uint64_t>(static_cast<int64_t>(-signal.rawLimit)) & signal.mask;
+        }
+
+        return static_cast<uint64_t>(static_cast<int64_t>(raw)) & signal.mask;
+    }
+
+    if(raw <= 0){
+        return 0;
+    }
+
+    if(raw >= signal.rawLimit){
+        return signal.mask;
+    }
+
+    return static_cast<uint64_t>(raw);
+}
+
+/**
+ * Loads the messages and signals of a DBC file.
+ *
+ * @param path - The path of the DBC file.
+ * @return False if the file could not be read.
+ */
+bool SignalDatabase::loadDbc(const std::string& path){
+
+    std::ifstream input(path);
+
+    // Error handling / Sanity check
+    if(!input){
+        Log::error("Error could not open DBC file ", path);
+        return false;
+    }
+
+    return parseDbc(input);
+}
+
+/**
+ * Parses the BO_ and SG_ lines of a DBC description. All further
+ * sections, e.g. comments and value tables, are ignored.
+ *
+ * @param input - The DBC description.
+ * @return False if the description contains no valid message.
+ */
+bool SignalDatabase::parseDbc(std::istream& input){
+
+    std::vector<MessageDefinition> messages;
+    std::string line;
+    size_t lineNumber = 0;
+
+    while(std::getline(input, line)){
+
+        lineNumber++;
+
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+
+        if(keyword == "BO_"){
+
+            unsigned long id = 0;
+            std::string name;
+            uint32_t length = 0;
+
+            tokens >> id >> name >> length;
+
+            if(tokens.fail() || name.empty()){
+                Log::warning("DBC line ", lineNumber, ": invalid message definition");
+                continue;
+            }
+
+            MessageDefinition message;
+            message.name   = name.substr(0, name.find(':'));
+            message.length = length;
+
+            if(id & DBC_EXTENDED_ID_FLAG){
+                message.canID = (static_cast<canid_t>(id) & CAN_EFF_MASK) | CAN_EFF_FLAG;
+            }else{
+                message.canID = static_cast<canid_t>(id) & CAN_SFF_MASK;
+            }
+
+            // Skip the pseudo message of the unmapped signals
+            if(id == DBC_INDEPENDENT_SIGNALS_ID){
+                message.name.clear();
+            }
+
+            messages.push_back(std::move(message));
+
+        }else if(keyword == "SG_"){
+
+            // Error handling / Sanity check
+            if(messages.empty() || messages.back().name.empty()){
+                continue;
+            }
+
+            SignalDefinition signal;
+            std::string multiplex;
+
+            tokens >> signal.name >> multiplex;
+
+            // Optional multiplex indicator between the name and the colon
+            if(multiplex != ":"){
+
+                if(multiplex == "M"){
+                    signal.isMultiplexor = true;
+                }else if(multiplex.size() > 1 && multiplex[0] == 'm'){
+                    signal.multiplexValue = std::atoi(multiplex.c_str() + 1);
+                }
+
+                tokens >> multiplex;
+            }
+
+            std::string layout;
+            std::getline(tokens, layout);
+
+            char byteOrder = 0;
+            char sign = 0;
+
+            int parsed = std::sscanf(layout.c_str(), " %u|%u@%c%c (%lf,%lf) [%lf|%lf]", &signal.startBit, &signal.length,
+                                     &byteOrder, &sign, &signal.factor, &signal.offset, &signal.minimum, &signal.maximum);
+
+            if(parsed < 6 || multiplex != ":"){
+                Log::warning("DBC line ", lineNumber, ": invalid signal definition");
+                continue;
+            }
+
+            signal.isBigEndian = byteOrder == '0';
+            signal.isSigned    = sign == '-';
+
+            // The unit is the first quoted string
+            size_t unitBegin = layout.find('"');
+            size_t unitEnd   = unitBegin == std::string::npos ? unitBegin : layout.find('"', unitBegin + 1);
+
+            if(unitEnd != std::string::npos){
+                signal.unit = layout.substr(unitBegin + 1, unitEnd - unitBegin - 1);
+            }
+
+            messages.back().signals.push_back(std::move(signal));
+        }
+    }
+
+    size_t added = 0;
+
+    for(auto& message : messages){
+        if(!message.name.empty() && addMessage(std::move(message)) != nullptr){
+            added++;
+        }
+    }
+
+    Log::info("Signal database loaded ", added, " messages");
+
+    return added > 0;
+}
+
+/**
+ * Compiles a message definition and adds it to the database. Signals
+ * that do not fit into a CANFD payload are removed with an error.
+ *
+ * @param definition - The message definition.
+ * @return The compiled layout or nullptr if the CAN ID or name already exists.
+ */
+const MessageLayout* SignalDatabase::addMessage(MessageDefinition definition){
+
+    // Error handling / Sanity check
+    if(layoutsByID.count(definition.canID) != 0 || layoutsByName.count(definition.name) != 0){
+        Log::error("Error message ", definition.name, " already exists in the signal database");
+        return nullptr;
+    }
+
+    auto invalid = [&definition](const SignalDefinition& signal){
+
+        uint32_t firstBit = signal.startBit;
+
+        if(signal.isBigEndian){
+            firstBit = (signal.startBit / 8) * 8 + (7 - signal.startBit % 8);
+        }
+
+        if(signal.length == 0 || signal.length > 64 || firstBit + signal.length > CANFD_MAX_DLEN * 8 || signal.factor == 0){
+            Log::error("Error signal ", signal.name, " of message ", definition.name, " has an invalid layout");
+            return true;
+        }
+
+        return false;
+    };
+
+    auto& signals = definition.signals;
+    signals.erase(std::remove_if(signals.begin(), signals.end(), invalid), signals.end());
+
+    layouts.push_back(std::make_unique<MessageLayout>(std::move(definition)));
+
+    const MessageLayout* layout = layouts.back().get();
+    layoutsByID[layout->canID()]   = layout;
+    layoutsByName[layout->name()] = layout;
+
+    return layout;
+}
+
+/**
+ * Looks up the layout of a CAN ID. Keep the pointer, it stays valid as long as the database.
+ *
+ * @param canID - The CAN ID, with CAN_EFF_FLAG for extended CAN IDs.
+ * @return The layout or nullptr.
+ */
+const MessageLayout* SignalDatabase::find(canid_t canID) const{
+
+    auto entry = layoutsByID.find(canID);
+    return entry == layoutsByID.end() ? nullptr : entry->second;
+}
+
+/**
+ * Looks up the layout of a message name. Keep the pointer, it stays valid as long as the database.
+ *
+ * @param messageName - The name of the message.
+ * @return The layout or nullptr.
+ */
+const MessageLayout* SignalDatabase::find(const std::string& messageName) const{
+
+    auto entry = layoutsByName.find(messageName);
+    return entry == layoutsByName.end() ? nullptr : entry->second;
+}
+
+/**
+ * Returns the number of messages in the database.
+ *
+ * @return The number of messages.
+ */
+size_t SignalDatabase::size() const{
+    return layouts.size();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
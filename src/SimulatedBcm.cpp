@@ -0,0 +1,943 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      SimulatedBcm.cpp
+ \brief     In-process simulation of the broadcast manager of one interface.
+            The simulation runs the cyclic TX jobs, the RX filters with their
+            timeouts and throttling and a loopback bus on a scaled clock.
+            Latency, lost frames, ENOBUFS and bus-off are injected with a
+            seeded random generator, so a run can be reproduced.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "SimulatedBcm.h"
+#include "Log.h"
+#include <poll.h>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <algorithm>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+// The largest number of frames of a BCM message, like MAX_NFRAMES of the kernel
+#define SIMULATED_BCM_MAX_NFRAMES 256
+
+// Real time the simulation waits for a connector that does not read its socket
+#define SIMULATED_BCM_BLOCKED_POLL_MS 1
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates a simulated BCM. The simulation starts when a connector opens it.
+ *
+ * @param options - The configuration of the simulation.
+ */
+SimulatedBcm::SimulatedBcm(const SimulatedBcmOptions& options) :
+    simulationOptions(options), start(std::chrono::steady_clock::now()), generator(options.seed){
+
+    // Error handling / Sanity check
+    if(simulationOptions.timeScale <= 0){
+        Log::warning("The time scale of the simulated BCM must be positive, using 1.0");
+        simulationOptions.timeScale = 1.0;
+    }
+
+}
+
+SimulatedBcm::~SimulatedBcm(){
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    wakeup.notify_all();
+
+    if(simulationThread.joinable()){
+        simulationThread.join();
+    }
+
+    if(simulationSocket >= 0){
+        ::close(simulationSocket);
+    }
+
+}
+
+/**
+ * Opens the socket of the connector. The simulation keeps the other end of a
+ * socket pair and sends the notifications on it. A simulated BCM serves one connector.
+ *
+ * @param socket         - The socket that is opened.
+ * @param interfaceName  - The name of the simulated interface.
+ * @param interfaceIndex - Not changed, the simulated interface has no kernel index.
+ * @return True if the socket pair was created.
+ */
+bool SimulatedBcm::open(boost::asio::generic::datagram_protocol::socket& socket, const std::string& interfaceName, int& interfaceIndex){
+
+    (void)interfaceIndex;
+
+    // Error handling / Sanity check
+    if(opened){
+        Log::error("The simulated BCM is already opened by another connector");
+        return false;
+    }
+
+    int descriptors[2];
+
+    if(::socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, descriptors) < 0){
+        Log::error("Could not create the socket pair of the simulated BCM: ", std::strerror(errno));
+        return false;
+    }
+
+    // Note: The kernel may cap the buffers, the simulation then holds back the notifications
+    int bufferSize = SIMULATED_BCM_SOCKET_BUFFER;
+    ::setsockopt(descriptors[1], SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+    ::setsockopt(descriptors[0], SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+    boost::system::error_code errorCode;
+    socket.assign(boost::asio::generic::datagram_protocol(AF_UNIX, 0), descriptors[0], errorCode);
+
+    if(errorCode){
+        Log::error("Could not assign the socket of the simulated BCM: ", errorCode.message());
+        ::close(descriptors[0]);
+        ::close(descriptors[1]);
+        return false;
+    }
+
+    simulationSocket = descriptors[1];
+    opened = true;
+    simulationThread = std::thread(&SimulatedBcm::run, this);
+
+    Log::info("Simulated BCM opened for interface ", interfaceName);
+
+    return true;
+}
+
+/**
+ * Processes BCM messages like the kernel does in sendmmsg. A rejected message
+ * stops the call, its errno is reported if it is the first message.
+ *
+ * @param fileDescriptor - The native handle of the socket of the connector.
+ * @param headers        - The message headers.
+ * @param count          - The number of messages.
+ * @return The number of processed messages or -1 with errno set.
+ */
+int SimulatedBcm::send(int fileDescriptor, struct mmsghdr* headers, unsigned int count){
+
+    (void)fileDescriptor;
+
+    int error = 0;
+    unsigned int processed = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        int64_t time = simulatedNow();
+        std::vector<uint8_t> gathered;
+
+        for(; processed < count; processed++){
+
+            const struct msghdr& header = headers[processed].msg_hdr;
+            const uint8_t* data = nullptr;
+            size_t size = 0;
+
+            // Note: The messages of a batch have a single iovec
+            if(header.msg_iovlen == 1){
+                data = static_cast<const uint8_t*>(header.msg_iov[0].iov_base);
+                size = header.msg_iov[0].iov_len;
+            }else{
+                gathered.clear();
+
+                for(size_t index = 0; index < header.msg_iovlen; index++){
+                    const uint8_t* base = static_cast<const uint8_t*>(header.msg_iov[index].iov_base);
+                    gathered.insert(gathered.end(), base, base + header.msg_iov[index].iov_len);
+                }
+
+                data = gathered.data();
+                size = gathered.size();
+            }
+
+            error = process(data, size, time);
+
+            if(error != 0){
+                counters.rejected++;
+                break;
+            }
+
+            counters.messages++;
+            headers[processed].msg_len = static_cast<unsigned int>(size);
+        }
+
+        flushDeliveries(time);
+    }
+
+    wakeup.notify_one();
+
+    if(processed == 0 && error != 0){
+        errno = error;
+        return -1;
+    }
+
+    return static_cast<int>(processed);
+}
+
+/**
+ * The simulated interface has no CAN_RAW socket, the one-shot frames go through the simulation.
+ *
+ * @return False.
+ */
+bool SimulatedBcm::supportsRawFastPath() const{
+    return false;
+}
+
+/**
+ * Puts a frame of another node on the simulated bus.
+ *
+ * @param frame   - The frame.
+ * @param isCANFD - Flag for a CANFD frame.
+ */
+void SimulatedBcm::inject(const struct canfd_frame& frame, bool isCANFD){
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        int64_t time = simulatedNow();
+
+        if(time < busOffUntil || roll(simulationOptions.dropRate)){
+            counters.framesDropped++;
+        }else{
+            receive(frame, isCANFD, time);
+        }
+
+        flushDeliveries(time);
+    }
+
+    wakeup.notify_one();
+}
+
+/**
+ * Drives the simulated controller bus-off. Frames are lost and TX_SEND
+ * messages are rejected with ENETDOWN until the recovery.
+ *
+ * @param duration - The simulated time until the recovery.
+ */
+void SimulatedBcm::setBusOff(std::chrono::microseconds duration){
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    busOffUntil = simulatedNow() + std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    counters.busOffs++;
+}
+
+/**
+ * Returns the simulated time since the creation of the simulation.
+ *
+ * @return The simulated time.
+ */
+std::chrono::nanoseconds SimulatedBcm::now() const{
+    return std::chrono::nanoseconds(simulatedNow());
+}
+
+/**
+ * Returns a snapshot of the counters of the simulation.
+ *
+ * @return The counters.
+ */
+SimulatedBcm::Statistics SimulatedBcm::statistics() const{
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Statistics snapshot = counters;
+    snapshot.txJobs = txJobs.size();
+    snapshot.rxJobs = rxJobs.size();
+
+    return snapshot;
+}
+
+/**
+ * Thread function of the simulation. Fires the due timers and delivers the
+ * due notifications, then sleeps until the next timer in scaled real time.
+ */
+void SimulatedBcm::run(){
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(!stopping){
+
+        int64_t time = simulatedNow();
+
+        while(!timers.empty() && timers.top().time <= time){
+
+            Timer timer = timers.top();
+            timers.pop();
+
+            // Skip the timers of deleted or restarted jobs
+            if(timer.kind == TimerKind::TxCycle){
+                auto job = txJobs.find(timer.key);
+
+                if(job != txJobs.end() && job->second.generation == timer.generation){
+                    txCycle(job->second, timer.key, timer.time);
+                }
+            }else{
+                auto job = rxJobs.find(timer.key);
+
+                if(job == rxJobs.end()){
+                    continue;
+                }
+
+                if(timer.kind == TimerKind::RxTimeout && job->second.timeoutGeneration == timer.generation){
+                    rxTimeout(job->second, timer.time);
+                }else if(timer.kind == TimerKind::RxThrottle && job->second.throttleGeneration == timer.generation){
+                    rxThrottle(job->second, timer.time);
+                }
+            }
+        }
+
+        flushDeliveries(time);
+
+        // The connector does not read its socket, wait until it is writable again
+        if(deliveryBlocked){
+            lock.unlock();
+
+            struct pollfd pollDescriptor = {simulationSocket, POLLOUT, 0};
+            ::poll(&pollDescriptor, 1, SIMULATED_BCM_BLOCKED_POLL_MS);
+
+            lock.lock();
+            continue;
+        }
+
+        int64_t next = INT64_MAX;
+
+        if(!timers.empty()){
+            next = timers.top().time;
+        }
+
+        if(!deliveries.empty()){
+            next = std::min(next, deliveries.front().time);
+        }
+
+        if(next == INT64_MAX){
+            wakeup.wait(lock);
+        }else{
+            auto realWait = static_cast<int64_t>(static_cast<double>(next - time) / simulationOptions.timeScale);
+            wakeup.wait_for(lock, std::chrono::nanoseconds(realWait + 1));
+        }
+    }
+
+}
+
+/**
+ * Returns the simulated time, the real time since the creation multiplied by the time scale.
+ *
+ * @return The simulated time in nanoseconds.
+ */
+int64_t SimulatedBcm::simulatedNow() const{
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    return static_cast<int64_t>(static_cast<double>(elapsed) * simulationOptions.timeScale);
+}
+
+/**
+ * Rolls a fault. A rate of zero does not draw from the generator.
+ *
+ * @param rate - The probability of the fault.
+ * @return True if the fault happens.
+ */
+bool SimulatedBcm::roll(double rate){
+    return rate > 0 && distribution(generator) < rate;
+}
+
+/**
+ * Processes a single BCM message.
+ *
+ * @param data - The message.
+ * @param size - The size of the message in bytes.
+ * @param time - The simulated time of the message.
+ * @return Zero or the errno of the rejected message.
+ */
+int SimulatedBcm::process(const uint8_t* data, size_t size, int64_t time){
+
+    // Error handling / Sanity check
+    if(data == nullptr || size < sizeof(struct bcm_msg_head)){
+        return EINVAL;
+    }
+
+    struct bcm_msg_head head;
+    std::memcpy(&head, data, sizeof(head));
+
+    bool isCANFD = (head.flags & CAN_FD_FRAME) != 0;
+    size_t frameSize = isCANFD ? sizeof(struct canfd_frame) : sizeof(struct can_frame);
+
+    if(head.nframes > SIMULATED_BCM_MAX_NFRAMES || size != sizeof(head) + head.nframes * frameSize){
+        return EINVAL;
+    }
+
+    // Note: CAN frames are widened, both layouts share the header and the first 8 data bytes
+    std::vector<struct canfd_frame> frames(head.nframes);
+
+    for(uint32_t index = 0; index < head.nframes; index++){
+        std::memcpy(&frames[index], data + sizeof(head) + index * frameSize, frameSize);
+    }
+
+    uint64_t key = keyOf(head.can_id, isCANFD);
+
+    switch(head.opcode){
+
+        case TX_SETUP:
+            return txSetup(&head, frames.data(), isCANFD, time);
+
+        case TX_DELETE:
+            return txJobs.erase(key) > 0 ? 0 : EINVAL;
+
+        case TX_READ:{
+            auto job = txJobs.find(key);
+
+            if(job == txJobs.end()){
+                return EINVAL;
+            }
+
+            const TxJob& txJob = job->second;
+            notify(TX_STATUS, txJob.flags, txJob.count, txJob.ival1, txJob.ival2, txJob.canID,
+                   txJob.frames.data(), static_cast<uint32_t>(txJob.frames.size()), isCANFD, time);
+            return 0;
+        }
+
+        case TX_SEND:
+            if(head.nframes != 1){
+                return EINVAL;
+            }
+
+            if(time < busOffUntil){
+                return ENETDOWN;
+            }
+
+            if(roll(simulationOptions.enobufsRate)){
+                counters.enobufsInjected++;
+                return ENOBUFS;
+            }
+
+            transmit(frames[0], isCANFD, time);
+            return 0;
+
+        case RX_SETUP:
+            return rxSetup(&head, frames.data(), isCANFD, time);
+
+        case RX_DELETE:
+            return rxJobs.erase(key) > 0 ? 0 : EINVAL;
+
+        case RX_READ:{
+            auto job = rxJobs.find(key);
+
+            if(job == rxJobs.end()){
+                return EINVAL;
+            }
+
+            const RxJob& rxJob = job->second;
+            notify(RX_STATUS, rxJob.flags, 0, rxJob.ival1, rxJob.ival2, rxJob.canID,
+                   rxJob.masks.data(), static_cast<uint32_t>(rxJob.masks.size()), isCANFD, time);
+            return 0;
+        }
+
+        default:
+            return EINVAL;
+    }
+
+}
+
+/**
+ * Creates or updates a TX job like TX_SETUP of the kernel. STARTTIMER sends
+ * the first frame immediately and starts the cycle.
+ *
+ * @param head    - The bcm_msg_head of the message.
+ * @param frames  - The frames of the message.
+ * @param isCANFD - Flag for CANFD frames.
+ * @param time    - The simulated time of the message.
+ * @return Zero or the errno of the rejected message.
+ */
+int SimulatedBcm::txSetup(const bcm_msg_head* head, const struct canfd_frame* frames, bool isCANFD, int64_t time){
+
+    // Error handling / Sanity check
+    if(head->nframes < 1){
+        return EINVAL;
+    }
+
+    uint64_t key = keyOf(head->can_id, isCANFD);
+    auto [entry, created] = txJobs.try_emplace(key);
+    TxJob& job = entry->second;
+
+    job.canID   = head->can_id;
+    job.isCANFD = isCANFD;
+    job.flags   = head->flags;
+    job.frames.assign(frames, frames + head->nframes);
+
+    if(head->flags & TX_CP_CAN_ID){
+        for(struct canfd_frame& frame : job.frames){
+            frame.can_id = head->can_id;
+        }
+    }
+
+    if(created || (head->flags & TX_RESET_MULTI_IDX) || job.currentFrame >= job.frames.size()){
+        job.currentFrame = 0;
+    }
+
+    if(head->flags & SETTIMER){
+        job.count = head->count;
+        job.ival1 = toNanoseconds(head->ival1);
+        job.ival2 = toNanoseconds(head->ival2);
+
+        // Zero intervals stop the cycle
+        if(job.ival1 == 0 && job.ival2 == 0){
+            job.generation = nextGeneration++;
+        }
+    }
+
+    // Note: Like the kernel, starting the timer announces the first frame
+    if(head->flags & (TX_ANNOUNCE | STARTTIMER)){
+        transmit(job.frames[job.currentFrame], isCANFD, time);
+        job.currentFrame = (job.currentFrame + 1) % job.frames.size();
+
+        if(job.count > 0){
+            job.count--;
+        }
+    }
+
+    if(head->flags & STARTTIMER){
+        job.generation = nextGeneration++;
+        scheduleTx(job, key, time);
+    }
+
+    return 0;
+}
+
+/**
+ * Creates or updates a RX filter like RX_SETUP of the kernel. Without frames
+ * the filter matches the CAN ID only, one frame is a content mask and more
+ * frames are multiplex masks with the multiplexer mask in the first frame.
+ * An update with more frames than the installed filter is rejected with E2BIG.
+ *
+ * @param head    - The bcm_msg_head of the message.
+ * @param frames  - The frames of the message.
+ * @param isCANFD - Flag for CANFD frames.
+ * @param time    - The simulated time of the message.
+ * @return Zero or the errno of the rejected message.
+ */
+int SimulatedBcm::rxSetup(const bcm_msg_head* head, const struct canfd_frame* frames, bool isCANFD, int64_t time){
+
+    uint64_t key = keyOf(head->can_id, isCANFD);
+    auto installed = rxJobs.find(key);
+
+    // Like the kernel, an installed filter cannot grow, it must be deleted first
+    if(installed != rxJobs.end() && head->nframes > installed->second.masks.size()){
+        return E2BIG;
+    }
+
+    RxJob& job = rxJobs[key];
+
+    job.canID   = head->can_id;
+    job.isCANFD = isCANFD;
+    job.flags   = head->flags;
+
+    if(head->nframes == 0 || (head->flags & RX_FILTER_ID)){
+        job.flags |= RX_FILTER_ID;
+    }
+
+    // New masks forget the received content
+    if(head->nframes > 0){
+        job.masks.assign(frames, frames + head->nframes);
+        job.lastFrames.assign(head->nframes, canfd_frame{});
+        job.received.assign(head->nframes, false);
+    }
+
+    if(head->flags & SETTIMER){
+        job.ival1 = toNanoseconds(head->ival1);
+        job.ival2 = toNanoseconds(head->ival2);
+
+        if(job.ival1 == 0){
+            job.timeoutGeneration = nextGeneration++;
+        }
+
+        if(job.ival2 == 0){
+            job.throttleGeneration = nextGeneration++;
+            job.throttled = false;
+            job.pending   = false;
+        }
+    }
+
+    if((head->flags & STARTTIMER) && job.ival1 > 0){
+        job.timeoutGeneration = nextGeneration++;
+        timers.push({time + job.ival1, key, job.timeoutGeneration, TimerKind::RxTimeout});
+    }
+
+    return 0;
+}
+
+/**
+ * Fires the cycle timer of a TX job like the timer handler of the kernel.
+ *
+ * @param job  - The TX job.
+ * @param key  - The key of the job.
+ * @param time - The simulated time of the timer.
+ */
+void SimulatedBcm::txCycle(TxJob& job, uint64_t key, int64_t time){
+
+    bool send = false;
+
+    if(job.ival1 > 0 && job.count > 0){
+        job.count--;
+
+        if(job.count == 0 && (job.flags & TX_COUNTEVT)){
+            notify(TX_EXPIRED, job.flags, 0, job.ival1, job.ival2, job.canID, nullptr, 0, job.isCANFD, time);
+        }
+
+        send = true;
+    }else if(job.ival2 > 0){
+        send = true;
+    }
+
+    if(send){
+        transmit(job.frames[job.currentFrame], job.isCANFD, time);
+        job.currentFrame = (job.currentFrame + 1) % job.frames.size();
+    }
+
+    scheduleTx(job, key, time);
+}
+
+/**
+ * Arms the next cycle of a TX job. Like the hrtimer of the kernel a cycle
+ * that is already over is skipped instead of sent late.
+ *
+ * @param job  - The TX job.
+ * @param key  - The key of the job.
+ * @param time - The simulated time of the last cycle.
+ */
+void SimulatedBcm::scheduleTx(TxJob& job, uint64_t key, int64_t time){
+
+    int64_t interval = (job.ival1 > 0 && job.count > 0) ? job.ival1 : job.ival2;
+
+    if(interval <= 0){
+        return;
+    }
+
+    int64_t current = simulatedNow();
+    int64_t next = time + interval;
+
+    if(next <= current){
+        next = current + interval - (current - time) % interval;
+    }
+
+    timers.push({next, key, job.generation, TimerKind::TxCycle});
+}
+
+/**
+ * Fires the timeout of a RX filter.
+ *
+ * @param job  - The RX filter.
+ * @param time - The simulated time of the timer.
+ */
+void SimulatedBcm::rxTimeout(RxJob& job, int64_t time){
+
+    notify(RX_TIMEOUT, job.flags, 0, job.ival1, job.ival2, job.canID, nullptr, 0, job.isCANFD, time);
+
+    // The next frame is announced as a change
+    if(job.flags & RX_ANNOUNCE_RESUME){
+        std::fill(job.received.begin(), job.received.end(), false);
+    }
+
+}
+
+/**
+ * Ends the throttle interval of a RX filter and sends the last held back change.
+ *
+ * @param job  - The RX filter.
+ * @param time - The simulated time of the timer.
+ */
+void SimulatedBcm::rxThrottle(RxJob& job, int64_t time){
+
+    job.throttled = false;
+
+    if(job.pending){
+        job.pending = false;
+        job.lastNotification = time;
+        notify(RX_CHANGED, job.flags, 0, job.ival1, job.ival2, job.canID, &job.pendingFrame, 1, job.isCANFD, time);
+    }
+
+}
+
+/**
+ * Puts a frame of a TX job on the simulated bus.
+ *
+ * @param frame   - The frame.
+ * @param isCANFD - Flag for a CANFD frame.
+ * @param time    - The simulated time of the transmission.
+ * @return False if the controller is bus-off.
+ */
+bool SimulatedBcm::transmit(const struct canfd_frame& frame, bool isCANFD, int64_t time){
+
+    if(time < busOffUntil){
+        counters.framesDropped++;
+        return false;
+    }
+
+    counters.framesSent++;
+
+    if(roll(simulationOptions.busOffRate)){
+        busOffUntil = time + std::chrono::duration_cast<std::chrono::nanoseconds>(simulationOptions.busOffDuration).count();
+        counters.busOffs++;
+    }
+
+    if(roll(simulationOptions.dropRate)){
+        counters.framesDropped++;
+        return true;
+    }
+
+    if(simulationOptions.loopback){
+        receive(frame, isCANFD, time);
+    }
+
+    return true;
+}
+
+/**
+ * Hands a frame of the bus to the RX filter of its CAN ID.
+ *
+ * @param frame   - The frame.
+ * @param isCANFD - Flag for a CANFD frame.
+ * @param time    - The simulated time of the reception.
+ */
+void SimulatedBcm::receive(const struct canfd_frame& frame, bool isCANFD, int64_t time){
+
+    uint64_t key = keyOf(frame.can_id, isCANFD);
+    auto entry = rxJobs.find(key);
+
+    if(entry == rxJobs.end()){
+        return;
+    }
+
+    RxJob& job = entry->second;
+
+    // Every frame restarts the timeout
+    if(job.ival1 > 0 && !(job.flags & RX_NO_AUTOTIMER)){
+        job.timeoutGeneration = nextGeneration++;
+        timers.push({time + job.ival1, key, job.timeoutGeneration, TimerKind::RxTimeout});
+    }
+
+    if(job.flags & RX_FILTER_ID){
+        notifyChanged(job, key, frame, time);
+        return;
+    }
+
+    size_t length = isCANFD ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+    size_t index = 0;
+
+    // Find the multiplex mask of the frame
+    if(job.masks.size() > 1){
+
+        const uint8_t* multiplexer = job.masks[0].data;
+
+        for(index = 1; index < job.masks.size(); index++){
+
+            bool matches = true;
+
+            for(size_t byte = 0; byte < length && matches; byte++){
+                matches = (frame.data[byte] & multiplexer[byte]) == (job.masks[index].data[byte] & multiplexer[byte]);
+            }
+
+            if(matches){
+                break;
+            }
+        }
+
+        if(index == job.masks.size()){
+            return;
+        }
+    }
+
+    const struct canfd_frame& mask = job.masks[index];
+    struct canfd_frame& last = job.lastFrames[index];
+    bool changed = !job.received[index] || ((job.flags & RX_CHECK_DLC) && frame.len != last.len);
+
+    for(size_t byte = 0; byte < length && !changed; byte++){
+        changed = (frame.data[byte] & mask.data[byte]) != (last.data[byte] & mask.data[byte]);
+    }
+
+    last = frame;
+    job.received[index] = true;
+
+    if(changed){
+        notifyChanged(job, key, frame, time);
+    }
+
+}
+
+/**
+ * Sends a RX_CHANGED notification unless the filter is throttled. A throttled
+ * filter holds back the last change until its throttle interval is over.
+ *
+ * @param job   - The RX filter.
+ * @param key   - The key of the filter.
+ * @param frame - The changed frame.
+ * @param time  - The simulated time of the change.
+ */
+void SimulatedBcm::notifyChanged(RxJob& job, uint64_t key, const struct canfd_frame& frame, int64_t time){
+
+    if(job.ival2 > 0 && job.lastNotification != INT64_MIN && time < job.lastNotification + job.ival2){
+
+        job.pending = true;
+        job.pendingFrame = frame;
+
+        if(!job.throttled){
+            job.throttled = true;
+            job.throttleGeneration = nextGeneration++;
+            timers.push({job.lastNotification + job.ival2, key, job.throttleGeneration, TimerKind::RxThrottle});
+        }
+
+        return;
+    }
+
+    job.lastNotification = time;
+    notify(RX_CHANGED, job.flags, 0, job.ival1, job.ival2, job.canID, &frame, 1, job.isCANFD, time);
+}
+
+/**
+ * Builds a notification and queues it for its delivery time. The latency
+ * keeps the order of the notifications like a real socket.
+ *
+ * @param opcode  - The opcode of the notification.
+ * @param flags   - The flags of the job.
+ * @param count   - The count of the job.
+ * @param ival1   - The first interval of the job in nanoseconds.
+ * @param ival2   - The second interval of the job in nanoseconds.
+ * @param canID   - The CAN ID of the job.
+ * @param frames  - The frames of the notification.
+ * @param nframes - The number of frames.
+ * @param isCANFD - Flag for CANFD frames.
+ * @param time    - The simulated time of the notification.
+ */
+void SimulatedBcm::notify(uint32_t opcode, uint32_t flags, uint32_t count, int64_t ival1, int64_t ival2, canid_t canID,
+                          const struct canfd_frame* frames, uint32_t nframes, bool isCANFD, int64_t time){
+
+    if(deliveries.size() >= SIMULATED_BCM_DELIVERY_LIMIT){
+        counters.notificationsLost++;
+        return;
+    }
+
+    size_t frameSize = isCANFD ? sizeof(struct canfd_frame) : sizeof(struct can_frame);
+
+    struct bcm_msg_head head = {0};
+    head.opcode  = opcode;
+    head.flags   = isCANFD ? (flags | CAN_FD_FRAME) : (flags & ~CAN_FD_FRAME);
+    head.count   = count;
+    head.ival1   = toTimeval(ival1);
+    head.ival2   = toTimeval(ival2);
+    head.can_id  = canID;
+    head.nframes = nframes;
+
+    Delivery delivery;
+    delivery.datagram.resize(sizeof(head) + nframes * frameSize);
+    std::memcpy(delivery.datagram.data(), &head, sizeof(head));
+
+    for(uint32_t index = 0; index < nframes; index++){
+        std::memcpy(delivery.datagram.data() + sizeof(head) + index * frameSize, &frames[index], frameSize);
+    }
+
+    int64_t delay = std::chrono::duration_cast<std::chrono::nanoseconds>(simulationOptions.latency).count();
+
+    if(simulationOptions.latencyJitter.count() > 0){
+        auto jitter = std::chrono::duration_cast<std::chrono::nanoseconds>(simulationOptions.latencyJitter).count();
+        delay += static_cast<int64_t>(distribution(generator) * static_cast<double>(jitter));
+    }
+
+    delivery.time    = std::max(time + delay, lastDeliveryTime);
+    lastDeliveryTime = delivery.time;
+
+    deliveries.push_back(std::move(delivery));
+}
+
+/**
+ * Sends the due notifications to the connector. Stops if its socket is full.
+ *
+ * @param time - The simulated time.
+ */
+void SimulatedBcm::flushDeliveries(int64_t time){
+
+    deliveryBlocked = false;
+
+    while(!deliveries.empty() && deliveries.front().time <= time){
+
+        const std::vector<uint8_t>& datagram = deliveries.front().datagram;
+        ssize_t result = ::send(simulationSocket, datagram.data(), datagram.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if(result < 0){
+
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                deliveryBlocked = true;
+                return;
+            }
+
+            if(errno == EINTR){
+                continue;
+            }
+
+            // The connector closed its socket
+            counters.notificationsLost++;
+        }else{
+            counters.notifications++;
+        }
+
+        deliveries.pop_front();
+    }
+
+}
+
+/**
+ * Calculates the key of a job.
+ *
+ * @param canID   - The CAN ID of the job.
+ * @param isCANFD - Flag for a CANFD job.
+ * @return The key.
+ */
+uint64_t SimulatedBcm::keyOf(canid_t canID, bool isCANFD){
+    return static_cast<uint64_t>(canID) | (static_cast<uint64_t>(isCANFD) << 32);
+}
+
+/**
+ * Converts an interval of a bcm_msg_head to nanoseconds.
+ *
+ * @param interval - The interval.
+ * @return The interval in nanoseconds.
+ */
+int64_t SimulatedBcm::toNanoseconds(const struct bcm_timeval& interval){
+    return static_cast<int64_t>(interval.tv_sec) * 1000000000 + static_cast<int64_t>(interval.tv_usec) * 1000;
+}
+
+/**
+ * Converts nanoseconds to an interval of a bcm_msg_head.
+ *
+ * @param interval - The interval in nanoseconds.
+ * @return The interval.
+ */
+struct bcm_timeval SimulatedBcm::toTimeval(int64_t interval){
+
+    struct bcm_timeval timeval;
+    timeval.tv_sec  = interval / 1000000000;
+    timeval.tv_usec = (interval % 1000000000) / 1000;
+
+    return timeval;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
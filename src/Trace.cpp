@@ -0,0 +1,286 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      Trace.cpp
+ \brief     Tracepoints of the TX and RX paths with per-thread lock-free trace
+            buffers that are exported in the Chrome trace format, which is
+            also read by Perfetto. The tracepoints compile to nothing unless
+            CAN_BCM_TRACE is set and cost a relaxed load while tracing is
+            stopped. With <sys/sdt.h> they are also USDT probes for perf
+            and other uprobe based tracers.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "Trace.h"
+#include "Log.h"
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <pthread.h>
+
+static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0, "TRACE_BUFFER_EVENTS must be a power of two");
+
+
+/*******************************************************************************
+ * VARIABLES
+ ******************************************************************************/
+
+std::atomic<bool> Trace::enabled{false};
+
+// The buffers outlive their threads, so the events of finished threads are exported too
+static std::mutex traceBuffersMutex;
+static std::vector<std::shared_ptr<TraceBuffer>> traceBuffers;
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates the trace buffer of a thread.
+ *
+ * @param threadID   - The thread id in the exported trace.
+ * @param threadName - The thread name in the exported trace.
+ */
+TraceBuffer::TraceBuffer(uint32_t threadID, std::string threadName) : tid(threadID), name(std::move(threadName)),
+                                                                      slots(std::make_unique<Slot[]>(TRACE_BUFFER_EVENTS)){}
+
+/**
+ * Records an event and overwrites the oldest one if the buffer is full.
+ *
+ * Note: Only called by the thread that owns the buffer.
+ *
+ * @param event - The event.
+ */
+void TraceBuffer::record(const TraceEvent& event){
+
+    uint64_t index = head.load(std::memory_order_relaxed);
+    Slot& slot     = slots[index & (TRACE_BUFFER_EVENTS - 1)];
+
+    // Claim the slot first, so a concurrent snapshot discards the event it overwrites
+    claimed.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.header.store((static_cast<uint64_t>(event.argument) << 8) | static_cast<uint8_t>(event.phase), std::memory_order_relaxed);
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.id.store(event.id, std::memory_order_relaxed);
+    slot.timestamp.store(event.timestamp, std::memory_order_relaxed);
+    slot.duration.store(event.duration, std::memory_order_relaxed);
+
+    head.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * Copies the recorded events that were not overwritten.
+ *
+ * @param events - The events are appended to this vector.
+ */
+void TraceBuffer::snapshot(std::vector<TraceEvent>& events) const{
+
+    uint64_t last  = head.load(std::memory_order_acquire);
+    uint64_t first = std::max(tail.load(std::memory_order_relaxed), last > TRACE_BUFFER_EVENTS ? last - TRACE_BUFFER_EVENTS : 0);
+    size_t offset  = events.size();
+
+    for(uint64_t index = first; index < last; index++){
+
+        const Slot& slot = slots[index & (TRACE_BUFFER_EVENTS - 1)];
+        uint64_t header  = slot.header.load(std::memory_order_relaxed);
+
+        TraceEvent event;
+        event.phase     = static_cast<TracePhase>(header & 0xFF);
+        event.argument  = static_cast<uint32_t>(header >> 8);
+        event.name      = slot.name.load(std::memory_order_relaxed);
+        event.id        = slot.id.load(std::memory_order_relaxed);
+        event.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+        event.duration  = slot.duration.load(std::memory_order_relaxed);
+
+        events.push_back(event);
+    }
+
+    // Discard the events the owning thread started to overwrite meanwhile
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t overwritten = claimed.load(std::memory_order_relaxed);
+
+    if(overwritten > first + TRACE_BUFFER_EVENTS){
+        size_t stale = std::min<uint64_t>(overwritten - TRACE_BUFFER_EVENTS - first, last - first);
+        events.erase(events.begin() + offset, events.begin() + offset + stale);
+    }
+
+}
+
+/**
+ * Discards the recorded events.
+ */
+void TraceBuffer::clear(){
+    tail.store(head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+/**
+ * Returns the thread id of the buffer in the exported trace.
+ *
+ * @return The thread id.
+ */
+uint32_t TraceBuffer::threadID() const{
+    return tid;
+}
+
+/**
+ * Returns the name of the thread of the buffer.
+ *
+ * @return The thread name.
+ */
+const std::string& TraceBuffer::threadName() const{
+    return name;
+}
+
+/**
+ * Starts recording the tracepoints.
+ */
+void Trace::start(){
+    enabled.store(true, std::memory_order_relaxed);
+    Log::info("Trace started");
+}
+
+/**
+ * Stops recording the tracepoints. The recorded events are kept for the export.
+ */
+void Trace::stop(){
+    enabled.store(false, std::memory_order_relaxed);
+    Log::info("Trace stopped");
+}
+
+/**
+ * Discards the recorded events of all threads.
+ */
+void Trace::clear(){
+
+    std::lock_guard<std::mutex> lock(traceBuffersMutex);
+
+    for(const std::shared_ptr<TraceBuffer>& buffer : traceBuffers){
+        buffer->clear();
+    }
+
+}
+
+/**
+ * Records an event into the trace buffer of the calling thread.
+ *
+ * @param phase     - The phase of the event.
+ * @param name      - The name of the event, must be a string literal.
+ * @param id        - The id of the span of an async event.
+ * @param argument  - The CAN ID of an async event or the count of a complete event.
+ * @param timestamp - The time of the event in Trace::now() nanoseconds.
+ * @param duration  - The duration of a complete event in nanoseconds.
+ */
+void Trace::record(TracePhase phase, const char* name, uint64_t id, uint32_t argument, int64_t timestamp, int64_t duration){
+    local().record(TraceEvent{phase, name, id, argument, timestamp, duration});
+}
+
+/**
+ * Returns the trace buffer of the calling thread and registers it on the first use.
+ *
+ * @return The trace buffer.
+ */
+TraceBuffer& Trace::local(){
+
+    thread_local std::shared_ptr<TraceBuffer> buffer;
+
+    if(buffer == nullptr){
+
+        char threadName[16] = {};
+        pthread_getname_np(pthread_self(), threadName, sizeof(threadName));
+
+        std::lock_guard<std::mutex> lock(traceBuffersMutex);
+        buffer = std::make_shared<TraceBuffer>(static_cast<uint32_t>(traceBuffers.size() + 1), threadName);
+        traceBuffers.push_back(buffer);
+    }
+
+    return *buffer;
+}
+
+/**
+ * Exports the recorded events of all threads in the Chrome trace format.
+ * The trace can be opened with chrome://tracing or ui.perfetto.dev.
+ *
+ * @return The trace as JSON document.
+ */
+std::string Trace::chromeTrace(){
+
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+
+    {
+        std::lock_guard<std::mutex> lock(traceBuffersMutex);
+        buffers = traceBuffers;
+    }
+
+    std::ostringstream output;
+    output << std::fixed << std::setprecision(3);
+    output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    bool first = true;
+    std::vector<TraceEvent> events;
+
+    for(const std::shared_ptr<TraceBuffer>& buffer : buffers){
+
+        output << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadID()
+               << ",\"args\":{\"name\":\"" << buffer->threadName() << "\"}}";
+        first = false;
+
+        events.clear();
+        buffer->snapshot(events);
+
+        for(const TraceEvent& event : events){
+
+            // Note: The Chrome trace format uses microseconds
+            output << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"can_bcm\",\"ph\":\"" << static_cast<char>(event.phase)
+                   << "\",\"pid\":1,\"tid\":" << buffer->threadID() << ",\"ts\":" << static_cast<double>(event.timestamp) / 1000.0;
+
+            if(event.phase == TracePhase::Complete){
+                output << ",\"dur\":" << static_cast<double>(event.duration) / 1000.0 << ",\"args\":{\"count\":" << event.argument << "}}";
+            }else{
+                output << ",\"id\":\"0x" << std::hex << event.id << "\",\"args\":{\"can_id\":\"0x" << event.argument << "\"}}" << std::dec;
+            }
+        }
+    }
+
+    output << "\n]}\n";
+
+    return output.str();
+}
+
+/**
+ * Writes the recorded events of all threads into a Chrome trace file.
+ *
+ * @param path - The path of the trace file. An existing file is truncated.
+ * @return False if the file could not be written.
+ */
+bool Trace::writeChromeTrace(const std::string& path){
+
+    std::ofstream file(path, std::ios::trunc);
+
+    if(!file){
+        Log::error("Error could not create trace file ", path);
+        return false;
+    }
+
+    file << chromeTrace();
+
+    if(!file){
+        Log::error("Error could not write trace file ", path);
+        return false;
+    }
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
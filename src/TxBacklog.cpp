@@ -0,0 +1,174 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      TxBacklog.cpp
+ \brief     Bounded backlog of the commands that were taken from the submission
+            queue while the socket is congested. One-shot frames are bounded
+            per CAN ID with an overflow policy, everything else waits.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "TxBacklog.h"
+#include <linux/can/bcm.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Sets the overflow policy of the one-shot frames of a CAN ID.
+ *
+ * @param canID   - The CAN ID of the frames.
+ * @param isCANFD - Flag for CANFD frames.
+ * @param policy  - The overflow policy.
+ * @param limit   - The number of frames of the CAN ID that may wait.
+ */
+void TxBacklog::setPolicy(canid_t canID, bool isCANFD, TxOverflowPolicy policy, size_t limit){
+
+    uint64_t key = static_cast<uint64_t>(canID) | (static_cast<uint64_t>(isCANFD) << 32);
+
+    if(policy == TxOverflowPolicy::Block){
+        limits.erase(key);
+        return;
+    }
+
+    limits[key] = Limit{policy, limit};
+}
+
+/**
+ * Appends a command to the backlog and applies the overflow policy of its CAN ID.
+ *
+ * @param command   - The command.
+ * @param displaced - Receives the rejected command for Dropped and Overwritten.
+ * @return What happened to the command.
+ */
+TxBacklog::Result TxBacklog::push(TxCommand&& command, TxCommand& displaced){
+
+    Result result = Result::Queued;
+    uint64_t key = 0;
+    auto limit = limits.end();
+
+    if(keyOf(command, key)){
+        limit = limits.find(key);
+    }
+
+    if(limit != limits.end()){
+
+        std::deque<uint64_t>& sequences = waiting[key];
+
+        if(sequences.size() >= limit->second.limit){
+
+            if(limit->second.policy == TxOverflowPolicy::Drop || sequences.empty()){
+                displaced = std::move(command);
+                return Result::Dropped;
+            }
+
+            // Overwrite the oldest waiting frame of the CAN ID
+            Entry& oldest = entries[sequences.front() - firstSequence];
+            sequences.pop_front();
+
+            displaced   = std::move(oldest.command);
+            oldest.live = false;
+            liveEntries--;
+            result = Result::Overwritten;
+        }
+
+        sequences.push_back(firstSequence + entries.size());
+    }
+
+    entries.push_back(Entry{std::move(command), key, limit != limits.end(), true});
+    liveEntries++;
+
+    return result;
+}
+
+/**
+ * Takes the oldest command of the backlog.
+ *
+ * @param command - Receives the command.
+ * @return False if the backlog is empty.
+ */
+bool TxBacklog::pop(TxCommand& command){
+
+    while(!entries.empty()){
+
+        Entry entry = std::move(entries.front());
+        entries.pop_front();
+        firstSequence++;
+
+        // Skip the entries that were overwritten
+        if(!entry.live){
+            continue;
+        }
+
+        if(entry.bounded){
+
+            auto sequences = waiting.find(entry.key);
+            sequences->second.pop_front();
+
+            if(sequences->second.empty()){
+                waiting.erase(sequences);
+            }
+        }
+
+        liveEntries--;
+        command = std::move(entry.command);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Returns the number of waiting commands.
+ *
+ * @return The number of commands.
+ */
+size_t TxBacklog::size() const{
+    return liveEntries;
+}
+
+/**
+ * Checks if no command waits.
+ *
+ * @return True if the backlog is empty.
+ */
+bool TxBacklog::empty() const{
+    return liveEntries == 0;
+}
+
+/**
+ * Returns the key of a one-shot frame. The CAN ID and the CANFD flag
+ * identify the frame, other commands have no key.
+ *
+ * @param command - The command.
+ * @param key     - Receives the key.
+ * @return False if the command is no TX_SEND of a single frame.
+ */
+bool TxBacklog::keyOf(const TxCommand& command, uint64_t& key){
+
+    if(command.batch != nullptr || !command.msg.buffer){
+        return false;
+    }
+
+    const bcm_msg_head* head = command.msg.buffer.head();
+
+    if(head->opcode != TX_SEND || head->nframes != 1){
+        return false;
+    }
+
+    key = static_cast<uint64_t>(head->can_id) | (static_cast<uint64_t>((head->flags & CAN_FD_FRAME) != 0) << 32);
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,152 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      TxJob.cpp
+ \brief     Handle of a cyclic transmission task. The job keeps a pre-built
+            TX_SETUP update message, the caller writes the signal bytes
+            straight into its frames and commits the dirty jobs.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "TxJob.h"
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Allocates the update message of the job once and fills out its bcm_msg_head.
+ *
+ * @param canID   - The CAN ID of the cyclic transmission task.
+ * @param nframes - The number of frames of the task.
+ * @param isCANFD - Flag for CANFD frames.
+ */
+TxJob::TxJob(canid_t canID, uint32_t nframes, bool isCANFD) :
+    message(new std::uint8_t[BcmMessageBuilder<canfd_frame>::messageSize(nframes)]()){
+
+    size = isCANFD ? BcmMessageBuilder<canfd_frame>::messageSize(nframes) : BcmMessageBuilder<can_frame>::messageSize(nframes);
+
+    // Note: Without SETTIMER and STARTTIMER the TX_SETUP only updates
+    // the frames of the running task and keeps its timers
+    auto head = reinterpret_cast<bcm_msg_head*>(message.get());
+    head->opcode  = TX_SETUP;
+    head->flags   = isCANFD ? BcmFrameTraits<canfd_frame>::flags : BcmFrameTraits<can_frame>::flags;
+    head->can_id  = canID;
+    head->nframes = nframes;
+}
+
+/**
+ * Returns the CAN ID of the task.
+ *
+ * @return The CAN ID in the bcm_msg_head.
+ */
+canid_t TxJob::canID() const{
+    return reinterpret_cast<const bcm_msg_head*>(message.get())->can_id;
+}
+
+/**
+ * Returns the number of frames of the task.
+ *
+ * @return The number of frames.
+ */
+uint32_t TxJob::frameCount() const{
+    return reinterpret_cast<const bcm_msg_head*>(message.get())->nframes;
+}
+
+/**
+ * Checks if the task sends CANFD frames.
+ *
+ * @return True for CANFD frames.
+ */
+bool TxJob::isCANFD() const{
+    return (reinterpret_cast<const bcm_msg_head*>(message.get())->flags & CAN_FD_FRAME) != 0;
+}
+
+/**
+ * Returns the data of a frame for direct writes and marks the job as dirty.
+ *
+ * @param frameIndex - The index of the frame in the sequence.
+ * @return Pointer to the data bytes of the frame.
+ */
+std::uint8_t* TxJob::data(uint32_t frameIndex){
+
+    markDirty();
+
+    // Note: can_frame and canfd_frame have their data at the same offset
+    return message.get() + sizeof(bcm_msg_head) + frameIndex * frameSize() + offsetof(struct canfd_frame, data);
+}
+
+/**
+ * Sets the data length of a frame and marks the job as dirty.
+ *
+ * @param frameIndex - The index of the frame in the sequence.
+ * @param length     - The new data length.
+ */
+void TxJob::setLength(uint32_t frameIndex, std::uint8_t length){
+
+    markDirty();
+    message[sizeof(bcm_msg_head) + frameIndex * frameSize() + offsetof(struct canfd_frame, len)] = length;
+}
+
+/**
+ * Marks the job as changed, the next commit sends its frames.
+ */
+void TxJob::markDirty(){
+    dirty.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * Checks if the job was changed since the last commit.
+ *
+ * @return True if the job is dirty.
+ */
+bool TxJob::isDirty() const{
+    return dirty.load(std::memory_order_relaxed);
+}
+
+/**
+ * Clears the dirty flag.
+ *
+ * @return True if the job was dirty.
+ */
+bool TxJob::takeDirty(){
+    return dirty.exchange(false, std::memory_order_relaxed);
+}
+
+/**
+ * Returns the update message of the job.
+ *
+ * @return Pointer to the bcm_msg_head followed by the frames.
+ */
+const std::uint8_t* TxJob::messageData() const{
+    return message.get();
+}
+
+/**
+ * Returns the size in bytes of the update message.
+ *
+ * @return The size of the message.
+ */
+size_t TxJob::messageSize() const{
+    return size;
+}
+
+/**
+ * Returns the size in bytes of a frame of the job.
+ *
+ * @return The size of a can_frame or canfd_frame.
+ */
+size_t TxJob::frameSize() const{
+    return isCANFD() ? sizeof(struct canfd_frame) : sizeof(struct can_frame);
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,516 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      TxScheduler.cpp
+ \brief     User-space TX scheduler for transmission patterns the BCM cannot
+            express, e.g. event-triggered bursts, jittered cycles and phase
+            aligned offsets. Deadlines are absolute CLOCK_MONOTONIC times of
+            a timerfd, purely cyclic patterns are handed off to the BCM.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "TxScheduler.h"
+#include "CANConnector.h"
+#include "Log.h"
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <functional>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates a scheduler for the frames of a connector. The scheduler must be destroyed
+ * before the connector.
+ *
+ * @param connector - The connector the frames are sent on.
+ */
+TxScheduler::TxScheduler(CANConnector& connector) : connector(connector), random(std::random_device()()){
+
+    timerDescriptor = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    eventDescriptor = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // Error handling / Sanity check
+    if(timerDescriptor < 0 || eventDescriptor < 0){
+        Log::error("Error could not create the descriptors of the TX scheduler: ", std::strerror(errno));
+    }
+
+}
+
+TxScheduler::~TxScheduler(){
+
+    stop();
+
+    if(timerDescriptor >= 0){
+        ::close(timerDescriptor);
+    }
+
+    if(eventDescriptor >= 0){
+        ::close(eventDescriptor);
+    }
+
+}
+
+/**
+ * Starts the scheduler thread. The cycles of all tasks are aligned to this point in time.
+ */
+void TxScheduler::start(){
+
+    // Error handling / Sanity check
+    if(timerDescriptor < 0 || eventDescriptor < 0 || running.exchange(true)){
+        return;
+    }
+
+    epoch = monotonicNow();
+    schedulerThread = std::thread(&TxScheduler::schedulerThreadFunction, this);
+}
+
+/**
+ * Stops the scheduler thread. Tasks that were handed off to the BCM keep running.
+ */
+void TxScheduler::stop(){
+
+    if(!running.exchange(false)){
+        return;
+    }
+
+    uint64_t wakeup = 1;
+
+    if(::write(eventDescriptor, &wakeup, sizeof(wakeup)) < 0){
+        Log::error("An error occurred on the write to the TX scheduler eventfd: ", std::strerror(errno));
+    }
+
+    if(schedulerThread.joinable()){
+        schedulerThread.join();
+    }
+
+}
+
+/**
+ * Checks if the scheduler thread is running.
+ *
+ * @return True if the scheduler is running.
+ */
+bool TxScheduler::isRunning() const{
+    return running.load();
+}
+
+/**
+ * Schedules a frame with a transmission pattern. Can be called from any thread.
+ *
+ * @param frame   - The frame that should be send.
+ * @param isCANFD - Flag for a CANFD frame.
+ * @param pattern - The transmission pattern.
+ * @return The identifier of the task or zero if the scheduler queue is full.
+ */
+TxScheduler::TaskId TxScheduler::schedule(const struct canfd_frame& frame, bool isCANFD, const TxPattern& pattern){
+
+    // Error handling / Sanity check
+    if(pattern.burstCount == 0 || pattern.period.count() < 0 || pattern.offset.count() < 0 || pattern.jitter.count() < 0){
+        Log::error("Error invalid TX pattern for CAN ID ", std::hex, frame.can_id);
+        return 0;
+    }
+
+    Command command;
+    command.type    = Command::Type::Schedule;
+    command.task    = nextTaskId.fetch_add(1, std::memory_order_relaxed);
+    command.frame   = frame;
+    command.isCANFD = isCANFD;
+    command.pattern = pattern;
+
+    TaskId task = command.task;
+
+    return post(std::move(command)) ? task : 0;
+}
+
+/**
+ * Sends a burst of the task immediately, in addition to its cycles.
+ *
+ * @param task - The identifier of the task.
+ * @return False if the scheduler queue is full.
+ */
+bool TxScheduler::trigger(TaskId task){
+
+    Command command;
+    command.type = Command::Type::Trigger;
+    command.task = task;
+
+    return post(std::move(command));
+}
+
+/**
+ * Replaces the frame of a task. The next frame of the task is sent with the new data.
+ *
+ * @param task  - The identifier of the task.
+ * @param frame - The frame with the updated data.
+ * @return False if the scheduler queue is full.
+ */
+bool TxScheduler::update(TaskId task, const struct canfd_frame& frame){
+
+    Command command;
+    command.type  = Command::Type::Update;
+    command.task  = task;
+    command.frame = frame;
+
+    return post(std::move(command));
+}
+
+/**
+ * Removes a task. A task that was handed off to the BCM is deleted with TX_DELETE.
+ *
+ * @param task - The identifier of the task.
+ * @return False if the scheduler queue is full.
+ */
+bool TxScheduler::cancel(TaskId task){
+
+    Command command;
+    command.type = Command::Type::Cancel;
+    command.task = task;
+
+    return post(std::move(command));
+}
+
+/**
+ * Returns the counters of the scheduler.
+ *
+ * @return The counters.
+ */
+TxScheduler::Statistics TxScheduler::statistics() const{
+
+    Statistics result;
+    result.sent        = sentFrames.load(std::memory_order_relaxed);
+    result.handedOff   = handedOffTasks.load(std::memory_order_relaxed);
+    result.ticks       = dueTicks.load(std::memory_order_relaxed);
+    result.maxLateness = maxLateness.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+/**
+ * Puts a command into the scheduler queue and wakes up the scheduler thread.
+ *
+ * @param command - The command.
+ * @return False if the scheduler queue is full.
+ */
+bool TxScheduler::post(Command&& command){
+
+    if(!commands.push(std::move(command))){
+        Log::error("Error the TX scheduler queue is full");
+        return false;
+    }
+
+    uint64_t wakeup = 1;
+
+    if(::write(eventDescriptor, &wakeup, sizeof(wakeup)) < 0){
+        Log::error("An error occurred on the write to the TX scheduler eventfd: ", std::strerror(errno));
+    }
+
+    return true;
+}
+
+/**
+ * Thread of the scheduler. Waits for the next deadline or a command.
+ */
+void TxScheduler::schedulerThreadFunction(){
+
+    struct pollfd descriptors[2] = {{timerDescriptor, POLLIN, 0}, {eventDescriptor, POLLIN, 0}};
+    uint64_t value;
+
+    while(running.load(std::memory_order_relaxed)){
+
+        processCommands();
+        processDeadlines(monotonicNow());
+        armTimer();
+
+        if(::poll(descriptors, 2, -1) < 0 && errno != EINTR){
+            Log::error("An error occurred on the poll of the TX scheduler: ", std::strerror(errno));
+            break;
+        }
+
+        // Reset the descriptors, the result does not matter
+        (void)!::read(timerDescriptor, &value, sizeof(value));
+        (void)!::read(eventDescriptor, &value, sizeof(value));
+    }
+
+}
+
+/**
+ * Takes all commands from the scheduler queue. Only called in the scheduler thread.
+ */
+void TxScheduler::processCommands(){
+
+    Command command;
+    int64_t now = monotonicNow();
+
+    while(commands.pop(command)){
+
+        if(command.type == Command::Type::Schedule){
+
+            Task& task = tasks[command.task];
+            task.frame   = command.frame;
+            task.isCANFD = command.isCANFD;
+            task.pattern = command.pattern;
+
+            if(task.pattern.period.count() > 0){
+
+                // First cycle of the grid of the task that is not in the past
+                int64_t period = task.pattern.period.count();
+                int64_t first  = epoch + task.pattern.offset.count() % period;
+
+                task.nominal = first + std::max<int64_t>(0, (now - first + period - 1) / period) * period;
+                startCycle(command.task, task);
+            }
+
+            continue;
+        }
+
+        auto entry = tasks.find(command.task);
+
+        if(entry == tasks.end()){
+            Log::warning("TX scheduler task ", command.task, " does not exist");
+            continue;
+        }
+
+        Task& task = entry->second;
+
+        switch(command.type){
+
+            case Command::Type::Trigger:
+
+                for(uint32_t index = 0; index < task.pattern.burstCount; index++){
+                    pushDeadline(command.task, task, now + index * task.pattern.burstGap.count(), false);
+                }
+                break;
+
+            case Command::Type::Update:
+
+                task.frame = command.frame;
+
+                if(task.handedOff){
+                    connector.txSetupUpdateSingleFrame(task.frame, task.isCANFD, false);
+                }
+                break;
+
+            case Command::Type::Cancel:
+
+                if(task.handedOff){
+                    connector.txDelete(task.frame.can_id, task.isCANFD);
+                }
+
+                tasks.erase(entry);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+}
+
+/**
+ * Sends every frame that is due. All frames of a wakeup are submitted as a
+ * single batch, so they leave with one sendmmsg call. Only called in the
+ * scheduler thread.
+ *
+ * @param now - The current CLOCK_MONOTONIC time in nanoseconds.
+ */
+void TxScheduler::processDeadlines(int64_t now){
+
+    std::unique_ptr<BcmBatch> batch;
+    auto later = std::greater<Deadline>();
+    bool first = true;
+
+    auto submit = [this, &batch](){
+        connector.submitBatch(std::move(batch), [](const BcmBatch& result){
+            if(result.failed() != 0){
+                Log::error("TX scheduler: ", result.failed(), " of ", result.size(), " messages failed");
+            }
+        });
+    };
+
+    while(!deadlines.empty() && deadlines.front().time <= now){
+
+        std::pop_heap(deadlines.begin(), deadlines.end(), later);
+        Deadline due = deadlines.back();
+        deadlines.pop_back();
+
+        auto entry = tasks.find(due.task);
+
+        // Skip the deadlines of removed or rescheduled tasks
+        if(entry == tasks.end() || (due.cycle && entry->second.generation != due.generation)){
+            continue;
+        }
+
+        Task& task = entry->second;
+
+        if(first){
+            int64_t lateness = now - due.time;
+            int64_t maximum  = maxLateness.load(std::memory_order_relaxed);
+
+            while(lateness > maximum && !maxLateness.compare_exchange_weak(maximum, lateness, std::memory_order_relaxed)){
+                // Retry with the updated maximum
+            }
+
+            dueTicks.fetch_add(1, std::memory_order_relaxed);
+            first = false;
+        }
+
+        if(batch != nullptr && batch->full()){
+            submit();
+        }
+
+        if(batch == nullptr){
+            batch = connector.acquireBatch();
+        }
+
+        if(due.cycle && isHandOff(task.pattern)){
+
+            // Note: STARTTIMER of the TX_SETUP sends the frame at once, so it is the frame of this
+            // cycle. The BCM sends the next frame one period later, so the phase is kept
+            int64_t period = task.pattern.period.count();
+
+            struct bcm_timeval ival2{};
+            ival2.tv_sec  = static_cast<long>(period / 1000000000);
+            ival2.tv_usec = static_cast<long>((period % 1000000000) / 1000);
+
+            if(connector.addTxSetup(*batch, task.frame, 0, {}, ival2, task.isCANFD)){
+                task.handedOff = true;
+                sentFrames.fetch_add(1, std::memory_order_relaxed);
+                handedOffTasks.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            // Keep sending the task ourselves, the next cycle tries the hand-off again
+            Log::error("Error could not hand off CAN ID ", std::hex, task.frame.can_id, " to the BCM");
+        }
+
+        if(connector.addTxSend(*batch, task.frame, task.isCANFD)){
+            sentFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if(!due.cycle){
+            continue;
+        }
+
+        if(--task.burstRemaining > 0){
+            pushDeadline(due.task, task, due.time + task.pattern.burstGap.count(), true);
+            continue;
+        }
+
+        task.cycles++;
+
+        if(task.pattern.repetitions == 0 || task.cycles < task.pattern.repetitions){
+            task.nominal += task.pattern.period.count();
+            startCycle(due.task, task);
+        }
+    }
+
+    if(batch != nullptr && !batch->empty()){
+        submit();
+    }
+
+}
+
+/**
+ * Puts a deadline of a task into the heap. Only called in the scheduler thread.
+ *
+ * @param id    - The identifier of the task.
+ * @param task  - The task.
+ * @param time  - The deadline in CLOCK_MONOTONIC nanoseconds.
+ * @param cycle - Flag for a frame of a cycle.
+ */
+void TxScheduler::pushDeadline(TaskId id, const Task& task, int64_t time, bool cycle){
+
+    deadlines.push_back({time, id, task.generation, cycle});
+    std::push_heap(deadlines.begin(), deadlines.end(), std::greater<Deadline>());
+}
+
+/**
+ * Starts the burst of the next cycle of a task at its nominal deadline.
+ *
+ * @param id   - The identifier of the task.
+ * @param task - The task.
+ */
+void TxScheduler::startCycle(TaskId id, Task& task){
+
+    task.burstRemaining = task.pattern.burstCount;
+    pushDeadline(id, task, jittered(task), true);
+}
+
+/**
+ * Applies the random jitter of a task to its nominal deadline.
+ *
+ * @param task - The task.
+ * @return The deadline of the cycle.
+ */
+int64_t TxScheduler::jittered(const Task& task){
+
+    int64_t jitter = task.pattern.jitter.count();
+
+    if(jitter == 0){
+        return task.nominal;
+    }
+
+    std::uniform_int_distribution<int64_t> deviation(-jitter, jitter);
+
+    return task.nominal + deviation(random);
+}
+
+/**
+ * Checks if a pattern is purely cyclic and can be sent by the BCM itself.
+ *
+ * @param pattern - The transmission pattern.
+ * @return True if the BCM can take over the task.
+ */
+bool TxScheduler::isHandOff(const TxPattern& pattern){
+    return pattern.period.count() > 0 && pattern.jitter.count() == 0 && pattern.burstCount == 1 && pattern.repetitions == 0;
+}
+
+/**
+ * Arms the timerfd with the earliest deadline or disarms it.
+ */
+void TxScheduler::armTimer(){
+
+    struct itimerspec timer{};
+
+    if(!deadlines.empty()){
+        timer.it_value.tv_sec  = deadlines.front().time / 1000000000;
+        timer.it_value.tv_nsec = deadlines.front().time % 1000000000;
+    }
+
+    if(::timerfd_settime(timerDescriptor, TFD_TIMER_ABSTIME, &timer, nullptr) < 0){
+        Log::error("An error occurred on the timerfd of the TX scheduler: ", std::strerror(errno));
+    }
+
+}
+
+/**
+ * Returns the current CLOCK_MONOTONIC time.
+ *
+ * @return The time in nanoseconds.
+ */
+int64_t TxScheduler::monotonicNow(){
+
+    struct timespec now{};
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
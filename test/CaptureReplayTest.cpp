@@ -0,0 +1,124 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      CaptureReplayTest.cpp
+ \brief     Tests of the replay of capture files on the simulated BCM.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "Test.h"
+#include "CANConnector.h"
+#include "CaptureReplay.h"
+#include "SimulatedBcm.h"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+// Records of the capture file, more than CAPTURE_REPLAY_RELEASE_SIZE bytes
+#define TEST_CAPTURE_RECORDS (CAPTURE_REPLAY_RELEASE_SIZE / sizeof(CaptureRecord) * 3 / 2)
+
+// Distance of the replayed frames, the records between them are empty
+#define TEST_CAPTURE_STRIDE 50000
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Writes a sparse capture file with a RX_CHANGED frame every TEST_CAPTURE_STRIDE records.
+ *
+ * @param path - The path of the capture file.
+ * @return The number of frames in the capture file or zero on an error.
+ */
+static size_t writeCapture(const std::string& path){
+
+    int fileDescriptor = ::open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+    if(fileDescriptor < 0){
+        return 0;
+    }
+
+    CaptureFileHeader header{};
+    std::memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version    = CAPTURE_VERSION;
+    header.recordSize = sizeof(CaptureRecord);
+
+    bool written = ::pwrite(fileDescriptor, &header, sizeof(header), 0) == sizeof(header) &&
+                   ::ftruncate(fileDescriptor, sizeof(header) + TEST_CAPTURE_RECORDS * sizeof(CaptureRecord)) == 0;
+    size_t frames = 0;
+
+    for(size_t index = 0; written && index < TEST_CAPTURE_RECORDS; index += TEST_CAPTURE_STRIDE){
+
+        CaptureRecord record{};
+        record.opcode       = RX_CHANGED;
+        record.canID        = 0x100;
+        record.direction    = CaptureDirection::Rx;
+        record.info         = CAPTURE_INFO_FRAME;
+        record.frame.can_id = 0x100;
+        record.frame.len    = 8;
+
+        off_t offset = static_cast<off_t>(sizeof(header) + index * sizeof(CaptureRecord));
+        written = ::pwrite(fileDescriptor, &record, sizeof(record), offset) == sizeof(record);
+        frames++;
+    }
+
+    ::close(fileDescriptor);
+
+    return written ? frames : 0;
+}
+
+/**
+ * A second replay of the same capture releases the mapping from the start
+ * again and sends the same frames.
+ */
+static void testReplayTwice(){
+
+    std::string path = "/tmp/CaptureReplayTest." + std::to_string(::getpid()) + ".bcmcap";
+    size_t frames = writeCapture(path);
+    CHECK(frames > 1);
+
+    auto simulation = std::make_shared<SimulatedBcm>();
+    CANConnector connector("sim0", simulation);
+
+    {
+        CaptureReplay replay(path);
+        CHECK(replay.isOpen());
+        CHECK(replay.size() == TEST_CAPTURE_RECORDS);
+
+        CaptureReplayOptions options;
+        options.speed = 0;
+
+        CHECK(replay.replay(connector, options) == frames);
+        CHECK(replay.replay(connector, options) == frames);
+        CHECK(replay.record(0).canID == 0x100);
+    }
+
+    CHECK(waitFor([&](){ return simulation->statistics().framesSent == 2 * frames; }));
+
+    ::unlink(path.c_str());
+}
+
+int main(){
+
+    Log::setLevel(LogLevel::Warning);
+
+    testReplayTwice();
+
+    return testResult();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,84 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      ConnectorConfigTest.cpp
+ \brief     Tests of the parser of the configuration file.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "Test.h"
+#include "ConnectorConfig.h"
+#include "Log.h"
+#include <sstream>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Parses a configuration and returns the TX jobs of its only interface.
+ *
+ * @param text - The configuration.
+ * @return The number of TX jobs that were not skipped.
+ */
+static size_t parsedTxJobs(const std::string& text){
+
+    ConnectorConfig config;
+    std::istringstream input("interface can0\n" + text);
+
+    if(!config.parse(input) || config.find("can0") == nullptr){
+        return 0;
+    }
+
+    return config.find("can0")->txSchedules.size();
+}
+
+/**
+ * Counts out of range are skipped like every other invalid line.
+ */
+static void testCountRange(){
+    CHECK(parsedTxJobs("tx 0x200 count=4294967295 ival1=1ms period=10ms\n") == 1);
+    CHECK(parsedTxJobs("tx 0x200 count=4294967296 ival1=1ms period=10ms\n") == 0);
+    CHECK(parsedTxJobs("tx 0x200 count=99999999999999999999999 ival1=1ms period=10ms\n") == 0);
+    CHECK(parsedTxJobs("tx 0x200 count=-1 ival1=1ms period=10ms\n") == 0);
+}
+
+/**
+ * Durations that do not fit into the microseconds are skipped.
+ */
+static void testDurationRange(){
+    CHECK(parsedTxJobs("tx 0x200 period=10ms\n") == 1);
+    CHECK(parsedTxJobs("tx 0x200 period=infs\n") == 0);
+    CHECK(parsedTxJobs("tx 0x200 period=nanms\n") == 0);
+    CHECK(parsedTxJobs("tx 0x200 period=1e30s\n") == 0);
+}
+
+/**
+ * Payloads with bytes outside of ASCII are no hexadecimal payloads.
+ */
+static void testPayload(){
+    CHECK(parsedTxJobs("tx 0x200 period=10ms data=A1B2\n") == 1);
+    CHECK(parsedTxJobs("tx 0x200 period=10ms data=A1\xE4\xB2\n") == 0);
+}
+
+int main(){
+
+    Log::setLevel(LogLevel::Error);
+
+    testCountRange();
+    testDurationRange();
+    testPayload();
+
+    return testResult();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,134 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      LogTest.cpp
+ \brief     Tests of the asynchronous sink of the logger.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "Test.h"
+#include "Log.h"
+#include <atomic>
+#include <vector>
+#include <iostream>
+#include <streambuf>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+// Number of logging threads and messages per thread
+#define TEST_LOG_THREADS 4
+#define TEST_LOG_MESSAGES 2000
+
+
+/*******************************************************************************
+ * CLASS DECLARATIONS
+ ******************************************************************************/
+
+/**
+ * Stream buffer that counts the written lines, so the test can read the
+ * count while the writer thread prints.
+ */
+class LineCounter : public std::streambuf{
+
+public:
+    std::atomic<long> lines{0};
+
+protected:
+    int_type overflow(int_type character) override{
+
+        if(character == '\n'){
+            lines.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return traits_type::not_eof(character);
+    }
+};
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Concurrent starts create a single writer thread and every message is
+ * written once, also the messages that are logged while the sink stops.
+ */
+static void testConcurrentStart(){
+
+    // Note: Warnings go to std::cerr, lower levels are removed from release builds
+    LineCounter output;
+    std::streambuf* console = std::cerr.rdbuf(&output);
+    size_t dropped = Log::dropped();
+
+    std::vector<std::thread> threads;
+
+    for(int thread = 0; thread < TEST_LOG_THREADS; thread++){
+        threads.emplace_back([thread](){
+            Log::startAsync();
+
+            for(int message = 0; message < TEST_LOG_MESSAGES; message++){
+                Log::warning("thread ", thread, " message ", message);
+            }
+        });
+    }
+
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+
+    Log::stopAsync();
+    std::cerr.rdbuf(console);
+
+    CHECK(output.lines.load() + static_cast<long>(Log::dropped() - dropped) == TEST_LOG_THREADS * TEST_LOG_MESSAGES);
+}
+
+/**
+ * The writer thread sleeps until a message arrives and prints it without a stop.
+ */
+static void testWakeup(){
+
+    LineCounter output;
+    std::streambuf* console = std::cerr.rdbuf(&output);
+    size_t dropped = Log::dropped();
+
+    Log::startAsync();
+
+    // Let the writer thread fall asleep
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    Log::warning("wakeup");
+
+    bool printed = waitFor([&](){ return output.lines.load() == 1; });
+
+    Log::stopAsync();
+    std::cerr.rdbuf(console);
+
+    CHECK(Log::dropped() == dropped);
+    CHECK(printed);
+}
+
+int main(){
+
+    Log::setLevel(LogLevel::Warning);
+
+    testConcurrentStart();
+    testWakeup();
+
+    // Note: The sink is left running, the exit of the process must stop it
+    Log::startAsync();
+    Log::warning("LogTest finished");
+
+    return testResult();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,112 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      SignalDatabaseTest.cpp
+ \brief     Tests of the encoding and decoding of signals.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "Test.h"
+#include "SignalDatabase.h"
+#include <cmath>
+#include <limits>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates the layout of a message with a single signal at bit 0.
+ *
+ * @param length   - The length of the signal in bits.
+ * @param isSigned - Flag for a signed signal.
+ * @return The layout.
+ */
+static MessageLayout singleSignal(uint32_t length, bool isSigned){
+
+    SignalDefinition signal;
+    signal.name     = "signal";
+    signal.length   = length;
+    signal.isSigned = isSigned;
+
+    MessageDefinition message;
+    message.canID  = 0x100;
+    message.name   = "message";
+    message.length = 8;
+    message.signals.push_back(signal);
+
+    return MessageLayout(message);
+}
+
+/**
+ * Encodes a value and decodes it again.
+ *
+ * @param layout - The layout of the message.
+ * @param value  - The physical value.
+ * @return The decoded physical value.
+ */
+static double roundTrip(const MessageLayout& layout, double value){
+
+    std::uint8_t data[8] = {};
+    layout.encodeSignal(0, value, data, sizeof(data));
+
+    return layout.decodeSignal(data, sizeof(data), 0);
+}
+
+/**
+ * A negative 64 bit signed value keeps its sign.
+ */
+static void testSigned64(){
+
+    MessageLayout layout = singleSignal(64, true);
+
+    CHECK(roundTrip(layout, -5) == -5);
+    CHECK(roundTrip(layout, 1234567) == 1234567);
+    CHECK(roundTrip(layout, -1e15) == -1e15);
+
+    std::uint8_t data[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    CHECK(layout.decodeSignal(data, sizeof(data), 0) == -1);
+}
+
+/**
+ * Values outside of the raw range are clamped to the range of the signal.
+ */
+static void testOutOfRange(){
+
+    MessageLayout unsigned8 = singleSignal(8, false);
+    CHECK(roundTrip(unsigned8, 300) == 255);
+    CHECK(roundTrip(unsigned8, -10) == 0);
+
+    MessageLayout signed8 = singleSignal(8, true);
+    CHECK(roundTrip(signed8, 200) == 127);
+    CHECK(roundTrip(signed8, -200) == -128);
+    CHECK(roundTrip(signed8, -128) == -128);
+
+    MessageLayout signed64 = singleSignal(64, true);
+    CHECK(roundTrip(signed64, 1e30) == static_cast<double>(std::numeric_limits<int64_t>::max()));
+    CHECK(roundTrip(signed64, -1e30) == static_cast<double>(std::numeric_limits<int64_t>::min()));
+    CHECK(roundTrip(signed64, std::numeric_limits<double>::quiet_NaN()) == 0);
+
+    MessageLayout unsigned64 = singleSignal(64, false);
+    CHECK(roundTrip(unsigned64, 1e30) == static_cast<double>(std::numeric_limits<uint64_t>::max()));
+    CHECK(roundTrip(unsigned64, std::numeric_limits<double>::infinity()) == static_cast<double>(std::numeric_limits<uint64_t>::max()));
+}
+
+int main(){
+
+    testSigned64();
+    testOutOfRange();
+
+    return testResult();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
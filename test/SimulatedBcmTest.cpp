@@ -0,0 +1,110 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      SimulatedBcmTest.cpp
+ \brief     Tests of the kernel behavior of the simulated BCM.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "Test.h"
+#include "CANConnector.h"
+#include "SimulatedBcm.h"
+#include <future>
+#include <boost/asio/use_future.hpp>
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Creates multiplex masks, the first one is the multiplexer mask.
+ *
+ * @param count - The number of masks.
+ * @return The masks.
+ */
+static std::vector<struct canfd_frame> multiplexMasks(size_t count){
+
+    std::vector<struct canfd_frame> masks(count);
+
+    for(size_t index = 0; index < count; index++){
+        masks[index].len     = 8;
+        masks[index].data[0] = index == 0 ? 0xFF : static_cast<uint8_t>(index);
+        masks[index].data[1] = 0xFF;
+    }
+
+    return masks;
+}
+
+/**
+ * Applies a RX filter configuration and waits for its result.
+ *
+ * @param connector - The connector.
+ * @param filters   - The RX filters.
+ * @return The result.
+ */
+static RxFilterResult apply(CANConnector& connector, std::vector<RxFilter> filters){
+
+    std::promise<RxFilterResult> result;
+    std::promise<RxFilterResult>* resultPointer = &result;
+
+    connector.applyRxFilters(std::move(filters), [resultPointer](const RxFilterResult& applied){
+        resultPointer->set_value(applied);
+    });
+
+    return result.get_future().get();
+}
+
+/**
+ * Like the kernel, a RX_SETUP with more frames than the installed filter fails
+ * with E2BIG, so a growing filter must be replaced.
+ */
+static void testRxSetupGrowth(){
+
+    auto simulation = std::make_shared<SimulatedBcm>();
+    CANConnector connector("sim0", simulation);
+
+    std::vector<struct canfd_frame> two   = multiplexMasks(2);
+    std::vector<struct canfd_frame> three = multiplexMasks(3);
+
+    // A plain setup with more masks fails
+    CHECK(apply(connector, {RxFilter(0x100, true, RxOptions(), two)}).failed == 0);
+
+    boost::system::error_code errorCode;
+
+    try{
+        connector.asyncRxSetup<struct canfd_frame>(0x100, three.data(), 3, RxOptions(), boost::asio::use_future).get();
+    }catch(const boost::system::system_error& error){
+        errorCode = error.code();
+    }
+
+    CHECK(errorCode == boost::system::errc::argument_list_too_long);
+
+    // The same or fewer masks update the installed filter
+    CHECK(connector.asyncRxSetup<struct canfd_frame>(0x100, two.data(), 2, RxOptions(), boost::asio::use_future).wait_for(std::chrono::seconds(2)) == std::future_status::ready);
+
+    // The filter set replaces the filter with RX_DELETE and RX_SETUP
+    RxFilterResult result = apply(connector, {RxFilter(0x100, true, RxOptions(), three)});
+    CHECK(result.failed == 0);
+    CHECK(result.updated == 1);
+    CHECK(simulation->statistics().rxJobs == 1);
+}
+
+int main(){
+
+    Log::setLevel(LogLevel::Error);
+
+    testRxSetupGrowth();
+
+    return testResult();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,91 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      Test.h
+ \brief     Minimal check macros for the unit tests. Every test is an own
+            executable that runs on the simulated BCM and is registered
+            with ctest.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+#ifndef CAN_BCM_BOOST_ASIO_TEST_H
+#define CAN_BCM_BOOST_ASIO_TEST_H
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+
+
+/*******************************************************************************
+ * DEFINES
+ ******************************************************************************/
+
+/**
+ * Checks a condition and records a failure without stopping the test.
+ */
+#define CHECK(condition)                                                                        \
+    do{                                                                                         \
+        if(!(condition)){                                                                       \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);  \
+            testFailures()++;                                                                   \
+        }                                                                                       \
+    }while(0)
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Returns the number of failed checks of the test executable.
+ *
+ * @return The counter of the failed checks.
+ */
+inline int& testFailures(){
+    static int failures = 0;
+    return failures;
+}
+
+/**
+ * Returns the exit code of the test executable.
+ *
+ * @return EXIT_SUCCESS if no check failed.
+ */
+inline int testResult(){
+    return testFailures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Waits until a condition is true.
+ *
+ * @param condition - The condition.
+ * @param timeout   - The maximum time to wait.
+ * @return False if the timeout expired.
+ */
+template<typename Condition>
+bool waitFor(Condition condition, std::chrono::milliseconds timeout = std::chrono::milliseconds(2000)){
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while(!condition()){
+
+        if(std::chrono::steady_clock::now() > deadline){
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+
+#endif //CAN_BCM_BOOST_ASIO_TEST_H
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
@@ -0,0 +1,71 @@
+/*******************************************************************************
+ \project   INFM_HIL_Interface
+ \file      TxSchedulerTest.cpp
+ \brief     Tests of the TX scheduler on the simulated BCM.
+ \author    Matthias Bank
+ \version   1.0.0
+ \date      12.11.2021
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+#include "Test.h"
+#include "CANConnector.h"
+#include "SimulatedBcm.h"
+#include "TxScheduler.h"
+
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * A purely cyclic task is handed off to the BCM. The frame that TX_SETUP
+ * announces is the frame of the hand-off cycle, so it is on the bus once.
+ */
+static void testHandOffSendsOneFrame(){
+
+    auto simulation = std::make_shared<SimulatedBcm>();
+    CANConnector connector("sim0", simulation);
+    TxScheduler scheduler(connector);
+    scheduler.start();
+
+    struct canfd_frame frame{};
+    frame.can_id = 0x321;
+    frame.len    = 8;
+
+    TxPattern pattern;
+    pattern.period = std::chrono::milliseconds(200);
+
+    scheduler.schedule(frame, false, pattern);
+
+    CHECK(waitFor([&](){ return simulation->statistics().txJobs == 1; }));
+
+    // Halfway to the next cycle only the frame of the hand-off is on the bus
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(simulation->statistics().framesSent == 1);
+    CHECK(scheduler.statistics().sent == 1);
+    CHECK(scheduler.statistics().handedOff == 1);
+
+    // The BCM sends the next frame one period after the hand-off
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CHECK(simulation->statistics().framesSent == 2);
+
+    scheduler.stop();
+}
+
+int main(){
+
+    Log::setLevel(LogLevel::Warning);
+
+    testHandOffSendsOneFrame();
+
+    return testResult();
+}
+
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/